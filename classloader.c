@@ -8,19 +8,30 @@
  *  - Implementar os metodos relacionados a exibicao de um arquivo ".class".
  *  - Implementar os metodos de leitura de arquivos ".class"
  *  - Implementar os metodos relacionados a manutencao de uma estrutura ArqClass
+ *  - Implementar a arena de onde sao alocados os metadados de cada classe
  *  - Implementar os metodos responsaveis pela manipulacao de arquivos
  */
 //##################################################################################################
 
 #define CLASSLOAD
+#define _GNU_SOURCE
 
 #include <stdio.h>
 #include <string.h>
 #include <wchar.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 #include "include/memoryunit.h"
 #include "include/executionengine.h"
 #include "include/classloader.h"
 #include "include/opcodes.h"
+#include "include/util.h"
+#include "include/verifier.h"
+#include "include/javastring.h"
 
 
 //--------------------------------------------------------------------------------------------------
@@ -38,7 +49,7 @@ int classVerifier(ArqClass* arqClass){
         return LinkageError_UnsupportedClassVersionError;;
     
     //Se a classe for a sua propria superclasse
-    if (strcmp(getClassNameFromConstantPool(arqClass->constant_pool, arqClass->super_class), getClassNameFromConstantPool(arqClass->constant_pool, arqClass->this_class)) == 0)
+    if (getClassNameFromConstantPool(arqClass->constant_pool, arqClass->super_class) == getClassNameFromConstantPool(arqClass->constant_pool, arqClass->this_class))
         return LinkageError_ClassCirculatityError;
     
     return LinkageSuccess;
@@ -97,136 +108,196 @@ int classGetFieldDescriptorSize(char* descriptor){
 
 //--------------------------------------------------------------------------------------------------
 /*!
- * Metodo que aloca o espaco de memoria necessarios para um determinado campo baseado no descritor
+ * Metodo que, dada uma estrutura de arquivo .class, verifica se todas as suas superclasses ou
+ * superinterfaces foram carregadas. Caso não, carrega as mesmas de forma recursiva.
  *
- * \param descriptor Descritor do campo
- * \return Referencia para o ponteiro de memoria a receber o endereco do espaco alocado
+ * \param arqClass Nome qualificado da classe ou interface a ser carregada
+ * \param environment ambiente atual de execucao
+ * \return Estrutura JavaClass da superclasse (ou nulo se for uma classe de biblioteca java)
  */
-void* classInitializeField(char* descriptor){
+JavaClass* classSuperClassChecker(ArqClass* arqClass, Environment* enviroment){
     
-    //Alocamos o espaco de memoria
-    void* memoryAddress = (void*) malloc(classGetFieldDescriptorSize(descriptor)*sizeof(void));
+    char* superClassName = getClassNameFromConstantPool(arqClass->constant_pool, arqClass->super_class);
     
-    //Inicializamos o atributo com o valor default
-    if (strcmp(descriptor, "B") == 0){
-        u1* byte = memoryAddress;
-        *byte = 0;
-    }
-    else if (strcmp(descriptor, "C")== 0){
-        char* c = memoryAddress;
-        *c = '0';
-    }
-    else if (strcmp(descriptor, "D")== 0){
-        double* d = memoryAddress;
-        *d = 0;
-    }
-    else if (strcmp(descriptor, "F")== 0){
-        float* f = memoryAddress;
-        *f = 0;
-    }
-    else if (strcmp(descriptor, "I")== 0){
-        int* i = memoryAddress;
-        *i = 0;
-    }
-    else if (strcmp(descriptor, "J")== 0){
-        u8* l = memoryAddress;
-        *l = 0;
-    }
-    else if (strcmp(descriptor, "Z")== 0){
-        u1* b = memoryAddress;
-        *b = 0;
-    }
-    else if (strcmp(descriptor, "S")== 0){
-        u2* s = memoryAddress;
-        *s = 0;
-    }
-    return memoryAddress;
+    //Superclasses de bibliotecas java nao possuem campos
+    if (javaLibIsFrom(superClassName)) return NULL;
+    
+    //Verificamos se a superclasse ja fora carregada. Caso nao, carregamos recursivamente
+    JavaClass* superClass = findJavaClassOnMethodArea(superClassName, enviroment->methodArea);
+    if(superClass == NULL)
+        superClass = loadCLass(superClassName, enviroment);
+    
+    return superClass;
 }
 
 
 //--------------------------------------------------------------------------------------------------
-Fields* classInitializeFields(JavaClass* javaClass, u2 flagsAccept, u2 flagsRegect){
+/*!
+ * Método que adiciona a uma tabela de campos os campos (estaticos ou de instancia) declarados pela
+ * classe, calculando os seus deslocamentos. Os campos sao agrupados por tamanho (8, 4, 2 e 1
+ * bytes), cada um alinhado ao seu tamanho.
+ *
+ * \param arqClass Referencia para a estrutura de arquivo .class
+ * \param fields Tabela de campos a receber os campos (com espaco para todos os campos da classe)
+ * \param size Deslocamento a partir do qual os campos sao dispostos
+ * \param staticFlag ACC_STATIC para campos estaticos, 0 para campos de instancia
+ * \return Deslocamento do final do ultimo campo
+ */
+u4 classLayoutFields(ArqClass* arqClass, Fields* fields, u4 size, u2 staticFlag){
     
-    //Numero de campos
-    int fieldsCount = javaClass->arqClass->fields_count;
+    //Campos da classe, agrupados do maior para o menor tamanho
+    for (u1 fieldSize = 8; fieldSize > 0; fieldSize >>= 1) {
+        for (int i = 0; i < arqClass->fields_count; i++) {
+            
+            field_info* fieldInfo = &arqClass->fields[i];
+            if ((fieldInfo->access_flags & ACC_STATIC) != staticFlag) continue;
+            
+            char* descriptor = getUTF8FromConstantPool(arqClass->constant_pool,
+                                                       fieldInfo->descriptor_index);
+            if (classGetFieldDescriptorSize(descriptor) != fieldSize) continue;
+            
+            //Alinhamos o campo ao seu tamanho
+            size = (size + fieldSize - 1) & ~(u4)(fieldSize - 1);
+            
+            FieldsTable* field = &fields->fieldsTable[fields->fieldsCount++];
+            field->name = getUTF8FromConstantPool(arqClass->constant_pool, fieldInfo->name_index);
+            field->descriptor = descriptor;
+            field->offset = size;
+            field->size = fieldSize;
+            field->fieldInfo = fieldInfo;
+            
+            size += fieldSize;
+        }
+    }
+    
+    return size;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Método que calcula o layout dos campos de instancia de uma classe. Os campos da superclasse
+ * ocupam o inicio do objeto (nos mesmos deslocamentos da superclasse) e os campos da propria
+ * classe sao dispostos em seguida.
+ *
+ * \param javaClass Referencia para a estrutura de classe
+ * \param superClass Referencia para a superclasse (ou nulo se for uma classe de biblioteca java)
+ */
+void classLayoutInstanceFields(JavaClass* javaClass, JavaClass* superClass){
     
-    //Resultado
-    Fields* fields;
+    ArqClass* arqClass = javaClass->arqClass;
+    Fields* fields = (Fields*) arenaAllocate(arqClass->arena, sizeof(Fields));
+    int superCount = superClass ? superClass->instanceFields->fieldsCount : 0;
     
-    //Alocamos espaco na tabela de campos para o numero de campos
-    fields = (Fields*) malloc(sizeof(Fields));
+    //Tabela com espaco para os campos herdados e os campos da classe
     fields->fieldsCount = 0;
+    u4 tableSize = (superCount + arqClass->fields_count + 1) * sizeof(FieldsTable);
+    fields->fieldsTable = (FieldsTable*) arenaAllocate(arqClass->arena, tableSize);
+    
+    //Campos herdados mantem os deslocamentos da superclasse
+    u4 size = sizeof(Object);
+    if (superClass) {
+        memcpy(fields->fieldsTable, superClass->instanceFields->fieldsTable,
+               superCount * sizeof(FieldsTable));
+        fields->fieldsCount = superCount;
+        size = superClass->instanceSize;
+    }
     
-    fields->fieldsTable = (FieldsTable*) malloc(sizeof(FieldsTable));
+    javaClass->instanceFields = fields;
+    javaClass->instanceSize = classLayoutFields(arqClass, fields, size, 0);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Método que atribui a um campo estatico o valor do seu atributo ConstantValue, caso exista.
+ *
+ * \param javaClass Referencia para a estrutura de classe
+ * \param field Campo estatico ja disposto no bloco de campos estaticos da classe
+ * \param thread Thread em cujo TLAB as strings constantes sao alocadas
+ */
+void classInitializeConstantValue(JavaClass* javaClass, FieldsTable* field, Thread* thread){
     
-    //Inicializamos cada campo estatico da classe
-    for (int i = 0; i < fieldsCount; i++) {
+    ConstantPool* cp = javaClass->arqClass->constant_pool;
+    char* constantValueName = internString("ConstantValue");
+    
+    for (int i = 0; i < field->fieldInfo->attributes_count; i++) {
         
-        //Verificamos as condicoes das flags
-        if (javaClass->arqClass->fields[i].access_flags & flagsAccept &&
-            !(javaClass->arqClass->fields[i].access_flags & flagsRegect)){
-            
-            //Redimensionamos a tabela de atributos estaticos da classe
-            fields->fieldsTable = (FieldsTable*) realloc(fields->fieldsTable, (fields->fieldsCount+1) * sizeof(FieldsTable));
-            
-            //Referencia para as informacoes do campo na estrutura de .class
-            field_info* fieldInfo = &javaClass->arqClass->fields[i];
-            fields->fieldsTable[fields->fieldsCount].fieldInfo = fieldInfo;
-            
-            
-            //Passamos uma referencia para o nome
-            fields->fieldsTable[fields->fieldsCount].name =
-            getUTF8FromConstantPool(javaClass->arqClass->constant_pool,
-                                    fieldInfo->name_index);
-            
-            //Passamos uma referencia para o descritor do campo
-            fields->fieldsTable[fields->fieldsCount].descriptor =
-            getUTF8FromConstantPool(javaClass->arqClass->constant_pool,
-                                    fieldInfo->descriptor_index);
-            
-            //Alocamos o espaco de memoria para o campo
-            fields->fieldsTable[fields->fieldsCount].memoryAddress = classInitializeField(fields->fieldsTable[fields->fieldsCount].descriptor);
-            
-            //Atualizamos a quantidade de fields
-            fields->fieldsCount++;
+        attribute_info* attribute = &field->fieldInfo->attributes[i];
+        if (getUTF8FromConstantPool(cp, attribute->attribute_name_index) != constantValueName)
+            continue;
+        
+        ConstantValueAttribute* constantValue = parseConstantValue(attribute->info);
+        u2 valueIndex = constantValue->constantvalue_index;
+        void* address = javaClass->staticData + field->offset;
+        free(constantValue);
+        
+        switch (cp->tags[valueIndex]) {
+            //Long e Double possuem o mesmo formato
+            case CONSTANT_Long:
+            case CONSTANT_Double:
+                *(u8*) address = getLongFromConstantPool(cp, valueIndex);
+                break;
+                
+            //Strings sao a string java da constante (como em ldc)
+            case CONSTANT_String:
+                *(u4*) address = getStringConstant(javaClass, valueIndex, thread);
+                break;
+                
+            //Integer e Float possuem o mesmo formato
+            default:
+                if (field->size == 1) *(u1*) address = (u1) cp->values[valueIndex];
+                else if (field->size == 2) *(u2*) address = (u2) cp->values[valueIndex];
+                else *(u4*) address = cp->values[valueIndex];
+                break;
         }
+        return;
     }
-    return fields;
 }
 
 
 //--------------------------------------------------------------------------------------------------
 /*!
- * Método que aloca todos os espaços de memoria necessarios para a classe e inicializa os campos
- * estaticos com os valores default
+ * Método que calcula o layout dos campos estaticos de uma classe e aloca um bloco contiguo para os
+ * seus valores (inicializados com o valor default).
  *
- * \param javaClass Referencia para a estrutura de classe a ser inicializada
- * \return Resultado de sucesso ou erros
+ * \param javaClass Referencia para a estrutura de classe
  */
-int classPreparing(JavaClass* javaClass){
+void classLayoutStaticFields(JavaClass* javaClass){
     
-    javaClass->staticFields = classInitializeFields(javaClass, ACC_STATIC, ACC_FINAL);
-    javaClass->objectList = NULL;
-    return LinkageSuccess;
+    ArqClass* arqClass = javaClass->arqClass;
+    Fields* fields = (Fields*) arenaAllocate(arqClass->arena, sizeof(Fields));
+    
+    fields->fieldsCount = 0;
+    fields->fieldsTable = (FieldsTable*) arenaAllocate(arqClass->arena,
+                                                (arqClass->fields_count + 1) * sizeof(FieldsTable));
+    
+    u4 size = classLayoutFields(arqClass, fields, 0, ACC_STATIC);
+    
+    javaClass->staticFields = fields;
+    javaClass->staticData = (u1*) arenaAllocate(arqClass->arena, size + 1);
 }
 
 
 //--------------------------------------------------------------------------------------------------
 /*!
- * Metodo que, dada uma estrutura de arquivo .class, verifica se todas as suas superclasses ou
- * superinterfaces foram carregadas. Caso não, carrega as mesmas de forma recursiva.
+ * Método que aloca todos os espaços de memoria necessarios para a classe e inicializa os campos
+ * estaticos com os valores default ou constantes. A superclasse eh carregada (se necessario)
+ * antes, pois o layout dos objetos da classe depende do layout dos objetos da superclasse.
  *
- * \param arqClass Nome qualificado da classe ou interface a ser carregada
+ * \param javaClass Referencia para a estrutura de classe a ser inicializada
  * \param environment ambiente atual de execucao
- * \return Estrutura arqClass preenchida com os dados da classe carregada
+ * \return Resultado de sucesso ou erros
  */
-void classSuperClassChecker(ArqClass* arqClass, Environment* enviroment){
+int classPreparing(JavaClass* javaClass, Environment* environment){
     
-    char* superClassName = getClassNameFromConstantPool(arqClass->constant_pool, arqClass->super_class);
-    JavaClass* superClass;
-    //Verificamos se a superclasse ja fora carregada. Caso nao, carregamos recursivamente
-    if(findJavaClassOnMethodArea(superClassName, enviroment->methodArea) == NULL)
-        superClass = loadCLass(superClassName, enviroment);
+    //Verificacao e carregamento de superclasses
+    javaClass->superClass = classSuperClassChecker(javaClass->arqClass, environment);
+    
+    classLayoutStaticFields(javaClass);
+    classLayoutInstanceFields(javaClass, javaClass->superClass);
+    javaClass->staticsDirty = 0;
+    return LinkageSuccess;
 }
 
 
@@ -234,11 +305,9 @@ void classSuperClassChecker(ArqClass* arqClass, Environment* enviroment){
 /*!
  * Método que executa o processo de inicializacao de uma classe ou interface.
  *
- * Passos:
- *
- * 1. Verifica e, se necessario, carrega recursivamente todas as suas superclasse ou interfaces
- * 2. Executa o inicializador de campos estáticos (exceto os final static, que são definidos em tempo
- *     de compilacao)
+ * Atribui aos campos final static os valores dos atributos ConstantValue e empilha o inicializador
+ * de campos estáticos. As superclasses ja foram carregadas na preparacao. A classe ja esta na area
+ * de metodos, portanto as strings constantes criadas aqui sao raizes do coletor de lixo.
  *
  * \param javaClass Referencia para a estrutura de classe a ser inicializada
  * \param environment ambiente atual de execucao
@@ -246,15 +315,20 @@ void classSuperClassChecker(ArqClass* arqClass, Environment* enviroment){
  */
 int classInitializer(JavaClass* javaClass, Environment* environment){
     
-    //Verificacao e carregamento de superclasses
-    classSuperClassChecker(javaClass->arqClass, environment);
+    char* clinitName = internString("<clinit>");
+    char* clinitDescriptor = internString("()V");
+    
+    //Valores constantes (static final) sao materializados uma unica vez
+    Fields* fields = javaClass->staticFields;
+    for (int i = 0; i < fields->fieldsCount; i++)
+        classInitializeConstantValue(javaClass, &fields->fieldsTable[i], environment->thread);
     
     //Se a classe nao tiver o metodo init
-    if (!getMethodInfoFromClass(javaClass,  "<clinit>", "()V")) return InitializerSuccess;
+    if (!getMethodInfoFromClass(javaClass, clinitName, clinitDescriptor)) return InitializerSuccess;
 
     //Empilhamos o metodo <clinit> da classe
     environment->thread->PC--; //Metodo eh invocado sem ser chamado, precisa decrementar PC
-    pushFrame(environment, getClassNameFromConstantPool(javaClass->arqClass->constant_pool, javaClass->arqClass->this_class), "<clinit>", "()V");
+    pushFrame(environment, getClassNameFromConstantPool(javaClass->arqClass->constant_pool, javaClass->arqClass->this_class), clinitName, clinitDescriptor);
     
     return InitializerSuccess;
     
@@ -268,6 +342,10 @@ JavaClass* loadCLass(const char* qualifiedName, Environment* environment){
     ArqClass* arqClass = (ArqClass*) malloc(sizeof(ArqClass));
     int opResult; //!< Resultado das operacoes (checagem de erros)
     
+    //Enquanto houver uma classe em carregamento, o coletor nao descarrega classes
+    environment->loadingClasses++;
+    javaClass->marked = 0;
+    
     //!LOADING - Fazemos a leitura do arquivo .class
     char* classExtension = ".class";
     
@@ -296,9 +374,20 @@ JavaClass* loadCLass(const char* qualifiedName, Environment* environment){
         return NULL;
     }
     
+    //Inferimos os tipos das variaveis locais e da pilha de operandos de cada metodo, criando os
+    // mapas de referencias usados pelo coletor de lixo
+    verifyClass(javaClass, environment->verifierThreads);
+    
+    //Montamos a tabela de busca de metodos da classe (nome, descritor) -> method_info
+    javaClass->methodTable = newMethodTable(javaClass);
+    
+    //Criamos a tabela de resolucoes do pool de constantes, preenchida sob demanda
+    javaClass->resolvedPool = (ResolvedPoolEntry*) calloc(arqClass->constant_pool_count,
+                                                          sizeof(ResolvedPoolEntry));
+    
     //LINKING - PREPARING - Alocamos todos os espacos de memoria necessarios para a classe
     // Campos estaticos sao criados e inicializados com os valores default
-    classPreparing(javaClass);
+    classPreparing(javaClass, environment);
     
     //INITIALIZATION - Executamos o o inicializador estatico <clinit>
     
@@ -309,6 +398,8 @@ JavaClass* loadCLass(const char* qualifiedName, Environment* environment){
     
     if (environment->debugFlags & DEBUG_ShowClassFiles) LECLASS_exibidor(javaClass->arqClass);
     
+    environment->loadingClasses--;
+    
     //Retornamos a estrutura inicializada
     return javaClass;
 }
@@ -317,30 +408,39 @@ JavaClass* loadCLass(const char* qualifiedName, Environment* environment){
 // SUBMODULO
 
 //--------------------------------------------------------------------------------------------------
-wchar_t * getUnicodeFromConstantPool(cp_info* cp, u2 index){
+wchar_t * getUnicodeFromConstantPool(ConstantPool* cp, u2 index){
     
-    int i;
-    wchar_t* string = (wchar_t * ) malloc( (cp[index-1].u.Utf8.lenght+1) * sizeof(wchar_t));
-    
-    for (i = 0; i < cp[index-1].u.Utf8.lenght; i++) string[i] = cp[index-1].u.Utf8.bytes[i];
-    
-    string[i] = '\0'; //Ultimo caractere
-    
-    return string;
+    //A versao unicode eh decodificada uma unica vez, no momento em que o simbolo eh criado
+    return cp->symbols[cp->values[index]]->unicode;
 }
 
 
 //--------------------------------------------------------------------------------------------------
-char * getUTF8FromConstantPool(cp_info* cp, u2 index){
+char * getUTF8FromConstantPool(ConstantPool* cp, u2 index){
     
-    wchar_t *unicode = getUnicodeFromConstantPool(cp, index);
-    char * result = (char*) malloc((wcslen(unicode)+1) * sizeof(char));
+    return cp->symbols[cp->values[index]]->utf8;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+u2 getFirstIndexFromConstantPool(ConstantPool* cp, u2 index){
     
-    wcstombs(result, unicode, wcslen(unicode)+1);
+    return (u2) (cp->values[index] >> 16);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+u2 getSecondIndexFromConstantPool(ConstantPool* cp, u2 index){
     
-    free(unicode);
+    return (u2) cp->values[index];
+}
+
+
+//--------------------------------------------------------------------------------------------------
+u8 getLongFromConstantPool(ConstantPool* cp, u2 index){
     
-    return result;
+    //Os 32 bits menos significativos ocupam a posicao seguinte do pool
+    return (u8) cp->values[index] << 32 | cp->values[index + 1];
 }
 
 
@@ -352,40 +452,40 @@ char * getUTF8FromConstantPool(cp_info* cp, u2 index){
  * \param cp    ponteiro para o pool de constantes
  * \param tag   tag do NameAndType no pool de constantes.
  */
-void printNameAndTypeInfoFromConstantPool(cp_info* cp, u2 index ){
-    printf(" (Name: \"%ls\"", getUnicodeFromConstantPool(cp, cp[index-1].u.NameAndType.name_index));
-    printf(" Descr: \"%ls\")", getUnicodeFromConstantPool(cp, cp[index-1].u.NameAndType.descriptor_index));
+void printNameAndTypeInfoFromConstantPool(ConstantPool* cp, u2 index ){
+    u2 name = getFirstIndexFromConstantPool(cp, index);
+    u2 descriptor = getSecondIndexFromConstantPool(cp, index);
+    printf(" (Name: \"%ls\"", getUnicodeFromConstantPool(cp, name));
+    printf(" Descr: \"%ls\")", getUnicodeFromConstantPool(cp, descriptor));
 }
 
 
 //--------------------------------------------------------------------------------------------------
-char* getClassNameFromConstantPool(cp_info* cp, u2 index){
+char* getClassNameFromConstantPool(ConstantPool* cp, u2 index){
     
-    return  getUTF8FromConstantPool(cp, cp[index-1].u.Class.name_index);
+    return  getUTF8FromConstantPool(cp, (u2) cp->values[index]);
 }
 
 
 //--------------------------------------------------------------------------------------------------
 void getFieldOrMethodInfoAttributesFromConstantPool(u2 index,
-                                            cp_info* constant_pool,
+                                            ConstantPool* constant_pool,
                                             char** class_name,
                                             char** name,
                                             char** descriptor)
 {
     
-    //Obtemos a referencia para o field_info ou method_info no pool de constantes
-    cp_info* field_or_method_info = &constant_pool[index-1];
-    
-    //Obtemos a referencia para o descritor
-    cp_info* nameAndType_info = &constant_pool[field_or_method_info->u.Fieldref.name_and_type_index-1];
+    //Obtemos os indices da classe e do NameAndType do field_info ou method_info
+    u2 classIndex = getFirstIndexFromConstantPool(constant_pool, index);
+    u2 nameAndType = getSecondIndexFromConstantPool(constant_pool, index);
     
     //Obtemos os nomes e descritor
-    *class_name = getClassNameFromConstantPool(constant_pool,
-                                              field_or_method_info->u.Fieldref.class_index);
+    *class_name = getClassNameFromConstantPool(constant_pool, classIndex);
     *name = getUTF8FromConstantPool(constant_pool,
-                                         nameAndType_info->u.NameAndType.name_index);
+                                    getFirstIndexFromConstantPool(constant_pool, nameAndType));
     *descriptor = getUTF8FromConstantPool(constant_pool,
-                                               nameAndType_info->u.NameAndType.descriptor_index);
+                                          getSecondIndexFromConstantPool(constant_pool,
+                                                                         nameAndType));
 }
 
 
@@ -396,14 +496,15 @@ void getFieldOrMethodInfoAttributesFromConstantPool(u2 index,
  *
  * \param code Ponteiro para o vetor que contem as excetion_tables
  * \param exception_table_length Numero de elementos na tabela de excessoes
- * \param cp ponteiro para o pool de constantes
+ * \param arena Arena de onde a tabela eh alocada
  * \return Ponteiro para um vetor de tabela de excessoes preenchida
  */
-ExceptionTable* parseExceptionTables(u1* exceptionTableList, u2 exception_table_length){
+ExceptionTable* parseExceptionTables(u1* exceptionTableList, u2 exception_table_length,
+                                     ClassArena* arena){
     
     u1* c = exceptionTableList;
     ExceptionTable* exceptionTable = (ExceptionTable*)
-                                    malloc(exception_table_length * sizeof(ExceptionTable));
+                        arenaAllocate(arena, exception_table_length * sizeof(ExceptionTable));
     
     for ( int i = 0; i < exception_table_length; i++) {
         
@@ -426,8 +527,21 @@ ExceptionTable* parseExceptionTables(u1* exceptionTableList, u2 exception_table_
 
 
 //--------------------------------------------------------------------------------------------------
-CodeAttribute* parseCode(u1* info){
-    CodeAttribute* code = (CodeAttribute*) malloc(sizeof(CodeAttribute));
+CodeAttribute* parseCode(attribute_info* attribute, ClassArena* arena){
+    
+    u1* info = attribute->info;
+    u4 length = attribute->attribute_length;
+    
+    //O atributo ja esta dentro do arquivo mapeado (attribute_length foi limitado pela leitura);
+    // os tamanhos declarados nele tambem precisam caber no atributo: cabecalho (max_stack,
+    // max_locals e code_length), codigo, tabela de excecoes e attributes_count
+    if (length < 8) return NULL;
+    u8 codeLength = (u8) info[4] << 24 | info[5] << 16 | info[6] << 8 | info[7];
+    if (codeLength + 8 + 2 > length) return NULL;
+    u8 tableLength = info[8 + codeLength] << 8 | info[8 + codeLength + 1];
+    if (8 + codeLength + 2 + tableLength * 4 * sizeof(u2) + 2 > length) return NULL;
+    
+    CodeAttribute* code = (CodeAttribute*) arenaAllocate(arena, sizeof(CodeAttribute));
     
     int index = 0;
     
@@ -450,7 +564,8 @@ CodeAttribute* parseCode(u1* info){
     code->exception_table_length = info[index++];
     code->exception_table_length = code->exception_table_length << 8 | info[index++];
     
-    code->exception_table = parseExceptionTables(&info[index], code->exception_table_length);
+    code->exception_table = parseExceptionTables(&info[index], code->exception_table_length,
+                                                 arena);
     
     index += code->exception_table_length * 4 * sizeof(u2); //Tamanho da Tabela de excessao = 4*u2
     
@@ -491,139 +606,132 @@ ExceptionAttribute* parseExceptionAttribute(u1* info){
 /*!
  * Metodo que que realiza a exibicao de um campo do pool de constantes
  *
- * \param cp               estrutura de pool de constante a ser exibida
  * \param constant_pool    ponteiro para o pool de constantes da classe
+ * \param index            indice da entrada a ser exibida
  */
-void printFromPool(cp_info* cp, cp_info* constant_pool){
+void printFromPool(ConstantPool* constant_pool, u2 index){
+    
+    u1 tag = constant_pool->tags[index];
+    u4 value = constant_pool->values[index];
+    u2 first = getFirstIndexFromConstantPool(constant_pool, index);
+    u2 second = getSecondIndexFromConstantPool(constant_pool, index);
     
-    switch (cp->tag) {
+    switch (tag) {
             
         case CONSTANT_Class:
             printf("CONSTANT_Class_info {");
-            printf("\n\tu1 tag: %d", cp->tag);
-            printf("\n\tu2 name_index: %d", cp->u.Class.name_index);
-            printf(" (\"%ls\")", getUnicodeFromConstantPool(constant_pool, cp->u.Class.name_index));
+            printf("\n\tu1 tag: %d", tag);
+            printf("\n\tu2 name_index: %d", value);
+            printf(" (\"%ls\")", getUnicodeFromConstantPool(constant_pool, (u2) value));
             printf("\n}\n");
             break;
             
         case CONSTANT_Fieldref:
             printf("CONSTANT_Fieldref_info {");
-            printf("\n\tu1 tag: %d", cp->tag);
-            printf("\n\tu2 class_index: %d", cp->u.Fieldref.class_index);
+            printf("\n\tu1 tag: %d", tag);
+            printf("\n\tu2 class_index: %d", first);
             
             //Imprimimos o nome da classe indicada por class_index
-            printf(" (\"%s\")", getClassNameFromConstantPool(constant_pool,
-                                                         cp->u.Fieldref.class_index));
+            printf(" (\"%s\")", getClassNameFromConstantPool(constant_pool, first));
             
-            printf("\n\tu2 name_and_type_index: %d", cp->u.Fieldref.name_and_type_index);
+            printf("\n\tu2 name_and_type_index: %d", second);
             
             //Imprimimos os atributos de name and type do indice name_and_type_index
-            printNameAndTypeInfoFromConstantPool(constant_pool,
-                                                 cp->u.Fieldref.name_and_type_index);
+            printNameAndTypeInfoFromConstantPool(constant_pool, second);
             printf("\n}\n");
             break;
             
         case CONSTANT_NameAndType:
             printf("CONSTANT_NameAndType_info {");
-            printf("\n\tu1 tag: %d", cp->tag);
-            printf("\n\tu2 name_index: %d", cp->u.NameAndType.name_index);
-            printf(" (\"%ls\")", getUnicodeFromConstantPool(constant_pool,
-                                                         cp->u.NameAndType.name_index));
-            printf("\n\tu2 descriptor_index: %d", cp->u.NameAndType.descriptor_index);
-            printf(" (\"%ls\")", getUnicodeFromConstantPool(constant_pool,
-                                                         cp->u.NameAndType.descriptor_index));
+            printf("\n\tu1 tag: %d", tag);
+            printf("\n\tu2 name_index: %d", first);
+            printf(" (\"%ls\")", getUnicodeFromConstantPool(constant_pool, first));
+            printf("\n\tu2 descriptor_index: %d", second);
+            printf(" (\"%ls\")", getUnicodeFromConstantPool(constant_pool, second));
             printf("\n}\n");
             break;
             
         case CONSTANT_Utf8:
             printf("CONSTANT_Utf8_info {");
-            printf("\n\tu1 tag: %d", cp->tag);
-            printf("\n\tu2 lenght: %d", cp->u.Utf8.lenght);
-            printf("\n\tu1 bytes[%d]: ", cp->u.Utf8.lenght);
-            printf("\"%ls\"", getUnicodeFromConstantPool(cp,1));
+            printf("\n\tu1 tag: %d", tag);
+            printf("\n\tu2 lenght: %d", constant_pool->symbols[value]->length);
+            printf("\n\tu1 bytes[%d]: ", constant_pool->symbols[value]->length);
+            printf("\"%ls\"", getUnicodeFromConstantPool(constant_pool, index));
             printf("\n}\n");
             break;
             
         case CONSTANT_Methodref:
             printf("CONSTANT_Methodref_info {");
-            printf("\n\tu1 tag: %d", cp->tag);
-            printf("\n\tu2 class_index: %d", cp->u.Methodref.class_index);
+            printf("\n\tu1 tag: %d", tag);
+            printf("\n\tu2 class_index: %d", first);
             
             //Imprimimos o nome da classe indicada por class_index
-            printf(" (\"%s\")", getClassNameFromConstantPool(constant_pool,
-                                                             cp->u.Methodref.class_index));
+            printf(" (\"%s\")", getClassNameFromConstantPool(constant_pool, first));
             
-            printf("\n\tu2 name_and_type_index: %d", cp->u.Methodref.name_and_type_index);
+            printf("\n\tu2 name_and_type_index: %d", second);
             
             //Imprimimos os atributos de name and type indice name_and_type_index
-            printNameAndTypeInfoFromConstantPool(constant_pool,
-                                                 cp->u.Methodref.name_and_type_index);
+            printNameAndTypeInfoFromConstantPool(constant_pool, second);
             printf("\n}\n");
             break;
             
         case CONSTANT_InterfaceMethodref:
             printf("CONSTANT_InterfaceMethodref_info {");
-            printf("\n\tu1 tag: %d", cp->tag);
-            printf("\n\tu2 class_index: %d", cp->u.InterfaceMethodref.class_index);
+            printf("\n\tu1 tag: %d", tag);
+            printf("\n\tu2 class_index: %d", first);
             
             //Imprimimos o nome da classe indicada por class_index
-            printf(" (\"%s\")", getClassNameFromConstantPool(constant_pool,
-                                                             cp->u.InterfaceMethodref.class_index));
+            printf(" (\"%s\")", getClassNameFromConstantPool(constant_pool, first));
             
-            printf("\n\tu2 name_and_type_index: %d", cp->u.InterfaceMethodref.name_and_type_index);
+            printf("\n\tu2 name_and_type_index: %d", second);
             
             //Imprimimos os atributos de name and type indice name_and_type_index
-            printNameAndTypeInfoFromConstantPool(constant_pool,
-                                                 cp->u.InterfaceMethodref.name_and_type_index);
+            printNameAndTypeInfoFromConstantPool(constant_pool, second);
             printf("\n}\n");
             break;
             
         case CONSTANT_String:
             printf("CONSTANT_String_info {");
-            printf("\n\tu1 tag: %d", cp->tag);
-            printf("\n\tu2 string_index: %d", cp->u.String.string_index);
-            printf(" (\"%ls\")", getUnicodeFromConstantPool(constant_pool,
-                                                         cp->u.String.string_index));
+            printf("\n\tu1 tag: %d", tag);
+            printf("\n\tu2 string_index: %d", value);
+            printf(" (\"%ls\")", getUnicodeFromConstantPool(constant_pool, (u2) value));
             printf("\n}\n");
             break;
             
         case CONSTANT_Integer:
             printf("CONSTANT_Integer_info {");
-            printf("\n\tu1 tag: %d", cp->tag);
-            printf("\n\tu4 bytes: %d", cp->u.Integer.bytes);
+            printf("\n\tu1 tag: %d", tag);
+            printf("\n\tu4 bytes: %d", value);
             printf("\n}\n");
             break;
             
         case CONSTANT_Float:
             printf("CONSTANT_Float_info {");
-            printf("\n\tu1 tag: %d", cp->tag);
-            printf("\n\tu4 bytes: %f", u4ToFLoat(cp->u.Float.bytes));
+            printf("\n\tu1 tag: %d", tag);
+            printf("\n\tu4 bytes: %f", u4ToFLoat(value));
             printf("\n}\n");
             break;
             
         case CONSTANT_Long:
             printf("CONSTANT_Long_info {");
-            printf("\n\tu1 tag: %d", cp->tag);
+            printf("\n\tu1 tag: %d", tag);
             
-            //Unimos os dois u4 em um u8 (u8)
-            u8 bytesl = cp->u.Long.high_bytes;
-            bytesl = bytesl << 32 | cp->u.Long.low_bytes;
+            //Os dois u4 ocupam posicoes seguidas do pool
+            u8 bytesl = getLongFromConstantPool(constant_pool, index);
             
-            printf("\n\tu4 high_bytes: 0x%x", cp->u.Long.high_bytes);
-            printf("\n\tu4 low_bytes: 0x%x", cp->u.Long.low_bytes);
-            printf("\n\t(u8 bytes: %lld)", bytesl);
+            printf("\n\tu4 high_bytes: 0x%x", value);
+            printf("\n\tu4 low_bytes: 0x%x", constant_pool->values[index + 1]);
+            printf("\n\t(u8 bytes: %lld)", (long long) bytesl);
             printf("\n}\n");
-            cp++; // Ocupa 2 indices
             break;
             
         case CONSTANT_Double:
             printf("CONSTANT_Double_info {");
-            printf("\n\tu1 tag: %d", cp->tag);
-            printf("\n\tu4 high_bytes: 0x%x", cp->u.Double.high_bytes);
-            printf("\n\tu4 low_bytes: 0x%x", cp->u.Double.low_bytes);
-            printf("\n\t(u8 bytes: %lf)", u4ToDouble(cp->u.Double.high_bytes, cp->u.Double.low_bytes));
+            printf("\n\tu1 tag: %d", tag);
+            printf("\n\tu4 high_bytes: 0x%x", value);
+            printf("\n\tu4 low_bytes: 0x%x", constant_pool->values[index + 1]);
+            printf("\n\t(u8 bytes: %lf)", u4ToDouble(value, constant_pool->values[index + 1]));
             printf("\n}\n");
-            cp++; // Ocupa 2 indices
             break;
             
         default:
@@ -640,15 +748,15 @@ void printFromPool(cp_info* cp, cp_info* constant_pool){
  */
 void exibeCtePool(ArqClass* arq_class){
 
-    cp_info* cp;
     //Para cada elemento do pool de constantes
-    for (cp = arq_class->constant_pool;
-         cp < arq_class->constant_pool + arq_class->constant_pool_count - 1;
-         cp++)
-    {
-        printf("%d. ", (cp - arq_class->constant_pool +1));
+    for (u2 index = 1; index < arq_class->constant_pool_count; index++) {
+        
+        //A posicao seguinte a um Long ou Double nao eh uma entrada (tag zero)
+        if (arq_class->constant_pool->tags[index] == 0) continue;
+        
+        printf("%d. ", index);
         //Imprimimos o elemento
-        printFromPool(cp, arq_class->constant_pool);
+        printFromPool(arq_class->constant_pool, index);
     }
 }
 
@@ -693,7 +801,7 @@ void exibeInterfaces(ArqClass* arq_class){
     for (int i = 0; i < arq_class->interfaces_count; i++) {
         printf("\n %d (\"%ls\")", arq_class->interfaces[i],
         getUnicodeFromConstantPool(arq_class->constant_pool,
-                                arq_class->constant_pool[arq_class->interfaces[i]-1].u.Class.name_index));
+                                (u2) arq_class->constant_pool->values[arq_class->interfaces[i]]));
     }
 }
 
@@ -751,7 +859,7 @@ void printByteCodes(u1* bytecodes, u4 code_length){
  * \param attribute ponteiro para o atributo a ser exibido
  * \param cp    ponteiro para o pool de constantes
  */
-void exibeAtributo(attribute_info* attribute, cp_info* cp); //A ser implementada abaixo...
+void exibeAtributo(attribute_info* attribute, ConstantPool* cp); //A ser implementada abaixo...
 
 
 //--------------------------------------------------------------------------------------------------
@@ -762,7 +870,7 @@ void exibeAtributo(attribute_info* attribute, cp_info* cp); //A ser implementada
  * \param attributes_count Numero de atributos
  * \param cp ponteiro para o pool de constantes
  */
-void printCodeAttributes(u1* code, u4 attributes_count, cp_info* cp){
+void printCodeAttributes(u1* code, u4 attributes_count, ConstantPool* cp){
     
     u1* c = code;
     
@@ -800,7 +908,7 @@ void printCodeAttributes(u1* code, u4 attributes_count, cp_info* cp){
  * \param exception_table_length Numero de elementos na tabela de excessoes
  * \param cp ponteiro para o pool de constantes
  */
-void printCodeExceptions(ExceptionTable* excTable, u2 exception_table_length, cp_info* cp){
+void printCodeExceptions(ExceptionTable* excTable, u2 exception_table_length, ConstantPool* cp){
     
     printf("\n\t\t{");
     
@@ -812,7 +920,7 @@ void printCodeExceptions(ExceptionTable* excTable, u2 exception_table_length, cp
         printf("\n\t\t\tCATCH_TYPE: %d", excTable[i].catch_type);
         
         printf("\n(((((((((((((((\n");
-        printFromPool(&cp[excTable[i].catch_type], cp);
+        printFromPool(cp, excTable[i].catch_type);
         printf(")))))))))))))))\n");
         printf("\n\t\t\t}");
     }
@@ -822,7 +930,7 @@ void printCodeExceptions(ExceptionTable* excTable, u2 exception_table_length, cp
 
 //--------------------------------------------------------------------------------------------------
 //
-void exibeAtributo(attribute_info* attribute, cp_info* cp){
+void exibeAtributo(attribute_info* attribute, ConstantPool* cp){
     
     //Exibimos o nome
     printf("\n\t\tNAME_INDEX:\t\t %d ", attribute->attribute_name_index);
@@ -840,7 +948,7 @@ void exibeAtributo(attribute_info* attribute, cp_info* cp){
         
         printf("\n\t\tCONSTANT_VALUE INDEX:\t\t %d ", constantValue->constantvalue_index);
         printf("\n(((((((((((((((\n");
-        printFromPool(&cp[constantValue->constantvalue_index-1], cp);
+        printFromPool(cp, constantValue->constantvalue_index);
         printf(")))))))))))))))\n");
         
         free(constantValue);
@@ -849,7 +957,13 @@ void exibeAtributo(attribute_info* attribute, cp_info* cp){
     //Caso seja CODE
     else if (wcscmp(getUnicodeFromConstantPool(cp, attribute->attribute_name_index), ATT_Code)==0) {
         
-        CodeAttribute* code = parseCode(attribute->info);
+        //A exibicao decodifica o atributo em uma arena temporaria
+        ClassArena* arena = newClassArena(attribute->attribute_length + sizeof(CodeAttribute));
+        CodeAttribute* code = parseCode(attribute, arena);
+        if (code == NULL) {
+            freeClassArena(arena);
+            return;
+        }
         
         printf("\n\t\tMAX_STACK:\t\t %d ", code->max_stack);
         
@@ -865,7 +979,7 @@ void exibeAtributo(attribute_info* attribute, cp_info* cp){
         printf("\n\t\tATTRIBUTES_COUNT:\t %d ", code->attributes_count);
         printCodeAttributes(code->attributes, code->attributes_count, cp);
         
-        free(code);
+        freeClassArena(arena);
     }
     //Caso seja Exception
     else if (wcscmp(getUnicodeFromConstantPool(cp, attribute->attribute_name_index), ATT_Exceptions)==0) {
@@ -876,7 +990,7 @@ void exibeAtributo(attribute_info* attribute, cp_info* cp){
         
         for (int i = 0; i < exception->number_of_exceptions; i ++) {
             printf("\n%d. (\n", i);
-            printFromPool(&cp[exception->exception_index_table[i]-1], cp);
+            printFromPool(cp, exception->exception_index_table[i]);
             printf(")\n");
         }
     }
@@ -908,7 +1022,7 @@ void exibeAtributos(ArqClass* arq_class){
  * \param count quantidade de campos ou metodos a serem exibidos
  * \param cp    ponteiro para o pool de constantes
  */
-void exibeCampMetd(field_or_method* fm, u2 count, cp_info* cp){
+void exibeCampMetd(field_or_method* fm, u2 count, ConstantPool* cp){
 
     for (int i = 0; i < count; i++) {
         
@@ -989,11 +1103,11 @@ OPresult LECLASS_exibidor(ArqClass* arq_class){
     printf("\nTHIS_CLASS:\t %d ", arq_class->this_class);
     printf("(\"%ls\")",
            getUnicodeFromConstantPool(arq_class->constant_pool,
-                                   arq_class->constant_pool[arq_class->this_class-1].u.Class.name_index));
+                                   (u2) arq_class->constant_pool->values[arq_class->this_class]));
     printf("\nSUPER_CLASS:\t %d ", arq_class->super_class);
     printf("(\"%ls\")",
            getUnicodeFromConstantPool(arq_class->constant_pool,
-                                   arq_class->constant_pool[arq_class->super_class-1].u.Class.name_index));
+                                   (u2) arq_class->constant_pool->values[arq_class->super_class]));
     
     printf("\nINTERFACES_COUNT: %d", arq_class->interfaces_count);
     printf("\n----------------------------------------------------\n");
@@ -1052,6 +1166,84 @@ void LECLASS_exibeErroOperacao(OPresult resultado, const char* fileName){
 
 }
 
+//--------------------------------------------------------------------------------------------------
+void LECLASS_free(ArqClass* arq_class){
+    
+    ConstantPool* cp = arq_class->constant_pool;
+    
+    //Os simbolos das entradas Utf8 deixam de ser referenciados pela classe
+    for (u2 i = 1; cp != NULL && i < arq_class->constant_pool_count; i++)
+        if (cp->tags[i] == CONSTANT_Utf8) releaseSymbol(cp->symbols[cp->values[i]]);
+    
+    libera_arquivo(arq_class->image, arq_class->imageSize);
+    arq_class->image = NULL;
+    arq_class->imageSize = 0;
+    freeClassArena(arq_class->arena);
+    arq_class->arena = NULL;
+    arq_class->constant_pool = NULL;
+    arq_class->interfaces = NULL;
+    arq_class->fields = NULL;
+    arq_class->methods = NULL;
+    arq_class->attributes = NULL;
+}
+
+//--------------------------------------------------------------------------------------------------
+// SUBMODULO: Arena de metadados das classes
+//--------------------------------------------------------------------------------------------------
+
+
+//--------------------------------------------------------------------------------------------------
+ClassArena* newClassArena(u4 size){
+    
+    ClassArena* arena = (ClassArena*) calloc(1, sizeof(ClassArena) + size);
+    
+    if (arena == NULL) JVMstopAbrupt("Erro de alocacao de memoria para os metadados da classe.");
+    
+    arena->size = size;
+    return arena;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+void* arenaAllocate(ClassArena* arena, u4 size){
+    
+    size = (size + LECLASS_ArenaAlign - 1) & ~(u4) (LECLASS_ArenaAlign - 1);
+    
+    //Procuramos um bloco com espaco livre, encadeando um novo se todos estiverem cheios
+    ClassArena* block = arena;
+    while (block->used + size > block->size) {
+        if (block->next == NULL)
+            block->next = newClassArena(size > arena->size / 2 ? size : arena->size / 2);
+        block = block->next;
+    }
+    
+    void* result = block->data + block->used;
+    block->used += size;
+    return result;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+u1 arenaContains(ClassArena* arena, const void* address){
+    
+    for (ClassArena* block = arena; block != NULL; block = block->next)
+        if ((const u1*) address >= block->data && (const u1*) address < block->data + block->size)
+            return 1;
+    
+    return 0;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+void freeClassArena(ClassArena* arena){
+    
+    while (arena != NULL) {
+        ClassArena* next = arena->next;
+        free(arena);
+        arena = next;
+    }
+}
+
 // SUBMODULO
 // Leitura de ".class"
 
@@ -1061,74 +1253,63 @@ void LECLASS_exibeErroOperacao(OPresult resultado, const char* fileName){
  * para uma estrutura inicializada de pool de constantes.
  *
  * \param constant_pool_count   Contador do pool de constantes.
- * \param arq                   Arquivo a ser lido.
+ * \param arq                   Cursor do arquivo a ser lido.
+ * \param arena                 Arena de onde o pool eh alocado.
  */
-cp_info* leCtePool(u2 constant_pool_count, FILE* arq){
+ConstantPool* leCtePool(u2 constant_pool_count, ClassReader* arq, ClassArena* arena){
 
-    cp_info* constant_pool = (cp_info *) malloc(constant_pool_count * sizeof(cp_info));
-    cp_info* cp;
+    ConstantPool* constant_pool = (ConstantPool*) arenaAllocate(arena, sizeof(ConstantPool));
+    u2 symbolCount = 0;
     
-    for (cp = constant_pool; cp < constant_pool + constant_pool_count - 1; cp++) {
+    //Vetores paralelos indexados pelo indice do pool (values tem uma posicao a mais, para um Long
+    // na ultima entrada de um arquivo corrompido). O vetor de simbolos eh dimensionado pelo numero
+    // de entradas, um limite para o numero de entradas Utf8
+    constant_pool->tags = (u1*) arenaAllocate(arena, constant_pool_count * sizeof(u1));
+    constant_pool->values = (u4*) arenaAllocate(arena, (constant_pool_count + 1) * sizeof(u4));
+    constant_pool->symbols = (Symbol**) arenaAllocate(arena, constant_pool_count * sizeof(Symbol*));
+    
+    for (u2 index = 1; index < constant_pool_count; index++) {
 
-        cp->tag = u1Le(arq); //Leitura da tag
+        u1 tag = u1Le(arq); //Leitura da tag
+        constant_pool->tags[index] = tag;
         
-        //Preenchemos os campos de acordo com o tipo de estrutura apontada pela tag
-        switch (cp->tag) {
+        //Preenchemos o valor de acordo com o tipo de estrutura apontada pela tag
+        switch (tag) {
         
+            //Um indice
             case CONSTANT_Class:
-                cp->u.Class.name_index = u2Le(arq);
+            case CONSTANT_String:
+                constant_pool->values[index] = u2Le(arq);
                 break;
                 
+            //Dois indices (o primeiro nos bits mais significativos) ou um valor de 32 bits
             case CONSTANT_Fieldref:
-                cp->u.Fieldref.class_index = u2Le(arq);
-                cp->u.Fieldref.name_and_type_index = u2Le(arq);
-                break;
-                
-            case CONSTANT_NameAndType:
-                cp->u.NameAndType.name_index = u2Le(arq);
-                cp->u.NameAndType.descriptor_index = u2Le(arq);
-                break;
-                
-            case CONSTANT_Utf8:
-                cp->u.Utf8.lenght = u2Le(arq);
-                //Alocamos espaco para o vetor de caracteres
-                cp->u.Utf8.bytes = (u1 *) malloc(cp->u.Utf8.lenght * sizeof(u1));
-                //Lemos cada um dos caracteres
-                for (int i = 0; i < cp->u.Utf8.lenght; i++) cp->u.Utf8.bytes[i] = u1Le(arq);
-                break;
-                
             case CONSTANT_Methodref:
-                cp->u.Methodref.class_index = u2Le(arq);
-                cp->u.Methodref.name_and_type_index = u2Le(arq);
-                break;
-                
             case CONSTANT_InterfaceMethodref:
-                cp->u.InterfaceMethodref.class_index = u2Le(arq);
-                cp->u.InterfaceMethodref.name_and_type_index = u2Le(arq);
-                break;
-                
-            case CONSTANT_String:
-                cp->u.String.string_index = u2Le(arq);
-                break;
-                
+            case CONSTANT_NameAndType:
             case CONSTANT_Integer:
-                cp->u.Integer.bytes = u4Le(arq);
-                break;
-                
             case CONSTANT_Float:
-                cp->u.Float.bytes = u4Le(arq);
+                constant_pool->values[index] = u4Le(arq);
                 break;
                 
-            case CONSTANT_Long:
-                cp->u.Long.high_bytes = u4Le(arq);
-                cp->u.Long.low_bytes = u4Le(arq);
-                cp++; //Long ocupa 2 indices no pool de constantes
+            case CONSTANT_Utf8: {
+                u2 length = u2Le(arq);
+                u1* bytes = bytesLe(arq, length);
+                if (arq->truncated) length = 0;
+                //A entrada passa a referenciar o simbolo canonico (compartilhado entre as classes).
+                // Os bytes sao procurados diretamente no mapeamento e so sao copiados se o simbolo
+                // ainda nao existir
+                constant_pool->symbols[symbolCount] = internSymbol(bytes, length);
+                constant_pool->symbols[symbolCount]->classRefs++;
+                constant_pool->values[index] = symbolCount++;
                 break;
+            }
                 
+            //Long e Double ocupam 2 indices no pool de constantes
+            case CONSTANT_Long:
             case CONSTANT_Double:
-                cp->u.Double.high_bytes = u4Le(arq);
-                cp->u.Double.low_bytes = u4Le(arq);
-                cp++; //Double ocupa 2 indices no pool de constantes
+                constant_pool->values[index] = u4Le(arq);
+                constant_pool->values[++index] = u4Le(arq);
                 break;
                 
             default:
@@ -1145,14 +1326,15 @@ cp_info* leCtePool(u2 constant_pool_count, FILE* arq){
  * passada como parametro
  *
  * \param atributo Atributo a ser preenchido
- * \param arq Arquivo a ser lido.
+ * \param arq Cursor do arquivo a ser lido.
  */
-void leAtributo(attribute_info* atributo, FILE* arq){
+void leAtributo(attribute_info* atributo, ClassReader* arq){
     
     atributo->attribute_name_index = u2Le(arq);
     atributo->attribute_length = u4Le(arq);
-    atributo->info = (u1 *) malloc(atributo->attribute_length * sizeof(u1));
-    for (int i = 0; i < atributo->attribute_length; i++) atributo->info[i] = u1Le(arq);
+    //Os bytes do atributo nao sao copiados: info aponta para o arquivo mapeado
+    atributo->info = bytesLe(arq, atributo->attribute_length);
+    if (arq->truncated) atributo->attribute_length = 0;
     
 }
 
@@ -1163,11 +1345,13 @@ void leAtributo(attribute_info* atributo, FILE* arq){
  * um ponteiro para uma estrutura inicializada de campo ou metodo.
  *
  * \param count Numero de metodos ou campos a serem lidos.
- * \param arq   Arquivo a ser lido.
+ * \param arq   Cursor do arquivo a ser lido.
+ * \param arena Arena de onde as estruturas sao alocadas.
  */
-field_or_method* leCampMetd(u2 count, FILE* arq){
+field_or_method* leCampMetd(u2 count, ClassReader* arq, ClassArena* arena){
     
-    field_or_method* resultado = (field_or_method * ) malloc(count * sizeof(field_or_method));
+    field_or_method* resultado = (field_or_method * ) arenaAllocate(arena,
+                                                                count * sizeof(field_or_method));
     field_or_method* fi;
     
     for (fi = resultado; fi < resultado + count; fi++) {
@@ -1177,7 +1361,8 @@ field_or_method* leCampMetd(u2 count, FILE* arq){
         fi->attributes_count = u2Le(arq);
 
         //Lemos os atributos
-        fi->attributes = (attribute_info *) malloc(fi->attributes_count * sizeof(attribute_info));
+        fi->attributes = (attribute_info *) arenaAllocate(arena,
+                                                fi->attributes_count * sizeof(attribute_info));
         for (int i = 0; i < fi->attributes_count; i++) leAtributo(&fi->attributes[i], arq);
         
     }
@@ -1188,13 +1373,17 @@ field_or_method* leCampMetd(u2 count, FILE* arq){
 
 //--------------------------------------------------------------------------------------------------
 /*!
- * Metodo que realiza a leitura de um arquivo ".class" preeenchendo uma estrutura ArqClass.
+ * Metodo que realiza a leitura de um arquivo ".class" preeenchendo uma estrutura ArqClass. Os
+ * metadados lidos sao alocados da arena da estrutura; os bytes dos atributos ficam no arquivo
+ * mapeado.
  *
  * \param arq_class Estrutura de arquivo ".class" a ser preenchida
- * \param arq       Arquivo ".class" a ser lido.
+ * \param arq       Cursor do arquivo ".class" mapeado.
  * \return          Resultado da operacao
  */
-OPresult arquivoParaArqClass(ArqClass* arq_class, FILE* arq){
+OPresult arquivoParaArqClass(ArqClass* arq_class, ClassReader* arq){
+    
+    ClassArena* arena = arq_class->arena;
     
     //Lemos e verificamos o Magic e as versoes
     arq_class->magic = u4Le(arq);
@@ -1204,7 +1393,7 @@ OPresult arquivoParaArqClass(ArqClass* arq_class, FILE* arq){
     
     //Constant pool
     arq_class->constant_pool_count = u2Le(arq);
-    arq_class->constant_pool = leCtePool(arq_class->constant_pool_count, arq); //Lemos o constant pool
+    arq_class->constant_pool = leCtePool(arq_class->constant_pool_count, arq, arena);
 
     arq_class->access_flags = u2Le(arq);
     arq_class->this_class = u2Le(arq);
@@ -1213,22 +1402,42 @@ OPresult arquivoParaArqClass(ArqClass* arq_class, FILE* arq){
     
     //Lemos as interfaces
     arq_class->interfaces_count = u2Le(arq);
-    arq_class->interfaces = (u2 *) malloc(arq_class->interfaces_count* sizeof(u2));
+    arq_class->interfaces = (u2 *) arenaAllocate(arena, arq_class->interfaces_count* sizeof(u2));
     for (int i = 0; i < arq_class->interfaces_count; i++) arq_class->interfaces[i]=u2Le(arq);
 
     //Lemos os campos
     arq_class->fields_count = u2Le(arq);
-    arq_class->fields = leCampMetd(arq_class->fields_count, arq);
+    arq_class->fields = leCampMetd(arq_class->fields_count, arq, arena);
     
     //Lemos os metodos
     arq_class->methods_count = u2Le(arq);
-    arq_class->methods = leCampMetd(arq_class->methods_count, arq);
+    arq_class->methods = leCampMetd(arq_class->methods_count, arq, arena);
     
     //Lemos os atributos
     arq_class->attributes_count = u2Le(arq);
-    arq_class->attributes = (attribute_info *)
-                            malloc(arq_class->attributes_count * sizeof(attribute_info));
-    for (int i = 0; i < arq_class->attributes_count; i++) leAtributo(&arq_class->attributes[i], arq);
+    arq_class->attributes = (attribute_info *) arenaAllocate(arena,
+                                            arq_class->attributes_count * sizeof(attribute_info));
+    for (int i = 0; i < arq_class->attributes_count; i++)
+        leAtributo(&arq_class->attributes[i], arq);
+    
+    //Arquivo truncado
+    if (arq->truncated) return LinkageError_ClassFormatError;
+    
+    //Os atributos Code sao decodificados uma unica vez, na arena, ao lado dos demais metadados
+    char* codeName = internString("Code");
+    for (method_info* method = arq_class->methods;
+         method < arq_class->methods + arq_class->methods_count; method++) {
+        for (int i = 0; i < method->attributes_count; i++) {
+            if (getUTF8FromConstantPool(arq_class->constant_pool,
+                                        method->attributes[i].attribute_name_index) != codeName)
+                continue;
+            
+            method->code = parseCode(&method->attributes[i], arena);
+            
+            //Atributo Code malformado
+            if (method->code == NULL) return LinkageError_ClassFormatError;
+        }
+    }
     
     return LinkageSuccess;
 }
@@ -1237,20 +1446,18 @@ OPresult arquivoParaArqClass(ArqClass* arq_class, FILE* arq){
 //--------------------------------------------------------------------------------------------------
 OPresult LECLASS_leitor(ArqClass* arq_class, const char* arq){
 
-    FILE *entrada;
+    //Mapeamos o arquivo de entrada, que continua mapeado enquanto a classe existir
+    arq_class->image = mapeia_arquivo(arq, &arq_class->imageSize);
+    if (!arq_class->image) return LinkageError_NoClassDefFoundError;
 
-    //Obtemos o arquivo de entrada
-    entrada = obter_entrada(arq);
-    
-    //Erro de abertura de arquivo
-    if (!entrada) return LinkageError_NoClassDefFoundError;
+    //A arena dos metadados eh dimensionada pelo tamanho do arquivo
+    arq_class->arena = newClassArena(LECLASS_ArenaFactor * arq_class->imageSize +
+                                     LECLASS_ArenaSlack);
 
-    //Lemos os dados e salvamos na estrutura ArqClass
-    OPresult result = arquivoParaArqClass(arq_class, entrada);
+    //Lemos os dados diretamente do mapeamento e salvamos na estrutura ArqClass
+    ClassReader leitor = {arq_class->image, arq_class->image + arq_class->imageSize, 0};
     
-    fclose(entrada);
-    
-    return result;
+    return arquivoParaArqClass(arq_class, &leitor);
 
 }
 
@@ -1259,44 +1466,137 @@ OPresult LECLASS_leitor(ArqClass* arq_class, const char* arq){
 //--------------------------------------------------------------------------------------------------
 
 
+//Conteudo devolvido para arquivos vazios, que nao podem ser mapeados
+static u1 arquivoVazio[1];
+
 //--------------------------------------------------------------------------------------------------
-FILE* obter_entrada(const char *arq){
+u1* mapeia_arquivo(const char* nome_arquivo, u4* tamanho){
+
+    *tamanho = 0;
+
+#ifdef _WIN32
+    //Sem mmap: o arquivo eh lido de uma vez para um buffer
+    FILE* arquivo = fopen(nome_arquivo, "rb");
+    if (!arquivo) return NULL;
+    fseek(arquivo, 0, SEEK_END);
+    long length = ftell(arquivo);
+    rewind(arquivo);
+    if (length <= 0 || (u8) length > 0xFFFFFFFFu){
+        fclose(arquivo);
+        return length == 0 ? arquivoVazio : NULL;
+    }
+    u1* conteudo = (u1*) malloc(length);
+    if (!conteudo || fread(conteudo, 1, length, arquivo) != (size_t) length){
+        free(conteudo);
+        fclose(arquivo);
+        return NULL;
+    }
+    fclose(arquivo);
+#else
+    int arquivo = open(nome_arquivo, O_RDONLY);
+    if (arquivo < 0) return NULL;
+    struct stat info;
+    if (fstat(arquivo, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size > 0xFFFFFFFFu){
+        close(arquivo);
+        return NULL;
+    }
+    off_t length = info.st_size;
+    if (length == 0){
+        close(arquivo);
+        return arquivoVazio;
+    }
+    //O mapeamento eh somente leitura: os metadados apontam para ele, mas nunca o alteram
+    u1* conteudo = (u1*) mmap(NULL, length, PROT_READ, MAP_PRIVATE, arquivo, 0);
+    //O mapeamento continua valido apos o fechamento do descritor
+    close(arquivo);
+    if (conteudo == (u1*) MAP_FAILED) return NULL;
+#endif
+
+    *tamanho = (u4) length;
+    return conteudo;
+}
 
-   FILE *arquivo; // Arquivo a ser carregado e retornado
 
-   arquivo = fopen(arq, "rb");
-    
-    if (arquivo) return arquivo;
+//--------------------------------------------------------------------------------------------------
+void libera_arquivo(u1* conteudo, u4 tamanho){
 
-return NULL;
+    if (!conteudo || tamanho == 0) return;
 
+#ifdef _WIN32
+    free(conteudo);
+#else
+    munmap(conteudo, tamanho);
+#endif
 }
 
 
 //--------------------------------------------------------------------------------------------------
-u1 u1Le(FILE *arquivo){
+u1 u1Le(ClassReader* leitor){
 
-    return getc(arquivo);
+    if (leitor->position >= leitor->end){
+        leitor->truncated = 1;
+        return 0;
+    }
+    
+    return *leitor->position++;
 }
 
 
 //--------------------------------------------------------------------------------------------------
-u2 u2Le(FILE *arquivo){
-    
-    u2 resultado = getc(arquivo);
+u2 u2Le(ClassReader* leitor){
     
-    resultado = (resultado << 8) | (getc(arquivo));
+    u2 resultado;
+
+    if (leitor->end - leitor->position < 2){
+        leitor->truncated = 1;
+        leitor->position = leitor->end;
+        return 0;
+    }
     
+    //Os dados do arquivo estao em big-endian
+    memcpy(&resultado, leitor->position, 2);
+    leitor->position += 2;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
     return resultado;
+#else
+    return __builtin_bswap16(resultado);
+#endif
 }
 
 
 //--------------------------------------------------------------------------------------------------
-u4 u4Le(FILE *arquivo){
+u4 u4Le(ClassReader* leitor){
     
-    u4 resultado = u2Le(arquivo);
+    u4 resultado;
 
-    resultado = (resultado << 16 | u2Le(arquivo));
+    if (leitor->end - leitor->position < 4){
+        leitor->truncated = 1;
+        leitor->position = leitor->end;
+        return 0;
+    }
     
+    //Os dados do arquivo estao em big-endian
+    memcpy(&resultado, leitor->position, 4);
+    leitor->position += 4;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
     return resultado;
+#else
+    return __builtin_bswap32(resultado);
+#endif
+}
+
+
+//--------------------------------------------------------------------------------------------------
+u1* bytesLe(ClassReader* leitor, u4 tamanho){
+    
+    u1* bytes = leitor->position;
+
+    if ((u4) (leitor->end - leitor->position) < tamanho){
+        leitor->truncated = 1;
+        leitor->position = leitor->end;
+        return bytes;
+    }
+    
+    leitor->position += tamanho;
+    return bytes;
 }
@@ -33,6 +33,8 @@
 #include "include/util.h"
 #include "include/memoryunit.h"
 #include "include/classloader.h"
+#include "include/heap.h"
+#include "include/verifier.h"
 
 //--------------------------------------------------------------------------------------------------
 // SUBMODULO: Interpretador.
@@ -85,23 +87,152 @@ void execute(Environment* environment){
 void configureClassMain(Environment* environment, int argc, const char* argv[]){
     
     //Empilhamos o metodo main a ser inicializado
-    Frame* newFrame = pushFrame(environment, argv[1], "main", "([Ljava/lang/String;)V");
+    Frame* newFrame = pushFrame(environment, internString(argv[1]), internString("main"),
+                                internString("([Ljava/lang/String;)V"));
     
-    //Criamos o conteudo do array e o JavaArray a receber o conteudo
-    void* arrayAddress;
-    u4* stringArray = (u4*) malloc((argc-2)*sizeof(u4));
-    JavaArray* array = newJavaArray(T_INT, argc-2, arrayAddress);
-    array->arrayAddress = stringArray;
+    //Criamos o array de strings; os elementos seguem o JavaArray no mesmo bloco
+    JavaArray* array = newJavaArray(T_REFERENCE, argc-2, environment->thread);
+    u4* stringArray = (u4*) (array + 1);
 
     //Preenchemos o array de strings com cada argumento
     for (int i = 2; i < argc; i++) {
-        wchar_t* string = (wchar_t*)malloc((strlen(argv[i])+1)*sizeof(wchar_t));
+        wchar_t* string = (wchar_t*) heapAllocate(environment->thread,
+                                                  (strlen(argv[i])+1)*sizeof(wchar_t),
+                                                  HEAP_StringData);
         mbstowcs(string, argv[i], (strlen(argv[i]))+1);
-        JavaString* string_info = newJavaString(string);
-        stringArray[i-2] = (u4) string_info;
+        JavaString* string_info = newJavaString(string, environment->thread);
+        stringArray[i-2] = encodeReference(string_info);
+        heapWriteBarrier(&stringArray[i-2]);
     }
     //Passamos o argumento argv da main java
-    newFrame->localVariablesVector[0] = (u4) array;
+    newFrame->localVariablesVector[0] = encodeReference(array);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que le o tamanho de uma opcao da JVM, em bytes ou com os sufixos k, m ou g.
+ *
+ * \param option Opcao completa (para a mensagem de erro)
+ * \param value Texto do tamanho
+ * \return Tamanho em bytes
+ */
+static u4 parseSizeOption(const char* option, const char* value){
+    
+    char* suffix;
+    unsigned long long size = strtoull(value, &suffix, 10);
+    
+    if (*suffix == 'k' || *suffix == 'K') size <<= 10, suffix++;
+    else if (*suffix == 'm' || *suffix == 'M') size <<= 20, suffix++;
+    else if (*suffix == 'g' || *suffix == 'G') size <<= 30, suffix++;
+    
+    if (suffix == value || *suffix != '\0' || size > 0xFFFFFFFFull) {
+        char buffer[200];
+        snprintf(buffer, sizeof(buffer), "Tamanho invalido: \"%s\".", option);
+        JVMstopAbrupt(buffer);
+    }
+    
+    return (u4) size;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que le as opcoes da JVM, passadas na linha de comando antes do nome da classe:
+ * - -Xmx<tamanho>: tamanho maximo do heap, incluindo os objetos grandes (padrao 64m)
+ * - -Xms<tamanho>: tamanho do heap comprometido na inicializacao (padrao 8m)
+ * - -Xmn<tamanho>: tamanho da geracao jovem (padrao: um oitavo do heap)
+ * - -XX:GCThreshold=<n>: ocupacao da geracao velha (%) a partir da qual a marcacao incremental eh
+ *   iniciada (0 inicia um ciclo de marcacao a cada coleta da geracao jovem)
+ * - -XX:MaxTenuringThreshold=<n>: numero de coletas da geracao jovem sobrevividas para que um
+ *   objeto seja promovido para a geracao velha
+ * - -verbose:gc: exibe um resumo de cada coleta e, ao final, o histograma das pausas
+ * - -XX:VerifierThreads=<n>: numero de threads que verificam os metodos de cada classe carregada
+ *   (padrao: o numero de processadores)
+ * - -XX:LargeObjectThreshold=<tamanho>: menor array alocado no espaco de objetos grandes
+ * - -XX:LargeObjectSpace=<tamanho>: tamanho reservado (virtual) para o espaco de objetos grandes
+ * - -XX:+UseTransparentHugePages: pede huge pages transparentes para o heap
+ * - -XX:+UseLargePages: mapeia o heap com huge pages explicitas (MAP_HUGETLB), se houver
+ * - -XX:+PrintClassHistogram: exibe, ao final, o censo dos objetos vivos por classe
+ * - -XX:+UseNoGC: sem coletor de lixo; os blocos sao alocados em arenas e so liberados no fim
+ * - -XX:-DoEscapeAnalysis: aloca no heap tambem os objetos que nao escapam do seu metodo
+ * - -XX:-ClassUnloading: mantem carregadas as classes que nao tem mais objetos vivos
+ *
+ * \param argc Numero de argumentos do programa
+ * \param argv Vetor de vetores de char passados pelo usuario
+ * \param heapOptions Opcoes do heap a serem preenchidas
+ * \param verifierThreads Numero de threads de verificacao a ser preenchido
+ * \return Indice do nome da classe em argv
+ */
+int parseVMOptions(int argc, const char* argv[], HeapOptions* heapOptions, u1* verifierThreads){
+    
+    int i;
+    
+    for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+        
+        if (strncmp(argv[i], "-Xmx", 4) == 0) {
+            u4 size = parseSizeOption(argv[i], &argv[i][4]);
+            heapOptions->size = size < HEAP_MinimumSize ? HEAP_MinimumSize : size;
+        }
+        else if (strncmp(argv[i], "-Xms", 4) == 0) {
+            heapOptions->initialSize = parseSizeOption(argv[i], &argv[i][4]);
+        }
+        else if (strncmp(argv[i], "-Xmn", 4) == 0) {
+            heapOptions->youngSize = parseSizeOption(argv[i], &argv[i][4]);
+        }
+        else if (strncmp(argv[i], "-XX:GCThreshold=", 16) == 0) {
+            int threshold = atoi(&argv[i][16]);
+            heapOptions->threshold = threshold < 0 ? 0 : threshold > 100 ? 100 : threshold;
+        }
+        else if (strncmp(argv[i], "-XX:MaxTenuringThreshold=", 25) == 0) {
+            int tenuring = atoi(&argv[i][25]);
+            heapOptions->tenuring = tenuring < 1 ? 1 : tenuring > 15 ? 15 : tenuring;
+        }
+        else if (strcmp(argv[i], "-verbose:gc") == 0) {
+            heapOptions->verbose = 1;
+        }
+        else if (strncmp(argv[i], "-XX:LargeObjectThreshold=", 25) == 0) {
+            u4 threshold = parseSizeOption(argv[i], &argv[i][25]);
+            //Arrays menores sao alocados nos TLABs, sem passar pelo caminho lento
+            heapOptions->largeObject = threshold < HEAP_TLABSize / 4 ? HEAP_TLABSize / 4
+                                                                     : threshold;
+        }
+        else if (strncmp(argv[i], "-XX:LargeObjectSpace=", 21) == 0) {
+            heapOptions->largeSpace = parseSizeOption(argv[i], &argv[i][21]);
+        }
+        else if (strcmp(argv[i], "-XX:+UseTransparentHugePages") == 0) {
+            heapOptions->hugePages = 1;
+        }
+        else if (strcmp(argv[i], "-XX:+UseLargePages") == 0) {
+            heapOptions->largePages = 1;
+        }
+        else if (strcmp(argv[i], "-XX:+PrintClassHistogram") == 0) {
+            heapOptions->classHistogram = 1;
+        }
+        else if (strcmp(argv[i], "-XX:+UseNoGC") == 0) {
+            heapOptions->noGC = 1;
+        }
+        else if (strcmp(argv[i], "-XX:-DoEscapeAnalysis") == 0) {
+            heapOptions->noEscapeAnalysis = 1;
+        }
+        else if (strcmp(argv[i], "-XX:-ClassUnloading") == 0) {
+            heapOptions->noClassUnloading = 1;
+        }
+        else if (strncmp(argv[i], "-XX:VerifierThreads=", 20) == 0) {
+            int threads = atoi(&argv[i][20]);
+            *verifierThreads = threads < 1 ? 1 :
+                               threads > VERIFIER_MaxThreads ? VERIFIER_MaxThreads : threads;
+        }
+        else {
+            char buffer[200];
+            snprintf(buffer, sizeof(buffer), "Opcao invalida: \"%s\".", argv[i]);
+            JVMstopAbrupt(buffer);
+        }
+    }
+    
+    if (i == argc) JVMstopAbrupt("Nome da classe nao informado.");
+    
+    return i;
 }
 
 
@@ -114,6 +245,13 @@ int main(int argc, const char * argv[]) {
 
     char opcoes;
     u1 debugFlags = 0;
+    HeapOptions heapOptions = {HEAP_DefaultSize, 0, HEAP_DefaultThreshold, HEAP_DefaultTenuring, 0,
+                               HEAP_DefaultLargeSpace, HEAP_DefaultLargeObject, 0,
+                               HEAP_DefaultInitialSize, 0, 0, 0, 0, 0};
+    u1 verifierThreads = defaultVerifierThreads();
+    
+    //Opcoes da JVM (antes do nome da classe)
+    int classIndex = parseVMOptions(argc, argv, &heapOptions, &verifierThreads);
     
     //Configuracoes de debug
     printf("Deseja ativar exibidor de .class?[N/s]:");
@@ -136,14 +274,22 @@ int main(int argc, const char * argv[]) {
     environment->methodArea = newMethodArea();
     environment->thread = newThread();
     environment->debugFlags = debugFlags;
+    environment->verifierThreads = verifierThreads;
+    environment->loadingClasses = 0;
+    
+    //Reservamos a regiao do heap (a pilha nativa a partir de main eh percorrida pelo coletor)
+    initHeap(&heapOptions, environment, &opcoes);
     
-    //Empilhamos o metodo main
-    configureClassMain(environment, argc, argv);
+    //Empilhamos o metodo main (argv[1] passa a ser o nome da classe)
+    configureClassMain(environment, argc - classIndex + 1, &argv[classIndex - 1]);
     
     //Passamos o ambiente de execucao para o interpretador
     execute(environment);
 
     printf("\n\n");
+    printHeapCensus();
+    printHeapStatistics();
+    releaseHeap();
     return 0;
 }
 
@@ -572,6 +718,12 @@ instruction decode(u1 bytecode){
         case OP_multianewarray:
             return multianewarray;
             break;
+        case OP_monitorenter:
+            return monitorenter;
+            break;
+        case OP_monitorexit:
+            return monitorexit;
+            break;
         case OP_ireturn:
             return ireturn;
             break;
@@ -776,6 +928,12 @@ void JVMThrow(int exception, Environment* environment){
         case NegativeArraySizeException:
             strcat(mensagem, "NegativeArraySizeException");
             break;
+        case IllegalMonitorStateException:
+            strcat(mensagem, "IllegalMonitorStateException");
+            break;
+        case OutOfMemoryError:
+            strcat(mensagem, "OutOfMemoryError");
+            break;
         default:
             break;
     }
@@ -1926,7 +2084,7 @@ void nop(Environment* environment){}
 //--------------------------------------------------------------------------------------------------
 void aconst_null(Environment* environment){
     
-    pushInOperandStack(environment->thread, (u4)NULL);
+    pushInOperandStack(environment->thread, 0);
 }
 
 
@@ -2098,19 +2256,22 @@ void ldc(Environment* environment){
                                               environment->thread->vmStack->top->javaClass->arqClass->constant_pool
                                               ,environment->thread->PC);
     
-    u1 tag_valor_constant_pool = environment->thread->vmStack->top->javaClass->arqClass->constant_pool[index_argument-1].tag;
+    ConstantPool* constant_pool =
+                            environment->thread->vmStack->top->javaClass->arqClass->constant_pool;
+    u1 tag_valor_constant_pool = constant_pool->tags[index_argument];
     
     if (tag_valor_constant_pool == CONSTANT_Integer || tag_valor_constant_pool == CONSTANT_Float){
         
         // Estrutra Integer e Float possuem o mesmo formato
-        u4 valor_numerico = environment->thread->vmStack->top->javaClass->arqClass->constant_pool[index_argument-1].u.Integer.bytes;
+        u4 valor_numerico = constant_pool->values[index_argument];
         
         pushInOperandStack(environment->thread, valor_numerico);
     }
     else if (tag_valor_constant_pool == CONSTANT_String){
         
-        //CORRECAO: REFERENCIA PARA STRING INFO, NAO PARA O INDICE DA STRING INFO
-        u4 referencia = (u4) &environment->thread->vmStack->top->javaClass->arqClass->constant_pool[index_argument-1];
+        //A string java da constante eh criada no primeiro uso
+        u4 referencia = getStringConstant(environment->thread->vmStack->top->javaClass,
+                                          index_argument, environment->thread);
         
         pushInOperandStack(environment->thread, referencia);
     }
@@ -2132,19 +2293,21 @@ void ldc_w(Environment* environment){
     
     u2 index_result = (index1byte_argument << 8) | index2byte_argument;
     
-    u1 tag_valor_constant_pool = environment->thread->vmStack->top->javaClass->arqClass->constant_pool[index_result-1].tag;
+    ConstantPool* constant_pool =
+                            environment->thread->vmStack->top->javaClass->arqClass->constant_pool;
+    u1 tag_valor_constant_pool = constant_pool->tags[index_result];
     
     if (tag_valor_constant_pool == CONSTANT_Integer || tag_valor_constant_pool == CONSTANT_Float){
         
         // Estrutra Integer e Float possuem o mesmo formato
-        u4 valor_numerico = environment->thread->vmStack->top->javaClass->arqClass->constant_pool[index_result-1].u.Integer.bytes;
+        u4 valor_numerico = constant_pool->values[index_result];
         
         pushInOperandStack(environment->thread, valor_numerico);
     }
     else if (tag_valor_constant_pool == CONSTANT_String){
         
-        u4 referencia = (u4) &environment->thread->vmStack->top->javaClass->arqClass->constant_pool[index_result-1];
-
+        u4 referencia = getStringConstant(environment->thread->vmStack->top->javaClass,
+                                          index_result, environment->thread);
         
         pushInOperandStack(environment->thread, referencia);
     }
@@ -2166,14 +2329,16 @@ void ldc2_w(Environment* environment){
     
     u2 index_result = (index1byte_argument << 8) | index2byte_argument;
     
-    u1 tag_valor_constant_pool = environment->thread->vmStack->top->javaClass->arqClass->constant_pool[index_result-1].tag;
+    ConstantPool* constant_pool =
+                            environment->thread->vmStack->top->javaClass->arqClass->constant_pool;
+    u1 tag_valor_constant_pool = constant_pool->tags[index_result];
     
     if (tag_valor_constant_pool == CONSTANT_Long || tag_valor_constant_pool == CONSTANT_Double){
         
-        //Estrutura Long e Double possuem o mesmo formato
-        u4 valor_numerico_high = environment->thread->vmStack->top->javaClass->arqClass->constant_pool[index_result-1].u.Long.high_bytes;
+        //Estrutura Long e Double possuem o mesmo formato: as duas metades em posicoes seguidas
+        u4 valor_numerico_high = constant_pool->values[index_result];
         
-        u4 valor_numerico_low = environment->thread->vmStack->top->javaClass->arqClass->constant_pool[index_result-1].u.Long.low_bytes;
+        u4 valor_numerico_low = constant_pool->values[index_result + 1];
         
         pushInOperandStack(environment->thread, valor_numerico_low);
         pushInOperandStack(environment->thread, valor_numerico_high);
@@ -2457,42 +2622,44 @@ void aload_3(Environment* environment){
 
 
 //--------------------------------------------------------------------------------------------------
-void iaload(Environment* environment){
+/*!
+ * Metodo que desempilha o indice e a referencia de array de uma instrucao de acesso a array e
+ * retorna o endereco do elemento. O tamanho do elemento eh dado pela propria instrucao, de modo
+ * que o acesso nao depende do tipo guardado no array.
+ *
+ * \param environment Ambiente de execucao atual
+ * \param elementSize Tamanho em bytes do elemento acessado pela instrucao
+ * \return Endereco do elemento
+ */
+static void* popArrayElement(Environment* environment, u4 elementSize){
     
     u4 index = popFromOperandStack(environment->thread);
     
-    JavaArray* array_info = (JavaArray*) popFromOperandStack(environment->thread);
+    JavaArray* array_info = (JavaArray*) decodeReference(popFromOperandStack(environment->thread));
     
-    if (array_info->arrayAddress == NULL) {
-        //TODO: throw NullPointerException;
-    }
-    if (index > array_info->count) {
-        //TODO: Otherwise, if index is not within the bounds of the array referenced by arrayref, the iaload instruction throws an ArrayIndexOutOfBoundsException.
-    }
+    if (array_info == NULL) JVMThrow(NullPointerException, environment);
     
-    u4 valor_numerico = *((u4*)((array_info->arrayAddress)+ index*sizeof(u4)));
+    //Indices negativos sao maiores que qualquer tamanho na comparacao sem sinal
+    if (index >= array_info->count) JVMThrow(ArrayIndexOutOfBoundsException, environment);
     
-    pushInOperandStack(environment->thread, valor_numerico);
+    //Os elementos seguem o JavaArray no mesmo bloco
+    return (u1*) (array_info + 1) + index * elementSize;
 }
 
 
 //--------------------------------------------------------------------------------------------------
-void laload(Environment* environment){
-    
-    u4 index = popFromOperandStack(environment->thread);
-    
-    JavaArray* array_info = (JavaArray*) popFromOperandStack(environment->thread);
+void iaload(Environment* environment){
     
-    if (array_info->arrayAddress == NULL) {
-        //TODO: throw NullPointerException;
-    }
-    if (index > array_info->count) {
-        //TODO: Otherwise, if index is not within the bounds of the array referenced by arrayref, the iaload instruction throws an ArrayIndexOutOfBoundsException.
-    }
+    u4 valor_numerico = *((u4*) popArrayElement(environment, sizeof(u4)));
     
-    u8* array = array_info->arrayAddress;
+    pushInOperandStack(environment->thread, valor_numerico);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+void laload(Environment* environment){
     
-    u8 value = array[index];
+    u8 value = *((u8*) popArrayElement(environment, sizeof(u8)));
     
     u4 valor_numerico_high = value >> 32;
     u4 valor_numerico_low = (u4) value;
@@ -2505,18 +2672,7 @@ void laload(Environment* environment){
 //--------------------------------------------------------------------------------------------------
 void faload(Environment* environment){
     
-    u4 index = popFromOperandStack(environment->thread);
-    
-    JavaArray* array_info = (JavaArray*) popFromOperandStack(environment->thread);
-    
-    if (array_info->arrayAddress == NULL) {
-        //TODO: throw NullPointerException;
-    }
-    if (index > array_info->count) {
-        //TODO: Otherwise, if index is not within the bounds of the array referenced by arrayref, the iaload instruction throws an ArrayIndexOutOfBoundsException.
-    }
-    
-    u4 valor_numerico = *((u4*)((array_info->arrayAddress)+index*sizeof(u4)));
+    u4 valor_numerico = *((u4*) popArrayElement(environment, sizeof(u4)));
     
     pushInOperandStack(environment->thread, valor_numerico);
 }
@@ -2525,20 +2681,7 @@ void faload(Environment* environment){
 //--------------------------------------------------------------------------------------------------
 void daload(Environment* environment){
     
-    u4 index = popFromOperandStack(environment->thread);
-    
-    JavaArray* array_info = (JavaArray*) popFromOperandStack(environment->thread);
-    
-    if (array_info->arrayAddress == NULL) {
-        //TODO: throw NullPointerException;
-    }
-    if (index > array_info->count) {
-        //TODO: Otherwise, if index is not within the bounds of the array referenced by arrayref, the iaload instruction throws an ArrayIndexOutOfBoundsException.
-    }
-    
-    u8* array = array_info->arrayAddress;
-    
-    u8 value = array[index];
+    u8 value = *((u8*) popArrayElement(environment, sizeof(u8)));
     
     u4 valor_numerico_high = value >> 32;
     u4 valor_numerico_low = (u4) value;
@@ -2551,19 +2694,7 @@ void daload(Environment* environment){
 //--------------------------------------------------------------------------------------------------
 void aaload(Environment* environment){
     
-    u4 index = popFromOperandStack(environment->thread);
-    
-    JavaArray* array_info = (JavaArray*) popFromOperandStack(environment->thread);
-    
-    if (array_info->arrayAddress == NULL) {
-        //TODO: throw NullPointerException;
-    }
-    //Verificacao de erro de acesso de indice
-    if (index >= array_info->count) JVMThrow(ArrayIndexOutOfBoundsException, environment);
-    
-    u4* array = array_info->arrayAddress;
-    
-    u4 valor_numerico = array[index];
+    u4 valor_numerico = *((u4*) popArrayElement(environment, sizeof(u4)));
     
     pushInOperandStack(environment->thread, valor_numerico);
 }
@@ -2572,33 +2703,9 @@ void aaload(Environment* environment){
 //--------------------------------------------------------------------------------------------------
 void baload(Environment* environment){
     
-    int valor_numerico;
-    
-    u4 index = popFromOperandStack(environment->thread);
-    
-    JavaArray* array_info = (JavaArray*) popFromOperandStack(environment->thread);
-    
-    if (array_info->arrayAddress == NULL) {
-        //TODO: throw NullPointerException;
-    }
-    if (index > array_info->count) {
-        //TODO: Otherwise, if index is not within the bounds of the array referenced by arrayref, the iaload instruction throws an ArrayIndexOutOfBoundsException.
-    }
-    
-    // Se o valor no componente do vetor for do tipo byte
-    if (array_info->atype == T_BYTE) {
-        
-        // O valor eh estendido com sinal
-        valor_numerico = *((char*)((array_info->arrayAddress)+index));
-        
-    }
-    // Se o valor no componente do vetor for do tipo boolean
-    else if (array_info->atype == T_BOOLEAN) {
-        
-        // O valor eh estendido sem sinal
-        valor_numerico = *((u1*)((array_info->arrayAddress)+index));
-        
-    }
+    //O valor eh estendido com sinal: como bastore guarda somente 0 ou 1 nos arrays de boolean, a
+    //extensao com sinal tambem serve para eles
+    int valor_numerico = *((signed char*) popArrayElement(environment, sizeof(u1)));
     
     pushInOperandStack(environment->thread, valor_numerico);
 }
@@ -2607,18 +2714,7 @@ void baload(Environment* environment){
 //--------------------------------------------------------------------------------------------------
 void caload(Environment* environment){
     
-    u4 index = popFromOperandStack(environment->thread);
-    
-    JavaArray* array_info = (JavaArray*) popFromOperandStack(environment->thread);
-    
-    if (array_info->arrayAddress == NULL) {
-        //TODO: throw NullPointerException;
-    }
-    if (index > array_info->count) {
-        //TODO: Otherwise, if index is not within the bounds of the array referenced by arrayref, the iaload instruction throws an ArrayIndexOutOfBoundsException.
-    }
-    
-    u4 valor_numerico_zero_extend = *((u1*)((array_info->arrayAddress)+index));
+    u4 valor_numerico_zero_extend = *((u2*) popArrayElement(environment, sizeof(u2)));
     
     pushInOperandStack(environment->thread, valor_numerico_zero_extend);
 }
@@ -2627,18 +2723,7 @@ void caload(Environment* environment){
 //--------------------------------------------------------------------------------------------------
 void saload(Environment* environment){
     
-    u4 index = popFromOperandStack(environment->thread);
-    
-    JavaArray* array_info = (JavaArray*) popFromOperandStack(environment->thread);
-    
-    if (array_info->arrayAddress == NULL) {
-        //TODO: throw NullPointerException;
-    }
-    if (index > array_info->count) {
-        //TODO: Otherwise, if index is not within the bounds of the array referenced by arrayref, the iaload instruction throws an ArrayIndexOutOfBoundsException.
-    }
-    
-    int valor_numerico_signal_extend = *((signed short*)((array_info->arrayAddress)+index*sizeof(u2)));
+    int valor_numerico_signal_extend = *((signed short*) popArrayElement(environment, sizeof(u2)));
     
     pushInOperandStack(environment->thread, valor_numerico_signal_extend);
 }
@@ -2919,18 +3004,7 @@ void iastore(Environment* environment){
     
     u4 valor_numerico = popFromOperandStack(environment->thread);
     
-    u4 index = popFromOperandStack(environment->thread);
-    
-    JavaArray* array_info = (JavaArray*) popFromOperandStack(environment->thread);
-    
-    if (array_info->arrayAddress == NULL) {
-        //TODO: throw NullPointerException;
-    }
-    if (index > array_info->count) {
-        //TODO: Otherwise, if index is not within the bounds of the array referenced by arrayref, the iaload instruction throws an ArrayIndexOutOfBoundsException.
-    }
-    
-    *((u4*)((array_info->arrayAddress)+index * sizeof(u4))) = valor_numerico;
+    *((u4*) popArrayElement(environment, sizeof(u4))) = valor_numerico;
 }
 
 
@@ -2940,23 +3014,10 @@ void lastore(Environment* environment){
     u4 valor_numerico_high = popFromOperandStack(environment->thread);
     u4 valor_numerico_low = popFromOperandStack(environment->thread);
     
-    u4 index = popFromOperandStack(environment->thread);
-    
-    JavaArray* array_info = (JavaArray*) popFromOperandStack(environment->thread);
-    
-    if (array_info->arrayAddress == NULL) {
-        //TODO: throw NullPointerException;
-    }
-    if (index > array_info->count) {
-        //TODO: Otherwise, if index is not within the bounds of the array referenced by arrayref, the iaload instruction throws an ArrayIndexOutOfBoundsException.
-    }
-    
     u8 value = valor_numerico_high;
     value = value<<32 | valor_numerico_low;
     
-    u8* array = array_info->arrayAddress;
-    
-    array[index] = value;
+    *((u8*) popArrayElement(environment, sizeof(u8))) = value;
 }
 
 
@@ -2965,18 +3026,7 @@ void fastore(Environment* environment){
     
     u4 valor_numerico = popFromOperandStack(environment->thread);
     
-    u4 index = popFromOperandStack(environment->thread);
-    
-    JavaArray* array_info = (JavaArray*) popFromOperandStack(environment->thread);
-    
-    if (array_info->arrayAddress == NULL) {
-        //TODO: throw NullPointerException;
-    }
-    if (index > array_info->count) {
-        //TODO: Otherwise, if index is not within the bounds of the array referenced by arrayref, the iaload instruction throws an ArrayIndexOutOfBoundsException.
-    }
-    
-    *((u4*)((array_info->arrayAddress) + index * sizeof(u4))) = valor_numerico;
+    *((u4*) popArrayElement(environment, sizeof(u4))) = valor_numerico;
 }
 
 
@@ -2986,22 +3036,10 @@ void dastore(Environment* environment){
     u4 valor_numerico_high = popFromOperandStack(environment->thread);
     u4 valor_numerico_low = popFromOperandStack(environment->thread);
     
-    u4 index = popFromOperandStack(environment->thread);
-    
-    JavaArray* array_info = (JavaArray*) popFromOperandStack(environment->thread);
-    
-    if (array_info->arrayAddress == NULL) {
-        //TODO: throw NullPointerException;
-    }
-    if (index > array_info->count) {
-        //TODO: Otherwise, if index is not within the bounds of the array referenced by arrayref, the iaload instruction throws an ArrayIndexOutOfBoundsException.
-    }
     u8 value = valor_numerico_high;
     value = value<<32 | valor_numerico_low;
     
-    u8* array = array_info->arrayAddress;
-    
-    array[index] = value;
+    *((u8*) popArrayElement(environment, sizeof(u8))) = value;
 }
 
 
@@ -3010,57 +3048,22 @@ void aastore(Environment* environment){
     
     u4 valor_numerico = popFromOperandStack(environment->thread);
     
-    u4 index = popFromOperandStack(environment->thread);
-    
-    JavaArray* array_info = (JavaArray*) popFromOperandStack(environment->thread);
-    
-    if (array_info->arrayAddress == NULL) {
-        //TODO: throw NullPointerException;
-    }
-    if (index > array_info->count) {
-        //TODO: Otherwise, if index is not within the bounds of the array referenced by arrayref, the iaload instruction throws an ArrayIndexOutOfBoundsException.
-    }
-    
     //TODO: Otherwise, if arrayref is not null and the actual type of value is not assignment compatible (§2.6.7) with the actual type of the components of the array, aastore throws an ArrayStoreException.
     
-    *((u4*)((array_info->arrayAddress)+ index * sizeof(u4))) = valor_numerico;
+    u4* slot = (u4*) popArrayElement(environment, sizeof(u4));
+    *slot = valor_numerico;
+    heapWriteBarrier(slot);
 }
 
 
 //--------------------------------------------------------------------------------------------------
 void bastore(Environment* environment){
     
-    u1 valor_numerico;
-    
     u4 valor_numerico_int = popFromOperandStack(environment->thread);
     
-    u4 index = popFromOperandStack(environment->thread);
-    
-    JavaArray* array_info = (JavaArray*) popFromOperandStack(environment->thread);
-    
-    if (array_info->arrayAddress == NULL) {
-        //TODO: throw NullPointerException;
-    }
-    if (index > array_info->count) {
-        //TODO: Otherwise, if index is not within the bounds of the array referenced by arrayref, the iaload instruction throws an ArrayIndexOutOfBoundsException.
-    }
-    
-    // Se componentes do vetor forem do tipo byte
-    if (array_info->atype == T_BYTE) {
-        
-        // O int value eh truncado para byte
-        valor_numerico = valor_numerico_int;
-        
-    }
-    // Se componentes do vetor forem do tipo boolean
-    else if (array_info->atype == T_BOOLEAN) {
-        
-        // O int value eh truncado para o seu bit de ordem mais baixa e estendido sem sinal
-        valor_numerico = (u1)(valor_numerico_int & 0x1);
-        
-    }
-    
-    *((u1*)((array_info->arrayAddress)+index)) = valor_numerico;
+    //O int value eh truncado para byte. Os compiladores so armazenam 0 ou 1 em arrays de boolean,
+    //de modo que o truncamento para o bit de ordem mais baixa nao precisa consultar o tipo
+    *((u1*) popArrayElement(environment, sizeof(u1))) = (u1) valor_numerico_int;
 }
 
 
@@ -3069,20 +3072,7 @@ void castore(Environment* environment){
     
     u4 valor_numerico_int = popFromOperandStack(environment->thread);
     
-    u4 index = popFromOperandStack(environment->thread);
-    
-    JavaArray* array_info = (JavaArray*) popFromOperandStack(environment->thread);
-    
-    if (array_info->arrayAddress == NULL) {
-        //TODO: throw NullPointerException;
-    }
-    if (index > array_info->count) {
-        //TODO: Otherwise, if index is not within the bounds of the array referenced by arrayref, the iaload instruction throws an ArrayIndexOutOfBoundsException.
-    }
-    
-    u1 valor_numerico_char = valor_numerico_int;
-    
-    *((u1*)((array_info->arrayAddress)+index)) = valor_numerico_char;
+    *((u2*) popArrayElement(environment, sizeof(u2))) = (u2) valor_numerico_int;
 }
 
 
@@ -3091,20 +3081,7 @@ void sastore(Environment* environment){
     
     u4 valor_numerico_int = popFromOperandStack(environment->thread);
     
-    u4 index = popFromOperandStack(environment->thread);
-    
-    JavaArray* array_info = (JavaArray*) popFromOperandStack(environment->thread);
-    
-    if (array_info->arrayAddress == NULL) {
-        //TODO: throw NullPointerException;
-    }
-    if (index > array_info->count) {
-        //TODO: Otherwise, if index is not within the bounds of the array referenced by arrayref, the iaload instruction throws an ArrayIndexOutOfBoundsException.
-    }
-    
-    u2 valor_numerico_short = valor_numerico_int;
-    
-    *((u2*)((array_info->arrayAddress)+ index * sizeof(u2))) = valor_numerico_short;
+    *((u2*) popArrayElement(environment, sizeof(u2))) = (u2) valor_numerico_int;
 }
 
 
@@ -4192,7 +4169,7 @@ void iinc(Environment* environment){
  * \param method Referencia para o PC da thread atual
  * \return Indice calculado como byte1 << 8 | byte2
  */
-u2 calculatePoolIndexFromCode(method_info* method, cp_info* constant_pool, Thread* thread){
+u2 calculatePoolIndexFromCode(method_info* method, ConstantPool* constant_pool, Thread* thread){
     // Obtemos o primeiro byte argumento para o indice no pool de cte
     thread->PC++;
     u2 index = getByteCodeFromMethod(method, constant_pool, thread->PC);
@@ -4206,11 +4183,107 @@ u2 calculatePoolIndexFromCode(method_info* method, cp_info* constant_pool, Threa
 
 
 //--------------------------------------------------------------------------------------------------
-void getstatic(Environment* environment){
+/*!
+ * Metodo que publica uma entrada do pool de resolucoes. Todos os campos da entrada devem estar
+ * preenchidos antes que a flag resolved seja escrita.
+ *
+ * \param entry Entrada a ser publicada
+ */
+void publishResolvedEntry(ResolvedPoolEntry* entry){
+    
+    //Barreira: os campos da entrada ficam visiveis antes da flag
+    __sync_synchronize();
+    entry->resolved = 1;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que retorna a resolucao da entrada Fieldref de indice index do pool de constantes de uma
+ * classe. Caso a entrada ainda nao tenha sido resolvida, ela eh resolvida e publicada.
+ *
+ * \param javaClass Classe cujo pool de constantes contem a entrada
+ * \param index Indice da entrada Fieldref no pool de constantes
+ * \param isStatic Diferente de zero se o campo referenciado eh estatico
+ * \param environment Ambiente de execucao
+ * \return Entrada resolvida
+ */
+ResolvedPoolEntry* resolveFieldref(JavaClass* javaClass, u2 index, int isStatic,
+                                   Environment* environment){
+    
+    ResolvedPoolEntry* entry = &javaClass->resolvedPool[index-1];
     
-    char* attribute_name;
-    char* class_name;
-    char* attribute_descriptor;
+    if (entry->resolved) return entry;
+    
+    //Obtemos os nomes da classe, o nome e descritor do field
+    getFieldOrMethodInfoAttributesFromConstantPool(index, javaClass->arqClass->constant_pool,
+                                                   &entry->className, &entry->name,
+                                                   &entry->descriptor);
+    entry->kind = getFieldType(entry->descriptor);
+    
+    //VERIFICACAO DE CAMPO DE BIBLIOTECA JAVA
+    if (javaLibIsFrom(entry->className)) entry->isJavaLib = 1;
+    
+    //Campos estaticos: guardamos o endereco do valor e a classe que declara o campo
+    else if (isStatic) {
+        entry->address = getClassAttributeReference(entry->className, entry->name, environment);
+        
+        for (JavaClass* class = getClass(entry->className, environment); class && entry->address;
+             class = class->superClass) {
+            Fields* fields = class->staticFields;
+            for (int i = 0; i < fields->fieldsCount; i++)
+                if (class->staticData + fields->fieldsTable[i].offset == entry->address)
+                    entry->javaClass = class;
+        }
+    }
+    
+    //Campos de instancia: guardamos o deslocamento do campo nos objetos da classe. Como o layout
+    // de uma subclasse estende o da superclasse, o deslocamento vale para objetos das subclasses
+    else {
+        entry->javaClass = getClass(entry->className, environment);
+        entry->offset = 0;
+        
+        //Buscamos a partir da classe mais derivada (campos da classe ficam apos os herdados)
+        Fields* fields = entry->javaClass->instanceFields;
+        for (int i = fields->fieldsCount - 1; i >= 0; i--) {
+            if (fields->fieldsTable[i].name == entry->name) {
+                entry->offset = fields->fieldsTable[i].offset;
+                break;
+            }
+        }
+    }
+    
+    publishResolvedEntry(entry);
+    
+    return entry;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que obtem o endereco de memoria de um atributo de objeto a partir de uma entrada Fieldref
+ * resolvida (base do objeto + deslocamento). Caso o campo nao tenha sido encontrado na resolucao,
+ * retorna nulo.
+ *
+ * \param object Endereco do objeto que contem o atributo
+ * \param field Entrada Fieldref resolvida
+ * \param environment Ambiente de execucao
+ * \return Endereco contendo o valor do atributo
+ */
+void* getResolvedObjectAttributeReference(Object* object, ResolvedPoolEntry* field,
+                                          Environment* environment){
+    
+    if (object == NULL) JVMThrow(NullPointerException, environment);
+    
+    //O deslocamento nunca eh zero para um campo encontrado (o cabecalho fica no inicio do objeto)
+    if (field->offset == 0) return NULL;
+    
+    return (u1*) object + field->offset;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+void getstatic(Environment* environment){
     
     JavaClass* actual_class = environment->thread->vmStack->top->javaClass;
     method_info* actual_method = environment->thread->vmStack->top->method_info;
@@ -4220,22 +4293,20 @@ void getstatic(Environment* environment){
                                           actual_class->arqClass->constant_pool,
                                           environment->thread);
     
-    //Obtemos os nomes da classe, o nome e descritor do field
-    getFieldOrMethodInfoAttributesFromConstantPool(index,
-                                           actual_class->arqClass->constant_pool,
-                                           &class_name, &attribute_name, &attribute_descriptor);
+    //Obtemos a resolucao do field
+    ResolvedPoolEntry* field = resolveFieldref(actual_class, index, 1, environment);
     
     //VERIFICACAO DE CAMPO DE BIBLIOTECA JAVA
-    if (javaLibIsFrom(class_name)) {
-        javaLibGetStatic(class_name, attribute_name, attribute_descriptor, environment);
+    if (field->isJavaLib) {
+        javaLibGetStatic(field->className, field->name, field->descriptor, environment);
         return;
     }
     
     //TODO: Verifica se campo eh estatico
     
     //Verificamos se eh de 32 ou 64 bits
-    if (strcmp(attribute_descriptor, "J") == 0 || strcmp(attribute_descriptor, "D") == 0) {
-        u8* value_reference = getClassAttributeReference(class_name, attribute_name, environment);
+    if (field->kind == TYPE_Long || field->kind == TYPE_Double) {
+        u8* value_reference = field->address;
         u8 value = *value_reference;
         
         u4 high_bytes = value >> 32;
@@ -4245,23 +4316,22 @@ void getstatic(Environment* environment){
     }
     else{
         //Se eh de 8bits
-        if (strcmp(attribute_descriptor, "B") == 0 || strcmp(attribute_descriptor, "C") == 0 ||
-            strcmp(attribute_descriptor, "Z") == 0){
+        if (field->kind == TYPE_Byte || field->kind == TYPE_Char || field->kind == TYPE_Boolean){
             
-            u1* value_reference = getClassAttributeReference(class_name, attribute_name, environment);
+            u1* value_reference = field->address;
             u1 value = *value_reference;
             pushInOperandStack(environment->thread, (u4) value);
         }
         
         //Se eh de 16bits
-        else if (strcmp(attribute_descriptor, "S") == 0){
-            u2* value_reference = getClassAttributeReference(class_name, attribute_name, environment);
+        else if (field->kind == TYPE_Short){
+            u2* value_reference = field->address;
             u2 value = *value_reference;
             pushInOperandStack(environment->thread, (u4) value);
         }
         //Se eh de 32bits
         else {
-            u4* value_reference = getClassAttributeReference(class_name, attribute_name, environment);
+            u4* value_reference = field->address;
             u4 value = *value_reference;
             pushInOperandStack(environment->thread, value);
         }
@@ -4272,10 +4342,6 @@ void getstatic(Environment* environment){
 //--------------------------------------------------------------------------------------------------
 void putstatic(Environment* environment){
     
-    char* attribute_name;
-    char* class_name;
-    char* attribute_descriptor;
-    
     JavaClass* actual_class = environment->thread->vmStack->top->javaClass;
     method_info* actual_method = environment->thread->vmStack->top->method_info;
     
@@ -4284,21 +4350,20 @@ void putstatic(Environment* environment){
                                           actual_class->arqClass->constant_pool,
                                           environment->thread);
     
-    //Obtemos os nomes da classe, o nome e descritor do field
-    getFieldOrMethodInfoAttributesFromConstantPool(index,
-                                           actual_class->arqClass->constant_pool,
-                                           &class_name, &attribute_name, &attribute_descriptor);
+    //Obtemos a resolucao do field
+    ResolvedPoolEntry* field = resolveFieldref(actual_class, index, 1, environment);
     
     
     //VERIFICACAO DE CAMPO DE BIBLIOTECA JAVA
-    if (javaLibIsFrom(class_name)) return;
+    if (field->isJavaLib) return;
     
     //TODO: Verifica se campo eh estatico
     
+    if (field->address == NULL) JVMThrow(NullPointerException, environment);
+    
     //Verificamos se eh de 64 bits
-    if (strcmp(attribute_descriptor, "J") == 0 || strcmp(attribute_descriptor, "D") == 0) {
-        u8* value_reference = getClassAttributeReference(class_name, attribute_name, environment);
-        if (value_reference == NULL) JVMThrow(NullPointerException, environment);
+    if (field->kind == TYPE_Long || field->kind == TYPE_Double) {
+        u8* value_reference = field->address;
         u8 value;
         
         //Obtemos e concatenamos os bytes
@@ -4317,25 +4382,24 @@ void putstatic(Environment* environment){
         
         
         //Se eh de 8bits
-        if (strcmp(attribute_descriptor, "B") == 0 || strcmp(attribute_descriptor, "C") == 0 ||
-                 strcmp(attribute_descriptor, "Z") == 0){
+        if (field->kind == TYPE_Byte || field->kind == TYPE_Char || field->kind == TYPE_Boolean){
             
-            u1* value_reference = getClassAttributeReference(class_name, attribute_name, environment);
-            if (value_reference == NULL) JVMThrow(NullPointerException, environment);
+            u1* value_reference = field->address;
             *value_reference = (u1) value;
         }
 
         //Se eh de 16bits
-        else if (strcmp(attribute_descriptor, "S") == 0){
-            u2* value_reference = getClassAttributeReference(class_name, attribute_name, environment);
-            if (value_reference == NULL) JVMThrow(NullPointerException, environment);
+        else if (field->kind == TYPE_Short){
+            u2* value_reference = field->address;
             *value_reference = (u2) value;
         }
         //Se eh de 32bits
         else {
-         u4* value_reference = getClassAttributeReference(class_name, attribute_name, environment);
-            if (value_reference == NULL) JVMThrow(NullPointerException, environment);
+            u4* value_reference = field->address;
             *value_reference = value;
+            
+            //Referencias: a coleta da geracao jovem percorre os campos estaticos da classe
+            if (field->kind >= TYPE_Reference) heapStaticWriteBarrier(field->javaClass);
         }
     }
 
@@ -4346,32 +4410,26 @@ void putstatic(Environment* environment){
 //--------------------------------------------------------------------------------------------------
 void getfield(Environment* environment){
     
-    char* attribute_name;
-    char* class_name;
-    char* attribute_descriptor;
-    
     JavaClass* actual_class = environment->thread->vmStack->top->javaClass;
     method_info* actual_method = environment->thread->vmStack->top->method_info;
     
     //Obtemos a referencia para o objeto
-    Object* objectRef = (Object*) popFromOperandStack(environment->thread);
+    Object* objectRef = (Object*) decodeReference(popFromOperandStack(environment->thread));
     
     //Calculamos o indice do fieldRef no pool
     u2 index = calculatePoolIndexFromCode(actual_method,
                                           actual_class->arqClass->constant_pool,
                                           environment->thread);
     
-    //Obtemos os nomes da classe, o nome e descritor do field
-    getFieldOrMethodInfoAttributesFromConstantPool(index,
-                                           actual_class->arqClass->constant_pool,
-                                           &class_name, &attribute_name, &attribute_descriptor);
+    //Obtemos a resolucao do field
+    ResolvedPoolEntry* field = resolveFieldref(actual_class, index, 0, environment);
     
     //VERIFICACAO DE CAMPO DE BIBLIOTECA JAVA
-    if (javaLibIsFrom(class_name)) return;
+    if (field->isJavaLib) return;
     
     //Verificamos se eh de 32 ou 64 bits
-    if (strcmp(attribute_descriptor, "J") == 0 || strcmp(attribute_descriptor, "D") == 0) {
-        u8* value_reference = getObjectAttributeReference(objectRef, attribute_name);
+    if (field->kind == TYPE_Long || field->kind == TYPE_Double) {
+        u8* value_reference = getResolvedObjectAttributeReference(objectRef, field, environment);
         u8 value = *value_reference;
         
         u4 high_bytes = value >> 32;
@@ -4381,23 +4439,22 @@ void getfield(Environment* environment){
     }
     else{
         //Se eh de 8bits
-        if (strcmp(attribute_descriptor, "B") == 0 || strcmp(attribute_descriptor, "C") == 0 ||
-            strcmp(attribute_descriptor, "Z") == 0){
+        if (field->kind == TYPE_Byte || field->kind == TYPE_Char || field->kind == TYPE_Boolean){
             
-            u1* value_reference = getObjectAttributeReference(objectRef, attribute_name);
+            u1* value_reference = getResolvedObjectAttributeReference(objectRef, field, environment);
             u1 value = *value_reference;
             pushInOperandStack(environment->thread, (u4) value);
         }
         
         //Se eh de 16bits
-        else if (strcmp(attribute_descriptor, "S") == 0){
-            u2* value_reference = getObjectAttributeReference(objectRef, attribute_name);
+        else if (field->kind == TYPE_Short){
+            u2* value_reference = getResolvedObjectAttributeReference(objectRef, field, environment);
             u2 value = *value_reference;
             pushInOperandStack(environment->thread, (u4) value);
         }
         //Se eh de 32bits
         else {
-            u4* value_reference = getObjectAttributeReference(objectRef, attribute_name);   
+            u4* value_reference = getResolvedObjectAttributeReference(objectRef, field, environment);
             u4 value = *value_reference;
             pushInOperandStack(environment->thread, value);
         }
@@ -4408,10 +4465,6 @@ void getfield(Environment* environment){
 //--------------------------------------------------------------------------------------------------
 void putfield(Environment* environment){
     
-    char* attribute_name;
-    char* class_name;
-    char* attribute_descriptor;
-    
     JavaClass* actual_class = environment->thread->vmStack->top->javaClass;
     method_info* actual_method = environment->thread->vmStack->top->method_info;
     
@@ -4420,27 +4473,25 @@ void putfield(Environment* environment){
                                           actual_class->arqClass->constant_pool,
                                           environment->thread);
     
-    //Obtemos os nomes da classe, o nome e descritor do field
-    getFieldOrMethodInfoAttributesFromConstantPool(index,
-                                           actual_class->arqClass->constant_pool,
-                                           &class_name, &attribute_name, &attribute_descriptor);
+    //Obtemos a resolucao do field
+    ResolvedPoolEntry* field = resolveFieldref(actual_class, index, 0, environment);
     
     
     //VERIFICACAO DE CAMPO DE BIBLIOTECA JAVA
-    if (javaLibIsFrom(class_name)) return;
+    if (field->isJavaLib) return;
     
     //TODO: Verifica se campo eh estatico
     
     //Verificamos se eh de 32 ou 64 bits
-    if (strcmp(attribute_descriptor, "J") == 0 || strcmp(attribute_descriptor, "D") == 0) {
+    if (field->kind == TYPE_Long || field->kind == TYPE_Double) {
         //Obtemos e concatenamos os bytes
         u8 value;
         value = popFromOperandStack(environment->thread);
         value = value << 32 | popFromOperandStack(environment->thread);
         //Obtemos a referencia para o objeto
-        Object* objectRef = (Object*) popFromOperandStack(environment->thread);
+        Object* objectRef = (Object*) decodeReference(popFromOperandStack(environment->thread));
         
-        u8* value_reference = getObjectAttributeReference(objectRef, attribute_name);
+        u8* value_reference = getResolvedObjectAttributeReference(objectRef, field, environment);
         if (value_reference == NULL) JVMThrow(NullPointerException, environment);
         //Atualizamos o campo
         *value_reference = value;
@@ -4448,67 +4499,34 @@ void putfield(Environment* environment){
     else{
         //Obtemos o valor
         u4 value = popFromOperandStack(environment->thread);
-        Object* objectRef = (Object*) popFromOperandStack(environment->thread);
+        Object* objectRef = (Object*) decodeReference(popFromOperandStack(environment->thread));
         
         //Se eh de 8bits
-        if (strcmp(attribute_descriptor, "B") == 0 || strcmp(attribute_descriptor, "C") == 0 ||
-            strcmp(attribute_descriptor, "Z") == 0){
+        if (field->kind == TYPE_Byte || field->kind == TYPE_Char || field->kind == TYPE_Boolean){
             
-            u1* value_reference = getObjectAttributeReference(objectRef, attribute_name);
+            u1* value_reference = getResolvedObjectAttributeReference(objectRef, field, environment);
             if (value_reference == NULL) JVMThrow(NullPointerException, environment);
             *value_reference = (u1) value;
         }
         
         //Se eh de 16bits
-        else if (strcmp(attribute_descriptor, "S") == 0){
-            u2* value_reference = getObjectAttributeReference(objectRef, attribute_name);
+        else if (field->kind == TYPE_Short){
+            u2* value_reference = getResolvedObjectAttributeReference(objectRef, field, environment);
             if (value_reference == NULL) JVMThrow(NullPointerException, environment);
             *value_reference = (u2) value;
         }
         //Se eh de 32bits
         else {
-            u4* value_reference = getObjectAttributeReference(objectRef, attribute_name);
+            u4* value_reference = getResolvedObjectAttributeReference(objectRef, field, environment);
             if (value_reference == NULL) JVMThrow(NullPointerException, environment);
             *value_reference = value;
+            
+            //Referencias: marcamos o cartao do campo para a coleta da geracao jovem
+            if (field->kind >= TYPE_Reference) heapWriteBarrier(value_reference);
         }
     }
 }
 
-//--------------------------------------------------------------------------------------------------
-/*! Metodo que retorna a quanitdade de parametros (de U4s) sao passados como parametro de um 
- *  desctritor de metodo.
- * 
- * \param descriptor Descritor do metodo
- *
- */
-int getParameterNumberFromMethodDescriptor(char* descriptor){
-    
-    int nParams = 0;
-    
-    if (descriptor[0] != '(') return -1;
-    
-    //Pulamos o '(' e procuramos o numero de parametros
-    for (int i = 1; i < strlen(descriptor); i++) {
-        //Fim de parametros
-        if (descriptor[i] == ')') break;
-        
-        //Se for L<Name>;
-        if (descriptor[i] == 'L') {
-            while (descriptor[i]!=';'){
-                i++; //Procuramos o ';'
-                if (i > strlen(descriptor)) return -1;
-            }
-            nParams++;
-        }
-        //Se for long ou double
-        else if (descriptor[i] == 'J' || descriptor[i] == 'D') nParams += 2;
-        //Se forem de 32bits
-        else nParams ++;
-    }
-    return nParams;
-}
-
-
 //--------------------------------------------------------------------------------------------------
 /*!
  * Metodo que verifica se uma classe eh subclasse de outra
@@ -4520,7 +4538,7 @@ int getParameterNumberFromMethodDescriptor(char* descriptor){
  */
 int isClassSubClassFromClass(char* className, char* supClassName, Environment* environment){
     
-    if(strcmp(className, supClassName) == 0) return 1;
+    if(className == supClassName) return 1;
     
     JavaClass* class = getClass(className, environment);
     char* superName = getClassNameFromConstantPool(class->arqClass->constant_pool, class->arqClass->super_class);
@@ -4534,22 +4552,21 @@ int isClassSubClassFromClass(char* className, char* supClassName, Environment* e
 //--------------------------------------------------------------------------------------------------
 /*!
  *  Metodo que verifica se existe o metodo existe na classe ou superclasse de uma classe passada e
- * retorna uma referencia para o method_info e o nome da classe do metodo eh copiada para o 
- * parametro method_class_name
+ * retorna uma referencia para o method_info e a classe do metodo eh copiada para o parametro
+ * method_class
  *
  * \param objectClass Referencia para a classe do objeto
  * \param method_name nome do metodo atual
  * \param method_descriptor descritor do metodo atual
  * \param environment Ambiente de execucao
- * \param method_class_name Nome da classe do metodo encontrado
+ * \param method_class Classe do metodo encontrado
  * \return method_info do metodo, se nao lanca excessao
  */
-method_info* isMethodInClassOrSuperClass(JavaClass* objectClass, char* method_name, char* method_descriptor, Environment* environment, char** method_class_name){
+method_info* isMethodInClassOrSuperClass(JavaClass* objectClass, char* method_name, char* method_descriptor, Environment* environment, JavaClass** method_class){
     
     method_info* method = getMethodInfoFromClass(objectClass, method_name, method_descriptor);
     if (method){
-        *method_class_name = getClassNameFromConstantPool(objectClass->arqClass->constant_pool,
-                                     objectClass->arqClass->this_class);
+        *method_class = objectClass;
         return method;
     }
     
@@ -4561,16 +4578,91 @@ method_info* isMethodInClassOrSuperClass(JavaClass* objectClass, char* method_na
         return NULL;
     }
     //Verificamos recursivamente
-    else return isMethodInClassOrSuperClass(getClass(superClassName, environment), method_name, method_descriptor, environment, method_class_name);
+    else return isMethodInClassOrSuperClass(getClass(superClassName, environment), method_name, method_descriptor, environment, method_class);
 }
 
 
 //--------------------------------------------------------------------------------------------------
-void invokevirtual(Environment* environment){
+/*!
+ * Metodo que retorna a resolucao da entrada Methodref (ou InterfaceMethodref) de indice index do
+ * pool de constantes de uma classe. Caso a entrada ainda nao tenha sido resolvida, ela eh resolvida
+ * e publicada. Para invocacoes que dependem da classe do objeto (invokevirtual e invokeinterface),
+ * somente os simbolos e o numero de argumentos sao resolvidos.
+ *
+ * \param javaClass Classe cujo pool de constantes contem a entrada
+ * \param index Indice da entrada Methodref no pool de constantes
+ * \param opcode Instrucao de invocacao que referencia a entrada
+ * \param environment Ambiente de execucao
+ * \return Entrada resolvida
+ */
+ResolvedPoolEntry* resolveMethodref(JavaClass* javaClass, u2 index, u1 opcode,
+                                    Environment* environment){
+    
+    ResolvedPoolEntry* entry = &javaClass->resolvedPool[index-1];
+    
+    if (entry->resolved) return entry;
+    
+    //Obtemos os nomes da classe, o nome e descritor do metodo
+    getFieldOrMethodInfoAttributesFromConstantPool(index, javaClass->arqClass->constant_pool,
+                                                   &entry->className, &entry->name,
+                                                   &entry->descriptor);
+    
+    //VERIFICACAO DE METODO DE BIBLIOTECA JAVA
+    if (javaLibIsFrom(entry->className)) {
+        entry->isJavaLib = 1;
+        publishResolvedEntry(entry);
+        return entry;
+    }
     
-    char* method_name;
-    char* class_name;
-    char* method_descriptor;
+    //Descritor pre-processado (quantidade de u4 a serem desempilhados como argumentos)
+    entry->signature = getSignature(entry->descriptor);
+    
+    //Resolvemos a classe do metodo, obtendo uma referencia para javaClass
+    if (opcode == OP_invokestatic) {
+        entry->javaClass = getClass(entry->className, environment);
+        entry->method = getMethodInfoFromClass(entry->javaClass, entry->name, entry->descriptor);
+    }
+    else if (opcode == OP_invokespecial) {
+        entry->method = isMethodInClassOrSuperClass(getClass(entry->className, environment),
+                                                    entry->name, entry->descriptor, environment,
+                                                    &entry->javaClass);
+    }
+    
+    publishResolvedEntry(entry);
+    
+    return entry;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que desempilha os argumentos de uma invocacao, guardando-os na ordem das variaveis locais
+ * do metodo invocado. O ultimo argumento esta no topo da pilha; o u4 do topo de um long ou double
+ * fica na primeira das suas duas variaveis, como em lstore e dstore.
+ *
+ * \param thread Thread cuja pilha de operandos contem os argumentos
+ * \param signature Descritor pre-processado do metodo invocado
+ * \param params Vetor que recebe os argumentos (argSlots posicoes)
+ */
+static void popArguments(Thread* thread, Signature* signature, u4* params){
+    
+    int slot = signature->argSlots;
+    
+    for (int i = signature->argCount - 1; i >= 0; i--) {
+        u1 type = signature->argTypes[i];
+        
+        if (type == TYPE_Long || type == TYPE_Double) {
+            slot -= 2;
+            params[slot] = popFromOperandStack(thread);
+            params[slot+1] = popFromOperandStack(thread);
+        }
+        else params[--slot] = popFromOperandStack(thread);
+    }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+void invokevirtual(Environment* environment){
     
     JavaClass* actual_class = environment->thread->vmStack->top->javaClass;
     method_info* actual_method = environment->thread->vmStack->top->method_info;
@@ -4580,41 +4672,40 @@ void invokevirtual(Environment* environment){
                                           actual_class->arqClass->constant_pool,
                                           environment->thread);
     
-    //2. Resolvemos o nome do metodo, obtendo a referencia do method_info
-    getFieldOrMethodInfoAttributesFromConstantPool(index,
-                                                   actual_class->arqClass->constant_pool,
-                                                   &class_name, &method_name, &method_descriptor);
+    //2. Resolvemos o nome do metodo
+    ResolvedPoolEntry* methodRef = resolveMethodref(actual_class, index, OP_invokevirtual, environment);
     
     //VERIFICACAO DE METODO DE BIBLIOTECA JAVA
-    if (javaLibIsFrom(class_name)){
-        javaLibExecuteMethod(class_name, method_name, method_descriptor, environment);
+    if (methodRef->isJavaLib){
+        javaLibExecuteMethod(methodRef->className, methodRef->name, methodRef->descriptor, environment);
         return;
     }
     
     //4. Baseado no descritor do metodo, desempilhamos os parametros
     //Obtemos a quantidade de parametros a serem desempilhados
-    int nParams = getParameterNumberFromMethodDescriptor(method_descriptor);
+    int nParams = methodRef->signature->argSlots;
     //Criamos um vetor de u4 para os parametros
-    u4* params = (u4*) malloc(nParams*sizeof(u4));
+    u4 params[nParams+1];
     //Desempilhamos os parametros e salvamos no vetor
-    for (int i = 0; i < nParams; i++) params[i] = popFromOperandStack(environment->thread);
+    popArguments(environment->thread, methodRef->signature, params);
     
     //5. Desempilhamos uma referencia para o objeto (Objectref)
-    Object* objectRef = (Object*) popFromOperandStack(environment->thread);
+    Object* objectRef = (Object*) decodeReference(popFromOperandStack(environment->thread));
     if (objectRef == NULL) JVMThrow(NullPointerException, environment);
     
 
     //6. Buscamos o metodo recursivamente na classe e superclasses do objeto
-    method_info* method = isMethodInClassOrSuperClass(objectRef->handler->javaClass, method_name, method_descriptor, environment, &class_name);
+    JavaClass* method_class;
+    method_info* method = isMethodInClassOrSuperClass(objectRef->javaClass, methodRef->name, methodRef->descriptor, environment, &method_class);
     
     if ((method->access_flags & ACC_ABSTRACT)) JVMThrow(AbstractMethodError, environment);
     
     //7. Criamos um novo frame e empilhamos
-    Frame* newFrame = pushFrame(environment, class_name, method_name, method_descriptor);
+    Frame* newFrame = pushMethodFrame(environment, method_class, method);
     environment->thread->PC--; //Pc é colocado para -1 devido ao incremento do interpretador
     
     //7.1. Passamos os argumentos para o vetor de variaveis locais
-    newFrame->localVariablesVector[0] = (u4) objectRef;
+    newFrame->localVariablesVector[0] = encodeReference(objectRef);
     for (int i = 0; i < nParams; i++) newFrame->localVariablesVector[i+1] = params[i];
 }
 
@@ -4647,7 +4738,7 @@ void verifyInvokeSpecial(Object* objectRef, JavaClass* method_class, char* metho
     
     int isSub = isClassSubClassFromClass(actual_class_name, method_class_name, environment);
     
-    int isInit = strcmp(method_name, "<init>") == 0;
+    int isInit = method_name == internString("<init>");
     
     if (!(isSuper && isSub && isInit)) return;
 }
@@ -4656,10 +4747,6 @@ void verifyInvokeSpecial(Object* objectRef, JavaClass* method_class, char* metho
 //--------------------------------------------------------------------------------------------------
 void invokespecial(Environment* environment){
     
-    char* method_name;
-    char* class_name;
-    char* method_descriptor;
-    
     JavaClass* actual_class = environment->thread->vmStack->top->javaClass;
     method_info* actual_method = environment->thread->vmStack->top->method_info;
     
@@ -4668,56 +4755,49 @@ void invokespecial(Environment* environment){
                                           actual_class->arqClass->constant_pool,
                                           environment->thread);
     
-    //2. Resolvemos o nome do metodo, obtendo a referencia do method_info
-    getFieldOrMethodInfoAttributesFromConstantPool(index,
-                                                   actual_class->arqClass->constant_pool,
-                                                   &class_name, &method_name, &method_descriptor);
+    //1. e 2. Resolvemos a classe e o metodo, obtendo a referencia do method_info
+    ResolvedPoolEntry* methodRef = resolveMethodref(actual_class, index, OP_invokespecial, environment);
     
     //VERIFICACAO DE METODO DE BIBLIOTECA JAVA
-    if (javaLibIsFrom(class_name)){
-        javaLibExecuteMethod(class_name, method_name, method_descriptor, environment);
+    if (methodRef->isJavaLib){
+        javaLibExecuteMethod(methodRef->className, methodRef->name, methodRef->descriptor, environment);
         return;
     }
     
-    //1. Resolvemos o a classe do metodo, obtendo uma referencia para javaClass
-    JavaClass* method_class = getClass(class_name, environment);
-    
     
     //4. Baseado no descritor do metodo, desempilhamos os parametros
     
     //Obtemos a quantidade de parametros a serem desempilhados
-    int nParams = getParameterNumberFromMethodDescriptor(method_descriptor);
+    int nParams = methodRef->signature->argSlots;
     
     //Criamos um vetor de u4 para os parametros
-    u4* params = (u4*) malloc(nParams*sizeof(u4));
+    u4 params[nParams+1];
     
     //Desempilhamos os parametros e salvamos no vetor
-    for (int i = 0; i < nParams; i++) params[i] = popFromOperandStack(environment->thread);
+    popArguments(environment->thread, methodRef->signature, params);
     
     
     //5. Desempilhamos uma referencia para o objeto (Objectref)
-    Object* objectRef = (Object*) popFromOperandStack(environment->thread);
+    Object* objectRef = (Object*) decodeReference(popFromOperandStack(environment->thread));
     if (objectRef == NULL) JVMThrow(NullPointerException, environment);
     
     
     //6. Verificacoes de invokespecial
-    verifyInvokeSpecial(objectRef, method_class, method_name, method_descriptor, environment);
+    verifyInvokeSpecial(objectRef, methodRef->javaClass, methodRef->name, methodRef->descriptor, environment);
     
     
-    //Buscamos o metodo recursivamente na classe e superclasses do objeto
-    method_info* method = isMethodInClassOrSuperClass(objectRef->handler->javaClass, method_name, method_descriptor, environment, &class_name);
-    
+    method_info* method = methodRef->method;
     
     if ((method->access_flags & ACC_STATIC)) JVMThrow(IncompatibleClassChangeError, environment);
     if ((method->access_flags & ACC_ABSTRACT)) JVMThrow(AbstractMethodError, environment);
     
     
     //7. Criamos um novo frame e empilhamos
-    Frame* newFrame = pushFrame(environment, class_name, method_name, method_descriptor);
+    Frame* newFrame = pushMethodFrame(environment, methodRef->javaClass, method);
     environment->thread->PC--; //Pc é colocado para -1 devido ao incremento do interpretador
     
     //7.1. Passamos os argumentos para o vetor de variaveis locais
-    newFrame->localVariablesVector[0] = (u4) objectRef;
+    newFrame->localVariablesVector[0] = encodeReference(objectRef);
     for (int i = 0; i < nParams; i++) newFrame->localVariablesVector[i+1] = params[i];
 }
 
@@ -4725,10 +4805,6 @@ void invokespecial(Environment* environment){
 //--------------------------------------------------------------------------------------------------
 void invokestatic(Environment* environment){
     
-    char* method_name;
-    char* class_name;
-    char* method_descriptor;
-    
     JavaClass* actual_class = environment->thread->vmStack->top->javaClass;
     method_info* actual_method = environment->thread->vmStack->top->method_info;
     
@@ -4737,37 +4813,32 @@ void invokestatic(Environment* environment){
                                           actual_class->arqClass->constant_pool,
                                           environment->thread);
     
-    //2. Resolvemos o nome do metodo, obtendo a referencia do method_info
-    getFieldOrMethodInfoAttributesFromConstantPool(index,
-                                                   actual_class->arqClass->constant_pool,
-                                                   &class_name, &method_name, &method_descriptor);
+    //1. e 2. Resolvemos a classe e o metodo, obtendo a referencia do method_info
+    ResolvedPoolEntry* methodRef = resolveMethodref(actual_class, index, OP_invokestatic, environment);
     
     //VERIFICACAO DE METODO DE BIBLIOTECA JAVA
-    if (javaLibIsFrom(class_name)){
-        javaLibExecuteMethod(class_name, method_name, method_descriptor, environment);
+    if (methodRef->isJavaLib){
+        javaLibExecuteMethod(methodRef->className, methodRef->name, methodRef->descriptor, environment);
         return;
     }
     
-    //1. Resolvemos o a classe do metodo, obtendo uma referencia para javaClass
-    JavaClass* method_class = getClass(class_name, environment);
-    
     
     //4. Baseado no descritor do metodo, desempilhamos os parametros
     //Obtemos a quantidade de parametros a serem desempilhados
-    int nParams = getParameterNumberFromMethodDescriptor(method_descriptor);
+    int nParams = methodRef->signature->argSlots;
     //Criamos um vetor de u4 para os parametros
-    u4* params = (u4*) malloc(nParams*sizeof(u4));
+    u4 params[nParams+1];
     //Desempilhamos os parametros e salvamos no vetor
-    for (int i = 0; i < nParams; i++) params[i] = popFromOperandStack(environment->thread);
+    popArguments(environment->thread, methodRef->signature, params);
     
     
     //Verificamos se o metodo eh estatico
-    method_info* method = getMethodInfoFromClass(method_class, method_name, method_descriptor);
+    method_info* method = methodRef->method;
     if ((method->access_flags & ACC_STATIC) == 0) JVMThrow(IncompatibleClassChangeError, environment);
     
     
     //7. Criamos um novo frame e empilhamos
-    Frame* newFrame = pushFrame(environment, class_name, method_name, method_descriptor);
+    Frame* newFrame = pushMethodFrame(environment, methodRef->javaClass, method);
     environment->thread->PC--; //Pc é colocado para -1 devido ao incremento do interpretador
     
     //7.1. Passamos os argumentos para o vetor de variaveis locais
@@ -4778,10 +4849,6 @@ void invokestatic(Environment* environment){
 //--------------------------------------------------------------------------------------------------
 void invokeinterface(Environment* environment){
 
-    char* method_name;
-    char* class_name;
-    char* method_descriptor;
-    
     JavaClass* actual_class = environment->thread->vmStack->top->javaClass;
     method_info* actual_method = environment->thread->vmStack->top->method_info;
     
@@ -4790,29 +4857,27 @@ void invokeinterface(Environment* environment){
                                           actual_class->arqClass->constant_pool,
                                           environment->thread);
     
-    //2. Resolvemos o nome do metodo, obtendo a referencia do method_info
-    getFieldOrMethodInfoAttributesFromConstantPool(index,
-                                                   actual_class->arqClass->constant_pool,
-                                                   &class_name, &method_name, &method_descriptor);
+    //2. Resolvemos o nome do metodo
+    ResolvedPoolEntry* methodRef = resolveMethodref(actual_class, index, OP_invokeinterface, environment);
     
     //VERIFICACAO DE METODO DE BIBLIOTECA JAVA
-    if (javaLibIsFrom(class_name)){
-        javaLibExecuteMethod(class_name, method_name, method_descriptor, environment);
+    if (methodRef->isJavaLib){
+        javaLibExecuteMethod(methodRef->className, methodRef->name, methodRef->descriptor, environment);
         return;
     }
     
     
     //4. Baseado no descritor do metodo, desempilhamos os parametros
     //Obtemos a quantidade de parametros a serem desempilhados
-    int nParams = getParameterNumberFromMethodDescriptor(method_descriptor);
+    int nParams = methodRef->signature->argSlots;
     //Criamos um vetor de u4 para os parametros
-    u4* params = (u4*) malloc(nParams*sizeof(u4));
+    u4 params[nParams+1];
     //Desempilhamos os parametros e salvamos no vetor
-    for (int i = 0; i < nParams; i++) params[i] = popFromOperandStack(environment->thread);
+    popArguments(environment->thread, methodRef->signature, params);
     
     
     //5. Desempilhamos uma referencia para o objeto (Objectref)
-    Object* objectRef = (Object*) popFromOperandStack(environment->thread);
+    Object* objectRef = (Object*) decodeReference(popFromOperandStack(environment->thread));
     
     environment->thread->PC++; //COUNT
     environment->thread->PC++; //Byte 0
@@ -4826,27 +4891,113 @@ void invokeinterface(Environment* environment){
     // 6.2. Se nao, se C tiver uma superclasse, o procedimento de busca eh realizado recursivamente
     //   na superclasse. O metodo a ser invocado eh o resultado do processo de busca recursiva.
     //   6.3. Se nao, AbstractMethodError.
-    method_info* method = isMethodInClassOrSuperClass(objectRef->handler->javaClass, method_name, method_descriptor, environment, &class_name);
+    JavaClass* method_class;
+    method_info* method = isMethodInClassOrSuperClass(objectRef->javaClass, methodRef->name, methodRef->descriptor, environment, &method_class);
     
     if ((method->access_flags & ACC_ABSTRACT)) JVMThrow(AbstractMethodError, environment);
     if (!(method->access_flags & ACC_PUBLIC)) JVMThrow(IllegalAccessError, environment);
     
     
     //7. Criamos um novo frame e empilhamos
-    //VERIFICAR METODO EM SUPERCLASSES DE FORMA RECURSIVA
-    class_name = getClassNameFromConstantPool(objectRef->handler->javaClass->arqClass->constant_pool, objectRef->handler->javaClass->arqClass->this_class);
-    Frame* newFrame = pushFrame(environment, class_name, method_name, method_descriptor);
+    Frame* newFrame = pushMethodFrame(environment, method_class, method);
     environment->thread->PC--; //Pc é colocado para -1 devido ao incremento do interpretador
     
     //7.1. Passamos os argumentos para o vetor de variaveis locais
-    newFrame->localVariablesVector[0] = (u4) objectRef;
+    newFrame->localVariablesVector[0] = encodeReference(objectRef);
     for (int i = 0; i < nParams; i++) newFrame->localVariablesVector[i+1] = params[i];
 }
 
 
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que retorna a resolucao da entrada Class de indice index do pool de constantes de uma
+ * classe. Caso a entrada ainda nao tenha sido resolvida, a classe eh carregada (se necessario) e a
+ * entrada eh publicada.
+ *
+ * \param javaClass Classe cujo pool de constantes contem a entrada
+ * \param index Indice da entrada Class no pool de constantes
+ * \param environment Ambiente de execucao
+ * \return Entrada resolvida
+ */
+ResolvedPoolEntry* resolveClass(JavaClass* javaClass, u2 index, Environment* environment){
+    
+    ResolvedPoolEntry* entry = &javaClass->resolvedPool[index-1];
+    
+    if (entry->resolved) return entry;
+    
+    entry->className = getClassNameFromConstantPool(javaClass->arqClass->constant_pool, index);
+    
+    if (javaLibIsFrom(entry->className)) entry->isJavaLib = 1;
+    else entry->javaClass = getClass(entry->className, environment);
+    
+    publishResolvedEntry(entry);
+    
+    return entry;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que verifica se os metodos invocados sobre um objeto que nao escapa do metodo que o usa
+ * tambem nao o deixam escapar. As invocacoes sao resolvidas para a classe exata do objeto, e o
+ * objeto this de cada metodo invocado deve ser descrito pela sua analise de escape. Nenhuma classe
+ * eh carregada: invocacoes de classes ainda nao carregadas, de bibliotecas java ou mais profundas
+ * que VERIFIER_MaxCallDepth (inclusive as recursivas) deixam o objeto escapar.
+ *
+ * \param objectClass Classe do objeto
+ * \param javaClass Classe do metodo que usa o objeto (pool de constantes das invocacoes)
+ * \param site Uso do objeto pelo metodo (local de alocacao ou objeto this)
+ * \param environment Ambiente de execucao
+ * \param depth Profundidade da invocacao
+ * \return 1 se o objeto nao escapa, 0 caso contrario
+ */
+static u1 staysInFrame(JavaClass* objectClass, JavaClass* javaClass, AllocationSite* site,
+                       Environment* environment, u1 depth){
+    
+    if (depth > VERIFIER_MaxCallDepth) return 0;
+    
+    for (u2 i = 0; i < site->callCount; i++) {
+        char *className, *name, *descriptor;
+        getFieldOrMethodInfoAttributesFromConstantPool(site->calls[i].index,
+                                                       javaClass->arqClass->constant_pool,
+                                                       &className, &name, &descriptor);
+        
+        //invokespecial nao depende da classe do objeto
+        JavaClass* methodClass = objectClass;
+        if (site->calls[i].opcode == OP_invokespecial)
+            methodClass = javaLibIsFrom(className) ? NULL :
+                          findJavaClassOnMethodArea(className, environment->methodArea);
+        method_info* method = NULL;
+        
+        //Busca na classe e nas superclasses. A busca para nas classes de bibliotecas java, que
+        // nao tem estruturas de classe na area de metodos
+        while (methodClass != NULL &&
+               (method = getMethodInfoFromClass(methodClass, name, descriptor)) == NULL) {
+            ArqClass* arqClass = methodClass->arqClass;
+            char* superName = getClassNameFromConstantPool(arqClass->constant_pool,
+                                                           arqClass->super_class);
+            methodClass = javaLibIsFrom(superName) ? NULL :
+                          findJavaClassOnMethodArea(superName, environment->methodArea);
+        }
+        
+        if (method == NULL) return 0;
+        
+        MethodEscapeInfo* escapeInfo = getEscapeInfo(methodClass, method);
+        
+        if ((method->access_flags & (ACC_STATIC | ACC_ABSTRACT)) || escapeInfo == NULL ||
+            escapeInfo->receiver == NULL ||
+            !staysInFrame(objectClass, methodClass, escapeInfo->receiver, environment, depth + 1))
+            return 0;
+    }
+    
+    return 1;
+}
+
+
 //--------------------------------------------------------------------------------------------------
 void New(Environment* environment){
     
+    Frame* frame = environment->thread->vmStack->top;
     JavaClass* actual_class = environment->thread->vmStack->top->javaClass;
     method_info* actual_method = environment->thread->vmStack->top->method_info;
     
@@ -4855,29 +5006,43 @@ void New(Environment* environment){
                                           actual_class->arqClass->constant_pool,
                                           environment->thread);
     
-    //Obtemos o nome da classe
-    char* className = getClassNameFromConstantPool(actual_class->arqClass->constant_pool, index);
+    //Obtemos a resolucao da classe
+    ResolvedPoolEntry* classRef = resolveClass(actual_class, index, environment);
     
     //VERIFICACAO DE METODO DE BIBLIOTECA JAVA
-    if (javaLibIsFrom(className)){
-        javaLibNewObject(className, environment);
+    if (classRef->isJavaLib){
+        javaLibNewObject(classRef->className, environment);
         return;
     }
     
+    Object* instance = NULL;
+    
+    //Objetos que nao escapam do metodo sao alocados no frame (o pc esta no ultimo byte do new). Se
+    // a resolucao empilhou o inicializador da classe, o objeto vai para o heap
+    AllocationSite* site = NULL;
+    
+    if (environment->thread->localBase != NULL && environment->thread->vmStack->top == frame)
+        site = getAllocationSite(actual_class, actual_method, environment->thread->PC - 2);
+    
+    if (site != NULL && site->state == VERIFIER_SiteUnchecked) {
+        site->state = staysInFrame(classRef->javaClass, actual_class, site, environment, 1) ?
+                      VERIFIER_SiteLocal : VERIFIER_SiteHeap;
+    }
+    
+    if (site != NULL && site->state == VERIFIER_SiteLocal)
+        instance = newLocalObject(frame, classRef->javaClass, site, environment);
+    
     //Criamos uma nova instancia de classe
-    Object* instance = newObjectFromClass(className, environment);
+    if (instance == NULL) instance = newObjectFromJavaClass(classRef->javaClass, environment);
 
     //Empilhamos na pilha de operandos
-    pushInOperandStack(environment->thread, (u4) instance);
+    pushInOperandStack(environment->thread, encodeReference(instance));
 }
 
 
 //--------------------------------------------------------------------------------------------------
 void newarray(Environment* environment){
     
-    void* array;
-    int i;
-    
     environment->thread->PC++;
     u1 atype_argument = getByteCodeFromMethod(environment->thread->vmStack->top->method_info,
                                                    environment->thread->vmStack->top->javaClass->arqClass->constant_pool
@@ -4887,59 +5052,10 @@ void newarray(Environment* environment){
     
     if (count < 0) JVMThrow(NegativeArraySizeException, environment);
     
-    if (atype_argument == T_BYTE || atype_argument == T_BOOLEAN) {
-        array = (u1*) malloc(sizeof(u1) * count);
-        for(i = 0; i < count; i++){
-            u1* b = (u1*) array+i;
-            *b = 0;
-        }
-    }
-    else if (atype_argument == T_CHAR) {
-        array = (u1*) malloc(sizeof(u1) * count);
-        for(i = 0; i < count; i++){
-            u1* b = (u1*) array+i;
-            *b = '\0';
-        }
-    }
-    else if (atype_argument == T_SHORT) {
-        array = (u2*) malloc(sizeof(u2) * count);
-        for(i = 0; i < count; i++){
-            u2* s = (u2*) array+i;
-            *s = 0;
-        }
-    }
-    else if (atype_argument == T_INT) {
-        array = (u4*) malloc(sizeof(u4) * count);
-        for(i = 0; i < count; i++){
-            u4* i_f = (u4*) array+i;
-            *i_f = 0;
-        }
-    }
-    else if (atype_argument == T_FLOAT) {
-        array = (u4*) malloc(sizeof(u4) * count);
-        for(i = 0; i < count; i++){
-            u4* i_f = (u4*) array+i;
-            *i_f = 0;
-        }
-    }
-    else if (atype_argument == T_LONG) {
-        array = (u8*) malloc(sizeof(u8) * count);
-        for(i = 0; i < count; i++){
-            u8* l_d  = (u8*) array+i;
-            *l_d = 0;
-        }
-    }
-    else if (atype_argument == T_DOUBLE) {
-        array = (u8*) malloc(sizeof(u8) * count);
-        for(i = 0; i < count; i++){
-            double* l_d  = (double*) array+i;
-            *l_d = 0.0;
-        }
-    }
-    
-    JavaArray* arrayref = newJavaArray(atype_argument, count, array);
+    //Os elementos ja sao inicializados com o valor default (zero) pelo heap
+    JavaArray* arrayref = newJavaArray(atype_argument, count, environment->thread);
     
-    pushInOperandStack(environment->thread, (u4) arrayref);
+    pushInOperandStack(environment->thread, encodeReference(arrayref));
 
 }
 
@@ -4947,104 +5063,37 @@ void newarray(Environment* environment){
 //--------------------------------------------------------------------------------------------------
 void anewarray(Environment* environment){
     
-    int i;
-    
-    u2 index_result = calculatePoolIndexFromCode(environment->thread->vmStack->top->method_info, environment->thread->vmStack->top->javaClass->arqClass->constant_pool, environment->thread);
-    
-    u4 atype = (u4) getClassNameFromConstantPool(environment->thread->vmStack->top->javaClass->arqClass->constant_pool, index_result);
+    //A classe dos elementos nao eh guardada no array: somente avancamos o PC
+    calculatePoolIndexFromCode(environment->thread->vmStack->top->method_info, environment->thread->vmStack->top->javaClass->arqClass->constant_pool, environment->thread);
     
     int count = (u4)popFromOperandStack(environment->thread);
     
     if (count < 0) JVMThrow(NegativeArraySizeException, environment);
     
-    u4* array = (u4*) malloc(sizeof(u4) * count);
-    
-    for(i = 0; i < count; i++){
-        array[i] = (u4) NULL;
-    }
-    
-    JavaArray* arrayref = newJavaArray(atype, count, array);
+    //Os elementos ja sao inicializados com nulo pelo heap
+    JavaArray* arrayref = newJavaArray(T_REFERENCE, count, environment->thread);
     
-    pushInOperandStack(environment->thread, (u4) arrayref);
+    pushInOperandStack(environment->thread, encodeReference(arrayref));
 }
 
 
 //--------------------------------------------------------------------------------------------------
 void arraylength(Environment* environment){
     
-    JavaArray* arrayref = (JavaArray*)popFromOperandStack(environment->thread);
+    JavaArray* arrayref = (JavaArray*) decodeReference(popFromOperandStack(environment->thread));
     
-    if (arrayref->arrayAddress == NULL) JVMThrow(NullPointerException, environment);
+    if (arrayref == NULL) JVMThrow(NullPointerException, environment);
     
     pushInOperandStack(environment->thread, arrayref->count);
 }
 
 
-//--------------------------------------------------------------------------------------------------
-//--------------------------------------------------------------------------------------------------
-/*!
- * Metodo que inicializa um array multidimensional.
- *
- * \param total_dimensions Total de dimensoes do array a ser inicializado.
- * \param current_dimension A dimensao atual do array a ser inicializado.
- * \param count O vetor count que possui o quantidade de componentes em cada dimensao do array a ser inicializado.
- * \param posicao A posicao do array em que sera inicializada com o valor inicial padrao do tipo dos componentes.
- * \param type_array O tipo dos componentes do array a ser inicializado.
- * \param array O array a ser inicializado.
- */
-void initializeNDArray(int total_dimensions, int current_dimension, int* count ,int posicao,
-                     char type_array, void* array){
-    int i;
-    current_dimension++;
-    // Enquanto ainda nao chegar na ultima dimensao, continua na recusividade
-    for (i = 0; i < count[current_dimension]; i++) {
-        posicao += i*count[current_dimension+1];
-        if (current_dimension != total_dimensions-1) {
-            initializeNDArray(total_dimensions, current_dimension, count, posicao, type_array, array);
-        }
-        else {
-            if (type_array == 'B' || type_array == 'Z') {
-                u1* b = (u1*) array+posicao+i;
-                *b = 0;
-            }
-            else if (type_array == 'C') {
-                u1* b = (u1*) array+posicao+i;
-                *b = '\0';
-            }
-            else if (type_array == 'S') {
-                u2* s = (u2*) array+posicao+i;
-                *s = 0;
-            }
-            else if (type_array == 'I') {
-                u4* i_f = (u4*) array+posicao+i;
-                *i_f = 0;
-            }
-            else if (type_array == 'F') {
-                u4* i_f = (u4*) array+posicao+i;
-                *i_f = 0.0f;
-            }
-            else if (type_array == 'J') {
-                u8* l_d  = (u8*) array+posicao+i;
-                *l_d = 0L;
-            }
-            else if (type_array == 'D') {
-                u8* l_d  = (u8*) array+posicao+i;
-                *l_d = 0.0;
-            }
-            return;
-        }
-    }
-}
-//--------------------------------------------------------------------------------------------------
-//--------------------------------------------------------------------------------------------------
-
-
 //--------------------------------------------------------------------------------------------------
 void multianewarray(Environment* environment){
     
     u2 index_result = calculatePoolIndexFromCode(environment->thread->vmStack->top->method_info, environment->thread->vmStack->top->javaClass->arqClass->constant_pool, environment->thread);
     
-    u4 atype = (u4) getClassNameFromConstantPool(environment->thread->vmStack->top->javaClass->arqClass->constant_pool, index_result);
+    char* atype = getClassNameFromConstantPool(environment->thread->vmStack->top->javaClass->arqClass->constant_pool, index_result);
     
     
     
@@ -5054,57 +5103,61 @@ void multianewarray(Environment* environment){
     
     //TODO: Otherwise, if the current class does not have permission to access the element type of the resolved array class, multianewarray throws an IllegalAccessError.
     
-    //TODO: Otherwise, if any of the dimensions values on the operand stack are less than zero, the multianewarray instruction throws a NegativeArraySizeException.
-    
     environment->thread->PC++;
     u1 dimensions_argument = getByteCodeFromMethod(environment->thread->vmStack->top->method_info,
                                                    environment->thread->vmStack->top->javaClass->arqClass->constant_pool
                                                    ,environment->thread->PC);
     
     //Vetor que armazena o tamanho de cada dimensao do array
-    int *count = (int*) malloc(sizeof(int) * dimensions_argument);
+    u4 count[256];
     
     //Desloca-se de todos os caracteres '[' que representam uma dimensao de array, para obter o caracter seguinte, que representara o tipo dos componentes do array.
-    char type_components = atype+dimensions_argument;
+    char type_components = atype[dimensions_argument];
     
     //O primeiro count a ser desempilhado eh quantidade de componentes na ultima dimensao do array
     for (int i = ((u1)dimensions_argument)-1; i >= 0; i--) {
         
         count[i] = popFromOperandStack(environment->thread);
+        
+        if ((int) count[i] < 0) JVMThrow(NegativeArraySizeException, environment);
     }
     
-    //Variavel auxiliar para se obter o tamanho total do array
-    int total = 1;
+    //Todos os subarrays sao alocados em um unico slab. Se o tipo tem mais dimensoes que as
+    //alocadas, os componentes da ultima dimensao alocada sao arrays nulos ('[' eh referencia)
+    JavaArray* arrayref = newJavaMultiArray(getArrayTypeFromDescriptor(type_components),
+                                            dimensions_argument, count, environment->thread);
     
-    //Saira do loop quando for a ultima dimensao a ser alocada, pois n eh o numero de dimensoes menos uma.
-    for (int i = 1; i < ((u1)dimensions_argument); i++) {
-        //Se count igual a zero, nenhuma dimensao subsequente sera alocada.
-        if (count[i] != 0) {
-            //Cada dimensao sera multiplicada pela proxima dimensao, obtendo o tamanho total em um componente na primeira dimensao
-            total *= count[i];
-        }
-        else break;
-    }
+    pushInOperandStack(environment->thread, encodeReference(arrayref));
+}
+
+//--------------------------------------------------------------------------------------------------
+void monitorenter(Environment* environment){
     
-    //O array multidimensional
-    void* array;
+    u4 reference = popFromOperandStack(environment->thread);
     
-    if (type_components == 'B' || type_components == 'Z' || type_components == 'C') {
-        array = (u1*) malloc(count[0] * total * sizeof(u1));
-        initializeNDArray(dimensions_argument, -1, count, 0, type_components, array);
-    }
-    else if (type_components == 'S') {
-        array = (u2*) malloc(count[0] * total * sizeof(u2));
-        initializeNDArray(dimensions_argument, -1, count, 0, type_components, array);
-    }
-    else if (type_components == 'I' || type_components == 'F') {
-        array = (u4*) malloc(count[0] * total * sizeof(u4));
-        initializeNDArray(dimensions_argument, -1, count, 0, type_components, array);
-    }
-    else if (type_components == 'J' || type_components == 'D') {
-        array = (u8*) malloc(count[0] * total * sizeof(u8));
-        initializeNDArray(dimensions_argument, -1, count, 0, type_components, array);
-    }
+    if (reference == 0) JVMThrow(NullPointerException, environment);
+    
+    //Somente objetos tem a palavra do monitor
+    if (getHeapBlock(decodeReference(reference))->kind != HEAP_Object) return;
+    
+    ((Object*) decodeReference(reference))->lock++;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+void monitorexit(Environment* environment){
+    
+    u4 reference = popFromOperandStack(environment->thread);
+    
+    if (reference == 0) JVMThrow(NullPointerException, environment);
+    
+    if (getHeapBlock(decodeReference(reference))->kind != HEAP_Object) return;
+    
+    Object* object = (Object*) decodeReference(reference);
+    
+    if (object->lock == 0) JVMThrow(IllegalMonitorStateException, environment);
+    
+    object->lock--;
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -0,0 +1,2835 @@
+//#################################################################################################
+/*! \file heap.c
+ *
+ *  \brief Modulo do Heap
+ *
+ *  Modulo responsavel por implementar os metodos de alocacao no heap da JVM, com submodulos
+ *  responsaveis por implementar:
+ *  - Reserva da regiao do heap
+ *  - Estatisticas de pausas
+ *  - Chunks do heap
+ *  - Listas de blocos livres da geracao velha
+ *  - Espaco de objetos grandes
+ *  - Alocacao por incremento de ponteiro nos TLABs das threads
+ *  - Raizes e referencias percorridas pelos coletores
+ *  - Coleta da geracao jovem (copia)
+ *  - Descarregamento de classes
+ *  - Coleta completa (marcacao e compactacao)
+ *  - Marcacao incremental da geracao velha
+ *  - Percurso e censo do heap
+ */
+//##################################################################################################
+
+#define HEAP
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#include "include/heap.h"
+#include "include/javaarray.h"
+#include "include/javastring.h"
+#include "include/executionengine.h"
+#include "include/classloader.h"
+#include "include/verifier.h"
+#include "include/memoryunit.h"
+
+
+//--------------------------------------------------------------------------------------------------
+// SUBMODULO: Reserva da regiao do heap
+//--------------------------------------------------------------------------------------------------
+
+static Heap heap; //!< Heap compartilhado por todas as threads da JVM
+
+static u1* takeChunks(u4 count, u1 kind);
+
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que reserva uma regiao de memoria diretamente do sistema operacional, sem compromete-la.
+ * As referencias java sao deslocamentos a partir do inicio da regiao, portanto ela pode ficar em
+ * qualquer endereco; o inicio eh alinhado a uma huge page. Com huge pages explicitas a regiao
+ * inteira eh mapeada (e comprometida) de uma vez; se o sistema nao tem huge pages suficientes,
+ * paginas normais sao usadas.
+ *
+ * \param size Tamanho da regiao em bytes
+ * \param largePages Tenta mapear a regiao com huge pages explicitas (MAP_HUGETLB)
+ * \return Endereco da regiao (ou nulo se nao foi possivel reserva-la)
+ */
+static u1* reserveRegion(u4 size, u1 largePages){
+#ifdef _WIN32
+    heap.reservation = (u1*) VirtualAlloc(NULL, size, MEM_RESERVE, PAGE_NOACCESS);
+    heap.reservationSize = size;
+    return heap.reservation;
+#else
+#ifdef MAP_HUGETLB
+    if (largePages) {
+        size_t hugeMask = HEAP_HugePageSize - 1;
+        size_t hugeSize = ((size_t) size + hugeMask) & ~hugeMask;
+        void* region = mmap(NULL, hugeSize, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+        if (region != MAP_FAILED) {
+            heap.hugeTLB = 1;
+            heap.reservation = (u1*) region;
+            heap.reservationSize = hugeSize;
+            return (u1*) region;
+        }
+        fprintf(stderr, "[Heap: huge pages indisponiveis, usando paginas normais]\n");
+    }
+#endif
+    //Sem permissao de escrita a reserva nao conta como memoria comprometida
+    void* region = mmap(NULL, (size_t) size + HEAP_HugePageSize, PROT_NONE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (region == MAP_FAILED) return NULL;
+
+    heap.reservation = (u1*) region;
+    heap.reservationSize = (u8) size + HEAP_HugePageSize;
+
+    uintptr_t mask = HEAP_HugePageSize - 1;
+
+    return (u1*) (((uintptr_t) region + mask) & ~mask);
+#endif
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que compromete uma parte da regiao reservada. Comprometer uma area ja comprometida nao
+ * altera o seu conteudo.
+ *
+ * \param address Inicio da area (alinhado a pagina)
+ * \param size Tamanho da area (multiplo da pagina)
+ * \return 1 se a area foi comprometida, 0 se o sistema operacional recusou o pedido
+ */
+static u1 commitRegion(u1* address, u4 size){
+#ifdef _WIN32
+    return VirtualAlloc(address, size, MEM_COMMIT, PAGE_READWRITE) != NULL;
+#else
+    return mprotect(address, size, PROT_READ | PROT_WRITE) == 0;
+#endif
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que avanca o fim da parte comprometida de um espaco ate cobrir um limite. A memoria eh
+ * comprometida em passos de uma huge page (contados a partir do inicio da regiao), sem passar do
+ * fim do espaco.
+ *
+ * \param committed Fim da parte comprometida do espaco (heap.committed ou heap.largeCommitted)
+ * \param limit Endereco que deve ficar comprometido
+ * \param end Fim do espaco
+ * \return 1 se o limite esta comprometido, 0 se o sistema operacional recusou o pedido
+ */
+static u1 commitUpTo(u1** committed, u1* limit, u1* end){
+
+    u1* current;
+    u8 mask = HEAP_HugePageSize - 1;
+
+    //Outra thread pode ter comprometido a mesma area; comprometer de novo nao a altera
+    while ((current = *committed) < limit) {
+        u8 offset = ((u8) (limit - heap.base) + mask) & ~mask;
+        u1* target = offset < (u8) (end - heap.base) ? heap.base + offset : end;
+
+        if (!commitRegion(current, (u4) (target - current))) return 0;
+
+        __sync_bool_compare_and_swap(committed, current, target);
+    }
+
+    return 1;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que calcula a ocupacao da geracao velha (e do espaco de objetos grandes) que inicia o
+ * proximo ciclo de marcacao. Se os objetos vivos ja passam do limite configurado, o proximo ciclo
+ * inicia na metade do espaco restante (com limite zero, um ciclo eh iniciado a cada coleta da
+ * geracao jovem ou alocacao de objeto grande).
+ */
+static void updateOldTrigger(){
+
+    u4 oldCapacity = (u4) (heap.end - heap.base) - heap.youngLimit * HEAP_TLABSize;
+    u4 threshold = (u4) ((u8) oldCapacity * heap.options.threshold / 100);
+
+    if (heap.oldUsed < threshold || threshold == 0) heap.oldTrigger = threshold;
+    else heap.oldTrigger = heap.oldUsed + (oldCapacity - heap.oldUsed) / 2;
+
+    //A reserva do espaco de objetos grandes eh virtual: um ciclo eh iniciado quando ele cresce,
+    //desde a ultima varredura, o mesmo que a geracao velha pode ocupar. A sua capacidade eh o que
+    //os chunks ja utilizados deixam livre do heap maximo
+    u4 largeCapacity = (u4) (heap.largeEnd - heap.end);
+    u4 heapFree = (u4) (heap.end - heap.top);
+    if (largeCapacity > heapFree) largeCapacity = heapFree;
+    u8 largeTrigger = (u8) heap.largeUsed + threshold;
+
+    if (largeTrigger < largeCapacity) heap.largeTrigger = (u4) largeTrigger;
+    else heap.largeTrigger = heap.largeUsed + (largeCapacity - heap.largeUsed) / 2;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+void initHeap(HeapOptions* options, Environment* environment, void* stackBase){
+
+    //Arredondamos para o tamanho de um chunk
+    u4 size = (options->size + HEAP_TLABSize - 1) & ~(HEAP_TLABSize - 1);
+    u4 chunkCount = size / HEAP_TLABSize;
+
+    //O espaco de objetos grandes segue os chunks; as referencias limitam a regiao a 4GB. Sem
+    // coletor todos os blocos sao alocados nas arenas
+    u8 largeSpace = options->noGC ? 0 : (options->largeSpace + HEAP_TLABSize - 1) &
+                                        ~(HEAP_TLABSize - 1);
+    u8 regionLimit = 0x100000000ull - HEAP_TLABSize;
+    if (size + largeSpace > regionLimit) largeSpace = size < regionLimit ? regionLimit - size : 0;
+    u4 regionSize = size + (u4) largeSpace;
+
+    memset(&heap, 0, sizeof(Heap));
+
+    u1* region = reserveRegion(regionSize, options->largePages);
+
+    if (region == NULL) JVMstopAbrupt("Erro de alocacao de memoria para o heap.");
+
+    heap.base = region;
+    heap.top = region;
+    heap.end = region + size;
+    heap.largeTop = heap.end;
+    heap.largeEnd = region + regionSize;
+    heap.committed = heap.hugeTLB ? heap.end : region;
+    heap.largeCommitted = heap.hugeTLB ? heap.largeEnd : heap.end;
+    heap.options = *options;
+    heap.environment = environment;
+    heap.stackBase = (u1*) stackBase;
+
+    //Um bit para cada posicao (alinhada) em que um bloco pode comecar
+    heap.blockStarts = (u1*) calloc(regionSize / HEAP_Alignment / 8, sizeof(u1));
+    heap.chunks = (u1*) calloc(regionSize / HEAP_TLABSize, sizeof(u1));
+    heap.freeChunks = (u4*) malloc(chunkCount * sizeof(u4));
+    heap.cards = (u1*) calloc(regionSize >> HEAP_CardShift, sizeof(u1));
+    heap.forwarding = (u4*) malloc((size >> HEAP_CardShift) * sizeof(u4));
+
+    if (!heap.blockStarts || !heap.chunks || !heap.freeChunks || !heap.cards || !heap.forwarding)
+        JVMstopAbrupt("Erro de alocacao de memoria para o heap.");
+
+    memset(&heap.chunks[chunkCount], HEAP_ChunkLarge, (u4) largeSpace / HEAP_TLABSize);
+
+    u4 initialSize = options->initialSize < size ? options->initialSize : size;
+
+    if (!commitUpTo(&heap.committed, region + initialSize, heap.end))
+        JVMstopAbrupt("Erro de alocacao de memoria para o heap.");
+
+#ifdef MADV_HUGEPAGE
+    //Chunks e arrays grandes percorridos sequencialmente usam menos entradas da TLB
+    if (options->hugePages && !heap.hugeTLB) madvise(region, regionSize, MADV_HUGEPAGE);
+#endif
+
+    //A geracao jovem ocupa no maximo metade do heap e tem pelo menos dois chunks
+    u4 youngSize = options->youngSize ? options->youngSize : size / 8;
+    heap.youngLimit = youngSize / HEAP_TLABSize;
+    if (heap.youngLimit > chunkCount / 2) heap.youngLimit = chunkCount / 2;
+    if (heap.youngLimit < 2) heap.youngLimit = 2;
+
+    updateOldTrigger();
+
+    //Regiao dos objetos que nao escapam do seu metodo, alocados nos frames da thread
+    Thread* thread = environment->thread;
+    u1* local = options->noEscapeAnalysis ? NULL :
+                takeChunks(HEAP_LocalSize / HEAP_TLABSize, HEAP_ChunkLocal);
+
+    thread->localBase = thread->localTop = local;
+    thread->localEnd = local != NULL ? local + HEAP_LocalSize : NULL;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+void throwOutOfMemoryError(){
+
+    Thread* thread = heap.environment->thread;
+
+    //Sem um frame em execucao nao ha classe nem metodo para a mensagem da excecao
+    if (thread->vmStack == NULL || thread->vmStack->top == NULL)
+        JVMstopAbrupt("Excessao: OutOfMemoryError");
+
+    JVMThrow(OutOfMemoryError, heap.environment);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+void releaseHeap(){
+
+#ifdef _WIN32
+    VirtualFree(heap.reservation, 0, MEM_RELEASE);
+#else
+    munmap(heap.reservation, heap.reservationSize);
+#endif
+    free(heap.blockStarts);
+    free(heap.chunks);
+    free(heap.freeChunks);
+    free(heap.cards);
+    free(heap.forwarding);
+    memset(&heap, 0, sizeof(Heap));
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// SUBMODULO: Estatisticas de pausas
+//--------------------------------------------------------------------------------------------------
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que retorna o instante atual, em microssegundos, para a medicao das pausas do coletor.
+ *
+ * \return Instante atual em microssegundos
+ */
+static u8 nowMicros(){
+#ifdef _WIN32
+    return (u8) clock() * 1000000 / CLOCKS_PER_SEC;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (u8) now.tv_sec * 1000000 + (u8) now.tv_nsec / 1000;
+#endif
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que registra no histograma uma pausa do coletor. A primeira faixa do histograma vai ate
+ * 64us e cada faixa seguinte dobra o limite da anterior.
+ *
+ * \param start Instante (nowMicros) em que a pausa comecou
+ * \return Duracao da pausa em milissegundos
+ */
+static double recordPause(u8 start){
+
+    u8 pause = nowMicros() - start;
+    u4 bucket = 0;
+
+    while (bucket < HEAP_PauseBuckets - 1 && pause >= ((u8) 64 << bucket)) bucket++;
+
+    heap.pauseHistogram[bucket]++;
+    heap.pauseCount++;
+    heap.pauseTotal += pause;
+    if (pause > heap.pauseMax) heap.pauseMax = pause;
+
+    return pause / 1000.0;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+void printHeapStatistics(){
+
+    if (!heap.options.verbose) return;
+
+    if (heap.localObjects > 0)
+        fprintf(stderr, "[GC: %u objetos alocados nos frames]\n", heap.localObjects);
+
+    if (heap.options.noGC) {
+        fprintf(stderr, "[GC: sem coletor: %uK alocados em arenas, %uK comprometidos]\n",
+                (u4) (heap.top - heap.base) / 1024, (u4) (heap.committed - heap.base) / 1024);
+        return;
+    }
+
+    if (heap.pauseCount == 0) return;
+
+    fprintf(stderr, "[GC: %u coletas jovens, %u ciclos de marcacao, %u coletas completas]\n",
+            heap.minorCollections, heap.markingCycles, heap.collections);
+    fprintf(stderr, "[GC: %u pausas, media %.3f ms, maxima %.3f ms]\n", heap.pauseCount,
+            heap.pauseTotal / 1000.0 / heap.pauseCount, heap.pauseMax / 1000.0);
+    fprintf(stderr, "[GC: chunks: %uK comprometidos, %uK reservados]\n",
+            (u4) (heap.committed - heap.base) / 1024, (u4) (heap.end - heap.base) / 1024);
+    fprintf(stderr, "[GC: objetos grandes: %uK ocupados, %uK comprometidos, %uK reservados]\n",
+            heap.largeUsed / 1024, (u4) (heap.largeCommitted - heap.end) / 1024,
+            (u4) (heap.largeEnd - heap.end) / 1024);
+
+    for (u4 bucket = 0; bucket < HEAP_PauseBuckets; bucket++) {
+        if (heap.pauseHistogram[bucket] == 0) continue;
+
+        if (bucket < HEAP_PauseBuckets - 1)
+            fprintf(stderr, "[GC:   < %9.3f ms: %u]\n", (64 << bucket) / 1000.0,
+                    heap.pauseHistogram[bucket]);
+        else
+            fprintf(stderr, "[GC:  >= %9.3f ms: %u]\n", (64 << (bucket - 1)) / 1000.0,
+                    heap.pauseHistogram[bucket]);
+    }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// SUBMODULO: Chunks do heap
+//--------------------------------------------------------------------------------------------------
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que retorna o indice do chunk que contem um endereco do heap.
+ *
+ * \param address Endereco dentro do heap
+ * \return Indice do chunk
+ */
+static u4 chunkIndex(void* address){
+
+    return (u4) ((u1*) address - heap.base) / HEAP_TLABSize;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que retorna o estado do chunk que contem um endereco do heap.
+ *
+ * \param address Endereco dentro do heap
+ * \return Estado do chunk (HEAP_Chunk*)
+ */
+static u1 chunkKind(void* address){
+
+    return heap.chunks[chunkIndex(address)];
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que retira da pilha de chunks livres uma sequencia de chunks livres contiguos.
+ *
+ * \param count Numero de chunks
+ * \return Endereco do primeiro chunk (ou nulo se nao ha sequencia livre desse tamanho)
+ */
+static u1* takeFreeRun(u4 count){
+
+    u4 limit = chunkIndex(heap.top);
+    u4 run = 0;
+
+    for (u4 index = 0; index < limit; index++) {
+        run = heap.chunks[index] == HEAP_ChunkFree ? run + 1 : 0;
+
+        if (run == count) {
+            u4 first = index + 1 - count;
+            u4 kept = 0;
+
+            for (u4 i = 0; i < heap.freeChunkCount; i++) {
+                if (heap.freeChunks[i] < first || heap.freeChunks[i] > index)
+                    heap.freeChunks[kept++] = heap.freeChunks[i];
+            }
+            heap.freeChunkCount = kept;
+
+            return heap.base + first * HEAP_TLABSize;
+        }
+    }
+
+    return NULL;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que retira chunks contiguos do heap. Um unico chunk eh retirado da pilha de chunks livres,
+ * se possivel; pedidos de varios chunks procuram uma sequencia de chunks livres e, se nao houver,
+ * avancam o topo da regiao. A area retornada esta zerada.
+ *
+ * \param count Numero de chunks
+ * \param kind Estado dos chunks retirados (HEAP_Chunk*)
+ * \return Endereco do primeiro chunk (ou nulo se o heap esta esgotado)
+ */
+static u1* takeChunks(u4 count, u1 kind){
+
+    u1* address = NULL;
+
+    if (count == 1 && heap.freeChunkCount > 0) {
+        address = heap.base + heap.freeChunks[--heap.freeChunkCount] * HEAP_TLABSize;
+        memset(address, 0, HEAP_TLABSize);
+    }
+    else if (count > 1 && heap.freeChunkCount >= count && (address = takeFreeRun(count)) != NULL) {
+        memset(address, 0, count * HEAP_TLABSize);
+    }
+    else {
+        u1* top;
+
+        //Outra thread pode ter movido o topo entre a leitura e a escrita
+        do {
+            top = heap.top;
+
+            //Os objetos grandes ocupados tambem contam no heap maximo (-Xmx)
+            if ((u8) (heap.end - top) < (u8) count * HEAP_TLABSize + heap.largeUsed) return NULL;
+
+            //O topo so avanca sobre memoria comprometida
+            if (!commitUpTo(&heap.committed, top + count * HEAP_TLABSize, heap.end)) return NULL;
+
+        } while (!__sync_bool_compare_and_swap(&heap.top, top, top + count * HEAP_TLABSize));
+
+        //Como a area nunca foi utilizada, ela ja esta zerada
+        address = top;
+    }
+
+    memset(&heap.chunks[chunkIndex(address)], kind, count);
+
+    return address;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que devolve um chunk para a pilha de chunks livres, limpando os inicios de bloco e os
+ * cartoes que o cobrem.
+ *
+ * \param index Indice do chunk
+ */
+static void releaseChunk(u4 index){
+
+    heap.chunks[index] = HEAP_ChunkFree;
+    heap.freeChunks[heap.freeChunkCount++] = index;
+
+    memset(&heap.blockStarts[index * (HEAP_TLABSize / HEAP_Alignment / 8)], 0,
+           HEAP_TLABSize / HEAP_Alignment / 8);
+    memset(&heap.cards[index * (HEAP_TLABSize >> HEAP_CardShift)], 0,
+           HEAP_TLABSize >> HEAP_CardShift);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// SUBMODULO: Listas de blocos livres da geracao velha
+//--------------------------------------------------------------------------------------------------
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que marca ou desmarca, no mapa de bits do heap, o inicio de um bloco.
+ *
+ * \param block Bloco do heap
+ * \param isStart Diferente de zero se um bloco comeca neste endereco
+ */
+static void setBlockStart(HeapBlock* block, u1 isStart){
+
+    u4 index = (u4) ((u1*) block - heap.base) / HEAP_Alignment;
+
+    if (isStart) heap.blockStarts[index / 8] |= (u1) (1 << (index % 8));
+    else heap.blockStarts[index / 8] &= (u1) ~(1 << (index % 8));
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que verifica, pelo mapa de bits do heap, se um bloco comeca no endereco recebido.
+ *
+ * \param block Endereco alinhado dentro do heap
+ * \return Diferente de zero se um bloco comeca neste endereco
+ */
+static u1 isBlockStart(HeapBlock* block){
+
+    u4 index = (u4) ((u1*) block - heap.base) / HEAP_Alignment;
+
+    return heap.blockStarts[index / 8] & (1 << (index % 8));
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que escreve o cabecalho de um bloco do heap.
+ *
+ * \param address Inicio do bloco
+ * \param size Tamanho do bloco (incluindo o cabecalho)
+ * \param kind Tipo do conteudo do bloco
+ * \return Endereco da area de conteudo do bloco
+ */
+static void* formatBlock(u1* address, u4 size, u1 kind){
+
+    HeapBlock* block = (HeapBlock*) address;
+    block->size = size;
+    block->kind = kind;
+    block->flags = 0;
+    block->age = 0;
+    setBlockStart(block, 1);
+
+    return address + sizeof(HeapBlock);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que retorna a referencia, guardada no conteudo de um bloco livre, para o proximo bloco da
+ * sua lista.
+ *
+ * \param block Bloco livre (com pelo menos HEAP_MinimumBlock bytes)
+ * \return Endereco do campo que guarda o proximo bloco da lista
+ */
+static HeapBlock** nextFreeBlock(HeapBlock* block){
+
+    return (HeapBlock**) (block + 1);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que transforma uma area da geracao velha em um bloco livre e o insere na lista
+ * correspondente ao seu tamanho. Areas menores que um bloco minimo nao cabem em nenhuma lista e so
+ * sao reaproveitadas quando unidas a blocos vizinhos na proxima varredura.
+ *
+ * \param address Inicio da area
+ * \param size Tamanho da area em bytes
+ */
+static void addFreeBlock(u1* address, u4 size){
+
+    HeapBlock* block = (HeapBlock*) address;
+    formatBlock(address, size, HEAP_Free);
+
+    if (size < HEAP_MinimumBlock) return;
+
+    HeapBlock** list = size <= HEAP_SmallBlock ? &heap.freeLists[size / HEAP_Alignment]
+                                               : &heap.largeFreeList;
+    *nextFreeBlock(block) = *list;
+    *list = block;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que libera uma area da geracao velha: os chunks inteiros da area voltam para a pilha de
+ * chunks livres e as sobras vao para as listas de blocos livres.
+ *
+ * \param start Inicio da area
+ * \param end Fim da area
+ */
+static void addFreeRange(u1* start, u1* end){
+
+    u1* firstChunk = heap.base + (((u4) (start - heap.base) + HEAP_TLABSize - 1) & ~(HEAP_TLABSize - 1));
+    u1* lastChunk = heap.base + ((u4) (end - heap.base) & ~(HEAP_TLABSize - 1));
+
+    if (firstChunk >= lastChunk) {
+        addFreeBlock(start, (u4) (end - start));
+        return;
+    }
+
+    for (u1* chunk = firstChunk; chunk < lastChunk; chunk += HEAP_TLABSize)
+        releaseChunk(chunkIndex(chunk));
+
+    if (start < firstChunk) addFreeBlock(start, (u4) (firstChunk - start));
+    if (lastChunk < end) addFreeBlock(lastChunk, (u4) (end - lastChunk));
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que aloca uma area na geracao velha: de um bloco livre do tamanho exato, do primeiro
+ * bloco livre grande que couber ou de novos chunks. A sobra volta para as listas de blocos livres.
+ * A area retornada esta zerada.
+ *
+ * \param size Tamanho do bloco (incluindo o cabecalho, ja alinhado)
+ * \param allocated Recebe o numero de bytes efetivamente retirados
+ * \return Endereco da area (ou nulo se o heap esta esgotado)
+ */
+static u1* allocateOld(u4 size, u4* allocated){
+
+    u1* address = NULL;
+    u4 available = 0;
+
+    //Bloco livre do tamanho exato
+    if (size <= HEAP_SmallBlock && heap.freeLists[size / HEAP_Alignment] != NULL) {
+        HeapBlock* block = heap.freeLists[size / HEAP_Alignment];
+        heap.freeLists[size / HEAP_Alignment] = *nextFreeBlock(block);
+        address = (u1*) block;
+        available = size;
+    }
+
+    //Primeiro bloco livre grande que couber
+    if (address == NULL) {
+        HeapBlock** link = &heap.largeFreeList;
+
+        while (*link != NULL && (*link)->size < size) link = nextFreeBlock(*link);
+
+        if (*link != NULL) {
+            address = (u1*) *link;
+            available = (*link)->size;
+            *link = *nextFreeBlock(*link);
+        }
+    }
+
+    //Novos chunks (ja zerados)
+    if (address == NULL) {
+        u4 count = (size + HEAP_TLABSize - 1) / HEAP_TLABSize;
+        address = takeChunks(count, HEAP_ChunkOld);
+
+        if (address == NULL) return NULL;
+
+        available = count * HEAP_TLABSize;
+        *allocated = available < size + HEAP_MinimumBlock ? available : size;
+    }
+    else {
+        *allocated = available < size + HEAP_MinimumBlock ? available : size;
+        memset(address, 0, *allocated);
+    }
+
+    //Sobras menores que um bloco minimo ficam com a area retirada
+    if (*allocated < available) addFreeBlock(address + *allocated, available - *allocated);
+
+    heap.oldUsed += *allocated;
+
+    return address;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// SUBMODULO: Espaco de objetos grandes
+//--------------------------------------------------------------------------------------------------
+
+static void collectYoungGeneration();
+static void startMarkingCycle();
+static void markStep();
+static void shadeReference(u4 value);
+static void shadeNewOldBlock(HeapBlock* block);
+static void shadePromotedBlock(HeapBlock* block);
+static void abortMarkingCycle();
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que devolve ao sistema operacional as paginas de uma area do espaco de objetos grandes.
+ * A area continua reservada e, quando voltar a ser usada, estara zerada.
+ *
+ * \param address Inicio da area (alinhado a pagina)
+ * \param size Tamanho da area (multiplo da pagina)
+ */
+static void releasePages(u1* address, u4 size){
+#ifdef _WIN32
+    VirtualFree(address, size, MEM_DECOMMIT);
+    VirtualAlloc(address, size, MEM_COMMIT, PAGE_READWRITE);
+#else
+    //Areas de huge pages explicitas so podem ser devolvidas inteiras: basta zera-las
+    if (madvise(address, size, MADV_DONTNEED) != 0) memset(address, 0, size);
+#endif
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que procura espaco para um objeto grande: o primeiro bloco livre que couber (dividido se
+ * sobrar espaco) ou, se nenhum couber, o fim do espaco ocupado.
+ *
+ * \param size Tamanho do bloco (multiplo da pagina)
+ * \return Inicio do bloco (ou nulo se o espaco de objetos grandes esta esgotado)
+ */
+static u1* allocateLarge(u4 size){
+
+    //Os objetos grandes dividem o heap maximo (-Xmx) com os chunks ja utilizados; a reserva do
+    // espaco de objetos grandes eh somente virtual
+    if ((u8) (heap.top - heap.base) + heap.largeUsed + size > (u8) (heap.end - heap.base))
+        return NULL;
+
+    for (u1* address = heap.end; address < heap.largeTop; address += ((HeapBlock*) address)->size) {
+        HeapBlock* block = (HeapBlock*) address;
+
+        if (block->kind != HEAP_Free || block->size < size) continue;
+
+        if (block->size > size) formatBlock(address + size, block->size - size, HEAP_Free);
+
+        return address;
+    }
+
+    if ((u4) (heap.largeEnd - heap.largeTop) < size) return NULL;
+
+    if (!commitUpTo(&heap.largeCommitted, heap.largeTop + size, heap.largeEnd)) return NULL;
+
+    u1* address = heap.largeTop;
+    heap.largeTop += size;
+
+    return address;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que aloca um array no espaco de objetos grandes, em paginas proprias. Como na geracao
+ * velha, a alocacao avanca a marcacao incremental ou, se a ocupacao passa do limite, inicia um
+ * novo ciclo; a coleta completa so eh executada quando o espaco se esgota.
+ *
+ * \param size Tamanho do bloco (incluindo o cabecalho)
+ * \param kind Tipo do conteudo do bloco
+ * \return Endereco da area de conteudo do bloco
+ */
+static void* heapAllocateLarge(u4 size, u1 kind){
+
+    size = (size + HEAP_PageSize - 1) & ~(HEAP_PageSize - 1);
+
+    if (heap.marking) {
+        markStep();
+    }
+    else if (heap.largeUsed + size > heap.largeTrigger) {
+        collectYoungGeneration();
+        if (!heap.marking) startMarkingCycle();
+    }
+
+    u1* address = allocateLarge(size);
+
+    if (address == NULL) {
+        collectGarbage();
+        address = allocateLarge(size);
+    }
+
+    if (address == NULL) throwOutOfMemoryError();
+
+    void* content = formatBlock(address, size, kind);
+    heap.largeUsed += size;
+    shadeNewOldBlock((HeapBlock*) address);
+
+    return content;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que varre o espaco de objetos grandes apos a marcacao (incremental ou completa): os
+ * objetos marcados sao desmarcados e os demais devolvem as suas paginas, formando blocos livres
+ * com os vizinhos. O bloco livre do fim do espaco ocupado deixa de existir.
+ */
+static void sweepLargeObjects(){
+
+    u1* freeStart = NULL;
+
+    heap.largeUsed = 0;
+
+    for (u1* address = heap.end; address < heap.largeTop; ) {
+        HeapBlock* block = (HeapBlock*) address;
+        u4 size = block->size;
+
+        if (block->flags & HEAP_Marked) {
+            block->flags &= ~(HEAP_Marked | HEAP_Pinned);
+            heap.largeUsed += size;
+
+            if (freeStart != NULL) formatBlock(freeStart, (u4) (address - freeStart), HEAP_Free);
+            freeStart = NULL;
+        }
+        else {
+            //O conteudo dos blocos livres ja esta zerado, exceto o cabecalho
+            if (block->kind != HEAP_Free) releasePages(address, size);
+            else if (freeStart != NULL) memset(block, 0, sizeof(HeapBlock));
+
+            if (freeStart == NULL) freeStart = address;
+            else setBlockStart(block, 0);
+        }
+        address += size;
+    }
+
+    if (freeStart != NULL) {
+        setBlockStart((HeapBlock*) freeStart, 0);
+        memset(freeStart, 0, sizeof(HeapBlock));
+        heap.largeTop = freeStart;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// SUBMODULO: Alocacao nos TLABs das threads
+//--------------------------------------------------------------------------------------------------
+
+
+//--------------------------------------------------------------------------------------------------
+void retireTLAB(Thread* thread){
+
+    if (thread->tlabTop < thread->tlabEnd) {
+        formatBlock(thread->tlabTop, (u4) (thread->tlabEnd - thread->tlabTop), HEAP_Free);
+    }
+    thread->tlabTop = NULL;
+    thread->tlabEnd = NULL;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que aloca um bloco diretamente na geracao velha. A alocacao avanca a marcacao incremental
+ * da geracao velha ou, se a ocupacao passa do limite, executa a coleta jovem que inicia um novo
+ * ciclo. A coleta completa so eh executada quando o heap se esgota.
+ *
+ * \param size Tamanho do bloco (incluindo o cabecalho, ja alinhado)
+ * \param kind Tipo do conteudo do bloco
+ * \return Endereco da area de conteudo do bloco
+ */
+static void* heapAllocateOld(u4 size, u1 kind){
+
+    u4 allocated;
+
+    if (heap.marking) markStep();
+    else if (heap.oldUsed + size > heap.oldTrigger) collectYoungGeneration();
+
+    u1* address = allocateOld(size, &allocated);
+
+    if (address == NULL) {
+        collectGarbage();
+        address = allocateOld(size, &allocated);
+    }
+
+    if (address == NULL) throwOutOfMemoryError();
+
+    void* content = formatBlock(address, allocated, kind);
+    shadeNewOldBlock((HeapBlock*) address);
+
+    return content;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que aloca um bloco sem coletor (-XX:+UseNoGC): o TLAB da thread eh substituido por uma
+ * nova arena, retirada do topo da regiao, com o bloco no seu inicio. Blocos maiores que uma arena
+ * recebem uma arena propria; quando nao cabe uma arena inteira, so os chunks do bloco sao
+ * retirados. Nada eh liberado ate o fim da execucao.
+ *
+ * \param thread Thread que realiza a alocacao
+ * \param size Tamanho do bloco (incluindo o cabecalho, ja alinhado)
+ * \param kind Tipo do conteudo do bloco
+ * \return Endereco da area de conteudo do bloco
+ */
+static void* heapAllocateArena(Thread* thread, u4 size, u1 kind){
+
+    u4 blockChunks = (size + HEAP_TLABSize - 1) / HEAP_TLABSize;
+    u4 arenaChunks = HEAP_ArenaSize / HEAP_TLABSize;
+
+    if (arenaChunks < blockChunks) arenaChunks = blockChunks;
+
+    retireTLAB(thread);
+
+    //Os chunks das arenas sao da geracao velha, portanto o heap continua podendo ser percorrido
+    u1* arena = takeChunks(arenaChunks, HEAP_ChunkOld);
+
+    if (arena == NULL) {
+        arenaChunks = blockChunks;
+        arena = takeChunks(arenaChunks, HEAP_ChunkOld);
+    }
+
+    if (arena == NULL) throwOutOfMemoryError();
+
+    thread->tlabTop = arena + size;
+    thread->tlabEnd = arena + arenaChunks * HEAP_TLABSize;
+
+    return formatBlock(arena, size, kind);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Caminho lento da alocacao: o bloco nao cabe no TLAB atual. Arrays grandes vao para o espaco de
+ * objetos grandes e os demais blocos grandes para a geracao velha; nos demais casos o TLAB eh
+ * substituido por um novo chunk da geracao jovem. A geracao jovem eh coletada quando atinge o seu
+ * tamanho maximo. Sem coletor, o bloco eh alocado em uma nova arena.
+ *
+ * \param thread Thread que realiza a alocacao
+ * \param size Tamanho do bloco (incluindo o cabecalho, ja alinhado)
+ * \param kind Tipo do conteudo do bloco
+ * \return Endereco da area de conteudo do bloco
+ */
+static void* heapAllocateSlow(Thread* thread, u4 size, u1 kind){
+
+    if (heap.options.noGC) return heapAllocateArena(thread, size, kind);
+
+    if (size >= heap.options.largeObject && (kind == HEAP_Array || kind == HEAP_ReferenceArray))
+        return heapAllocateLarge(size, kind);
+
+    //Um bloco maior que um quarto do TLAB desperdicaria muito espaco do TLAB atual
+    if (size > HEAP_TLABSize / 4) return heapAllocateOld(size, kind);
+
+    retireTLAB(thread);
+
+    if (heap.youngChunks >= heap.youngLimit) collectYoungGeneration();
+
+    //A marcacao incremental da geracao velha avanca um passo a cada novo TLAB
+    if (heap.marking) markStep();
+
+    u1* tlab = takeChunks(1, HEAP_ChunkYoung);
+
+    //Sem chunks livres (chunks fixos fragmentam a geracao velha), o bloco eh alocado nos blocos
+    // livres da geracao velha
+    if (tlab == NULL) return heapAllocateOld(size, kind);
+
+    heap.youngChunks++;
+    thread->tlabTop = tlab + size;
+    thread->tlabEnd = tlab + HEAP_TLABSize;
+
+    return formatBlock(tlab, size, kind);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que retorna o tamanho do bloco que guarda uma area: o tamanho da area com o cabecalho,
+ * arredondado para o alinhamento do heap.
+ *
+ * \param size Numero de bytes da area
+ * \return Tamanho do bloco
+ */
+static u4 blockSize(u4 size){
+
+    size = (size + sizeof(HeapBlock) + HEAP_Alignment - 1) & ~(HEAP_Alignment - 1);
+
+    return size < HEAP_MinimumBlock ? HEAP_MinimumBlock : size;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+void* heapAllocate(Thread* thread, u4 size, u1 kind){
+
+    size = blockSize(size);
+
+    u1* address = thread->tlabTop;
+
+    //Caminho rapido: incremento de ponteiro no TLAB da thread
+    if (size <= (u4) (thread->tlabEnd - address)) {
+        thread->tlabTop = address + size;
+        return formatBlock(address, size, kind);
+    }
+
+    return heapAllocateSlow(thread, size, kind);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+void* heapAllocateLocal(Thread* thread, u4 size, u1 kind){
+
+    u4 total = blockSize(size);
+
+    if (thread->localTop == NULL || (u4) (thread->localEnd - thread->localTop) < total)
+        return NULL;
+
+    //Os blocos desempilhados com os frames nao sao limpos: a area eh zerada aqui
+    void* content = formatBlock(thread->localTop, total, kind);
+    thread->localTop += total;
+    heap.localObjects++;
+    memset(content, 0, size);
+
+    return content;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+void* heapAllocateSlab(Thread* thread, u4 levels, const u4* counts, const u4* sizes,
+                       const u1* kinds){
+
+    u8 total = 0;
+
+    for (u4 level = 0; level < levels; level++)
+        total += (u8) counts[level] * blockSize(sizes[level]);
+
+    if (total > 0x7FFFFFFF) throwOutOfMemoryError();
+
+    //Um unico bloco reserva todo o slab
+    u1* address = (u1*) getHeapBlock(heapAllocate(thread, (u4) total - sizeof(HeapBlock),
+                                                  HEAP_Free));
+    u1* end = address + ((HeapBlock*) address)->size;
+    u1 flags = ((HeapBlock*) address)->flags;
+    void* first = address + sizeof(HeapBlock);
+    HeapBlock* last = NULL;
+
+    //Todos os blocos herdam a marcacao do slab (alocado marcado durante a marcacao incremental)
+    for (u4 level = 0; level < levels; level++) {
+        for (u4 i = 0; i < counts[level]; i++) {
+            formatBlock(address, blockSize(sizes[level]), kinds[level]);
+            last = (HeapBlock*) address;
+            last->flags = flags;
+            address += last->size;
+        }
+    }
+
+    //A alocacao na geracao velha pode entregar alguns bytes a mais, que ficam com o ultimo bloco
+    last->size += (u4) (end - address);
+
+    return first;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+u1 heapIsLargeArray(u4 size){
+
+    return !heap.options.noGC && blockSize(size) >= heap.options.largeObject;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+HeapBlock* getHeapBlock(void* address){
+
+    return (HeapBlock*) ((u1*) address - sizeof(HeapBlock));
+}
+
+
+//--------------------------------------------------------------------------------------------------
+u4 encodeReference(void* address){
+
+    return address != NULL ? (u4) ((u1*) address - heap.base) : 0;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+void* decodeReference(u4 reference){
+
+    return reference != 0 ? heap.base + reference : NULL;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+void heapWriteBarrier(void* slot){
+
+    if ((u1*) slot >= heap.base && (u1*) slot < heap.largeEnd)
+        heap.cards[(u4) ((u1*) slot - heap.base) >> HEAP_CardShift] = 1;
+
+    //Atualizacao incremental: a referencia escrita nao pode se esconder em um bloco ja percorrido
+    if (heap.marking) shadeReference(*(u4*) slot);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+void heapStaticWriteBarrier(JavaClass* javaClass){
+
+    javaClass->staticsDirty = 1;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// SUBMODULO: Raizes e referencias percorridas pelos coletores
+//--------------------------------------------------------------------------------------------------
+
+typedef void (*ValueVisitor)(u4 value); //!< Recebe um valor que pode ser uma referencia
+typedef void (*SlotVisitor)(u4* slot); //!< Recebe o endereco de um campo de referencia
+
+//! Pilha de blocos alcancados cujo conteudo ainda nao foi percorrido
+typedef struct GrayStack{
+    HeapBlock** blocks; //!< Blocos empilhados
+    u4 top; //!< Numero de blocos na pilha
+    u4 size; //!< Capacidade da pilha
+} GrayStack;
+
+static GrayStack grayStack; //!< Pilha das coletas com as threads paradas (jovem e completa)
+static GrayStack markStack; //!< Pilha da marcacao incremental (preservada entre os passos)
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que empilha um bloco alcancado, para que o seu conteudo seja percorrido.
+ *
+ * \param stack Pilha que recebe o bloco
+ * \param block Bloco alcancado
+ */
+static void pushGray(GrayStack* stack, HeapBlock* block){
+
+    if (stack->top == stack->size) {
+        stack->size = stack->size ? stack->size * 2 : 1024;
+        stack->blocks = (HeapBlock**) realloc(stack->blocks, stack->size * sizeof(HeapBlock*));
+
+        if (stack->blocks == NULL)
+            JVMstopAbrupt("Erro de alocacao de memoria para o coletor de lixo.");
+    }
+    stack->blocks[stack->top++] = block;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que retorna o bloco cujo conteudo comeca na referencia recebida. Como a pilha nativa e
+ * os frames sem mapa de referencias nao indicam quais valores sao referencias, todo valor eh
+ * verificado. Os objetos locais dos frames nao sao gerenciados pelos coletores.
+ *
+ * \param value Valor que pode ser uma referencia para o heap
+ * \return Bloco referenciado (ou nulo se o valor nao referencia um bloco ocupado do heap)
+ */
+static HeapBlock* findBlock(u4 value){
+
+    //Os blocos ocupados ficam abaixo do topo dos chunks ou do topo do espaco de objetos grandes
+    u4 limit = value >= (u4) (heap.end - heap.base) ? (u4) (heap.largeTop - heap.base)
+                                                    : (u4) (heap.top - heap.base);
+
+    //O conteudo de um bloco sempre comeca apos um cabecalho, em um deslocamento alinhado
+    if (value < sizeof(HeapBlock) || value >= limit) return NULL;
+    if (value % HEAP_Alignment != 0) return NULL;
+
+    HeapBlock* block = getHeapBlock(heap.base + value);
+
+    if (!isBlockStart(block) || block->kind == HEAP_Free) return NULL;
+    if (chunkKind(block) == HEAP_ChunkLocal) return NULL;
+
+    return block;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que visita os campos de referencia (descritor de objeto ou de array) de uma tabela de
+ * campos que estao dentro de um intervalo de enderecos.
+ *
+ * \param fields Tabela de campos
+ * \param data Bloco com os valores dos campos (objeto ou campos estaticos)
+ * \param from Inicio do intervalo
+ * \param to Fim do intervalo
+ * \param visit Metodo que recebe cada campo
+ */
+static void visitFields(Fields* fields, u1* data, u1* from, u1* to, SlotVisitor visit){
+
+    for (int i = 0; i < fields->fieldsCount; i++) {
+        char type = fields->fieldsTable[i].descriptor[0];
+        u1* slot = data + fields->fieldsTable[i].offset;
+
+        if ((type == 'L' || type == '[') && slot >= from && slot < to) visit((u4*) slot);
+    }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que visita as referencias contidas em um bloco que estao dentro de um intervalo de
+ * enderecos.
+ *
+ * \param block Bloco do heap
+ * \param from Inicio do intervalo
+ * \param to Fim do intervalo
+ * \param visit Metodo que recebe cada referencia
+ */
+static void visitBlockSlots(HeapBlock* block, u1* from, u1* to, SlotVisitor visit){
+
+    void* content = block + 1;
+    u1* slot;
+
+    switch (block->kind) {
+        case HEAP_Object:{
+            Object* object = (Object*) content;
+            visitFields(object->javaClass->instanceFields, (u1*) object, from, to, visit);
+            break;
+        }
+        case HEAP_String:
+            slot = (u1*) &((JavaString*) content)->stringAddress;
+            if (slot >= from && slot < to) visit((u4*) slot);
+            break;
+        case HEAP_ReferenceArray:{
+            //Os elementos seguem o JavaArray no mesmo bloco
+            JavaArray* array = (JavaArray*) content;
+            u1* end = (u1*) (array + 1) + array->count * sizeof(u4);
+            slot = (u1*) (array + 1) < from ? from : (u1*) (array + 1);
+            for (; slot < end && slot < to; slot += sizeof(u4)) visit((u4*) slot);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que visita uma variavel local ou posicao da pilha de operandos de um frame, de acordo
+ * com a sua categoria no mapa de referencias.
+ *
+ * \param map Mapa de referencias da instrucao em execucao no frame (ou nulo)
+ * \param index Indice da posicao no mapa
+ * \param slot Endereco do valor
+ * \param visitValue Metodo que recebe as raizes conservadoras (ou nulo)
+ * \param visitSlot Metodo que recebe as raizes exatas (ou nulo)
+ */
+static void visitFrameSlot(ReferenceMap* map, u2 index, u4* slot, ValueVisitor visitValue,
+                           SlotVisitor visitSlot){
+
+    u1 category = map ? getReferenceMapSlot(map, index) : VERIFIER_Unknown;
+
+    if (category == VERIFIER_Reference) {
+        if (visitSlot) visitSlot(slot);
+    }
+    else if (category == VERIFIER_Unknown) {
+        if (visitValue) visitValue(*slot);
+    }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que visita as raizes dos frames da thread: vetores de variaveis locais e pilhas de
+ * operandos. Se a instrucao em execucao no frame tem um mapa de referencias, as referencias sao
+ * raizes exatas (campos que podem ser atualizados) e os demais valores sao ignorados; sem mapa,
+ * ou se a pilha de operandos nao tem a profundidade do mapa, todo valor eh uma raiz conservadora.
+ * Os campos de referencia dos objetos locais dos frames tambem sao raizes exatas.
+ *
+ * \param thread Thread cuja pilha JVM sera percorrida
+ * \param visitValue Metodo que recebe as raizes conservadoras (ou nulo)
+ * \param visitSlot Metodo que recebe as raizes exatas (ou nulo)
+ */
+static void visitThreadRoots(Thread* thread, ValueVisitor visitValue, SlotVisitor visitSlot){
+
+    //O pc de um frame abaixo do topo foi salvo no frame do metodo que ele invocou
+    int pc = thread->PC;
+
+    for (VMStack* stack = thread->vmStack; stack != NULL; stack = stack->next) {
+        Frame* frame = stack->top;
+
+        if (frame == NULL) continue;
+
+        //A base da pilha de operandos nao guarda valor: a posicao i fica no elemento i + 1
+        OperandStack* base = frame->opStk;
+        while (base != NULL && base->nextStack != NULL) base = base->nextStack;
+        u2 depth = base != NULL ? (u2) (frame->opStk - base) : 0;
+
+        ReferenceMap* map = getReferenceMap(frame->javaClass, frame->method_info, pc);
+        if (map != NULL && map->stackDepth != depth) map = NULL;
+
+        for (u2 i = 0; i < frame->maxLocals; i++)
+            visitFrameSlot(map, i, &frame->localVariablesVector[i], visitValue, visitSlot);
+
+        for (u2 i = 0; i < depth; i++) {
+            visitFrameSlot(map, frame->maxLocals + i, &base[i + 1].top, visitValue, visitSlot);
+        }
+
+        pc = frame->returnPC;
+    }
+
+    for (u1* address = thread->localBase; visitSlot != NULL && address < thread->localTop;
+         address += ((HeapBlock*) address)->size) {
+        HeapBlock* block = (HeapBlock*) address;
+        visitBlockSlots(block, address, address + block->size, visitSlot);
+    }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que visita os valores da pilha nativa, da base registrada ate o frame deste metodo. Os
+ * registradores ja devem ter sido salvos na pilha pelo coletor. Os metodos da JVM guardam tanto
+ * referencias comprimidas quanto ponteiros para o heap, portanto cada palavra alinhada que aponta
+ * para dentro do heap tambem eh visitada como a referencia correspondente.
+ *
+ * \param visit Metodo que recebe cada valor
+ */
+static void __attribute__((noinline)) visitNativeStackRoots(ValueVisitor visit){
+
+    u1 stackTop;
+
+    //Alinhamos o inicio em 4 bytes
+    for (u4* slot = (u4*) ((uintptr_t) &stackTop & ~(uintptr_t) 3); (u1*) (slot + 1) <= heap.stackBase;
+         slot++) {
+        visit(*slot);
+
+        if ((uintptr_t) slot % sizeof(u1*) != 0 || (u1*) slot + sizeof(u1*) > heap.stackBase)
+            continue;
+
+        u1* address = *(u1**) slot;
+        if (address > heap.base && address < heap.largeTop) visit(encodeReference(address));
+    }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que visita as referencias guardadas nas estruturas de uma classe: os campos estaticos de
+ * referencia e as strings das constantes String ja usadas.
+ *
+ * \param javaClass Classe carregada
+ * \param visit Metodo que recebe cada campo
+ */
+static void visitClassRoots(JavaClass* javaClass, SlotVisitor visit){
+
+    //A classe pode estar sendo carregada
+    if (javaClass->staticFields != NULL && javaClass->staticData != NULL) {
+        visitFields(javaClass->staticFields, javaClass->staticData, javaClass->staticData,
+                    (u1*) UINTPTR_MAX, visit);
+    }
+
+    for (int i = 0; i < javaClass->arqClass->constant_pool_count - 1; i++)
+        if (javaClass->resolvedPool[i].string != 0) visit(&javaClass->resolvedPool[i].string);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que visita as referencias guardadas nas estruturas das classes carregadas.
+ *
+ * \param methodArea Area de metodos com as classes carregadas
+ * \param visit Metodo que recebe cada campo
+ */
+static void visitStaticRoots(MethodArea* methodArea, SlotVisitor visit){
+
+    for (int i = 0; i < methodArea->classCount; i++)
+        visitClassRoots(methodArea->classTable[i].javaClass, visit);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// SUBMODULO: Coleta da geracao jovem (copia)
+//--------------------------------------------------------------------------------------------------
+
+static u1 scanningOld = 0; //!< O bloco sendo percorrido sera da geracao velha apos a coleta
+static u1 staticsYoung = 0; //!< A classe sendo percorrida ainda referencia a geracao jovem
+static u1* survivorTop = NULL; //!< Proximo byte livre do chunk de sobreviventes
+static u1* survivorEnd = NULL; //!< Fim do chunk de sobreviventes
+static u4 survivorChunks = 0; //!< Numero de chunks de sobreviventes
+static u4 promotedBytes = 0; //!< Bytes promovidos para a geracao velha na coleta
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que reserva espaco para um sobrevivente nos chunks de sobreviventes. Os sobreviventes
+ * ocupam no maximo metade da geracao jovem; os demais sao promovidos.
+ *
+ * \param size Tamanho do bloco
+ * \return Endereco do espaco (ou nulo se nao ha espaco para sobreviventes)
+ */
+static u1* allocateSurvivor(u4 size){
+
+    if (size > (u4) (survivorEnd - survivorTop)) {
+        if (survivorTop < survivorEnd)
+            formatBlock(survivorTop, (u4) (survivorEnd - survivorTop), HEAP_Free);
+        survivorTop = survivorEnd = NULL;
+
+        if (survivorChunks >= heap.youngLimit / 2) return NULL;
+
+        u1* chunk = takeChunks(1, HEAP_ChunkSurvivor);
+
+        if (chunk == NULL) return NULL;
+
+        survivorChunks++;
+        survivorTop = chunk;
+        survivorEnd = chunk + HEAP_TLABSize;
+    }
+
+    u1* address = survivorTop;
+    survivorTop += size;
+
+    return address;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que marca um bloco de um chunk fixo (que nao sera movido) como alcancavel.
+ *
+ * \param block Bloco de um chunk HEAP_ChunkPinned
+ */
+static void markPinnedBlock(HeapBlock* block){
+
+    if (block->flags & HEAP_Marked) return;
+
+    block->flags |= HEAP_Marked;
+    pushGray(&grayStack, block);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que copia um bloco da geracao jovem para os chunks de sobreviventes ou, se ja sobreviveu
+ * a coletas suficientes (ou nao ha espaco para sobreviventes), para a geracao velha. O endereco da
+ * copia fica no conteudo do bloco original.
+ *
+ * \param block Bloco a ser copiado
+ * \return Endereco do conteudo da copia (ou nulo se nao ha espaco para a copia)
+ */
+static u1* copyBlock(HeapBlock* block){
+
+    u4 size = block->size;
+    u4 allocated = size;
+    u1 age = block->age + 1;
+    u1* address = NULL;
+
+    if (age < heap.options.tenuring) address = allocateSurvivor(size);
+
+    if (address == NULL) {
+        address = allocateOld(size, &allocated);
+
+        if (address == NULL) return NULL;
+
+        promotedBytes += allocated;
+    }
+
+    HeapBlock* copy = (HeapBlock*) address;
+    memcpy(copy, block, size);
+    copy->size = allocated;
+    copy->age = age;
+    setBlockStart(copy, 1);
+
+    block->flags |= HEAP_Forwarded;
+    *(u4*) (block + 1) = encodeReference(copy + 1);
+
+    pushGray(&grayStack, copy);
+    if (chunkKind(copy) == HEAP_ChunkOld) shadePromotedBlock(copy);
+
+    return (u1*) (copy + 1);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que verifica se uma referencia continuara na geracao jovem apos a coleta em andamento
+ * (copiada para os sobreviventes ou em um chunk fixo).
+ *
+ * \param value Referencia ja atualizada
+ * \return Diferente de zero se a referencia continuara na geracao jovem
+ */
+static u1 isYoungAfterCollection(u4 value){
+
+    if (findBlock(value) == NULL) return 0;
+
+    u1 kind = chunkKind(decodeReference(value));
+
+    return kind == HEAP_ChunkSurvivor || kind == HEAP_ChunkPinned;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que recebe uma raiz conservadora da coleta da geracao jovem. Como o valor pode nao ser
+ * uma referencia, ele nao pode ser atualizado: o chunk do bloco referenciado fica fixo e continua
+ * na geracao jovem.
+ *
+ * \param value Valor que pode ser uma referencia para o heap
+ */
+static void pinYoungReference(u4 value){
+
+    HeapBlock* block = findBlock(value);
+
+    if (block == NULL) return;
+
+    u4 index = chunkIndex(block);
+
+    if (heap.chunks[index] == HEAP_ChunkYoung) heap.chunks[index] = HEAP_ChunkPinned;
+
+    if (heap.chunks[index] == HEAP_ChunkPinned) markPinnedBlock(block);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que atualiza um campo de referencia na coleta da geracao jovem: blocos jovens sao
+ * copiados e o campo passa a apontar para a copia. Se o campo pertence a geracao velha e continua
+ * apontando para a jovem, o seu cartao eh marcado.
+ *
+ * \param slot Endereco do campo
+ */
+static void scavengeSlot(u4* slot){
+
+    HeapBlock* block = findBlock(*slot);
+
+    if (block == NULL) return;
+
+    u4 index = chunkIndex(block);
+
+    if (heap.chunks[index] == HEAP_ChunkYoung || heap.chunks[index] == HEAP_ChunkPinned) {
+
+        if (block->flags & HEAP_Forwarded) {
+            *slot = *(u4*) (block + 1);
+        }
+        else if (heap.chunks[index] == HEAP_ChunkYoung) {
+            u1* copy = copyBlock(block);
+
+            if (copy != NULL) {
+                *slot = encodeReference(copy);
+            }
+            //Sem espaco para a copia, o bloco fica onde esta
+            else {
+                heap.chunks[index] = HEAP_ChunkPinned;
+                markPinnedBlock(block);
+            }
+        }
+        else {
+            markPinnedBlock(block);
+        }
+    }
+
+    if (scanningOld && isYoungAfterCollection(*slot)) heapWriteBarrier(slot);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que percorre o conteudo dos blocos alcancados (copiados ou fixos), atualizando os seus
+ * campos de referencia, ate que a pilha se esvazie.
+ */
+static void processScavengeStack(){
+
+    while (grayStack.top > 0) {
+        HeapBlock* block = grayStack.blocks[--grayStack.top];
+
+        scanningOld = chunkKind(block) == HEAP_ChunkOld;
+        visitBlockSlots(block, (u1*) block, (u1*) block + block->size, scavengeSlot);
+    }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que atualiza um campo estatico (ou string de constante) na coleta da geracao jovem,
+ * registrando se a classe continua referenciando a geracao jovem.
+ *
+ * \param slot Endereco do campo
+ */
+static void scavengeStaticSlot(u4* slot){
+
+    scavengeSlot(slot);
+
+    if (isYoungAfterCollection(*slot)) staticsYoung = 1;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que atualiza os campos estaticos e as strings das constantes das classes marcadas pela
+ * barreira de escrita. A classe continua marcada se algum campo ainda referencia a geracao jovem.
+ *
+ * \param methodArea Area de metodos com as classes carregadas
+ */
+static void scavengeStaticRoots(MethodArea* methodArea){
+
+    scanningOld = 0;
+
+    for (int i = 0; i < methodArea->classCount; i++) {
+        JavaClass* javaClass = methodArea->classTable[i].javaClass;
+
+        if (!javaClass->staticsDirty) continue;
+
+        staticsYoung = 0;
+        visitClassRoots(javaClass, scavengeStaticSlot);
+        javaClass->staticsDirty = staticsYoung;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que atualiza os campos de referencia dos cartoes marcados da geracao velha. O primeiro
+ * bloco de cada cartao eh encontrado pelo mapa de bits de inicio de blocos.
+ */
+static void scavengeDirtyCards(){
+
+    u4 cardCount = (u4) (heap.top - heap.base) >> HEAP_CardShift;
+
+    for (u4 card = 0; card < cardCount; card++) {
+        if (!heap.cards[card]) continue;
+
+        u1* cardStart = heap.base + (card << HEAP_CardShift);
+        u1* cardEnd = cardStart + (1 << HEAP_CardShift);
+
+        if (chunkKind(cardStart) != HEAP_ChunkOld) continue;
+
+        heap.cards[card] = 0;
+        scanningOld = 1;
+
+        //Bloco que contem o inicio do cartao (bytes sem inicio de bloco sao pulados inteiros)
+        u4 index = (u4) (cardStart - heap.base) / HEAP_Alignment;
+        while (!(heap.blockStarts[index / 8] & (1 << (index % 8)))) {
+            if (index % 8 == 0) while (heap.blockStarts[index / 8 - 1] == 0) index -= 8;
+            index--;
+        }
+
+        for (u1* address = heap.base + index * HEAP_Alignment; address < cardEnd; ) {
+            HeapBlock* block = (HeapBlock*) address;
+            visitBlockSlots(block, cardStart, cardEnd, scavengeSlot);
+            address += block->size;
+        }
+
+        //Os blocos copiados a partir do cartao sao percorridos antes do proximo cartao
+        processScavengeStack();
+    }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que atualiza os campos de referencia dos cartoes marcados dos arrays de referencias do
+ * espaco de objetos grandes. Cada objeto grande comeca em uma pagina propria, portanto um cartao
+ * nunca eh compartilhado entre dois deles.
+ */
+static void scavengeLargeObjects(){
+
+    for (u1* address = heap.end; address < heap.largeTop; address += ((HeapBlock*) address)->size) {
+        HeapBlock* block = (HeapBlock*) address;
+
+        if (block->kind != HEAP_ReferenceArray) continue;
+
+        u4 first = (u4) (address - heap.base) >> HEAP_CardShift;
+        u4 last = (u4) (address + block->size - 1 - heap.base) >> HEAP_CardShift;
+
+        for (u4 card = first; card <= last; card++) {
+            if (!heap.cards[card]) continue;
+
+            u1* cardStart = heap.base + card * (1 << HEAP_CardShift);
+
+            heap.cards[card] = 0;
+            scanningOld = 1;
+            visitBlockSlots(block, cardStart, cardStart + (1 << HEAP_CardShift), scavengeSlot);
+            processScavengeStack();
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que mantem um chunk fixo na geracao jovem: os blocos marcados ficam onde estao e os
+ * demais (nao alcancados ou ja copiados) sao unidos em blocos livres, que nao podem mais ser
+ * alcancados. Quando nenhuma raiz conservadora fixar mais o chunk, os seus blocos vivos sao
+ * copiados como os de qualquer outro chunk jovem e o chunk eh liberado.
+ *
+ * \param index Indice do chunk
+ */
+static void retainPinnedChunk(u4 index){
+
+    u1* chunkStart = heap.base + index * HEAP_TLABSize;
+    u1* chunkEnd = chunkStart + HEAP_TLABSize;
+    u1* freeStart = NULL;
+
+    heap.chunks[index] = HEAP_ChunkYoung;
+
+    for (u1* address = chunkStart; address < chunkEnd; ) {
+        HeapBlock* block = (HeapBlock*) address;
+        u4 size = block->size;
+
+        if (block->flags & HEAP_Marked) {
+            block->flags &= ~HEAP_Marked;
+
+            if (freeStart != NULL) formatBlock(freeStart, (u4) (address - freeStart), HEAP_Free);
+            freeStart = NULL;
+        }
+        else if (freeStart == NULL) {
+            freeStart = address;
+        }
+        else {
+            setBlockStart(block, 0);
+        }
+        address += size;
+    }
+
+    if (freeStart != NULL) formatBlock(freeStart, (u4) (chunkEnd - freeStart), HEAP_Free);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que executa a coleta da geracao jovem. Os blocos jovens alcancados por campos de
+ * referencia (de objetos, arrays, frames com mapa de referencias, campos estaticos e cartoes
+ * marcados da geracao velha e do espaco de objetos grandes) sao copiados; os chunks referenciados
+ * por raizes conservadoras ficam fixos e continuam na geracao jovem. Os demais chunks jovens sao
+ * liberados, portanto o custo eh proporcional aos sobreviventes.
+ */
+static void collectYoungGeneration(){
+
+    Environment* environment = heap.environment;
+    u4 youngBefore = heap.youngChunks;
+    u4 pinnedChunks = 0;
+    u8 start = nowMicros();
+
+    //Salvamos os registradores na pilha nativa, para que sejam percorridos como raizes
+    __builtin_unwind_init();
+
+    retireTLAB(environment->thread);
+
+    survivorTop = survivorEnd = NULL;
+    survivorChunks = 0;
+    promotedBytes = 0;
+
+    //Raizes conservadoras fixam os seus chunks
+    visitThreadRoots(environment->thread, pinYoungReference, NULL);
+    visitNativeStackRoots(pinYoungReference);
+
+    //Referencias exatas dos frames, dos campos estaticos e da geracao velha para a jovem
+    scanningOld = 0;
+    visitThreadRoots(environment->thread, NULL, scavengeSlot);
+    scavengeStaticRoots(environment->methodArea);
+    processScavengeStack();
+    scavengeDirtyCards();
+    scavengeLargeObjects();
+
+    if (survivorTop < survivorEnd)
+        formatBlock(survivorTop, (u4) (survivorEnd - survivorTop), HEAP_Free);
+
+    //Chunks jovens nao fixos sao liberados; os chunks de sobreviventes formam a nova geracao jovem
+    u4 chunkCount = (u4) (heap.top - heap.base) / HEAP_TLABSize;
+    for (u4 i = 0; i < chunkCount; i++) {
+        if (heap.chunks[i] == HEAP_ChunkYoung) releaseChunk(i);
+        else if (heap.chunks[i] == HEAP_ChunkSurvivor) heap.chunks[i] = HEAP_ChunkYoung;
+        else if (heap.chunks[i] == HEAP_ChunkPinned) {
+            retainPinnedChunk(i);
+            pinnedChunks++;
+        }
+    }
+    heap.youngChunks = survivorChunks + pinnedChunks;
+    heap.minorCollections++;
+
+    double pause = recordPause(start);
+
+    //A marcacao inicial da geracao velha aproveita o fim da coleta jovem, quando a geracao jovem
+    // contem somente os sobreviventes
+    u1 startMarking = !heap.marking && (heap.oldUsed > heap.oldTrigger || heap.oldTrigger == 0);
+
+    if (heap.options.verbose) {
+        fprintf(stderr, "[GC (jovem) #%u: %uK->%uK, %uK promovidos, %u chunks fixos, %.3f ms]\n",
+                heap.minorCollections, youngBefore * HEAP_TLABSize / 1024,
+                heap.youngChunks * HEAP_TLABSize / 1024, promotedBytes / 1024, pinnedChunks, pause);
+    }
+
+    if (startMarking) startMarkingCycle();
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// SUBMODULO: Descarregamento de classes
+//--------------------------------------------------------------------------------------------------
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que verifica se o descarregamento de uma classe seria observavel caso ela fosse carregada
+ * novamente: o inicializador estatico seria executado outra vez e os campos estaticos que nao sao
+ * constantes perderiam os seus valores. Como a JVM tem um unico carregador de classes, essas
+ * classes nunca sao descarregadas.
+ *
+ * \param javaClass Classe carregada
+ * \return Diferente de zero se a classe deve permanecer carregada
+ */
+static u1 isClassReloadObservable(JavaClass* javaClass){
+
+    ArqClass* arqClass = javaClass->arqClass;
+
+    if (getMethodInfoFromClass(javaClass, internString("<clinit>"), internString("()V")) != NULL)
+        return 1;
+
+    for (u2 i = 0; i < arqClass->fields_count; i++) {
+        u2 flags = arqClass->fields[i].access_flags;
+        if ((flags & ACC_STATIC) && !(flags & ACC_FINAL)) return 1;
+    }
+
+    return 0;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que verifica se um endereco aponta para as estruturas de uma classe: a JavaClass, a
+ * ArqClass, o arquivo mapeado com o codigo ou a arena com os metadados e os campos estaticos.
+ *
+ * \param javaClass Classe carregada
+ * \param address Endereco a ser verificado
+ * \return Diferente de zero se o endereco pertence a classe
+ */
+static u1 isClassAddress(JavaClass* javaClass, u1* address){
+
+    ArqClass* arqClass = javaClass->arqClass;
+
+    if (address >= (u1*) javaClass && address < (u1*) (javaClass + 1)) return 1;
+    if (address >= (u1*) arqClass && address < (u1*) (arqClass + 1)) return 1;
+    //Bytecodes e atributos apontam para o arquivo mapeado
+    if (address >= arqClass->image && address < arqClass->image + arqClass->imageSize) return 1;
+
+    return arenaContains(arqClass->arena, address);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que marca a classe para cujas estruturas um valor da pilha nativa aponta. Um valor que
+ * aponta para uma entrada resolvida marca tambem a classe referenciada pela entrada. O metodo eh
+ * chamado pelo percurso da pilha, portanto os seus frames ficam abaixo da regiao percorrida.
+ *
+ * \param methodArea Area de metodos com as classes carregadas
+ * \param address Valor da pilha nativa, tratado como um possivel ponteiro
+ */
+static void __attribute__((noinline)) markClassAddress(MethodArea* methodArea, u1* address){
+
+    for (int i = 0; i < methodArea->classCount; i++) {
+        JavaClass* javaClass = methodArea->classTable[i].javaClass;
+        u1* pool = (u1*) javaClass->resolvedPool;
+
+        if (address >= pool && address < pool + javaClass->arqClass->constant_pool_count *
+                                                sizeof(ResolvedPoolEntry)) {
+            ResolvedPoolEntry* entry =
+                &javaClass->resolvedPool[(address - pool) / sizeof(ResolvedPoolEntry)];
+
+            javaClass->marked = 1;
+            if (entry->javaClass != NULL) entry->javaClass->marked = 1;
+        }
+        else if (!javaClass->marked && isClassAddress(javaClass, address)) {
+            javaClass->marked = 1;
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que marca as classes referenciadas pela pilha nativa. Um metodo da JVM interrompido pela
+ * coleta pode guardar ponteiros para as estruturas de uma classe que ainda nao tem objetos nem
+ * frames (por exemplo, durante a alocacao do seu primeiro objeto). Como na busca de raizes, cada
+ * palavra alinhada eh tratada como um possivel ponteiro. Deve ser chamado no inicio da coleta,
+ * antes que os metodos do coletor deixem ponteiros para classes na pilha.
+ *
+ * \param methodArea Area de metodos com as classes carregadas
+ */
+static void __attribute__((noinline)) markNativeStackClasses(MethodArea* methodArea){
+
+    u1 stackTop;
+
+    for (u1** slot = (u1**) ((uintptr_t) &stackTop & ~(uintptr_t) (sizeof(u1*) - 1));
+         (u1*) (slot + 1) <= heap.stackBase; slot++)
+        markClassAddress(methodArea, *slot);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que marca, apos a marcacao da coleta completa, as classes que devem permanecer
+ * carregadas. As classes referenciadas pela pilha nativa e as classes dos objetos alcancados ja
+ * foram marcadas; sao marcadas tambem as classes dos frames e dos objetos locais dos frames, as
+ * classes cujo recarregamento seria observavel e as superclasses das classes marcadas. Enquanto
+ * alguma classe esta sendo carregada (ou com -XX:-ClassUnloading) todas as classes sao marcadas.
+ *
+ * \return Numero de classes nao marcadas, que serao descarregadas
+ */
+static u4 markLiveClasses(){
+
+    Environment* environment = heap.environment;
+    MethodArea* methodArea = environment->methodArea;
+    Thread* thread = environment->thread;
+    u4 unmarked = 0;
+
+    for (VMStack* stack = thread->vmStack; stack != NULL; stack = stack->next)
+        if (stack->top != NULL && stack->top->javaClass != NULL) stack->top->javaClass->marked = 1;
+
+    for (u1* address = thread->localBase; address < thread->localTop;
+         address += ((HeapBlock*) address)->size) {
+        HeapBlock* block = (HeapBlock*) address;
+        if (block->kind == HEAP_Object) ((Object*) (block + 1))->javaClass->marked = 1;
+    }
+
+    for (int i = 0; i < methodArea->classCount; i++) {
+        JavaClass* javaClass = methodArea->classTable[i].javaClass;
+
+        if (heap.options.noClassUnloading || environment->loadingClasses > 0 ||
+            isClassReloadObservable(javaClass))
+            javaClass->marked = 1;
+
+        if (!javaClass->marked) unmarked++;
+    }
+
+    if (unmarked == 0) return 0;
+
+    //Uma classe marcada mantem carregadas as suas superclasses
+    for (int i = 0; i < methodArea->classCount; i++) {
+        JavaClass* javaClass = methodArea->classTable[i].javaClass;
+
+        if (!javaClass->marked) continue;
+
+        for (JavaClass* superClass = javaClass->superClass; superClass && !superClass->marked;
+             superClass = superClass->superClass)
+            superClass->marked = 1;
+    }
+
+    unmarked = 0;
+    for (int i = 0; i < methodArea->classCount; i++)
+        if (!methodArea->classTable[i].javaClass->marked) unmarked++;
+
+    return unmarked;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que descarrega as classes que nao foram marcadas e desfaz a marca das demais.
+ *
+ * \return Numero de classes descarregadas
+ */
+static u4 unloadClasses(){
+
+    MethodArea* methodArea = heap.environment->methodArea;
+    u4 unloaded = 0;
+
+    //A area de metodos eh percorrida do fim, pois cada descarregamento desloca as classes seguintes
+    for (int i = methodArea->classCount - 1; i >= 0; i--) {
+        JavaClass* javaClass = methodArea->classTable[i].javaClass;
+
+        if (javaClass->marked) {
+            javaClass->marked = 0;
+            continue;
+        }
+
+        unloadJavaClass(javaClass, methodArea);
+        unloaded++;
+    }
+
+    return unloaded;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// SUBMODULO: Coleta completa (marcacao e compactacao)
+//--------------------------------------------------------------------------------------------------
+
+static ptrdiff_t blockDisplacement = 0; //!< Deslocamento do bloco cujos campos sao atualizados
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que marca o bloco referenciado por um valor, caso o valor seja o endereco do conteudo de
+ * um bloco do heap.
+ *
+ * \param value Valor que pode ser uma referencia para o heap
+ */
+static void markReference(u4 value){
+
+    HeapBlock* block = findBlock(value);
+
+    if (block == NULL || (block->flags & HEAP_Marked)) return;
+
+    block->flags |= HEAP_Marked;
+    pushGray(&grayStack, block);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que recebe uma raiz conservadora da coleta completa. Como o valor pode nao ser uma
+ * referencia, ele nao pode ser atualizado: o bloco referenciado eh marcado e fixado, e a
+ * compactacao nao o move.
+ *
+ * \param value Valor que pode ser uma referencia para o heap
+ */
+static void pinReference(u4 value){
+
+    HeapBlock* block = findBlock(value);
+
+    if (block == NULL) return;
+
+    block->flags |= HEAP_Pinned;
+
+    if (block->flags & HEAP_Marked) return;
+
+    block->flags |= HEAP_Marked;
+    pushGray(&grayStack, block);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que marca o bloco referenciado por um campo de referencia.
+ *
+ * \param slot Endereco do campo
+ */
+static void markSlot(u4* slot){
+
+    markReference(*slot);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que percorre o conteudo dos blocos marcados, marcando os blocos que eles referenciam,
+ * ate que a pilha de marcacao se esvazie.
+ */
+static void processMarkStack(){
+
+    while (grayStack.top > 0) {
+        HeapBlock* block = grayStack.blocks[--grayStack.top];
+        visitBlockSlots(block, (u1*) block, (u1*) block + block->size, markSlot);
+
+        //A classe de um objeto alcancado nao pode ser descarregada
+        if (block->kind == HEAP_Object) ((Object*) (block + 1))->javaClass->marked = 1;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que varre um chunk da geracao jovem na coleta completa: os blocos sao desmarcados e, se
+ * nenhum deles foi alcancado, o chunk eh liberado. Os demais blocos jovens nao alcancados sao
+ * liberados com o seu chunk na proxima coleta da geracao jovem.
+ *
+ * \param index Indice do chunk
+ */
+static void sweepYoungChunk(u4 index){
+
+    u1* chunkStart = heap.base + index * HEAP_TLABSize;
+    u1 live = 0;
+
+    for (u1* address = chunkStart; address < chunkStart + HEAP_TLABSize; ) {
+        HeapBlock* block = (HeapBlock*) address;
+
+        if (block->flags & HEAP_Marked) {
+            block->flags &= ~(HEAP_Marked | HEAP_Pinned);
+            live = 1;
+        }
+        //Os objetos nao alcancados das classes que serao descarregadas deixam de ser objetos
+        else if (block->kind == HEAP_Object && !((Object*) (block + 1))->javaClass->marked) {
+            block->kind = HEAP_Free;
+        }
+        address += block->size;
+    }
+
+    if (live) heap.youngChunks++;
+    else releaseChunk(index);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que calcula o destino dos blocos vivos da geracao velha. Cada sequencia de chunks
+ * contiguos da geracao velha eh compactada em direcao ao seu inicio: os blocos fixos ficam onde
+ * estao e os blocos seguintes deslizam ate o fim deles. Para cada cartao eh guardado o destino do
+ * primeiro bloco que comeca nele; o destino dos demais eh obtido percorrendo o cartao.
+ */
+static void planCompaction(){
+
+    u1* cursor = NULL;
+    u4 lastCard = UINT32_MAX;
+    u1* address = heap.base;
+
+    while (address < heap.top) {
+        u4 index = chunkIndex(address);
+
+        //Chunks livres e jovens encerram a sequencia de chunks da geracao velha
+        if (heap.chunks[index] != HEAP_ChunkOld) {
+            cursor = NULL;
+            address = heap.base + (index + 1) * HEAP_TLABSize;
+            continue;
+        }
+        if (cursor == NULL) cursor = address;
+
+        HeapBlock* block = (HeapBlock*) address;
+        u4 card = (u4) (address - heap.base) >> HEAP_CardShift;
+
+        if (card != lastCard) {
+            heap.forwarding[card] = (u4) (cursor - heap.base);
+            lastCard = card;
+        }
+
+        if (block->flags & HEAP_Pinned) cursor = address + block->size;
+        else if (block->flags & HEAP_Marked) cursor += block->size;
+
+        address += block->size;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que retorna o destino de um bloco vivo da geracao velha: a partir do destino do primeiro
+ * bloco que comeca no seu cartao, os blocos vivos anteriores do cartao sao somados.
+ *
+ * \param block Bloco vivo da geracao velha
+ * \return Endereco de destino do bloco
+ */
+static u1* forwardingAddress(HeapBlock* block){
+
+    if (block->flags & HEAP_Pinned) return (u1*) block;
+
+    u4 card = (u4) ((u1*) block - heap.base) >> HEAP_CardShift;
+    u1* cursor = heap.base + heap.forwarding[card];
+    u4 index = (card << HEAP_CardShift) / HEAP_Alignment;
+
+    //Primeiro bloco que comeca no cartao
+    while (!(heap.blockStarts[index / 8] & (1 << (index % 8)))) index++;
+
+    for (u1* address = heap.base + index * HEAP_Alignment; address < (u1*) block; ) {
+        HeapBlock* previous = (HeapBlock*) address;
+
+        if (previous->flags & HEAP_Pinned) cursor = address + previous->size;
+        else if (previous->flags & HEAP_Marked) cursor += previous->size;
+
+        address += previous->size;
+    }
+
+    return cursor;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que atualiza um campo de referencia para o destino do bloco referenciado. Se o campo
+ * pertence a geracao velha e referencia a jovem, o cartao do seu endereco de destino eh marcado.
+ *
+ * \param slot Endereco do campo
+ */
+static void forwardSlot(u4* slot){
+
+    HeapBlock* block = findBlock(*slot);
+
+    if (block == NULL) return;
+
+    if (chunkKind(block) == HEAP_ChunkOld) {
+        *slot = encodeReference(forwardingAddress(block) + sizeof(HeapBlock));
+    }
+    else if (scanningOld) {
+        heap.cards[(u4) ((u1*) slot + blockDisplacement - heap.base) >> HEAP_CardShift] = 1;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que atualiza, antes da movimentacao, todas as referencias para os blocos da geracao velha:
+ * campos dos blocos vivos (jovens, velhos e grandes), raizes exatas dos frames e campos estaticos.
+ * As raizes conservadoras so referenciam blocos fixos, que nao mudam de endereco. Os cartoes da
+ * geracao velha sao refeitos para os enderecos de destino.
+ *
+ * \param methodArea Area de metodos com as classes carregadas
+ */
+static void updateReferences(MethodArea* methodArea){
+
+    memset(heap.cards, 0, (u4) (heap.largeEnd - heap.base) >> HEAP_CardShift);
+
+    scanningOld = 0;
+    visitThreadRoots(heap.environment->thread, NULL, forwardSlot);
+    visitStaticRoots(methodArea, forwardSlot);
+
+    for (u1* address = heap.base; address < heap.top; ) {
+        u4 index = chunkIndex(address);
+
+        if (heap.chunks[index] != HEAP_ChunkOld && heap.chunks[index] != HEAP_ChunkYoung) {
+            address = heap.base + (index + 1) * HEAP_TLABSize;
+            continue;
+        }
+
+        HeapBlock* block = (HeapBlock*) address;
+
+        if (block->flags & HEAP_Marked) {
+            scanningOld = heap.chunks[index] == HEAP_ChunkOld;
+            blockDisplacement = scanningOld ? forwardingAddress(block) - address : 0;
+            visitBlockSlots(block, address, address + block->size, forwardSlot);
+        }
+        address += block->size;
+    }
+
+    //Os objetos grandes nao sao movidos
+    scanningOld = 1;
+    blockDisplacement = 0;
+
+    for (u1* address = heap.end; address < heap.largeTop; address += ((HeapBlock*) address)->size) {
+        HeapBlock* block = (HeapBlock*) address;
+
+        if (block->flags & HEAP_Marked)
+            visitBlockSlots(block, address, address + block->size, forwardSlot);
+    }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que move os blocos vivos da geracao velha para os seus destinos, na ordem dos enderecos
+ * (o destino de um bloco nunca passa do seu endereco atual). Os espacos antes dos blocos fixos e
+ * o fim de cada sequencia de chunks viram blocos livres, e os chunks que ficaram inteiramente
+ * livres voltam para a pilha de chunks livres. Os chunks jovens e o espaco de objetos grandes sao
+ * varridos.
+ *
+ * \return Numero de bytes movidos
+ */
+static u4 compact(){
+
+    u1* cursor = NULL;
+    u1* address = heap.base;
+    u4 movedBytes = 0;
+
+    memset(heap.freeLists, 0, sizeof(heap.freeLists));
+    heap.largeFreeList = NULL;
+    heap.oldUsed = 0;
+    heap.youngChunks = 0;
+
+    while (address < heap.top) {
+        u4 index = chunkIndex(address);
+
+        if (heap.chunks[index] != HEAP_ChunkOld) {
+            if (cursor != NULL && cursor < address) addFreeRange(cursor, address);
+            cursor = NULL;
+
+            if (heap.chunks[index] == HEAP_ChunkYoung) sweepYoungChunk(index);
+
+            address = heap.base + (index + 1) * HEAP_TLABSize;
+            continue;
+        }
+        if (cursor == NULL) cursor = address;
+
+        HeapBlock* block = (HeapBlock*) address;
+        u4 size = block->size;
+
+        //Blocos nao alcancados deixam de existir; os vivos sao refeitos no destino
+        setBlockStart(block, 0);
+
+        if (block->flags & HEAP_Pinned) {
+            if (cursor < address) addFreeRange(cursor, address);
+
+            block->flags &= ~(HEAP_Marked | HEAP_Pinned);
+            setBlockStart(block, 1);
+            cursor = address + size;
+            heap.oldUsed += size;
+        }
+        else if (block->flags & HEAP_Marked) {
+            HeapBlock* moved = (HeapBlock*) cursor;
+
+            //O destino pode se sobrepor ao proprio bloco
+            if (cursor != address) {
+                memmove(moved, block, size);
+                movedBytes += size;
+            }
+            moved->flags &= ~HEAP_Marked;
+            setBlockStart(moved, 1);
+            cursor += size;
+            heap.oldUsed += size;
+        }
+        address += size;
+    }
+
+    if (cursor != NULL && cursor < address) addFreeRange(cursor, address);
+
+    sweepLargeObjects();
+
+    return movedBytes;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+void collectGarbage(){
+
+    if (heap.options.noGC) return;
+
+    Environment* environment = heap.environment;
+    u4 usedBefore = heap.oldUsed;
+    u8 start = nowMicros();
+
+    //Salvamos os registradores na pilha nativa, para que sejam percorridos como raizes
+    __builtin_unwind_init();
+
+    //Ponteiros para as estruturas das classes mantem as classes carregadas
+    if (!heap.options.noClassUnloading) markNativeStackClasses(environment->methodArea);
+
+    //O restante do TLAB vira um bloco livre para que o heap possa ser percorrido
+    retireTLAB(environment->thread);
+
+    //A coleta completa marca tambem a geracao jovem, que a marcacao incremental nao percorre
+    if (heap.marking) abortMarkingCycle();
+
+    //Marcacao: as raizes conservadoras fixam os blocos que referenciam
+    visitThreadRoots(environment->thread, pinReference, markSlot);
+    visitNativeStackRoots(pinReference);
+    visitStaticRoots(environment->methodArea, markSlot);
+    processMarkStack();
+    markLiveClasses();
+
+    //Compactacao
+    planCompaction();
+    updateReferences(environment->methodArea);
+    u4 movedBytes = compact();
+    heap.collections++;
+
+    //As classes sem objetos, frames e subclasses vivos sao descarregadas apos a varredura
+    u4 unloadedClasses = unloadClasses();
+
+    updateOldTrigger();
+
+    double pause = recordPause(start);
+
+    if (heap.options.verbose) {
+        fprintf(stderr, "[GC (completa) #%u: %uK->%uK (%uK), %uK movidos, %u chunks jovens, "
+                "%u classes descarregadas, %.3f ms]\n", heap.collections, usedBefore / 1024,
+                heap.oldUsed / 1024, (u4) (heap.committed - heap.base) / 1024, movedBytes / 1024,
+                heap.youngChunks, unloadedClasses, pause);
+    }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// SUBMODULO: Marcacao incremental da geracao velha
+//--------------------------------------------------------------------------------------------------
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que marca o bloco da geracao velha (ou objeto grande) referenciado por um valor e o
+ * empilha na pilha da marcacao incremental. Referencias para a geracao jovem sao ignoradas: a
+ * geracao jovem eh percorrida por inteiro na remarcacao.
+ *
+ * \param value Valor que pode ser uma referencia para o heap
+ */
+static void shadeReference(u4 value){
+
+    HeapBlock* block = findBlock(value);
+
+    if (block == NULL || (block->flags & HEAP_Marked)) return;
+
+    if (chunkKind(block) != HEAP_ChunkOld && chunkKind(block) != HEAP_ChunkLarge) return;
+
+    block->flags |= HEAP_Marked;
+    pushGray(&markStack, block);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que marca o bloco da geracao velha referenciado por um campo de referencia.
+ *
+ * \param slot Endereco do campo
+ */
+static void shadeSlot(u4* slot){
+
+    shadeReference(*slot);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que marca um bloco alocado na geracao velha ou no espaco de objetos grandes durante a
+ * marcacao. O bloco nasce sem referencias e nao eh empilhado: as referencias escritas nele depois
+ * passam pela barreira de escrita, que marca os blocos referenciados.
+ *
+ * \param block Bloco recem alocado
+ */
+static void shadeNewOldBlock(HeapBlock* block){
+
+    if (heap.marking) block->flags |= HEAP_Marked;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que marca um bloco promovido para a geracao velha durante a marcacao. Ao contrario de um
+ * bloco alocado, a copia ja contem referencias, que nao passaram pela barreira de escrita; por isso
+ * o bloco eh empilhado para ser percorrido.
+ *
+ * \param block Copia promovida
+ */
+static void shadePromotedBlock(HeapBlock* block){
+
+    if (!heap.marking) return;
+
+    block->flags |= HEAP_Marked;
+    pushGray(&markStack, block);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que marca os blocos da geracao velha referenciados pelas raizes: frames, pilha nativa e
+ * campos estaticos. Os registradores ja devem ter sido salvos na pilha pelo chamador.
+ */
+static void shadeRoots(){
+
+    visitThreadRoots(heap.environment->thread, shadeReference, shadeSlot);
+    visitNativeStackRoots(shadeReference);
+    visitStaticRoots(heap.environment->methodArea, shadeSlot);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que marca os blocos da geracao velha referenciados por qualquer bloco da geracao jovem,
+ * alcancavel ou nao. Blocos jovens inalcancaveis mantem vivos os seus referenciados ate o proximo
+ * ciclo.
+ */
+static void shadeYoungGeneration(){
+
+    u4 chunkCount = (u4) (heap.top - heap.base) / HEAP_TLABSize;
+
+    for (u4 i = 0; i < chunkCount; i++) {
+        if (heap.chunks[i] != HEAP_ChunkYoung) continue;
+
+        u1* chunkStart = heap.base + i * HEAP_TLABSize;
+
+        for (u1* address = chunkStart; address < chunkStart + HEAP_TLABSize; ) {
+            HeapBlock* block = (HeapBlock*) address;
+            visitBlockSlots(block, address, address + block->size, shadeSlot);
+            address += block->size;
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que percorre blocos da pilha da marcacao incremental ate esvaziar a pilha ou atingir o
+ * limite de bytes recebido. Blocos sem referencias (arrays de tipo primitivo e caracteres) nao tem
+ * conteudo a percorrer e contam somente o cabecalho.
+ *
+ * \param limit Numero maximo de bytes percorridos
+ */
+static void drainMarkStack(u4 limit){
+
+    u4 scanned = 0;
+
+    while (markStack.top > 0 && scanned < limit) {
+        HeapBlock* block = markStack.blocks[--markStack.top];
+        visitBlockSlots(block, (u1*) block, (u1*) block + block->size, shadeSlot);
+        
+        if (block->kind == HEAP_Array || block->kind == HEAP_StringData)
+            scanned += sizeof(HeapBlock);
+        else
+            scanned += block->size;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que inicia um ciclo de marcacao incremental da geracao velha (pausa de marcacao inicial):
+ * somente as raizes e os sobreviventes da geracao jovem sao percorridos; o restante do grafo eh
+ * percorrido em passos intercalados com a execucao do programa.
+ */
+static void startMarkingCycle(){
+
+    u8 start = nowMicros();
+
+    //Salvamos os registradores na pilha nativa, para que sejam percorridos como raizes
+    __builtin_unwind_init();
+
+    heap.marking = 1;
+    shadeRoots();
+    shadeYoungGeneration();
+
+    double pause = recordPause(start);
+
+    if (heap.options.verbose) {
+        fprintf(stderr, "[GC (marcacao inicial) #%u: %uK ocupados, %u blocos cinzas, %.3f ms]\n",
+                heap.markingCycles + 1, heap.oldUsed / 1024, markStack.top, pause);
+    }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que percorre o heap da base ate o topo, desmarcando os blocos marcados e unindo os blocos
+ * nao marcados vizinhos da geracao velha em blocos livres. As listas de blocos livres sao refeitas
+ * e os chunks que ficaram inteiramente livres voltam para a pilha de chunks livres. Em seguida o
+ * espaco de objetos grandes eh varrido.
+ */
+static void sweep(){
+
+    u1* freeStart = NULL;
+    u1* address = heap.base;
+
+    memset(heap.freeLists, 0, sizeof(heap.freeLists));
+    heap.largeFreeList = NULL;
+    heap.oldUsed = 0;
+    heap.youngChunks = 0;
+
+    while (address < heap.top) {
+        u4 index = chunkIndex(address);
+
+        //Chunks livres e jovens encerram o bloco livre anterior
+        if (heap.chunks[index] != HEAP_ChunkOld) {
+            if (freeStart != NULL) addFreeRange(freeStart, address);
+            freeStart = NULL;
+
+            if (heap.chunks[index] == HEAP_ChunkYoung) heap.youngChunks++;
+
+            address = heap.base + (index + 1) * HEAP_TLABSize;
+            continue;
+        }
+
+        HeapBlock* block = (HeapBlock*) address;
+        u4 size = block->size;
+
+        if (block->flags & HEAP_Marked) {
+            block->flags &= ~HEAP_Marked;
+            heap.oldUsed += size;
+
+            if (freeStart != NULL) addFreeRange(freeStart, address);
+            freeStart = NULL;
+        }
+        else if (freeStart == NULL) {
+            freeStart = address;
+        }
+        else {
+            //O bloco passa a fazer parte do bloco livre anterior
+            setBlockStart(block, 0);
+        }
+        address += size;
+    }
+
+    if (freeStart != NULL) addFreeRange(freeStart, address);
+
+    sweepLargeObjects();
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que conclui o ciclo de marcacao incremental (pausa de remarcacao). As raizes e a geracao
+ * jovem sao percorridas novamente, pois nao possuem barreira de escrita que acompanhe a marcacao;
+ * em seguida a geracao velha eh varrida.
+ */
+static void finishMarkingCycle(){
+
+    Environment* environment = heap.environment;
+    u4 usedBefore = heap.oldUsed;
+    u8 start = nowMicros();
+
+    //Salvamos os registradores na pilha nativa, para que sejam percorridos como raizes
+    __builtin_unwind_init();
+
+    retireTLAB(environment->thread);
+
+    shadeRoots();
+    shadeYoungGeneration();
+    drainMarkStack(UINT32_MAX);
+    heap.marking = 0;
+
+    //Varredura da geracao velha
+    sweep();
+    heap.markingCycles++;
+
+    updateOldTrigger();
+
+    double pause = recordPause(start);
+
+    if (heap.options.verbose) {
+        fprintf(stderr, "[GC (remarcacao) #%u: %uK->%uK (%uK), %.3f ms]\n", heap.markingCycles,
+                usedBefore / 1024, heap.oldUsed / 1024, (u4) (heap.committed - heap.base) / 1024,
+                pause);
+    }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que executa um passo da marcacao incremental, percorrendo no maximo HEAP_MarkStepBytes.
+ * Quando a pilha de marcacao se esvazia, o ciclo eh concluido.
+ */
+static void markStep(){
+
+    u8 start = nowMicros();
+
+    drainMarkStack(HEAP_MarkStepBytes);
+
+    if (markStack.top > 0) recordPause(start);
+    else finishMarkingCycle();
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que descarta o ciclo de marcacao incremental em andamento, desmarcando os blocos da
+ * geracao velha e os objetos grandes, para que a coleta completa marque o heap a partir das raizes.
+ */
+static void abortMarkingCycle(){
+
+    heap.marking = 0;
+    markStack.top = 0;
+
+    for (u1* address = heap.base; address < heap.top; ) {
+        u4 index = chunkIndex(address);
+
+        if (heap.chunks[index] != HEAP_ChunkOld) {
+            address = heap.base + (index + 1) * HEAP_TLABSize;
+            continue;
+        }
+
+        HeapBlock* block = (HeapBlock*) address;
+        block->flags &= ~HEAP_Marked;
+        address += block->size;
+    }
+
+    for (u1* address = heap.end; address < heap.largeTop; address += ((HeapBlock*) address)->size)
+        ((HeapBlock*) address)->flags &= ~HEAP_Marked;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// SUBMODULO: Percurso e censo do heap
+//--------------------------------------------------------------------------------------------------
+
+typedef void (*BlockVisitor)(HeapBlock* block, void* data); //!< Recebe cada bloco ocupado do heap
+
+
+//--------------------------------------------------------------------------------------------------
+//! Estrutura de uma linha do censo do heap
+typedef struct CensusEntry{
+    char* name; //!< Classe ou tipo de array
+    u4 count; //!< Numero de instancias
+    u8 bytes; //!< Bytes ocupados (incluindo os cabecalhos dos blocos)
+} CensusEntry;
+
+
+//--------------------------------------------------------------------------------------------------
+//! Estrutura do censo do heap
+/*!
+ * Linhas do censo: uma para cada classe da area de metodos (no indice da classe), seguidas de uma
+ * para cada tipo de array (T_BOOLEAN a T_REFERENCE) e de uma para as strings.
+ */
+typedef struct HeapCensus{
+    CensusEntry* rows; //!< Linhas do censo
+    u4 rowCount; //!< Numero de linhas
+    int lastClass; //!< Indice da ultima classe encontrada (objetos seguidos costumam repeti-la)
+} HeapCensus;
+
+
+//--------------------------------------------------------------------------------------------------
+//! Estrutura dos parametros do percurso de objetos
+typedef struct ObjectWalk{
+    JavaClass* javaClass; //!< Classe procurada (nulo para todas)
+    ObjectVisitor visit; //!< Funcao chamada para cada objeto
+    void* data; //!< Dado repassado para a funcao
+} ObjectWalk;
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que percorre os blocos ocupados do heap: os chunks jovens e velhos (o TLAB da thread eh
+ * descartado antes, para que todo chunk seja uma sequencia de blocos) e o espaco de objetos
+ * grandes.
+ *
+ * \param visit Funcao chamada para cada bloco
+ * \param data Dado repassado para a funcao
+ */
+static void walkBlocks(BlockVisitor visit, void* data){
+
+    retireTLAB(heap.environment->thread);
+
+    for (u1* address = heap.base; address < heap.top; ) {
+        u4 index = chunkIndex(address);
+
+        if (heap.chunks[index] != HEAP_ChunkOld && heap.chunks[index] != HEAP_ChunkYoung) {
+            address = heap.base + (index + 1) * HEAP_TLABSize;
+            continue;
+        }
+
+        HeapBlock* block = (HeapBlock*) address;
+
+        if (block->kind != HEAP_Free) visit(block, data);
+        address += block->size;
+    }
+
+    for (u1* address = heap.end; address < heap.largeTop; address += ((HeapBlock*) address)->size) {
+        HeapBlock* block = (HeapBlock*) address;
+
+        if (block->kind != HEAP_Free) visit(block, data);
+    }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que repassa um bloco do percurso de objetos para o visitante, se for um objeto da classe
+ * procurada.
+ *
+ * \param block Bloco ocupado do heap
+ * \param data Parametros do percurso (ObjectWalk)
+ */
+static void visitObjectBlock(HeapBlock* block, void* data){
+
+    ObjectWalk* walk = (ObjectWalk*) data;
+    Object* object = (Object*) (block + 1);
+
+    if (block->kind != HEAP_Object) return;
+    if (walk->javaClass != NULL && object->javaClass != walk->javaClass) return;
+
+    walk->visit(object, walk->data);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+void heapWalkObjects(JavaClass* javaClass, ObjectVisitor visit, void* data){
+
+    ObjectWalk walk = {javaClass, visit, data};
+
+    walkBlocks(visitObjectBlock, &walk);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que conta um bloco na linha do censo correspondente ao seu conteudo.
+ *
+ * \param block Bloco ocupado do heap
+ * \param data Censo em construcao (HeapCensus)
+ */
+static void countBlock(HeapBlock* block, void* data){
+
+    HeapCensus* census = (HeapCensus*) data;
+    MethodArea* methodArea = heap.environment->methodArea;
+    u4 row;
+
+    switch (block->kind) {
+        case HEAP_Object: {
+            JavaClass* javaClass = ((Object*) (block + 1))->javaClass;
+
+            if (methodArea->classTable[census->lastClass].javaClass != javaClass) {
+                for (int i = 0; i < methodArea->classCount; i++) {
+                    if (methodArea->classTable[i].javaClass == javaClass) census->lastClass = i;
+                }
+            }
+            row = census->lastClass;
+            break;
+        }
+        case HEAP_Array:
+        case HEAP_ReferenceArray:
+            row = methodArea->classCount + ((JavaArray*) (block + 1))->atype - T_BOOLEAN;
+            break;
+        case HEAP_String:
+            row = census->rowCount - 1;
+            break;
+        case HEAP_StringData:
+            //Os caracteres pertencem a uma string (ou a um StringBuffer): contamos so os bytes
+            census->rows[census->rowCount - 1].bytes += block->size;
+            return;
+        default:
+            return;
+    }
+
+    census->rows[row].count++;
+    census->rows[row].bytes += block->size;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que compara duas linhas do censo para a ordenacao decrescente por bytes ocupados.
+ *
+ * \param a Primeira linha (CensusEntry)
+ * \param b Segunda linha (CensusEntry)
+ * \return Negativo se a primeira ocupa mais bytes, positivo se ocupa menos, zero se iguais
+ */
+static int compareCensusEntries(const void* a, const void* b){
+
+    u8 bytesA = ((const CensusEntry*) a)->bytes;
+    u8 bytesB = ((const CensusEntry*) b)->bytes;
+
+    return bytesA < bytesB ? 1 : bytesA > bytesB ? -1 : 0;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+void printHeapCensus(){
+
+    static char* arrayNames[] = {"[Z", "[C", "[F", "[D", "[B", "[S", "[I", "[J", "[L"};
+
+    if (!heap.options.classHistogram) return;
+
+    MethodArea* methodArea = heap.environment->methodArea;
+    HeapCensus census;
+
+    //So os objetos vivos sao contados. A coleta pode descarregar classes, por isso as linhas do
+    // censo so sao montadas depois dela
+    collectGarbage();
+
+    census.rowCount = methodArea->classCount + T_REFERENCE - T_BOOLEAN + 2;
+    census.rows = (CensusEntry*) calloc(census.rowCount, sizeof(CensusEntry));
+    census.lastClass = 0;
+
+    if (census.rows == NULL) JVMstopAbrupt("Erro de alocacao de memoria para o censo do heap.");
+
+    for (int i = 0; i < methodArea->classCount; i++) {
+        ArqClass* arqClass = methodArea->classTable[i].javaClass->arqClass;
+        census.rows[i].name = getClassNameFromConstantPool(arqClass->constant_pool,
+                                                           arqClass->this_class);
+    }
+    for (u4 i = 0; i <= T_REFERENCE - T_BOOLEAN; i++) {
+        census.rows[methodArea->classCount + i].name = arrayNames[i];
+    }
+    census.rows[census.rowCount - 1].name = "java/lang/String";
+
+    walkBlocks(countBlock, &census);
+
+    qsort(census.rows, census.rowCount, sizeof(CensusEntry), compareCensusEntries);
+
+    u4 totalCount = 0;
+    u8 totalBytes = 0;
+
+    fprintf(stderr, "[Censo: %10s %12s  %s]\n", "instancias", "bytes", "classe");
+    for (u4 i = 0; i < census.rowCount && census.rows[i].bytes > 0; i++) {
+        fprintf(stderr, "[Censo: %10u %12llu  %s]\n", census.rows[i].count,
+                (unsigned long long) census.rows[i].bytes, census.rows[i].name);
+        totalCount += census.rows[i].count;
+        totalBytes += census.rows[i].bytes;
+    }
+    fprintf(stderr, "[Censo: %10u %12llu  total]\n", totalCount, (unsigned long long) totalBytes);
+
+    free(census.rows);
+}
@@ -8,6 +8,7 @@
  *  - Implementar os metodos relacionados a exibicao de um arquivo ".class".
  *  - Implementar os metodos de leitura de arquivos ".class"
  *  - Implementar os metodos relacionados a manutencao de uma estrutura ArqClass
+ *  - Implementar a arena de onde sao alocados os metadados de cada classe
  *  - Implementar os metodos responsaveis pela manipulacao de arquivos
  */
 //##################################################################################################
@@ -24,44 +25,84 @@
 #include <stdlib.h>
 #include "estruturas.h"
 
+#define LECLASS_ArenaFactor 2 //!< Tamanho do 1o bloco da arena, em multiplos do tamanho do arquivo
+#define LECLASS_ArenaSlack  1024 //!< Bytes somados ao 1o bloco (estruturas de tamanho fixo)
+#define LECLASS_ArenaAlign  8 //!< Alinhamento (bytes) dos blocos alocados na arena
+
+//--------------------------------------------------------------------------------------------------
+//! Estrutura do ClassReader
+/*!
+ * Cursor de leitura de um arquivo ".class" mapeado em memoria. Os valores sao lidos diretamente do
+ * mapeamento (big-endian); uma leitura que passaria do fim do arquivo devolve zero e marca o
+ * arquivo como truncado.
+ */
+typedef struct ClassReader{
+    u1* position; //!< Proximo byte a ser lido
+    u1* end; //!< Fim do arquivo mapeado
+    u1 truncated; //!< Alguma leitura passou do fim do arquivo
+} ClassReader;
+
+
 // Funcoes de persistencia do Leitor e Exibidor de ClassFile
 // Interfaces responsaveis por prover os metodos de manipulacao de arquivos ".class".
 
 //--------------------------------------------------------------------------------------------------
 /*!
- * Metodo responsavel por abrir e retornar um arquivo em modo de leitura.
+ * Metodo responsavel por mapear um arquivo em memoria, somente para leitura.
  *
- * \param nome_arquivo Nome ou caminho do arquivo a ser aberto.
+ * \param nome_arquivo Nome ou caminho do arquivo a ser mapeado.
+ * \param tamanho Recebe o numero de bytes do arquivo.
+ * \return Inicio do mapeamento (ou nulo se o arquivo nao pode ser aberto)
  */
-EXTC FILE* obter_entrada(const char * nome_arquivo);
+EXTC u1* mapeia_arquivo(const char* nome_arquivo, u4* tamanho);
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo responsavel por desfazer o mapeamento de um arquivo.
+ *
+ * \param conteudo Inicio do mapeamento (pode ser nulo)
+ * \param tamanho Numero de bytes do arquivo
+ */
+EXTC void libera_arquivo(u1* conteudo, u4 tamanho);
 
 
 //--------------------------------------------------------------------------------------------------
 /*!
  * Le um tipo u1 (8bits) do arquivo.
  *
- * \param arquivo Arquivo no qual sera realizada a leitura.
+ * \param leitor Cursor do arquivo no qual sera realizada a leitura.
  */
-EXTC u1 u1Le(FILE *arquivo);
+EXTC u1 u1Le(ClassReader* leitor);
+
 
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Le um tipo u2 (16bits, big-endian) do arquivo.
+ *
+ * \param leitor Cursor do arquivo no qual sera realizada a leitura.
+ */
+EXTC u2 u2Le(ClassReader* leitor);
 
 
 //--------------------------------------------------------------------------------------------------
 /*!
- * Le um tipo u2 (16bits) do arquivo.
+ * Le um tipo u4 (32bits, big-endian) do arquivo.
  *
- * \param arquivo Arquivo no qual sera realizada a leitura.
+ * \param leitor Cursor do arquivo no qual sera realizada a leitura.
  */
-EXTC u2 u2Le(FILE *arquivo);
+EXTC u4 u4Le(ClassReader* leitor);
 
 
 //--------------------------------------------------------------------------------------------------
 /*!
- * Le um tipo u4 (32bits) do arquivo.
+ * Avanca o cursor sobre uma sequencia de bytes do arquivo, sem copia-los.
  *
- * \param arquivo Arquivo no qual sera realizada a leitura.
+ * \param leitor Cursor do arquivo no qual sera realizada a leitura.
+ * \param tamanho Numero de bytes da sequencia.
+ * \return Inicio da sequencia no mapeamento (valido enquanto o arquivo estiver mapeado)
  */
-EXTC u4 u4Le(FILE *arquivo);
+EXTC u1* bytesLe(ClassReader* leitor, u4 tamanho);
 
 
 // Funcoes de Interface do Leitor e exibidor e .class
@@ -91,13 +132,60 @@ EXTC OPresult LECLASS_exibidor(ArqClass* arq_class);
 
 //--------------------------------------------------------------------------------------------------
 /*!
- * Metodo responsavel por prover o servico de liberacao recursiva de uma estrutura ".class"
+ * Metodo responsavel por prover o servico de liberacao de uma estrutura ".class". Todos os
+ * metadados lidos estao na arena da classe, que eh liberada de uma so vez, os simbolos do pool
+ * de constantes deixam de ser referenciados pela classe e o mapeamento do arquivo eh desfeito.
  *
  * \param arq_class         Estrutura inicializada do tipo ArqClass a ser liberada.
  */
 EXTC void LECLASS_free(ArqClass* arq_class);
 
 
+// Arena de metadados das classes
+// Interfaces responsaveis pela alocacao dos metadados de uma classe em blocos contiguos
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que cria uma arena de metadados com um primeiro bloco do tamanho pedido.
+ *
+ * \param size Numero de bytes do primeiro bloco
+ * \return Arena criada
+ */
+EXTC ClassArena* newClassArena(u4 size);
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que aloca um bloco zerado da arena, alinhado a LECLASS_ArenaAlign bytes. Caso os
+ * blocos da arena estejam cheios, um novo bloco eh encadeado.
+ *
+ * \param arena Arena de onde o bloco eh alocado
+ * \param size Numero de bytes do bloco
+ * \return Ponteiro para o bloco (valido ate a liberacao da arena)
+ */
+EXTC void* arenaAllocate(ClassArena* arena, u4 size);
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que verifica se um endereco pertence a algum dos blocos de uma arena de metadados.
+ *
+ * \param arena Arena a ser consultada
+ * \param address Endereco a ser verificado
+ * \return Diferente de zero se o endereco esta dentro da arena
+ */
+EXTC u1 arenaContains(ClassArena* arena, const void* address);
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que libera todos os blocos de uma arena de metadados.
+ *
+ * \param arena Arena a ser liberada (pode ser nula)
+ */
+EXTC void freeClassArena(ClassArena* arena);
+
+
 //--------------------------------------------------------------------------------------------------
 /*!
  * Metodo responsavel por prover mensagens de resuldados de erro de operacoes do leitor ".class"
@@ -117,7 +205,7 @@ EXTC void LECLASS_exibeErroOperacao(OPresult resultado, const char* fileName);
  * \param index   indice da classe no pool de constantes.
  *  \return        string de char de 16bits (w_char_t).
  */
-EXTC char* getClassNameFromConstantPool(cp_info* cp, u2 index);
+EXTC char* getClassNameFromConstantPool(ConstantPool* cp, u2 index);
 
 
 //--------------------------------------------------------------------------------------------------
@@ -133,7 +221,7 @@ EXTC char* getClassNameFromConstantPool(cp_info* cp, u2 index);
  * \param descriptor Referencia para um vetor de char a receber o descritor do field/metd
  */
 EXTC void getFieldOrMethodInfoAttributesFromConstantPool(u2 index,
-                                                 cp_info* constant_pool,
+                                                 ConstantPool* constant_pool,
                                                  char** class_name,
                                                  char** name,
                                                  char** descriptor);
@@ -146,9 +234,9 @@ EXTC void getFieldOrMethodInfoAttributesFromConstantPool(u2 index,
  *
  * \param cp      ponteiro para o pool de constantes
  * \param index   indice da estrutura UTF8_Info no pool de constantes.
- *  \return        string de char de 16bits (w_char_t).
+ *  \return        string de char de 16bits (w_char_t), compartilhada (nao deve ser liberada).
  */
-EXTC wchar_t * getUnicodeFromConstantPool(cp_info* cp, u2 index);
+EXTC wchar_t * getUnicodeFromConstantPool(ConstantPool* cp, u2 index);
 
 
 //--------------------------------------------------------------------------------------------------
@@ -158,21 +246,60 @@ EXTC wchar_t * getUnicodeFromConstantPool(cp_info* cp, u2 index);
  *
  * \param cp      ponteiro para o pool de constantes
  * \param index   indice da estrutura UTF8_Info no pool de constantes.
- *  \return        string de char de 8bits (char *).
+ *  \return        string de char de 8bits (char *). Eh o endereco canonico do simbolo, podendo
+ *                 ser comparado por igualdade de ponteiros (nao deve ser liberada).
+ */
+EXTC char * getUTF8FromConstantPool(ConstantPool* cp, u2 index);
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que obtem o primeiro indice referenciado por uma entrada Fieldref, Methodref,
+ * InterfaceMethodref (class_index) ou NameAndType (name_index) do pool de constantes.
+ *
+ * \param cp      ponteiro para o pool de constantes
+ * \param index   indice da entrada no pool de constantes.
+ * \return        primeiro indice referenciado pela entrada
+ */
+EXTC u2 getFirstIndexFromConstantPool(ConstantPool* cp, u2 index);
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que obtem o segundo indice referenciado por uma entrada Fieldref, Methodref,
+ * InterfaceMethodref (name_and_type_index) ou NameAndType (descriptor_index) do pool de
+ * constantes.
+ *
+ * \param cp      ponteiro para o pool de constantes
+ * \param index   indice da entrada no pool de constantes.
+ * \return        segundo indice referenciado pela entrada
  */
-EXTC char * getUTF8FromConstantPool(cp_info* cp, u2 index);
+EXTC u2 getSecondIndexFromConstantPool(ConstantPool* cp, u2 index);
 
 
 //--------------------------------------------------------------------------------------------------
 /*!
- * Metodo que, dado uma referencia para um vetor de informacoes de um atributo do tipo code,
- * preenche e retorna uma estrutura
- * CodeAttribute.
+ * Metodo que obtem os 64 bits de uma entrada Long ou Double do pool de constantes.
  *
- * \param info Referencia para o atributo code
- * \return Estrutura codeAttribute preenchida
+ * \param cp      ponteiro para o pool de constantes
+ * \param index   indice da entrada no pool de constantes.
+ * \return        bytes da constante (os mais significativos nos 32 bits superiores)
  */
-EXTC CodeAttribute* parseCode(u1* info);
+EXTC u8 getLongFromConstantPool(ConstantPool* cp, u2 index);
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que, dado um atributo do tipo code, preenche e retorna uma estrutura CodeAttribute. A
+ * estrutura e a sua tabela de excecoes sao alocadas, lado a lado, na arena passada. O codigo
+ * continua apontando para os bytes do atributo.
+ *
+ * \param attribute Atributo code
+ * \param arena Arena de onde a estrutura eh alocada
+ * \return Estrutura codeAttribute preenchida (ou nulo se os tamanhos de codigo e da tabela de
+ *         excecoes nao cabem no atributo)
+ */
+EXTC CodeAttribute* parseCode(attribute_info* attribute, ClassArena* arena);
 
 
 //--------------------------------------------------------------------------------------------------
@@ -211,14 +338,4 @@ EXTC ExceptionAttribute* parseException(u1* info);
 EXTC JavaClass* loadCLass(const char* qualifiedName, Environment* environment);
 
 
-//--------------------------------------------------------------------------------------------------
-/*!
- * Método que aloca todos os espaços de memoria necessarios para os campos de uma classe ou objeto e inicializa os inicializa com os valores default.
- *
- * \param javaClass Referencia para a estrutura de classe com os parametros
- * \param flagsAccept Flags para o tipos de campos aceitos (Ex.: STATIC, FINAL)
- * \param flagsRegect Flags para o tipos de campos rejeitados (Ex.: STATIC, FINAL)
- * \return Estrutura de campos preenchida
- */
-EXTC Fields* classInitializeFields(JavaClass* javaClass, u2 flagsAccept, u2 flagsRegect);
 #endif
\ No newline at end of file
@@ -11,6 +11,7 @@
 #define ESTRUT
 
 #include <stdint.h>
+#include <wchar.h>
 
 //--------------------------------------------------------------------------------------------------
 // Definicoes de sucesso e erro de operacoes
@@ -115,57 +116,90 @@ typedef unsigned short OPresult; //!< Representa o resultado de uma operacao
 typedef  char String[STRING_LENGTH];
 
 
+//--------------------------------------------------------------------------------------------------
+//Tipos de valores dos descritores de campos e metodos
+
+#define TYPE_Void           0 //!< Retorno void
+#define TYPE_Boolean        1 //!< Z
+#define TYPE_Byte           2 //!< B
+#define TYPE_Char           3 //!< C
+#define TYPE_Short          4 //!< S
+#define TYPE_Int            5 //!< I
+#define TYPE_Float          6 //!< F
+#define TYPE_Long           7 //!< J
+#define TYPE_Double         8 //!< D
+#define TYPE_Reference      9 //!< L<classe>; ou array
+#define TYPE_String         10 //!< Ljava/lang/String;
+#define TYPE_Object         11 //!< Ljava/lang/Object;
+
+
+//--------------------------------------------------------------------------------------------------
+//! Estrutura da Signature
+/*!
+ * Descritor de metodo pre-processado. Eh criado uma unica vez para cada simbolo de descritor.
+ */
+typedef struct Signature{
+    u2 argSlots; //!< Numero de u4 ocupados pelos argumentos
+    u2 argCount; //!< Numero de argumentos
+    u1 returnType; //!< Tipo do retorno (TYPE_*)
+    u1* argTypes; //!< Tipo de cada argumento (TYPE_*)
+} Signature;
+
+
+//--------------------------------------------------------------------------------------------------
+//! Estrutura do Symbol
+/*!
+ * Simbolo interno da JVM. Cada sequencia distinta de bytes Utf8 lida dos pools de constantes eh
+ * decodificada uma unica vez e representada por um unico Symbol, compartilhado entre todas as
+ * classes. Assim, o endereco de utf8 eh canonico e nomes e descritores podem ser comparados por
+ * igualdade de ponteiros. Um simbolo que so aparece nos pools de constantes de classes
+ * descarregadas eh liberado junto com a ultima delas.
+ */
+typedef struct Symbol{
+    struct Symbol* next; //!< Proximo simbolo do mesmo bucket da tabela de simbolos
+    u4 hash; //!< Hash (FNV-1a) dos bytes do simbolo
+    u2 length; //!< Numero de bytes do simbolo (sem o '\0')
+    wchar_t* unicode; //!< Versao unicode do simbolo, terminada em '\0'
+    Signature* signature; //!< Descritor de metodo pre-processado (criado sob demanda)
+    u4 classRefs; //!< Numero de entradas Utf8 de pools de constantes carregados com o simbolo
+    u1 permanent; //!< Simbolo usado pela propria JVM (nunca eh liberado)
+    char utf8[]; //!< Bytes do simbolo, terminados em '\0'
+} Symbol;
+
+
+//--------------------------------------------------------------------------------------------------
+//! Estrutura da SymbolTable
+/*!
+ * Tabela hash (encadeada) de todos os simbolos da JVM.
+ */
+typedef struct SymbolTable{
+    u4 mask; //!< Numero de buckets - 1 (o numero de buckets eh sempre potencia de 2)
+    u4 count; //!< Numero de simbolos na tabela
+    Symbol** buckets; //!< Vetor de buckets
+} SymbolTable;
+
+
 //--------------------------------------------------------------------------------------------------
 //! Estrutura do Pool de Constantes
 /*!
- * Estrutura utilizada para a representacao de um pool de constantes.
- */
-
-typedef struct constPool{
-    u1 tag;
-    union{
-        struct{
-            u2 name_index;
-        } Class;
-        struct{
-            u2 class_index;
-            u2 name_and_type_index;
-        } Fieldref;
-        struct{
-            u2 name_index;
-            u2 descriptor_index;
-        } NameAndType;
-        struct{
-            u2 lenght;
-            u1* bytes; //!< bytes[length]
-        } Utf8;
-        struct{
-            u2 class_index;
-            u2 name_and_type_index;
-        } Methodref;
-        struct{
-            u2 class_index;
-            u2 name_and_type_index;
-        } InterfaceMethodref;
-        struct{
-            u2 string_index;
-        } String;
-        struct{
-            u4 bytes;
-        } Integer;
-        struct{
-            u4 bytes;
-        } Float;
-        struct{
-            u4 high_bytes;
-            u4 low_bytes;
-        } Long;
-        struct{
-            u4 high_bytes;
-            u4 low_bytes;
-        } Double;
-    } u;
-} cp_info;
+ * Estrutura utilizada para a representacao de um pool de constantes, organizada como vetores
+ * paralelos indexados diretamente pelo indice do pool (a posicao 0 nao eh usada):
+ * - tags guarda, de forma densa, a tag de cada entrada;
+ * - values guarda o valor de 32 bits de cada entrada, no formato em que aparece no arquivo:
+ *   - Class e String: o indice referenciado (name_index ou string_index);
+ *   - Fieldref, Methodref, InterfaceMethodref e NameAndType: os dois indices referenciados, o
+ *     primeiro nos 16 bits mais significativos;
+ *   - Integer e Float: os bytes do valor;
+ *   - Long e Double: os bytes mais significativos; os menos significativos ficam na posicao
+ *     seguinte, que a entrada ja ocupa no pool;
+ *   - Utf8: a posicao do simbolo da entrada em symbols.
+ * Os bytes das entradas Utf8 ficam nos simbolos, compartilhados entre todas as classes.
+ */
+typedef struct ConstantPool{
+    u1* tags; //!< Tag de cada entrada
+    u4* values; //!< Valor de cada entrada
+    Symbol** symbols; //!< Simbolos das entradas Utf8, na ordem em que aparecem no pool
+} ConstantPool;
 
 
 //--------------------------------------------------------------------------------------------------
@@ -177,7 +211,7 @@ typedef struct constPool{
 typedef struct attribute{
     u2 attribute_name_index;
     u4  attribute_length;
-    u1* info;
+    u1* info; //!< Bytes do atributo, no arquivo mapeado (somente leitura)
     
 } attribute_info;
 
@@ -249,6 +283,8 @@ typedef struct fieldAndMethod{
     u2 descriptor_index;
     u2 attributes_count;
     attribute_info* attributes;
+    CodeAttribute* code; //!< Atributo Code decodificado na leitura (nulo em campos e metodos
+                         //!< abstratos ou nativos)
     
 } field_or_method;
 typedef struct fieldAndMethod field_info; //!< Estrutura utilizada para a representacao de um campo.
@@ -256,10 +292,28 @@ typedef struct fieldAndMethod method_info; //!< Estrutura utilizada para a repre
 //!um metodo.
 
 
+//--------------------------------------------------------------------------------------------------
+//! Estrutura da ClassArena
+/*!
+ * Bloco de memoria de onde sao alocados, por incremento de ponteiro, os metadados de uma classe
+ * lida (pool de constantes, campos, metodos, atributos e atributos Code decodificados). O primeiro
+ * bloco eh dimensionado pelo tamanho do arquivo ".class"; se ele esgotar, novos blocos sao
+ * encadeados. Todos os blocos sao liberados juntos, com a classe.
+ */
+typedef struct ClassArena{
+    struct ClassArena* next; //!< Proximo bloco da arena (nulo no ultimo)
+    u4 size; //!< Numero de bytes do bloco
+    u4 used; //!< Numero de bytes ja alocados do bloco
+    u1 data[]; //!< Memoria do bloco, zerada na criacao
+} ClassArena;
+
+
 //--------------------------------------------------------------------------------------------------
 //! Estrutura de Arquivo .class
 /*!
- * Estrutura utilizada para a representacao de um arquivo ".class".
+ * Estrutura utilizada para a representacao de um arquivo ".class". O arquivo fica mapeado em
+ * memoria (somente leitura) enquanto a classe estiver carregada: os bytes dos atributos, e
+ * portanto o codigo dos metodos, apontam diretamente para o mapeamento.
  */
 
 typedef struct arqClass {
@@ -267,7 +321,7 @@ typedef struct arqClass {
     u2                  minor_version;
     u2                  major_version;
     u2                  constant_pool_count;
-    cp_info*            constant_pool;
+    ConstantPool*       constant_pool;
     u2                  access_flags;
     u2                  this_class;
     u2                  super_class;
@@ -279,7 +333,9 @@ typedef struct arqClass {
     method_info*        methods;
     u2                  attributes_count;
     attribute_info*     attributes;
-    
+    ClassArena*         arena; //!< Arena de onde os metadados da classe foram alocados
+    u1*                 image; //!< Conteudo do arquivo ".class" mapeado em memoria
+    u4                  imageSize; //!< Numero de bytes do arquivo
     
 } ArqClass;
 
@@ -294,7 +350,8 @@ typedef struct arqClass {
 typedef struct FieldsTable{
     char* name; //!< Aponta para o nome do campo
     char* descriptor; //!< Aponta para o descritor do campo
-    void* memoryAddress; //!< Endereco de memoria contendo o valor do campo
+    u4 offset; //!< Deslocamento do campo no objeto (ou no bloco de campos estaticos da classe)
+    u1 size; //!< Numero de bytes ocupados pelo campo
     field_info* fieldInfo; //!< Aponta para a estrutura field_info referente ao campo
 } FieldsTable;
 
@@ -313,35 +370,138 @@ typedef struct Fields{
 struct JavaClass;
 
 //--------------------------------------------------------------------------------------------------
-//! Estrutura da Handler
+//! Estrutura do Object
 /*!
- *
+ * Cabecalho de um objeto: ponteiro para a classe e uma palavra com o hash de identidade e o
+ * contador do monitor. Os campos de instancia sao alocados logo apos o cabecalho, no mesmo bloco
+ * de memoria, nos deslocamentos definidos pela tabela instanceFields da classe. O estado do
+ * coletor de lixo (marca, encaminhamento, idade) fica no cabecalho do bloco do heap.
  */
-typedef struct Handler{
-    struct JavaClass *javaClass;
-    Fields* fields;
-} Handler;
+typedef struct Object{
+    struct JavaClass *javaClass; //!< Classe do objeto
+    u4 hash; //!< Hash de identidade (zero enquanto nao foi pedido)
+    u4 lock; //!< Numero de entradas no monitor do objeto (zero se livre)
+} Object;
 
 
 //--------------------------------------------------------------------------------------------------
-//! Estrutura do Object
+//! Estrutura de uma entrada da MethodTable
 /*!
- * 
+ * Entrada da tabela hash de metodos de uma classe. Uma entrada com method nulo esta vazia.
  */
-typedef struct Object{
-    Handler *handler;
-} Object;
+typedef struct MethodTableEntry{
+    u4 hash; //!< Hash do par (nome, descritor)
+    char* name; //!< Nome do metodo (simbolo)
+    char* descriptor; //!< Descritor do metodo (simbolo)
+    method_info* method; //!< Aponta para a estrutura method_info referente ao metodo
+} MethodTableEntry;
 
 
 //--------------------------------------------------------------------------------------------------
-//! Estrutura da ObjectList
+//! Estrutura da MethodTable
 /*!
- * 
+ * Tabela hash (enderecamento aberto) dos metodos de uma classe, indexada pelo par
+ * (nome, descritor). Eh montada uma unica vez no carregamento da classe.
+ */
+typedef struct MethodTable{
+    u4 mask; //!< Tamanho da tabela - 1 (o tamanho eh sempre potencia de 2)
+    MethodTableEntry* entries; //!< Vetor de entradas
+} MethodTable;
+
+
+//--------------------------------------------------------------------------------------------------
+//! Estrutura de uma entrada do ResolvedPool
+/*!
+ * Resultado da resolucao de uma entrada Class, Fieldref, Methodref, InterfaceMethodref ou String
+ * do pool de constantes. O vetor de entradas eh paralelo ao constant_pool da classe e eh
+ * preenchido na primeira execucao de uma instrucao que referencia a entrada. Todos os campos sao
+ * escritos antes de resolved, portanto uma entrada com resolved diferente de zero pode ser lida
+ * sem travas.
+ */
+typedef struct ResolvedPoolEntry{
+    volatile u1 resolved; //!< Diferente de zero quando a entrada ja foi resolvida
+    u1 isJavaLib; //!< A entrada referencia uma classe de biblioteca java (simulada)
+    u1 kind; //!< Fieldref: tipo do campo (TYPE_*)
+    Signature* signature; //!< Methodref: descritor pre-processado do metodo
+    u4 offset; //!< Fieldref de instancia: deslocamento do campo no objeto
+    struct JavaClass* javaClass; //!< Classe resolvida (da entrada Class, do metodo ou do campo)
+    method_info* method; //!< Methodref: metodo resolvido (nulo se depende do objeto)
+    void* address; //!< Fieldref estatico: endereco do valor do campo
+    char* className; //!< Nome da classe referenciada (simbolo)
+    char* name; //!< Nome do campo ou metodo (simbolo)
+    char* descriptor; //!< Descritor do campo ou metodo (simbolo)
+    u4 string; //!< String: string java da constante, criada no primeiro uso (raiz do coletor)
+} ResolvedPoolEntry;
+
+
+//--------------------------------------------------------------------------------------------------
+//! Estrutura do ReferenceMap
+/*!
+ * Mapa de referencias de uma instrucao que pode iniciar uma coleta de lixo (ponto seguro), criado
+ * pelo verificador de bytecodes. Indica, com 2 bits para cada posicao (VERIFIER_*), quais
+ * variaveis locais e posicoes da pilha de operandos guardam referencias enquanto a instrucao
+ * executa. Os operandos consumidos pela instrucao nao fazem parte do mapa.
+ */
+typedef struct ReferenceMap{
+    u2 pc; //!< Posicao do ultimo byte da instrucao
+    u2 stackDepth; //!< Numero de posicoes da pilha de operandos durante a instrucao
+    u1* slots; //!< Categorias das variaveis locais seguidas das posicoes da pilha de operandos
+} ReferenceMap;
+
+
+//--------------------------------------------------------------------------------------------------
+//! Estrutura do MethodReferenceMaps
+/*!
+ * Mapas de referencias de um metodo, ordenados por pc. Um metodo sem mapas (count igual a zero)
+ * nao foi verificado.
+ */
+typedef struct MethodReferenceMaps{
+    u2 count; //!< Numero de mapas
+    ReferenceMap* maps; //!< Vetor de mapas
+} MethodReferenceMaps;
+
+
+//--------------------------------------------------------------------------------------------------
+//! Estrutura do ReceiverCall
+/*!
+ * Invocacao que recebe como objeto (receptor) um objeto que, no restante do metodo, nao escapa.
+ */
+typedef struct ReceiverCall{
+    u1 opcode; //!< invokevirtual, invokespecial ou invokeinterface
+    u2 index; //!< Indice da entrada Methodref ou InterfaceMethodref no pool de constantes
+} ReceiverCall;
+
+
+//--------------------------------------------------------------------------------------------------
+//! Estrutura do AllocationSite
+/*!
+ * Local de alocacao (instrucao new) cujo objeto nao escapa do metodo, criado pela analise de
+ * escape do verificador: o objeto nao eh guardado em campos ou arrays, devolvido ou passado como
+ * argumento, e nenhum objeto anterior do mesmo local continua vivo quando a instrucao executa. Os
+ * metodos invocados sobre o objeto sao verificados na primeira execucao da instrucao, quando a
+ * classe do objeto ja eh conhecida. O objeto this de um metodo de instancia tambem eh descrito
+ * por um AllocationSite.
+ */
+typedef struct AllocationSite{
+    u2 pc; //!< Posicao da instrucao new
+    u2 slot; //!< Posicao do objeto no vetor de objetos locais do frame
+    u1 state; //!< Resultado da verificacao das invocacoes (VERIFIER_Site*)
+    u2 callCount; //!< Numero de invocacoes que recebem o objeto
+    ReceiverCall* calls; //!< Invocacoes que recebem o objeto
+} AllocationSite;
+
+
+//--------------------------------------------------------------------------------------------------
+//! Estrutura do MethodEscapeInfo
+/*!
+ * Resultado da analise de escape de um metodo. Um metodo que nao foi verificado nao tem locais de
+ * alocacao, e o seu objeto this escapa.
  */
-typedef struct ObjectList{
-    struct ObjectList *next;
-    Object *object;
-} ObjectList;
+typedef struct MethodEscapeInfo{
+    u2 siteCount; //!< Numero de locais de alocacao cujo objeto nao escapa
+    AllocationSite* sites; //!< Locais de alocacao, ordenados por pc
+    AllocationSite* receiver; //!< Uso do objeto this (nulo se ele escapa)
+} MethodEscapeInfo;
 
 
 //--------------------------------------------------------------------------------------------------
@@ -350,9 +510,18 @@ typedef struct ObjectList{
  * A StaticFieldsTable do JavaClass foi generalizada como uma FieldsTable normal
  */
 typedef struct JavaClass{
-    ObjectList *objectList;
     ArqClass *arqClass;
-    Fields* staticFields;
+    Fields* staticFields; //!< Layout dos campos estaticos da classe
+    u1* staticData; //!< Bloco contiguo com os valores dos campos estaticos
+    u1 staticsDirty; //!< Algum campo estatico recebeu uma referencia desde a ultima coleta jovem
+    struct JavaClass* superClass; //!< Superclasse (nulo se for uma classe de biblioteca java)
+    MethodTable* methodTable; //!< Tabela de busca dos metodos da classe
+    ResolvedPoolEntry* resolvedPool; //!< Resolucoes do pool de constantes (paralelo ao pool)
+    Fields* instanceFields; //!< Layout dos campos de instancia, incluindo os das superclasses
+    u4 instanceSize; //!< Numero de bytes de um objeto da classe (cabecalho e campos)
+    MethodReferenceMaps* referenceMaps; //!< Mapas de referencias (paralelo a arqClass->methods)
+    MethodEscapeInfo* escapeInfo; //!< Analise de escape (paralelo a arqClass->methods)
+    u1 marked; //!< Classe viva na coleta completa em andamento (nao pode ser descarregada)
 }JavaClass;
 
 
@@ -406,7 +575,10 @@ typedef struct Frame{
     method_info *method_info;
     int returnPC;
     u4 *localVariablesVector;
+    u2 maxLocals; //!< Tamanho do vetor de variaveis locais
     OperandStack *opStk;
+    u4* localObjects; //!< Objetos alocados no frame, um por local de alocacao (nulo se nenhum)
+    u1* localMark; //!< Topo da regiao de objetos locais da thread na criacao do frame
 }Frame;
 
 typedef struct VMStack{
@@ -423,6 +595,11 @@ typedef struct VMStack{
 typedef struct Thread{
     int PC;
     VMStack *vmStack;
+    u1* tlabTop; //!< Proximo byte livre do TLAB (buffer de alocacao da thread no heap)
+    u1* tlabEnd; //!< Fim do TLAB
+    u1* localBase; //!< Inicio da regiao de objetos locais dos frames (objetos que nao escapam)
+    u1* localTop; //!< Proximo byte livre da regiao de objetos locais
+    u1* localEnd; //!< Fim da regiao de objetos locais
 }Thread;
 
 
@@ -435,6 +612,8 @@ typedef struct Environment{
     Thread *thread; //!< Referencia para a thread em execucao
     MethodArea* methodArea; //!< Referencia para a area de metodos
     u1 debugFlags; //!< Flags de debug
+    u1 verifierThreads; //!< Numero de threads que verificam os metodos das classes carregadas
+    u2 loadingClasses; //!< Numero de classes em carregamento (nenhuma classe eh descarregada)
 }Environment;
 
 
@@ -18,6 +18,8 @@
 #define IllegalAccessError              43 //!< Erro de acesso
 #define ArrayIndexOutOfBoundsException  44 //!< Erro acesso index array
 #define NegativeArraySizeException      45 //!< Erro de tamanho de array negativo
+#define IllegalMonitorStateException    46 //!< Erro de saida de monitor nao ocupado
+#define OutOfMemoryError                47 //!< Erro de heap esgotado
 
 #define DEBUG_ShowClassFiles            0b001 //!< Ativar exibidor.class
 #define DEBUG_DebugModus                0b010 //!< Imprimir frames por instrução
\ No newline at end of file
@@ -1927,11 +1927,46 @@ EXTE void arraylength(Environment* environment);
  * da ultima dimensao alocada do array sao inicializados para o valor inicial padrao pelo tipo dos
  * componentes. Uma reference arrayref para o novo array eh empilhada na pilha de operandos.
  *
+ * Todos os arrays e subarrays sao alocados com uma unica alocacao (newJavaMultiArray), contiguos e
+ * na ordem das linhas.
+ *
+ *  Excessoes:
+ *      1. Se algum valor count for negativo, lancamos NegativeArraySizeException.
+ *
  * \param environment Ambiente de execucao atual.
  */
 EXTE void multianewarray(Environment* environment);
 
 
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que entra no monitor do objeto cuja referencia eh desempilhada, incrementando o contador
+ * do monitor no cabecalho do objeto. A JVM executa uma unica thread, portanto o monitor nunca esta
+ * ocupado por outra thread. Arrays e strings nao tem cabecalho de objeto: somente a referencia eh
+ * verificada.
+ *
+ *  Excessoes:
+ *      1. Se Objectref eh nulo, lancamos NullPointerException.
+ *
+ * \param environment Ambiente de execucao atual.
+ */
+EXTE void monitorenter(Environment* environment);
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que sai do monitor do objeto cuja referencia eh desempilhada, decrementando o contador do
+ * monitor no cabecalho do objeto.
+ *
+ *  Excessoes:
+ *      1. Se Objectref eh nulo, lancamos NullPointerException.
+ *      2. Se o monitor do objeto esta livre, lancamos IllegalMonitorStateException.
+ *
+ * \param environment Ambiente de execucao atual.
+ */
+EXTE void monitorexit(Environment* environment);
+
+
 //--------------------------------------------------------------------------------------------------
 // SUBMODULO: 
 //--------------------------------------------------------------------------------------------------
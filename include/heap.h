@@ -0,0 +1,379 @@
+//#################################################################################################
+/*! \file heap.h
+ *
+ *  \brief Interface do Heap da JVM.
+ *
+ *  Interface responsavel por disponibilizar os servicos de alocacao de objetos, arrays e strings
+ *  java no heap da JVM.
+ */
+//##################################################################################################
+
+#ifndef HEAP_h
+#define HEAP_h
+#ifdef HEAP
+#define EXTH
+#else
+#define EXTH extern
+#endif
+
+#include "estruturas.h"
+
+
+//--------------------------------------------------------------------------------------------------
+//Tipos de bloco do heap
+
+#define HEAP_Free           0 //!< Espaco sem conteudo (sobra de um TLAB descartado)
+#define HEAP_Object         1 //!< Objeto (Object e seus campos)
+#define HEAP_Array          2 //!< Array de tipo primitivo (JavaArray seguido dos elementos)
+#define HEAP_ReferenceArray 3 //!< Array de referencias (JavaArray seguido das referencias)
+#define HEAP_String         4 //!< Cabecalho de string (JavaString)
+#define HEAP_StringData     5 //!< Caracteres (wchar_t) de uma string ou de um StringBuffer
+
+
+//--------------------------------------------------------------------------------------------------
+//Dimensoes do heap
+
+#define HEAP_DefaultSize    (64*1024*1024) //!< Tamanho maximo do heap (regiao reservada)
+#define HEAP_DefaultInitialSize (8*1024*1024) //!< Tamanho do heap comprometido na inicializacao
+#define HEAP_MinimumSize    (256*1024) //!< Menor tamanho maximo aceito para o heap
+#define HEAP_TLABSize       (32*1024) //!< Tamanho de um TLAB e de um chunk do heap
+#define HEAP_Alignment      8 //!< Alinhamento de todo bloco do heap
+#define HEAP_MinimumBlock   16 //!< Menor bloco alocado (cabecalho e endereco de encaminhamento)
+#define HEAP_SmallBlock     256 //!< Maior bloco livre guardado nas listas por tamanho exato
+#define HEAP_CardShift      9 //!< Cada cartao da tabela de cartoes cobre 512 bytes
+#define HEAP_DefaultThreshold 75 //!< Ocupacao da geracao velha (%) que inicia a marcacao
+#define HEAP_DefaultTenuring 3 //!< Numero de coletas sobrevividas para promover um objeto
+#define HEAP_MarkStepBytes  (128*1024) //!< Bytes percorridos por passo da marcacao incremental
+#define HEAP_PauseBuckets   12 //!< Faixas do histograma de pausas (a primeira ate 64us)
+#define HEAP_PageSize       4096 //!< Alinhamento e granularidade dos objetos grandes
+#define HEAP_HugePageSize   (2*1024*1024) //!< Huge page: alinhamento da regiao e do comprometimento
+#define HEAP_DefaultLargeSpace (512*1024*1024) //!< Tamanho reservado para os objetos grandes
+#define HEAP_DefaultLargeObject (256*1024) //!< Menor array alocado no espaco de objetos grandes
+#define HEAP_ArenaSize      (1024*1024) //!< Arena de alocacao da thread sem coletor (-XX:+UseNoGC)
+#define HEAP_LocalSize      (64*1024) //!< Regiao dos objetos alocados nos frames de uma thread
+
+
+//--------------------------------------------------------------------------------------------------
+//Flags de um bloco do heap
+
+#define HEAP_Marked         0x01 //!< Bloco alcancavel (marcado pelo coletor de lixo)
+#define HEAP_Forwarded      0x02 //!< Bloco copiado; o endereco da copia esta no seu conteudo
+#define HEAP_Pinned         0x04 //!< Bloco referenciado por uma raiz conservadora (nao movido)
+
+
+//--------------------------------------------------------------------------------------------------
+//Estados de um chunk do heap
+
+#define HEAP_ChunkFree      0 //!< Chunk sem uso
+#define HEAP_ChunkYoung     1 //!< Chunk da geracao jovem (TLAB ou sobreviventes)
+#define HEAP_ChunkOld       2 //!< Chunk da geracao velha
+#define HEAP_ChunkSurvivor  3 //!< Chunk que recebe os sobreviventes durante a coleta da jovem
+#define HEAP_ChunkPinned    4 //!< Chunk jovem referenciado por uma raiz conservadora (nao movido)
+#define HEAP_ChunkLarge     5 //!< Trecho do espaco de objetos grandes (objetos nunca movidos)
+#define HEAP_ChunkLocal     6 //!< Chunk da regiao de objetos locais dos frames de uma thread
+
+
+//--------------------------------------------------------------------------------------------------
+//! Estrutura do cabecalho de um bloco do heap
+/*!
+ * Cabecalho que precede toda area alocada no heap. Como todo bloco conhece o seu tamanho, o heap
+ * pode ser percorrido sequencialmente da base ate o topo.
+ */
+typedef struct HeapBlock{
+    u4 size; //!< Tamanho do bloco em bytes, incluindo o cabecalho
+    u1 kind; //!< Tipo do conteudo do bloco (HEAP_*)
+    u1 flags; //!< Flags do coletor de lixo (HEAP_Marked, HEAP_Forwarded, HEAP_Pinned)
+    u1 age; //!< Numero de coletas da geracao jovem sobrevividas
+    u1 reserved;
+} HeapBlock;
+
+
+//--------------------------------------------------------------------------------------------------
+//! Estrutura das opcoes do Heap
+/*!
+ * Opcoes do heap e do coletor de lixo, recebidas na linha de comando da JVM.
+ */
+typedef struct HeapOptions{
+    u4 size; //!< Tamanho maximo do heap em bytes (-Xmx), incluindo os objetos grandes
+    u4 youngSize; //!< Tamanho da geracao jovem em bytes (0 usa um oitavo do heap)
+    u1 threshold; //!< Ocupacao da geracao velha (%) a partir da qual a marcacao eh iniciada
+    u1 tenuring; //!< Numero de coletas da geracao jovem sobrevividas para promover um objeto
+    u1 verbose; //!< Exibe um resumo de cada coleta
+    u4 largeSpace; //!< Tamanho em bytes reservado para o espaco de objetos grandes
+    u4 largeObject; //!< Menor array (em bytes) alocado no espaco de objetos grandes
+    u1 hugePages; //!< Pede huge pages transparentes para o heap e os objetos grandes
+    u4 initialSize; //!< Tamanho em bytes comprometido na inicializacao do heap
+    u1 largePages; //!< Reserva a regiao com huge pages explicitas (MAP_HUGETLB)
+    u1 classHistogram; //!< Exibe, ao final da execucao, o censo dos objetos vivos por classe
+    u1 noGC; //!< Sem coletor: blocos alocados em arenas e liberados so no fim da execucao
+    u1 noEscapeAnalysis; //!< Aloca no heap tambem os objetos que nao escapam do seu metodo
+    u1 noClassUnloading; //!< Mantem carregadas as classes sem objetos vivos (sem descarregamento)
+} HeapOptions;
+
+
+//--------------------------------------------------------------------------------------------------
+//! Estrutura do Heap
+/*!
+ * Regiao contigua de memoria dividida em chunks do tamanho de um TLAB. Os TLABs das threads sao
+ * chunks da geracao jovem; objetos grandes e objetos promovidos ficam em chunks da geracao velha.
+ * Os blocos livres da geracao velha sao guardados em listas: os pequenos em uma lista para cada
+ * tamanho, os demais em uma lista unica. A geracao velha eh marcada incrementalmente, em passos
+ * intercalados com a execucao do programa.
+ *
+ * Apos os chunks fica o espaco de objetos grandes: arrays grandes ocupam paginas proprias, nunca
+ * sao copiados nem compactados e, quando morrem, as suas paginas sao devolvidas ao sistema
+ * operacional. Como as referencias sao deslocamentos a partir da base, os dois espacos fazem parte
+ * da mesma regiao reservada; as tabelas de inicios de bloco, de chunks e de cartoes cobrem ambos.
+ *
+ * A regiao eh apenas reservada na inicializacao (o tamanho maximo do heap) e comprometida aos
+ * poucos, em passos de uma huge page, conforme os topos dos dois espacos avancam. Quando o heap
+ * maximo se esgota, mesmo apos uma coleta completa, a alocacao lanca OutOfMemoryError.
+ *
+ * Sem coletor (-XX:+UseNoGC) nao ha espaco de objetos grandes: os TLABs sao arenas de varios
+ * chunks, nada eh liberado e a regiao inteira eh devolvida de uma vez no fim da execucao.
+ *
+ * Os objetos que nao escapam do metodo que os aloca ficam na regiao de objetos locais da thread,
+ * uma pilha de blocos desempilhados junto com os frames. Os coletores nao os movem nem os marcam:
+ * os seus campos sao raizes exatas, como as variaveis locais dos frames.
+ */
+typedef struct Heap{
+    u1* reservation; //!< Inicio da reserva feita ao sistema operacional (antes do alinhamento)
+    u8 reservationSize; //!< Tamanho da reserva feita ao sistema operacional
+    u1* base; //!< Inicio da regiao
+    u1* top; //!< Inicio do primeiro chunk nunca utilizado
+    u1* end; //!< Fim da regiao dos chunks (inicio do espaco de objetos grandes)
+    u1* largeTop; //!< Fim do ultimo objeto grande
+    u1* largeEnd; //!< Fim do espaco de objetos grandes (fim da regiao reservada)
+    u1* committed; //!< Fim da parte comprometida da regiao dos chunks
+    u1* largeCommitted; //!< Fim da parte comprometida do espaco de objetos grandes
+    u1 hugeTLB; //!< Regiao mapeada com huge pages explicitas (inteiramente comprometida)
+    u4 largeUsed; //!< Bytes ocupados por objetos grandes
+    u4 largeTrigger; //!< Ocupacao do espaco de objetos grandes que inicia um ciclo de marcacao
+    u1* blockStarts; //!< Mapa de bits com o inicio de cada bloco (um bit para cada 8 bytes)
+    u1* chunks; //!< Estado de cada chunk (HEAP_Chunk*)
+    u4* freeChunks; //!< Pilha de indices de chunks livres
+    u4 freeChunkCount; //!< Numero de chunks na pilha de chunks livres
+    u1* cards; //!< Tabela de cartoes: cartoes da geracao velha que podem referenciar a jovem
+    u4* forwarding; //!< Destino, na compactacao, do primeiro bloco que comeca em cada cartao
+    HeapBlock* freeLists[HEAP_SmallBlock/HEAP_Alignment + 1]; //!< Blocos livres pequenos (tamanho)
+    HeapBlock* largeFreeList; //!< Blocos livres maiores que HEAP_SmallBlock
+    u4 youngChunks; //!< Numero de chunks da geracao jovem
+    u4 youngLimit; //!< Numero maximo de chunks da geracao jovem
+    u4 oldUsed; //!< Bytes ocupados na geracao velha
+    u4 oldTrigger; //!< Ocupacao da geracao velha que inicia o proximo ciclo de marcacao
+    u1 marking; //!< Ciclo de marcacao incremental da geracao velha em andamento
+    u4 minorCollections; //!< Numero de coletas da geracao jovem executadas
+    u4 markingCycles; //!< Numero de ciclos de marcacao incremental concluidos
+    u4 collections; //!< Numero de coletas completas executadas
+    u4 pauseHistogram[HEAP_PauseBuckets]; //!< Numero de pausas em cada faixa de duracao
+    u4 pauseCount; //!< Numero de pausas do coletor
+    u8 pauseTotal; //!< Soma das pausas em microssegundos
+    u8 pauseMax; //!< Maior pausa em microssegundos
+    u4 localObjects; //!< Numero de objetos alocados na regiao de objetos locais
+    HeapOptions options; //!< Opcoes do heap
+    Environment* environment; //!< Ambiente cujas raizes sao percorridas pelo coletor
+    u1* stackBase; //!< Base da pilha nativa da thread da JVM
+} Heap;
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que reserva a regiao de memoria do heap (tamanho maximo) e compromete o seu tamanho
+ * inicial. Deve ser chamado antes de qualquer alocacao.
+ *
+ * \param options Opcoes do heap e do coletor de lixo
+ * \param environment Ambiente cujas raizes (frames e campos estaticos) sao percorridas pelo coletor
+ * \param stackBase Endereco de uma variavel local de main (base da pilha nativa)
+ */
+EXTH void initHeap(HeapOptions* options, Environment* environment, void* stackBase);
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que aloca um bloco no heap. A alocacao eh feita no TLAB da thread por incremento de
+ * ponteiro; quando o TLAB se esgota ele eh substituido por um novo chunk da geracao jovem. Blocos
+ * grandes sao alocados diretamente na geracao velha, e arrays a partir de largeObject bytes no
+ * espaco de objetos grandes. A area retornada esta zerada.
+ *
+ * \param thread Thread que realiza a alocacao
+ * \param size Numero de bytes a serem alocados
+ * \param kind Tipo do conteudo do bloco (HEAP_*)
+ * \return Endereco da area alocada
+ */
+EXTH void* heapAllocate(Thread* thread, u4 size, u1 kind);
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que aloca uma sequencia de blocos contiguos com uma unica alocacao (slab), agrupados em
+ * niveis: counts[0] blocos de sizes[0] bytes, seguidos de counts[1] blocos de sizes[1] bytes, e
+ * assim por diante. Cada bloco continua sendo um bloco independente do heap. As areas retornadas
+ * estao zeradas; a area de um bloco seguinte comeca no fim do bloco anterior (veja getHeapBlock).
+ *
+ * \param thread Thread que realiza a alocacao
+ * \param levels Numero de niveis
+ * \param counts Numero de blocos de cada nivel
+ * \param sizes Numero de bytes da area de cada bloco do nivel
+ * \param kinds Tipo do conteudo dos blocos do nivel (HEAP_*)
+ * \return Endereco da area do primeiro bloco
+ */
+EXTH void* heapAllocateSlab(Thread* thread, u4 levels, const u4* counts, const u4* sizes,
+                            const u1* kinds);
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que verifica se um array eh alocado no espaco de objetos grandes (a partir de largeObject
+ * bytes, exceto sem coletor). Arrays grandes nao devem fazer parte de um slab.
+ *
+ * \param size Numero de bytes do array (JavaArray e elementos)
+ * \return Diferente de zero se o array vai para o espaco de objetos grandes
+ */
+EXTH u1 heapIsLargeArray(u4 size);
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que aloca um bloco na regiao de objetos locais da thread, por incremento de ponteiro. O
+ * bloco eh liberado quando o frame em execucao eh desempilhado (veja Frame.localMark). A area
+ * retornada esta zerada.
+ *
+ * \param thread Thread que realiza a alocacao
+ * \param size Numero de bytes a serem alocados
+ * \param kind Tipo do conteudo do bloco (HEAP_*)
+ * \return Endereco da area alocada (ou nulo se a regiao esta esgotada ou nao existe)
+ */
+EXTH void* heapAllocateLocal(Thread* thread, u4 size, u1 kind);
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que descarta o restante do TLAB da thread, marcando-o como um bloco livre para que o
+ * heap continue percorrivel.
+ *
+ * \param thread Thread cujo TLAB sera descartado
+ */
+EXTH void retireTLAB(Thread* thread);
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que retorna o cabecalho do bloco do heap que contem a area recebida.
+ *
+ * \param address Endereco retornado por heapAllocate
+ * \return Referencia para o cabecalho do bloco
+ */
+EXTH HeapBlock* getHeapBlock(void* address);
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que converte o endereco de uma area do heap na referencia guardada nas variaveis locais,
+ * na pilha de operandos e nos campos: o deslocamento (32 bits) da area a partir da base do heap.
+ * Como toda area comeca apos um cabecalho, o deslocamento zero representa a referencia nula.
+ *
+ * \param address Endereco retornado por heapAllocate (ou nulo)
+ * \return Referencia comprimida
+ */
+EXTH u4 encodeReference(void* address);
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que converte uma referencia comprimida no endereco da area do heap.
+ *
+ * \param reference Referencia comprimida (ou zero)
+ * \return Endereco da area (ou nulo)
+ */
+EXTH void* decodeReference(u4 reference);
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Barreira de escrita: deve ser chamada sempre que uma referencia eh escrita em um campo de objeto
+ * ou elemento de array, apos a escrita. Marca o cartao do endereco escrito, para que a coleta da
+ * geracao jovem encontre referencias da geracao velha para a jovem sem percorrer a geracao velha,
+ * e, durante a marcacao incremental, marca o bloco referenciado.
+ *
+ * \param slot Endereco escrito
+ */
+EXTH void heapWriteBarrier(void* slot);
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Barreira de escrita dos campos estaticos: deve ser chamada sempre que uma referencia eh escrita
+ * em um campo estatico. Somente os campos estaticos das classes marcadas sao percorridos na coleta
+ * da geracao jovem.
+ *
+ * \param javaClass Classe que declara o campo
+ */
+EXTH void heapStaticWriteBarrier(JavaClass* javaClass);
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que executa a coleta completa (marcacao de todo o heap e compactacao da geracao velha,
+ * com todas as threads paradas), descartando o ciclo de marcacao incremental em andamento. Sao
+ * raizes os vetores de variaveis locais e as pilhas de operandos dos frames (exatas se o metodo
+ * tem mapa de referencias), os campos estaticos das classes carregadas e a pilha nativa da JVM.
+ * Os blocos vivos da geracao velha deslizam para o inicio da sua sequencia de chunks e todas as
+ * referencias para eles sao atualizadas; os blocos referenciados pelas raizes conservadoras (que
+ * nao podem ser atualizadas) ficam onde estao. Sem coletor (-XX:+UseNoGC) nada eh feito.
+ */
+EXTH void collectGarbage();
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que devolve ao sistema operacional, de uma vez, a regiao do heap e as suas tabelas. Deve
+ * ser chamado no fim da execucao: nenhum bloco do heap pode ser acessado depois.
+ */
+EXTH void releaseHeap();
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que lanca OutOfMemoryError: o heap maximo esta esgotado ou o bloco pedido excede o maior
+ * bloco do heap. Antes da execucao do primeiro metodo a JVM eh simplesmente encerrada.
+ */
+EXTH void throwOutOfMemoryError();
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que exibe, se a opcao -verbose:gc foi informada, o numero de coletas e o histograma das
+ * pausas do coletor (coletas jovens, marcacao inicial, passos de marcacao, remarcacao e coletas
+ * completas).
+ */
+EXTH void printHeapStatistics();
+
+
+//--------------------------------------------------------------------------------------------------
+//! Funcao que recebe cada objeto percorrido por heapWalkObjects (e o dado passado pelo chamador)
+typedef void (*ObjectVisitor)(Object* object, void* data);
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que percorre os objetos do heap, bloco a bloco, nos chunks e no espaco de objetos grandes.
+ * As classes nao guardam as suas instancias: a classe de cada objeto vem do seu cabecalho. Objetos
+ * ja inalcancaveis mas ainda nao coletados tambem sao percorridos. O visitante nao deve alocar.
+ *
+ * \param javaClass Classe cujas instancias sao percorridas (nulo percorre todos os objetos)
+ * \param visit Funcao chamada para cada objeto
+ * \param data Dado repassado para a funcao
+ */
+EXTH void heapWalkObjects(JavaClass* javaClass, ObjectVisitor visit, void* data);
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que exibe, se a opcao -XX:+PrintClassHistogram foi informada, o censo do heap: numero de
+ * instancias e bytes ocupados por classe (e por tipo de array), em ordem decrescente de bytes. Uma
+ * coleta completa eh executada antes, para que so os objetos vivos sejam contados (sem coletor,
+ * todos os objetos alocados sao contados).
+ */
+EXTH void printHeapCensus();
+
+#endif
@@ -33,32 +33,75 @@
 #define T_SHORT     9
 #define T_INT       10
 #define T_LONG      11
+#define T_REFERENCE 12 //!< Elementos sao referencias (anewarray)
 
 
 
 //--------------------------------------------------------------------------------------------------
 //! Estrutura de Array Java
 /*!
- * Estrutura utilizada para a representacao de um Array Java
+ * Estrutura utilizada para a representacao de um Array Java. Os elementos seguem a estrutura no
+ * mesmo bloco do heap (a partir de array + 1), com o tamanho de getArrayElementSize: boolean e
+ * byte ocupam 1 byte, char e short 2, int, float e referencias 4, long e double 8. Como a
+ * estrutura ocupa 8 bytes, os elementos de 8 bytes ficam alinhados.
  */
 typedef struct ArrayRef{
-    u4 atype;
-    u2 count;
-    void* arrayAddress;
+    u4 atype; //!< Tipo dos elementos (T_*)
+    u4 count; //!< Numero de elementos
 } JavaArray;
 
 
 
 //--------------------------------------------------------------------------------------------------
 /*!
- * Metodo responsavel por inicializar e retornar uma estrutura de array java preenchida a partir
- * de um vetor de char
+ * Metodo que retorna o tamanho em bytes de um elemento de array
  *
- * \param value Value de tipo int, long, float, double, reference, byte, boolean, char ou short a
- * ser carregado na estrutura java array
+ * \param atype Tipo dos elementos (T_*)
+ * \return Tamanho de um elemento
+ */
+EXTJA u4 getArrayElementSize(u4 atype);
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que retorna o tipo dos elementos de um array a partir do descritor do elemento
+ *
+ * \param descriptor Primeiro caractere do descritor do elemento ('I', 'J', 'L', '[', ...)
+ * \return Tipo dos elementos (T_*)
+ */
+EXTJA u4 getArrayTypeFromDescriptor(char descriptor);
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo responsavel por alocar um array java em um unico bloco do heap: a estrutura JavaArray
+ * seguida dos elementos, inicializados com o valor default (zero ou nulo) pelo heap.
+ *
+ * \param n_atype Tipo dos elementos (T_*)
+ * \param n_count Numero de elementos
+ * \param thread Thread em cujo TLAB o array eh alocado
  * \return estrutura JavaArray preenchida
  */
-EXTJA JavaArray* newJavaArray(u4 n_type, u2 n_length, void* n_arrayAddress);
+EXTJA JavaArray* newJavaArray(u4 n_atype, u4 n_count, Thread* thread);
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo responsavel por alocar um array multidimensional (array de arrays) com uma unica
+ * alocacao: todos os arrays sao blocos contiguos de um slab, com os arrays de cada dimensao
+ * seguindo os da dimensao anterior na ordem das linhas. O slab termina antes da primeira dimensao
+ * cujos arrays vao para o espaco de objetos grandes: cada um desses arrays (com as dimensoes
+ * seguintes) eh alocado separadamente, para nao ser movido pelo coletor. Se um tamanho for zero,
+ * nenhuma dimensao seguinte eh alocada. Os elementos da ultima dimensao alocada sao inicializados
+ * com o valor default; se o array tiver mais dimensoes que as alocadas, eles sao referencias nulas.
+ *
+ * \param n_atype Tipo dos elementos da ultima dimensao alocada (T_*)
+ * \param dimensions Numero de dimensoes alocadas (de 1 a 255)
+ * \param counts Tamanho de cada dimensao alocada
+ * \param thread Thread em cujo TLAB o array eh alocado
+ * \return estrutura JavaArray da primeira dimensao
+ */
+EXTJA JavaArray* newJavaMultiArray(u4 n_atype, u4 dimensions, const u4* counts, Thread* thread);
 
 
 #endif /* JAVAARRAY_h */
@@ -36,7 +36,7 @@
 typedef struct StringRef{
     u1 tag;
     u2 size;
-    wchar_t* stringAddress;
+    u4 stringAddress; //!< Referencia para os caracteres (bloco do heap)
     
 } JavaString;
 
@@ -48,9 +48,24 @@ typedef struct StringRef{
  * de um vetor de char
  *
  * \param string String c a ser carregada na estrutura java string
+ * \param thread Thread em cujo TLAB a estrutura eh alocada
  * \return estrutura JavaString preenchida
  */
-EXTJS JavaString* newJavaString(const wchar_t* string);
+EXTJS JavaString* newJavaString(const wchar_t* string, Thread* thread);
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que retorna a string java de uma constante String do pool de constantes de uma classe.
+ * A string eh criada no heap no primeiro uso da constante e guardada no pool de resolucoes da
+ * classe, que eh percorrido pelo coletor de lixo como os campos estaticos.
+ *
+ * \param javaClass Classe cujo pool de constantes contem a entrada
+ * \param index Indice da entrada String no pool de constantes
+ * \param thread Thread em cujo TLAB a string eh alocada
+ * \return Referencia para a string java
+ */
+EXTJS u4 getStringConstant(JavaClass* javaClass, u2 index, Thread* thread);
 
 
 #endif /* JAVASTRING_h */
@@ -18,6 +18,84 @@
 #include "estruturas.h"
 
 
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que retorna o simbolo canonico da sequencia de bytes recebida. Caso o simbolo ainda nao
+ * exista na tabela de simbolos da JVM, ele eh criado (e decodificado) neste momento.
+ *
+ * \param bytes Bytes (Utf8) do simbolo
+ * \param length Numero de bytes
+ * \return Referencia para o simbolo canonico
+ */
+EXTM Symbol* internSymbol(const u1* bytes, u2 length);
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que retorna o endereco canonico (simbolo) da string recebida. Nomes e descritores
+ * comparados por igualdade de ponteiros com os do pool de constantes devem passar por aqui.
+ *
+ * \param string String terminada em '\0'
+ * \return Bytes do simbolo canonico
+ */
+EXTM char* internString(const char* string);
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que retorna a estrutura Symbol a partir do endereco canonico dos seus bytes.
+ *
+ * \param utf8 Bytes de um simbolo (obtidos do pool de constantes ou de internString)
+ * \return Referencia para o simbolo
+ */
+EXTM Symbol* getSymbolFromUTF8(const char* utf8);
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que desfaz a referencia de uma entrada Utf8 de um pool de constantes a um simbolo. O
+ * simbolo que nao eh mais referenciado por nenhum pool e nao eh usado pela propria JVM (criado
+ * por internString) eh retirado da tabela de simbolos e liberado.
+ *
+ * \param symbol Simbolo referenciado pela entrada
+ */
+EXTM void releaseSymbol(Symbol* symbol);
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que decodifica o tipo (TYPE_*) que comeca na posicao apontada de um descritor e avanca
+ * a posicao para o proximo tipo. Nao altera estruturas compartilhadas, portanto pode ser chamado
+ * pelas threads de verificacao.
+ *
+ * \param descriptor Referencia para a posicao atual no descritor
+ * \return Tipo decodificado
+ */
+EXTM u1 parseDescriptorType(const char** descriptor);
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que retorna o tipo (TYPE_*) de um descritor de campo.
+ *
+ * \param descriptor Descritor do campo
+ * \return Tipo do campo
+ */
+EXTM u1 getFieldType(const char* descriptor);
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que retorna o descritor de metodo pre-processado (numero de u4 dos argumentos, tipo de
+ * cada argumento e tipo de retorno). O descritor eh processado somente na primeira chamada para
+ * cada simbolo.
+ *
+ * \param descriptor Descritor do metodo (simbolo)
+ * \return Referencia para a estrutura Signature do descritor
+ */
+EXTM Signature* getSignature(const char* descriptor);
+
+
 //--------------------------------------------------------------------------------------------------
 /*!
  * Metodo responsavel por criar, inicializar e retornar uma uma referencia para uma estrutura Thread
@@ -43,15 +121,28 @@ EXTM MethodArea* newMethodArea();
  * thread.
  *
  * \param environment Thread e area de metodos do ambiente em execucao
- * \param className Nome qualificado da classe que contem o metodo a ser empilhado
- * \param methodName Nome do metodo a ser empilhado
- * \param methodDescriptor Descritor do metodo a ser executado (polimorfismo)
+ * \param className Nome qualificado da classe que contem o metodo a ser empilhado (simbolo)
+ * \param methodName Nome do metodo a ser empilhado (simbolo)
+ * \param methodDescriptor Descritor do metodo a ser executado (simbolo)
  * \return referencia para o frame criado
  */
 EXTM Frame* pushFrame(Environment* environment, const char* className, const char* methodName,
                             const char*  methodDescriptor);
 
 
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo responsavel por criar e inicializar um novo frame para um metodo ja resolvido e o empilhar
+ * na pilha da thread. A classe do metodo ja deve estar carregada.
+ *
+ * \param environment Thread e area de metodos do ambiente em execucao
+ * \param javaClass Classe que contem o metodo a ser empilhado
+ * \param method Metodo a ser empilhado
+ * \return referencia para o frame criado
+ */
+EXTM Frame* pushMethodFrame(Environment* environment, JavaClass* javaClass, method_info* method);
+
+
 //--------------------------------------------------------------------------------------------------
 /*!
  * Metodo responsavel por desempilhar o frame que está no topo da pilha da thread.
@@ -77,7 +168,7 @@ EXTM Frame* getCurrentFrame(Thread* thread);
  * Metodo que recebe o nome de uma classe como parametro e retorna uma referencia para esta 
  * estrutura na area de metodos. Caso a classe nao seja encontrada, retorna nulo.
  *
- * \param qualifiedName Nome qualificado da classe a ser procurada
+ * \param qualifiedName Nome qualificado da classe a ser procurada (simbolo)
  * \param methodArea Area de metodos a ser utulizada na busca
  * \return Endereco da estrutura JavaClass (ou nulo se nao existe)
  */
@@ -107,14 +198,38 @@ EXTM JavaClass* getClass(const char* qualifiedName, Environment* environment);
 EXTM void addJavaClassToMethodArea(JavaClass* javaClass, MethodArea* methodArea);
 
 
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que descarrega uma classe: a classe eh retirada da area de metodos, as resolucoes das
+ * demais classes que a referenciam voltam a ser feitas sob demanda e todas as suas estruturas
+ * (metadados, pool de constantes, codigo, campos estaticos e resultados do verificador) sao
+ * liberadas. A classe nao pode ter objetos, frames ou subclasses carregadas.
+ *
+ * \param javaClass Classe a ser descarregada
+ * \param methodArea Area de metodos que contem a classe
+ */
+EXTM void unloadJavaClass(JavaClass* javaClass, MethodArea* methodArea);
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que monta a tabela hash de metodos de uma classe carregada, indexada pelo par
+ * (nome, descritor) de cada metodo.
+ *
+ * \param javaClass Estrutura javaClass cuja estrutura arqClass ja foi lida
+ * \return Referencia para a tabela de metodos preenchida
+ */
+EXTM MethodTable* newMethodTable(JavaClass* javaClass);
+
+
 //--------------------------------------------------------------------------------------------------
 /*!
  * Metodo que, dado um ponteiro para uma estrutura javaClass, busca e retorna uma referencia para
  * a estrutura method_info referente ao metodo buscado
  *
  * \param javaClass Estrutura javaClass da classe que contem o metodo
- * \param methodName Nome do metodo a ser empilhado
- * \param methodDescriptor Descritor do metodo a ser executado (polimorfismo)
+ * \param methodName Nome do metodo a ser empilhado (simbolo)
+ * \param methodDescriptor Descritor do metodo a ser executado (simbolo)
  * \return Referencia para uma estrutura method_info referente ao metodo buscado
  */
 EXTM method_info* getMethodInfoFromClass(JavaClass* javaClass,
@@ -140,14 +255,15 @@ EXTM CodeAttribute* getCodeAttributeFromMethod(JavaClass* javaClass,
 //--------------------------------------------------------------------------------------------------
 /*!
  * Metodo que, dado um ponteiro para uma estrutura method_info e o pool de constantes contendo as
- * constantes relativas ao metodo, busca e retorna uma referencia para o atributo code, o qual
- * estara preenchido.
+ * constantes relativas ao metodo, retorna uma referencia para o atributo code, o qual estara
+ * preenchido. O atributo eh decodificado na leitura da classe e pertence a arena da classe (nao
+ * deve ser liberado).
  *
  * \param method Referencia para o method_info contendo o codigo
  * \param constant_pool Referencia para o pool de constantes da classe do metodo
- * \return Referencia para uma estrutura CodeAttribute referente ao metodo buscado
+ * \return Referencia para uma estrutura CodeAttribute referente ao metodo buscado (ou nulo)
  */
-EXTM CodeAttribute* getCodeFromMethodInfo(method_info* method, cp_info* constant_pool);
+EXTM CodeAttribute* getCodeFromMethodInfo(method_info* method, ConstantPool* constant_pool);
 //--------------------------------------------------------------------------------------------------
 /*!
  * Metodo que retorna o byte do atributo CODE apontado por PC da estrutura MethodInfo passada como
@@ -158,16 +274,16 @@ EXTM CodeAttribute* getCodeFromMethodInfo(method_info* method, cp_info* constant
  * \param pc Endereco da intrucao (indice do byte no vetor de bytes PC)
  * \return Opcode que esta na posicao apontada por PC
  */
-EXTM u1 getByteCodeFromMethod(method_info* methodInfo, cp_info* constant_pool, int pc);
+EXTM u1 getByteCodeFromMethod(method_info* methodInfo, ConstantPool* constant_pool, int pc);
 
 
 //--------------------------------------------------------------------------------------------------
 /*!
  * Metodo que obtem o endereco de memoria do atributo de classe (static field) cujo nome eh passado
- * por parametro.
+ * por parametro, no bloco de campos estaticos da classe ou de uma de suas superclasses.
  *
  * \param className Nome qualificado da classe que possui o atributo
- * \param attributeName Nome do atributo de classe
+ * \param attributeName Nome do atributo de classe (simbolo)
  * \param environment Thread e area de metodos do ambiente em execucao
  * \return Endereco de memoria contendo o valor do atributo
  */
@@ -180,7 +296,7 @@ EXTM void* getClassAttributeReference(const char* className, const char* attribu
  * passado por parametro.
  *
  * \param object Endereco do objeto que contem o atributo
- * \param attributeName Nome do atributo do bjeto
+ * \param attributeName Nome do atributo do bjeto (simbolo)
  * \return Endereco contendo o valor do atributo
  */
 EXTM void* getObjectAttributeReference(Object* object, const char* attributeName);
@@ -199,6 +315,45 @@ EXTM void* getObjectAttributeReference(Object* object, const char* attributeName
 EXTM Object* newObjectFromClass(const char* className, Environment* environment );
 
 
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Método que cria e inicializa e retorna uma nova instancia da classe (ja carregada) passada como
+ * parametro.
+ *
+ * \param javaClass Referencia para a classe do objeto
+ * \param environment Thread e area de metodos do ambiente em execucao
+ * \return Endereco do objeto
+ */
+EXTM Object* newObjectFromJavaClass(JavaClass* javaClass, Environment* environment);
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que cria uma instancia de uma classe no frame do topo da pilha, para um local de alocacao
+ * cujo objeto nao escapa do metodo. Cada local de alocacao guarda no frame um unico objeto,
+ * reutilizado (com os campos zerados) nas execucoes seguintes da instrucao new.
+ *
+ * \param frame Frame do topo da pilha, em execucao
+ * \param javaClass Referencia para a classe do objeto
+ * \param site Local de alocacao da instrucao new em execucao
+ * \param environment Thread e area de metodos do ambiente em execucao
+ * \return Endereco do objeto (ou nulo se a regiao de objetos locais esta esgotada)
+ */
+EXTM Object* newLocalObject(Frame* frame, JavaClass* javaClass, AllocationSite* site,
+                            Environment* environment);
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que retorna o hash de identidade de um objeto. O hash eh sorteado no primeiro pedido e
+ * guardado no cabecalho do objeto, portanto nao muda quando o coletor de lixo move o objeto.
+ *
+ * \param object Endereco do objeto
+ * \return Hash de identidade (positivo e diferente de zero)
+ */
+EXTM u4 getObjectHash(Object* object);
+
+
 //--------------------------------------------------------------------------------------------------
 /*!
  * Metodo que empilha um valor na pilha de operandos do frame atual da thread passada como parametro
@@ -50,6 +50,22 @@ EXTU void javaLibExecuteMethod(const char* className, const char* methodName,
                                 const char* descriptorName, Environment* environment);
 
 
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que verifica se a simulacao de um metodo de uma biblioteca java desempilha e empilha
+ * exatamente os valores indicados pelo seu descritor. Nao altera estruturas compartilhadas,
+ * portanto pode ser chamado pelas threads de verificacao.
+ *
+ * \param className Nome da classe do metodo
+ * \param methodName Nome do metodo
+ * \param descriptorName Descritor do metodo
+ * \param hasReceiver 1 se a invocacao desempilha o objeto (nao estatica), 0 caso contrario
+ * \return 1 caso sim, 0 caso nao.
+ */
+EXTU int javaLibFollowsDescriptor(const char* className, const char* methodName,
+                                  const char* descriptorName, int hasReceiver);
+
+
 //--------------------------------------------------------------------------------------------------
 /*!
  * Metodo que obtem o valor de um campo estatico de uma biblioteca java e empilha na pilha de 
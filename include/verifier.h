@@ -0,0 +1,122 @@
+//#################################################################################################
+/*! \file verifier.h
+ *
+ *  \brief Interface do Verificador de bytecodes da JVM.
+ *
+ *  Interface responsavel por verificar o codigo dos metodos de uma classe no seu carregamento e
+ *  disponibilizar os mapas de referencias usados pelo coletor de lixo e os objetos que, por nao
+ *  escaparem do seu metodo, podem ser alocados no frame.
+ */
+//##################################################################################################
+
+#ifndef VERIFIER_h
+#define VERIFIER_h
+#ifdef VERIFIER
+#define EXTV
+#else
+#define EXTV extern
+#endif
+
+#include "estruturas.h"
+
+
+//--------------------------------------------------------------------------------------------------
+//Categorias de uma variavel local ou posicao da pilha de operandos em um mapa de referencias
+
+#define VERIFIER_NotReference   0 //!< Valor que nao eh referencia (int, float, parte de long...)
+#define VERIFIER_Reference      1 //!< Referencia (ou nulo)
+#define VERIFIER_Unknown        2 //!< Nao inicializada ou de categorias diferentes em cada caminho
+
+//Estados de um local de alocacao cujo objeto nao escapa do metodo (AllocationSite)
+
+#define VERIFIER_SiteUnchecked  0 //!< Metodos invocados sobre o objeto ainda nao verificados
+#define VERIFIER_SiteLocal      1 //!< Objeto alocado no frame
+#define VERIFIER_SiteHeap       2 //!< Objeto alocado no heap: um metodo invocado o deixa escapar
+
+#define VERIFIER_MaxCallDepth   8 //!< Profundidade das invocacoes verificadas sobre um objeto
+#define VERIFIER_MaxThreads     16 //!< Numero maximo de threads de verificacao
+#define VERIFIER_ParallelCode   4096 //!< Bytes de codigo a partir dos quais a classe eh dividida
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que retorna o numero padrao de threads de verificacao: o numero de processadores.
+ *
+ * \return Numero de threads de verificacao
+ */
+EXTV u1 defaultVerifierThreads();
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que verifica o codigo dos metodos de uma classe, inferindo a categoria de cada variavel
+ * local e posicao da pilha de operandos em cada instrucao, e cria os mapas de referencias das
+ * instrucoes que podem iniciar uma coleta de lixo. A mesma analise de fluxo de dados encontra os
+ * locais de alocacao cujo objeto nao escapa do metodo. Os metodos sao divididos entre as threads
+ * de verificacao. Um metodo que nao pode ser verificado fica sem mapas, e os seus frames
+ * continuam sendo percorridos de forma conservadora.
+ *
+ * \param javaClass Classe carregada (arqClass preenchido)
+ * \param threads Numero de threads de verificacao
+ */
+EXTV void verifyClass(JavaClass* javaClass, u1 threads);
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que libera os resultados da verificacao de uma classe (mapas de referencias e analise de
+ * escape), na descarga da classe.
+ *
+ * \param javaClass Classe verificada
+ */
+EXTV void releaseVerifierData(JavaClass* javaClass);
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que retorna o mapa de referencias de uma instrucao. As instrucoes sao identificadas pelo
+ * seu ultimo byte, que eh o valor do PC durante a execucao da instrucao (frame do topo) e o PC
+ * salvo no frame do metodo invocado (demais frames).
+ *
+ * \param javaClass Classe do metodo
+ * \param method Metodo em execucao no frame
+ * \param pc Posicao do ultimo byte da instrucao em execucao
+ * \return Mapa de referencias (ou nulo se o metodo nao foi verificado ou a instrucao nao tem mapa)
+ */
+EXTV ReferenceMap* getReferenceMap(JavaClass* javaClass, method_info* method, int pc);
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que retorna a categoria de uma posicao de um mapa de referencias.
+ *
+ * \param map Mapa de referencias
+ * \param index Indice da posicao (variaveis locais seguidas das posicoes da pilha de operandos)
+ * \return Categoria da posicao (VERIFIER_*)
+ */
+EXTV u1 getReferenceMapSlot(ReferenceMap* map, u2 index);
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que retorna o resultado da analise de escape de um metodo.
+ *
+ * \param javaClass Classe do metodo
+ * \param method Metodo
+ * \return Resultado da analise (ou nulo se a classe nao foi verificada)
+ */
+EXTV MethodEscapeInfo* getEscapeInfo(JavaClass* javaClass, method_info* method);
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que retorna o local de alocacao de uma instrucao new cujo objeto nao escapa do metodo.
+ *
+ * \param javaClass Classe do metodo
+ * \param method Metodo em execucao no frame
+ * \param pc Posicao da instrucao new
+ * \return Local de alocacao (ou nulo se o objeto escapa ou o metodo nao foi verificado)
+ */
+EXTV AllocationSite* getAllocationSite(JavaClass* javaClass, method_info* method, int pc);
+
+#endif
@@ -10,15 +10,157 @@
 #define JAVAARRAY
 
 #include "../include/javaarray.h"
+#include "../include/heap.h"
+#include "../include/executionengine.h"
 
 
 //--------------------------------------------------------------------------------------------------
-JavaArray* newJavaArray(u4 n_atype, u2 n_count, void* n_arrayAddress){
+u4 getArrayElementSize(u4 atype){
+
+    switch (atype) {
+        case T_BOOLEAN:
+        case T_BYTE:
+            return sizeof(u1);
+        case T_CHAR:
+        case T_SHORT:
+            return sizeof(u2);
+        case T_LONG:
+        case T_DOUBLE:
+            return sizeof(u8);
+        default:
+            return sizeof(u4);
+    }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+u4 getArrayTypeFromDescriptor(char descriptor){
+
+    switch (descriptor) {
+        case 'Z': return T_BOOLEAN;
+        case 'C': return T_CHAR;
+        case 'F': return T_FLOAT;
+        case 'D': return T_DOUBLE;
+        case 'B': return T_BYTE;
+        case 'S': return T_SHORT;
+        case 'I': return T_INT;
+        case 'J': return T_LONG;
+        default: return T_REFERENCE;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+JavaArray* newJavaArray(u4 n_atype, u4 n_count, Thread* thread){
+    
+    //Tamanho calculado em 64 bits: arrays grandes nao podem estourar o tamanho do bloco
+    u8 size = sizeof(JavaArray) + (u8) n_count * getArrayElementSize(n_atype);
+    if (size > 0x7FFFFFFF) throwOutOfMemoryError();
     
-    JavaArray* array_info = (JavaArray*) malloc(sizeof(JavaArray));
+    JavaArray* array_info = (JavaArray*) heapAllocate(thread, (u4) size,
+                                n_atype == T_REFERENCE ? HEAP_ReferenceArray : HEAP_Array);
     array_info->atype = n_atype;
     array_info->count = n_count;
-    array_info->arrayAddress = n_arrayAddress;
     
     return array_info;
-}
\ No newline at end of file
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que preenche os elementos dos arrays de um nivel com arrays multidimensionais alocados
+ * separadamente (as dimensoes que nao fazem parte do slab). Os arrays do nivel sao alcancados
+ * pelas referencias, lidas novamente apos cada alocacao: uma coleta pode mover os blocos que nao
+ * estao em variaveis locais.
+ *
+ * \param array Array a partir do qual o nivel eh alcancado
+ * \param depth Numero de dimensoes entre o array e o nivel (zero se o array eh do nivel)
+ * \param n_atype Tipo dos elementos da ultima dimensao alocada (T_*)
+ * \param dimensions Numero de dimensoes dos subarrays
+ * \param counts Tamanho de cada dimensao dos subarrays
+ * \param thread Thread que realiza a alocacao
+ */
+static void fillSubarrays(JavaArray* array, u4 depth, u4 n_atype, u4 dimensions,
+                          const u4* counts, Thread* thread){
+    
+    //O array esta em uma variavel local, que fixa o seu bloco durante as coletas
+    for (u4 j = 0; j < array->count; j++) {
+        u4* elements = (u4*) (array + 1);
+        
+        if (depth > 0) {
+            fillSubarrays((JavaArray*) decodeReference(elements[j]), depth - 1, n_atype,
+                          dimensions, counts, thread);
+            continue;
+        }
+        
+        JavaArray* subarray = newJavaMultiArray(n_atype, dimensions, counts, thread);
+        elements[j] = encodeReference(subarray);
+        heapWriteBarrier(&elements[j]);
+    }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+JavaArray* newJavaMultiArray(u4 n_atype, u4 dimensions, const u4* counts, Thread* thread){
+    
+    u4 arrays[256], sizes[256];
+    u1 kinds[256];
+    u4 levels = 0;
+    u8 total = 1;
+    
+    //Um nivel para cada dimensao: o numero de arrays do nivel eh o produto dos tamanhos das
+    //dimensoes anteriores. Se um tamanho for zero, nenhuma dimensao seguinte eh alocada
+    while (levels < dimensions && total != 0) {
+        u4 atype = levels == dimensions - 1 ? n_atype : T_REFERENCE;
+        u8 size = sizeof(JavaArray) + (u8) counts[levels] * getArrayElementSize(atype);
+        
+        if (size > 0x7FFFFFFF || total > 0x7FFFFFFF) throwOutOfMemoryError();
+        
+        //Arrays grandes nao fazem parte do slab: eles vao para o espaco de objetos grandes
+        if (heapIsLargeArray((u4) size)) break;
+        
+        arrays[levels] = (u4) total;
+        sizes[levels] = (u4) size;
+        kinds[levels] = atype == T_REFERENCE ? HEAP_ReferenceArray : HEAP_Array;
+        total *= counts[levels];
+        levels++;
+    }
+    
+    //A primeira dimensao ja eh um array grande
+    if (levels == 0) {
+        JavaArray* array = newJavaArray(dimensions == 1 ? n_atype : T_REFERENCE, counts[0], thread);
+        if (dimensions > 1) fillSubarrays(array, 0, n_atype, dimensions - 1, counts + 1, thread);
+        return array;
+    }
+    
+    JavaArray* first = (JavaArray*) heapAllocateSlab(thread, levels, arrays, sizes, kinds);
+    
+    //Os arrays do slab estao em ordem de nivel e, em cada nivel, na ordem das linhas: os subarrays
+    //de um array sao os proximos ainda nao ligados do nivel seguinte
+    JavaArray* array = first;
+    JavaArray* child = first;
+    
+    for (u4 level = 0; level < levels; level++) {
+        for (u4 i = 0; i < arrays[level]; i++) {
+            array->atype = level == dimensions - 1 ? n_atype : T_REFERENCE;
+            array->count = counts[level];
+            
+            if (level + 1 < levels) {
+                u4* elements = (u4*) (array + 1);
+                
+                for (u4 j = 0; j < counts[level]; j++) {
+                    child = (JavaArray*) ((u1*) child + getHeapBlock(child)->size);
+                    elements[j] = encodeReference(child);
+                }
+            }
+            array = (JavaArray*) ((u1*) array + getHeapBlock(array)->size);
+        }
+    }
+    
+    //As dimensoes a partir do primeiro array grande sao alocadas separadamente, como elementos do
+    //ultimo nivel do slab
+    if (levels < dimensions && total != 0)
+        fillSubarrays(first, levels - 1, n_atype, dimensions - levels, counts + levels, thread);
+    
+    return first;
+}
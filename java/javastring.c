@@ -13,15 +13,39 @@
 #include <stdlib.h>
 #include <string.h>
 #include "../include/javastring.h"
+#include "../include/heap.h"
+#include "../include/classloader.h"
 
 
 //--------------------------------------------------------------------------------------------------
-JavaString* newJavaString(const wchar_t* string){
+JavaString* newJavaString(const wchar_t* string, Thread* thread){
 
-    JavaString* string_info = (JavaString*) malloc(sizeof(JavaString));
+    JavaString* string_info = (JavaString*) heapAllocate(thread, sizeof(JavaString), HEAP_String);
     string_info->tag = CONSTANT_StringJava;
     string_info->size =  wcslen(string);
-    string_info->stringAddress = (wchar_t*) string;
+    string_info->stringAddress = encodeReference((void*) string);
     
     return string_info;
-}
\ No newline at end of file
+}
+
+
+//--------------------------------------------------------------------------------------------------
+u4 getStringConstant(JavaClass* javaClass, u2 index, Thread* thread){
+
+    ResolvedPoolEntry* entry = &javaClass->resolvedPool[index-1];
+
+    if (entry->string != 0) return entry->string;
+
+    ConstantPool* constant_pool = javaClass->arqClass->constant_pool;
+    wchar_t* unicode = getUnicodeFromConstantPool(constant_pool, (u2) constant_pool->values[index]);
+
+    //Os caracteres sao copiados para o heap, como os de qualquer string java
+    size_t size = (wcslen(unicode) + 1) * sizeof(wchar_t);
+    wchar_t* string = (wchar_t*) heapAllocate(thread, size, HEAP_StringData);
+    memcpy(string, unicode, size);
+
+    entry->string = encodeReference(newJavaString(string, thread));
+    heapStaticWriteBarrier(javaClass);
+
+    return entry->string;
+}
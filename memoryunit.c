@@ -5,6 +5,7 @@
  *
  *  Modulo responsavel por implementar os metodos relacionados as operacoes na Memory Unit,
  *  com submodulos responsaveis por implementar: 
+ *  - Operacoes da tabela de simbolos da JVM
  *  - Operacoes da area de metodos da JVM
  *  - 
  */
@@ -15,11 +16,235 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
 #include "include/memoryunit.h"
 #include "include/executionengine.h"
 #include "include/classloader.h"
 #include "include/exceptions.h"
 #include "include/util.h"
+#include "include/heap.h"
+#include "include/verifier.h"
+
+//--------------------------------------------------------------------------------------------------
+// SUBMODULO: Operacoes da tabela de simbolos da JVM
+//--------------------------------------------------------------------------------------------------
+
+static SymbolTable symbolTable = {0, 0, NULL}; //!< Tabela de simbolos compartilhada por toda a JVM
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que calcula o hash (FNV-1a) de uma sequencia de bytes.
+ *
+ * \param bytes Bytes a serem utilizados
+ * \param length Numero de bytes
+ * \return Hash dos bytes
+ */
+u4 hashBytes(const u1* bytes, u2 length){
+
+    u4 hash = 2166136261u;
+
+    for (int i = 0; i < length; i++) hash = (hash ^ bytes[i]) * 16777619u;
+
+    return hash;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que dobra o numero de buckets da tabela de simbolos, redistribuindo os simbolos.
+ */
+void growSymbolTable(){
+
+    u4 size = symbolTable.buckets ? 2 * (symbolTable.mask + 1) : 256;
+    Symbol** buckets = (Symbol**) calloc(size, sizeof(Symbol*));
+
+    if (buckets == NULL)
+        JVMstopAbrupt("Erro de alocacao de memoria na tabela de simbolos.");
+
+    //Redistribuimos os simbolos ja existentes
+    if (symbolTable.buckets) {
+        for (u4 i = 0; i <= symbolTable.mask; i++) {
+            Symbol* symbol = symbolTable.buckets[i];
+            while (symbol) {
+                Symbol* next = symbol->next;
+                symbol->next = buckets[symbol->hash & (size - 1)];
+                buckets[symbol->hash & (size - 1)] = symbol;
+                symbol = next;
+            }
+        }
+        free(symbolTable.buckets);
+    }
+
+    symbolTable.mask = size - 1;
+    symbolTable.buckets = buckets;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+Symbol* internSymbol(const u1* bytes, u2 length){
+
+    //Ocupacao maxima de um simbolo por bucket
+    if (symbolTable.count >= symbolTable.mask) growSymbolTable();
+
+    u4 hash = hashBytes(bytes, length);
+
+    //Procuramos o simbolo no bucket
+    for (Symbol* symbol = symbolTable.buckets[hash & symbolTable.mask]; symbol; symbol = symbol->next)
+        if (symbol->hash == hash && symbol->length == length && memcmp(symbol->utf8, bytes, length) == 0)
+            return symbol;
+
+    //Simbolo novo: decodificamos uma unica vez
+    Symbol* symbol = (Symbol*) malloc(sizeof(Symbol) + length + 1);
+    symbol->unicode = (wchar_t*) malloc((length + 1) * sizeof(wchar_t));
+
+    if (symbol == NULL || symbol->unicode == NULL)
+        JVMstopAbrupt("Erro de alocacao de memoria na tabela de simbolos.");
+
+    symbol->hash = hash;
+    symbol->length = length;
+    symbol->signature = NULL;
+    symbol->classRefs = 0;
+    symbol->permanent = 0;
+    memcpy(symbol->utf8, bytes, length);
+    symbol->utf8[length] = '\0';
+    for (int i = 0; i < length; i++) symbol->unicode[i] = bytes[i];
+    symbol->unicode[length] = '\0';
+
+    //Inserimos no inicio do bucket
+    symbol->next = symbolTable.buckets[hash & symbolTable.mask];
+    symbolTable.buckets[hash & symbolTable.mask] = symbol;
+    symbolTable.count++;
+
+    return symbol;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+char* internString(const char* string){
+
+    Symbol* symbol = internSymbol((const u1*) string, (u2) strlen(string));
+
+    //Os enderecos obtidos aqui ficam guardados pela JVM, portanto o simbolo nunca eh liberado
+    symbol->permanent = 1;
+
+    return symbol->utf8;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+Symbol* getSymbolFromUTF8(const char* utf8){
+    
+    //Os bytes do simbolo ficam no final da propria estrutura Symbol
+    return (Symbol*) (utf8 - offsetof(Symbol, utf8));
+}
+
+
+//--------------------------------------------------------------------------------------------------
+void releaseSymbol(Symbol* symbol){
+
+    if (symbol->classRefs > 0) symbol->classRefs--;
+    if (symbol->classRefs > 0 || symbol->permanent) return;
+
+    //Retiramos o simbolo do seu bucket
+    Symbol** link = &symbolTable.buckets[symbol->hash & symbolTable.mask];
+    while (*link != NULL && *link != symbol) link = &(*link)->next;
+    if (*link == NULL) return;
+
+    *link = symbol->next;
+    symbolTable.count--;
+
+    if (symbol->signature != NULL) {
+        free(symbol->signature->argTypes);
+        free(symbol->signature);
+    }
+    free(symbol->unicode);
+    free(symbol);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+u1 parseDescriptorType(const char** descriptor){
+    
+    const char* c = *descriptor;
+    u1 type;
+    
+    switch (*c) {
+        case 'Z': type = TYPE_Boolean; break;
+        case 'B': type = TYPE_Byte; break;
+        case 'C': type = TYPE_Char; break;
+        case 'S': type = TYPE_Short; break;
+        case 'I': type = TYPE_Int; break;
+        case 'F': type = TYPE_Float; break;
+        case 'J': type = TYPE_Long; break;
+        case 'D': type = TYPE_Double; break;
+        case 'V': type = TYPE_Void; break;
+            
+        case 'L':
+            if (strncmp(c, "Ljava/lang/String;", 18) == 0) type = TYPE_String;
+            else if (strncmp(c, "Ljava/lang/Object;", 18) == 0) type = TYPE_Object;
+            else type = TYPE_Reference;
+            while (*c && *c != ';') c++;
+            break;
+            
+        case '[':
+            type = TYPE_Reference;
+            while (*c == '[') c++;
+            if (*c == 'L') while (*c && *c != ';') c++;
+            break;
+            
+        default:
+            JVMstopAbrupt("Descritor invalido.");
+            return TYPE_Void;
+    }
+    
+    *descriptor = c + 1;
+    
+    return type;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+u1 getFieldType(const char* descriptor){
+    
+    return parseDescriptorType(&descriptor);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+Signature* getSignature(const char* descriptor){
+    
+    Symbol* symbol = getSymbolFromUTF8(descriptor);
+    
+    //O descritor eh processado somente no primeiro uso
+    if (symbol->signature) return symbol->signature;
+    
+    if (descriptor[0] != '(') JVMstopAbrupt("Descritor de metodo invalido.");
+    
+    Signature* signature = (Signature*) malloc(sizeof(Signature));
+    //Um descritor nao pode ter mais argumentos que caracteres
+    signature->argTypes = (u1*) malloc(symbol->length);
+    signature->argCount = 0;
+    signature->argSlots = 0;
+    
+    //Pulamos o '(' e decodificamos cada argumento
+    const char* c = &descriptor[1];
+    while (*c && *c != ')') {
+        u1 type = parseDescriptorType(&c);
+        signature->argTypes[signature->argCount++] = type;
+        //Long e double ocupam dois u4
+        signature->argSlots += (type == TYPE_Long || type == TYPE_Double) ? 2 : 1;
+    }
+    
+    if (*c != ')') JVMstopAbrupt("Descritor de metodo invalido.");
+    c++;
+    signature->returnType = parseDescriptorType(&c);
+    
+    symbol->signature = signature;
+    
+    return signature;
+}
+
 
 //--------------------------------------------------------------------------------------------------
 // SUBMODULO: Operacoes da area de metodos da JVM
@@ -43,9 +268,9 @@ JavaClass* findJavaClassOnMethodArea(const char* qualifiedName, MethodArea* meth
     //Se for uma classe de bibliotecas java
     if (javaLibIsFrom(qualifiedName)) return (JavaClass*) 1;
     
-    //Pesquisamos a classe
+    //Pesquisamos a classe (nomes sao simbolos, basta comparar os enderecos)
     for (int i = 0; i < methodArea->classCount; i++)
-        if (strcmp(qualifiedName, methodArea->classTable[i].name)==0)
+        if (qualifiedName == methodArea->classTable[i].name)
             return methodArea->classTable[i].javaClass;
     
     return NULL;
@@ -85,51 +310,123 @@ void addJavaClassToMethodArea(JavaClass* javaClass, MethodArea* methodArea){
 }
 
 
+//--------------------------------------------------------------------------------------------------
+void unloadJavaClass(JavaClass* javaClass, MethodArea* methodArea){
+
+    int index = 0;
+
+    while (index < methodArea->classCount && methodArea->classTable[index].javaClass != javaClass)
+        index++;
+
+    if (index == methodArea->classCount) return;
+
+    //Retiramos a classe da area de metodos, mantendo a ordem de carregamento das demais
+    memmove(&methodArea->classTable[index], &methodArea->classTable[index + 1],
+            (methodArea->classCount - index - 1) * sizeof(ClassTable));
+    methodArea->classCount--;
+
+    //As entradas resolvidas para a classe (ou para os seus campos e metodos) sao desfeitas
+    for (int i = 0; i < methodArea->classCount; i++) {
+        JavaClass* class = methodArea->classTable[i].javaClass;
+
+        for (int j = 0; j < class->arqClass->constant_pool_count - 1; j++)
+            if (class->resolvedPool[j].javaClass == javaClass)
+                memset(&class->resolvedPool[j], 0, sizeof(ResolvedPoolEntry));
+    }
+
+    //Os campos estaticos, o codigo e a tabela de metodos ficam na arena da classe
+    releaseVerifierData(javaClass);
+    free(javaClass->resolvedPool);
+    LECLASS_free(javaClass->arqClass);
+    free(javaClass->arqClass);
+    free(javaClass);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que calcula o hash do par (nome, descritor) de um metodo. Como nome e descritor sao
+ * simbolos, o hash eh calculado sobre os seus enderecos.
+ *
+ * \param name Nome do metodo (simbolo)
+ * \param descriptor Descritor do metodo (simbolo)
+ * \return Hash do par
+ */
+u4 hashMethodKey(const char* name, const char* descriptor){
+
+    u4 hash = (u4) ((uintptr_t) name >> 3) * 2654435761u;
+    hash = (hash ^ (u4) ((uintptr_t) descriptor >> 3)) * 2654435761u;
+
+    return hash ^ (hash >> 16);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+MethodTable* newMethodTable(JavaClass* javaClass){
+
+    ArqClass* arqClass = javaClass->arqClass;
+    MethodTable* methodTable = (MethodTable*) arenaAllocate(arqClass->arena, sizeof(MethodTable));
+
+    //Tamanho potencia de 2 com no maximo 50% de ocupacao
+    u4 size = 4;
+    while (size < 2 * (u4) arqClass->methods_count) size <<= 1;
+
+    //A tabela fica na arena da classe, junto dos method_info que ela referencia
+    methodTable->mask = size - 1;
+    methodTable->entries = (MethodTableEntry*) arenaAllocate(arqClass->arena,
+                                                             size * sizeof(MethodTableEntry));
+
+    for (int i = 0; i < arqClass->methods_count; i++) {
+
+        //Nome e descritor ja sao simbolos
+        char* name = getUTF8FromConstantPool(arqClass->constant_pool, arqClass->methods[i].name_index);
+        char* descriptor = getUTF8FromConstantPool(arqClass->constant_pool,
+                                                   arqClass->methods[i].descriptor_index);
+        u4 hash = hashMethodKey(name, descriptor);
+
+        //Sondagem linear ate uma entrada vazia
+        u4 slot = hash & methodTable->mask;
+        while (methodTable->entries[slot].method != NULL) slot = (slot + 1) & methodTable->mask;
+
+        methodTable->entries[slot].hash = hash;
+        methodTable->entries[slot].name = name;
+        methodTable->entries[slot].descriptor = descriptor;
+        methodTable->entries[slot].method = &arqClass->methods[i];
+    }
+
+    return methodTable;
+}
+
+
 //--------------------------------------------------------------------------------------------------
 method_info* getMethodInfoFromClass(JavaClass* javaClass,
                                           const char* methodName,
                                           const char* methodDescriptor){
-    
-    for (int i = 0 ; i< javaClass->arqClass->methods_count; i++) {
-        
-        //Buscamos nome do metodo
-        char* actMethodName =
-        getUTF8FromConstantPool(javaClass->arqClass->constant_pool,
-                                javaClass->arqClass->methods[i].name_index);
-        
-        //Buscamos descritor do metodo
-        char* actMethodDescriptor =
-        getUTF8FromConstantPool(javaClass->arqClass->constant_pool,
-                                javaClass->arqClass->methods[i].descriptor_index);
-        
-        
+
+    MethodTable* methodTable = javaClass->methodTable;
+    u4 hash = hashMethodKey(methodName, methodDescriptor);
+
+    //Percorremos as entradas a partir do slot do hash ate encontrar uma entrada vazia
+    for (u4 slot = hash & methodTable->mask;
+         methodTable->entries[slot].method != NULL;
+         slot = (slot + 1) & methodTable->mask) {
+
+        MethodTableEntry* entry = &methodTable->entries[slot];
+
         //Comparamos para verificar se eh ou nao o metodo. Caso sim, retornamos o metodo.
-        if (strcmp(methodName, actMethodName) == 0 &&
-            strcmp(methodDescriptor, actMethodDescriptor) == 0) {
-            return &javaClass->arqClass->methods[i];
+        if (methodName == entry->name && methodDescriptor == entry->descriptor) {
+            return entry->method;
         }
     }
-    
+
     return NULL;
 }
 
 
 //--------------------------------------------------------------------------------------------------
-CodeAttribute* getCodeFromMethodInfo(method_info* method, cp_info* constant_pool){
+CodeAttribute* getCodeFromMethodInfo(method_info* method, ConstantPool* constant_pool){
     
-    for (int i = 0; i< method->attributes_count; i++) {
-        //Obtemos o nome do atributo
-        char* attrName = getUTF8FromConstantPool(constant_pool,
-                                                 method->attributes[i].attribute_name_index);
-        
-        //Se for o atributo code, criamos, preenchemos e retornamos uma estrutura CodeAttribute
-        if(strcmp(attrName, "Code")==0) {
-            free(attrName);
-            return parseCode(method->attributes[i].info);
-        }
-    }
-
-    return NULL;
+    return method->code;
 }
 
 
@@ -145,7 +442,7 @@ CodeAttribute* getCodeAttributeFromMethod(JavaClass* javaClass,
 
 
 //--------------------------------------------------------------------------------------------------
-u1 getByteCodeFromMethod(method_info* methodInfo, cp_info* constant_pool, int pc){
+u1 getByteCodeFromMethod(method_info* methodInfo, ConstantPool* constant_pool, int pc){
     
     u1 result;
     
@@ -153,62 +450,41 @@ u1 getByteCodeFromMethod(method_info* methodInfo, cp_info* constant_pool, int pc
     
     result = code->code[pc];
     
-    free(code);
-    
     return result;
 }
 
 
 //--------------------------------------------------------------------------------------------------
-/*!
- * Metodo que, dado um ponteiro para uma estrutura field_info e o pool de constantes contendo as
- * constantes relativas ao campo, busca e retorna uma referencia para o atributo constant_value,
- * o qual estara preenchido.
- *
- * \param field Referencia para o field_info contendo a referencia para constant_value
- * \param cp Referencia para o pool de constantes da classe do campo
- * \return Referencia para uma estrutura ConstantValueAttribute referente ao campo buscado
- */
-ConstantValueAttribute* getConstantValueAtrributeFromField(field_info* field, cp_info* cp){
+void* getClassAttributeReference(const char* className, const char* attributeName,
+                                 Environment* environment){
+    
+    //TODO: Checar restricao de acesso ao atributo
     
-    for (int j = 0; j < field->attributes_count; j++) {
+    //Buscamos o campo na classe e, caso nao exista, nas superclasses
+    for (JavaClass* class = getClass(className, environment); class; class = class->superClass) {
         
-        if (strcmp(getUTF8FromConstantPool(cp, field->attributes[j].attribute_name_index), "ConstantValue")==0) {
-            ConstantValueAttribute* constantValue = parseConstantValue(field->attributes[j].info);
-            return constantValue;
-        }
+        Fields* fields = class->staticFields;
+        
+        for (int i = 0 ; i < fields->fieldsCount; i++)
+            if (attributeName == fields->fieldsTable[i].name)
+                return class->staticData + fields->fieldsTable[i].offset;
     }
-
+    
     return NULL;
 }
 
 
 //--------------------------------------------------------------------------------------------------
-/*!
- * Metodo que, da uma referencia para uma estrtutura javaClass e um nome de um atributo, busca
- * um atributo final na classe com este nome. Caso exista, retonamos uma referencia para o valor
- * do atributo no pool de constantes. Caso nao exista, retorna nulo.
- *
- * \param javaClass Referencia para a Estrutura javaClass
- * \param attributeName Nome do atributo a ser pesquisado
- * \return Referencia para o valor do atributo final
- */
-void* getClassFinalStaticAttributeReference(JavaClass* javaClass, const char* attributeName){
+void* getObjectAttributeReference(Object* object, const char* attributeName){
     
-    for (int i = 0; i< javaClass->arqClass->fields_count; i++) {
-        
-        field_info* field = &javaClass->arqClass->fields[i];
-        
-        if ( strcmp(getUTF8FromConstantPool(javaClass->arqClass->constant_pool, field->name_index), attributeName) == 0 &&
-            field->access_flags & ACC_FINAL &&
-            field->access_flags & ACC_STATIC ) {
-            
-            //Procuramos o atributo constant value
-            ConstantValueAttribute* contantValue =
-            getConstantValueAtrributeFromField(field, javaClass->arqClass->constant_pool);
-            
-            //Retornamos a referencia para o valor (sempre se encontra apos a tag, nao importa o tipo)
-            if (contantValue) return &javaClass->arqClass->constant_pool[contantValue->constantvalue_index].u.Float.bytes;
+    //TODO: Checar restricao de acesso ao atributo
+    
+    Fields* fields = object->javaClass->instanceFields;
+    
+    //Buscamos a partir da classe mais derivada (campos da classe ficam apos os herdados)
+    for (int i = fields->fieldsCount - 1; i >= 0; i--) {
+        if (attributeName == fields->fieldsTable[i].name) {
+            return (u1*) object + fields->fieldsTable[i].offset;
         }
     }
     return NULL;
@@ -216,79 +492,69 @@ void* getClassFinalStaticAttributeReference(JavaClass* javaClass, const char* at
 
 
 //--------------------------------------------------------------------------------------------------
-void* getClassAttributeReference(const char* className, const char* attributeName,
-                                 Environment* environment){
-    
-    JavaClass* class = getClass(className, environment);
-    
-    //TODO: Checar restricao de acesso ao atributo
-    
-    for (int i = 0 ; i < class->staticFields->fieldsCount; i++)
-        if (strcmp(attributeName, class->staticFields->fieldsTable[i].name) == 0)
-            return class->staticFields->fieldsTable[i].memoryAddress;
-    
-    //Verificamos se é final
-    return getClassFinalStaticAttributeReference(class, attributeName);
+Object* newObjectFromClass(const char* className, Environment* environment ){
+
+    return newObjectFromJavaClass(getClass(className, environment), environment);
 }
 
 
 //--------------------------------------------------------------------------------------------------
-void* getObjectAttributeReference(Object* object, const char* attributeName){
+Object* newObjectFromJavaClass(JavaClass* javaClass, Environment* environment){
     
-    //TODO: Checar restricao de acesso ao atributo
+    //Cabecalho e campos em um unico bloco, com os campos inicializados com o valor default (zero)
+    Object* object = (Object*) heapAllocate(environment->thread, javaClass->instanceSize,
+                                            HEAP_Object);
     
-    for (int i = 0; i < object->handler->fields->fieldsCount; i++) {
-        if (strcmp(attributeName, object->handler->fields->fieldsTable[i].name)==0) {
-            return object->handler->fields->fieldsTable[i].memoryAddress;
-        }
-    }
-    return NULL;
+    object->javaClass = javaClass;
+
+    return object;
 }
 
 
 //--------------------------------------------------------------------------------------------------
-/*!
- * Metodo que, da uma referencia para uma estrutura javaClass e uma referencia a um objeto, adiciona
- * este objeto na lista de objetos da classe. A adicao acontece na forma de empilhamento.
- *
-* \param object Referencia ao objeto adicionado
- * \param javaClass Referencia para a Estrutura javaClass
- */
-void addObjectReferenceToJavaClass(Object* object, JavaClass* javaClass){
+Object* newLocalObject(Frame* frame, JavaClass* javaClass, AllocationSite* site,
+                       Environment* environment){
     
-    ObjectList* newObject = (ObjectList*)malloc(sizeof(ObjectList));
+    //Vetor de objetos locais do frame, com uma posicao para cada local de alocacao do metodo
+    if (frame->localObjects == NULL) {
+        MethodEscapeInfo* escapeInfo = getEscapeInfo(frame->javaClass, frame->method_info);
+        frame->localObjects = (u4*) calloc(escapeInfo->siteCount, sizeof(u4));
+    }
     
-    newObject->object = object;
-
-    //Caso a lista esteja vazia, simplesmente adicionamos o objeto.
-    if (!javaClass->objectList) {
-        javaClass->objectList = newObject;
-        newObject->next = NULL;
+    Object* object = (Object*) decodeReference(frame->localObjects[site->slot]);
+    
+    //O objeto da execucao anterior do local de alocacao nao esta mais vivo e eh reutilizado
+    if (object != NULL) {
+        memset(object, 0, javaClass->instanceSize);
     }
-    //Caso nao, adicionamos o na lista (em forma de pilha)
-    else{
-        newObject->next = javaClass->objectList;
-        javaClass->objectList = newObject;
+    else {
+        object = (Object*) heapAllocateLocal(environment->thread, javaClass->instanceSize,
+                                             HEAP_Object);
+        
+        if (object == NULL) return NULL;
+        
+        frame->localObjects[site->slot] = encodeReference(object);
     }
+    
+    object->javaClass = javaClass;
+    
+    return object;
 }
 
-//--------------------------------------------------------------------------------------------------
-Object* newObjectFromClass(const char* className, Environment* environment ){
 
-    JavaClass* javaClass = getClass(className, environment);
-    
-    Object* object = (Object*) malloc(sizeof(Object));
-    object->handler = (Handler*) malloc(sizeof(Handler));
+//--------------------------------------------------------------------------------------------------
+u4 getObjectHash(Object* object){
     
-    object->handler->javaClass = javaClass;
+    static u4 seed = 2463534242u; //Estado do gerador xorshift
     
-    //Alocamos espaco na tabela de campos para o numero de campos
-    object->handler->fields = classInitializeFields(javaClass, 0xFFFF, ACC_STATIC);
+    while (object->hash == 0) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        object->hash = seed & 0x7FFFFFFF;
+    }
     
-    //Adicionamos uma referencia ao objeto na lista de objetos da classe
-    addObjectReferenceToJavaClass(object, javaClass);
-
-    return object;
+    return object->hash;
 }
 
 
@@ -306,29 +572,89 @@ Thread* newThread(){
     
     thread->vmStack = NULL;
     
+    //O primeiro TLAB eh obtido na primeira alocacao
+    thread->tlabTop = NULL;
+    thread->tlabEnd = NULL;
+    
+    //A regiao de objetos locais eh criada na inicializacao do heap
+    thread->localBase = NULL;
+    thread->localTop = NULL;
+    thread->localEnd = NULL;
+    
     return thread;    
 }
 
 
 //--------------------------------------------------------------------------------------------------
-Frame* pushFrame(Environment* environment, const char* className, const char* methodName,
-               const char*  MethodDescriptor){
+/*!
+ * Metodo que cria um frame vazio e o empilha na pilha da thread, salvando o PC do metodo anterior.
+ *
+ * \param thread Thread contendo a pilha JVM
+ * \return referencia para o frame criado
+ */
+Frame* newFrameOnStack(Thread* thread){
     
     Frame* newFrame = (Frame*) malloc(sizeof(Frame));
     
-    
     //Salvamos o pc do metodo anterior
-    newFrame->returnPC = environment->thread->PC;
+    newFrame->returnPC = thread->PC;
+    
+    //O coletor de lixo pode percorrer o frame antes que o seu metodo seja carregado
+    newFrame->javaClass = NULL;
+    newFrame->method_info = NULL;
+    newFrame->localVariablesVector = NULL;
+    newFrame->maxLocals = 0;
+    newFrame->opStk = NULL;
+    
+    //Os objetos locais alocados pelo frame ficam acima do topo atual da regiao
+    newFrame->localObjects = NULL;
+    newFrame->localMark = thread->localTop;
     
     //Colocamos pc na posicao de inicio do codigo do novo metodo
-    environment->thread->PC = 0;
+    thread->PC = 0;
     
     //Empilhamos o frame
     VMStack* newStackFrame = (VMStack*) malloc(sizeof(VMStack));
-    newStackFrame->next = environment->thread->vmStack;
-    environment->thread->vmStack = newStackFrame;
+    newStackFrame->next = thread->vmStack;
+    thread->vmStack = newStackFrame;
+    
+    thread->vmStack->top = newFrame;
+    
+    return newFrame;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que aloca o vetor de variaveis locais e a pilha de operandos de um frame, de acordo com
+ * o atributo code do seu metodo.
+ *
+ * \param frame Frame com javaClass e method_info ja preenchidos
+ */
+void allocateFrameStorage(Frame* frame){
+    
+    //Obtemos o atributo code do metodo
+    CodeAttribute* methodCode = getCodeFromMethodInfo(frame->method_info,
+                                                      frame->javaClass->arqClass->constant_pool);
+    
+    //Lancamento de erro caso nao exista atributo code
+    if(methodCode == NULL)
+        JVMstopAbrupt("Metodo nao possui atributo CODE.");
+    
+    //Alocamos o array de variaveis locais
+    frame->localVariablesVector = (u4*) calloc(methodCode->max_locals, sizeof(u4));
+    frame->maxLocals = methodCode->max_locals;
+    
+    //Alocamos a pilha de operandos
+    frame->opStk = (OperandStack*) calloc(methodCode->max_stack+1, sizeof(OperandStack));
+}
+
+
+//--------------------------------------------------------------------------------------------------
+Frame* pushFrame(Environment* environment, const char* className, const char* methodName,
+               const char*  MethodDescriptor){
     
-    environment->thread->vmStack->top = newFrame;
+    Frame* newFrame = newFrameOnStack(environment->thread);
     
     newFrame->javaClass = getClass(className, environment);
     
@@ -345,21 +671,21 @@ Frame* pushFrame(Environment* environment, const char* className, const char* me
     JVMstopAbrupt(buffer);
     }
     
-    //Obtemos o atributo code do metodo
-    CodeAttribute* methodCode = getCodeAttributeFromMethod(newFrame->javaClass, methodName,
-                                                           MethodDescriptor);
+    allocateFrameStorage(newFrame);
     
-    //Lancamento de erro caso nao exista atributo code
-    if(methodCode == NULL)
-        JVMstopAbrupt("Metodo nao possui atributo CODE.");
+    return newFrame;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+Frame* pushMethodFrame(Environment* environment, JavaClass* javaClass, method_info* method){
     
-    //Alocamos o array de variaveis locais
-    newFrame->localVariablesVector = (u4*) calloc(methodCode->max_locals, sizeof(u4));
+    Frame* newFrame = newFrameOnStack(environment->thread);
     
-    //Alocamos a pilha de operandos
-    newFrame->opStk = (OperandStack*) calloc(methodCode->max_stack+1, sizeof(OperandStack));
+    newFrame->javaClass = javaClass;
+    newFrame->method_info = method;
     
-    free(methodCode);
+    allocateFrameStorage(newFrame);
     
     return newFrame;
 }
@@ -377,6 +703,7 @@ void freeFrame(Frame* frame){
     
     free(frame->opStk);
     free(frame->localVariablesVector);
+    free(frame->localObjects);
     free(frame);
 }
 
@@ -392,6 +719,9 @@ void popFrame(Thread* thread){
         //Retornamos PC
         thread->PC = oldStackFrame->top->returnPC;
         
+        //Liberamos os objetos locais do frame
+        thread->localTop = oldStackFrame->top->localMark;
+        
         //Liberamos o frame da memoria
         freeFrame(oldStackFrame->top);
     }
@@ -24,6 +24,7 @@
 #include "include/memoryunit.h"
 #include "include/javastring.h"
 #include "include/classloader.h"
+#include "include/heap.h"
 
 //--------------------------------------------------------------------------------------------------
 // SUBMODULO: Decoder
@@ -56,6 +57,57 @@ void javaLibExecuteMethod(const char* className, const char* methodName, const c
 }
 
 
+//--------------------------------------------------------------------------------------------------
+int javaLibFollowsDescriptor(const char* className, const char* methodName,
+                             const char* descriptorName, int hasReceiver){
+    
+    //Numero de u4 consumidos e produzidos segundo o descritor
+    const char* c = &descriptorName[1];
+    int argCount = 0, argSlots = 0;
+    u1 argType = TYPE_Void;
+    
+    while (*c && *c != ')') {
+        u1 type = parseDescriptorType(&c);
+        if (argCount++ == 0) argType = type;
+        argSlots += (type == TYPE_Long || type == TYPE_Double) ? 2 : 1;
+    }
+    if (*c == ')') c++;
+    u1 returnType = parseDescriptorType(&c);
+    
+    int consumed = argSlots + (hasReceiver ? 1 : 0);
+    int produced = returnType == TYPE_Void ? 0 :
+                   (returnType == TYPE_Long || returnType == TYPE_Double) ? 2 : 1;
+    
+    //Numero de u4 desempilhados e empilhados pela simulacao: a maioria dos metodos desempilha um
+    int popped = 1, pushed = 0;
+    
+    if (strncmp(className, "java/lang/StringBuffer", 22)==0) {
+        if (strncmp(methodName, "toString", 6)==0) pushed = 1;
+        else if (strncmp(methodName, "append", 6)==0) {
+            //Arrays nao sao simulados: nada eh desempilhado
+            if (argCount != 1 || argType == TYPE_Reference) popped = 0;
+            else {
+                popped = argSlots + 1;
+                pushed = 1;
+            }
+        }
+    }
+    else if (strncmp(className, "java/lang/Object", 16)==0) {
+        if (strncmp(methodName, "getClass", 8)==0) popped = 0;
+        else if (strncmp(methodName, "hashCode", 8)==0) pushed = 1;
+    }
+    else if (strncmp(className, "java/lang/System", 16)==0) {
+        if (strncmp(methodName, "identityHashCode", 16)==0) pushed = 1;
+    }
+    else if (strncmp(className, "java/io/PrintStream", 19)==0) {
+        //O argumento de println (ou um u4, se nao houver exatamente um) e o PrintStream
+        if (strncmp(methodName, "println", 7)==0) popped = (argCount == 1 ? argSlots : 1) + 1;
+    }
+    
+    return popped == consumed && pushed == produced;
+}
+
+
 //--------------------------------------------------------------------------------------------------
 void javaLibGetStatic(const char* className, const char* fieldName,
                           const char* fieldDescriptor, Environment* environment){
@@ -145,54 +197,50 @@ u2 concat2Bytes(u1 high_bytes, u1 low_bytes){
 /*!
  * Metodo que decodifica e simula a execucao do metodo de java.io.java.io.PrintStream.println
  *
- * \param descriptor Descritor do metodo a ser executado.
+ * \param descriptor Descritor do metodo a ser executado (simbolo).
  * \param environment Ambiente de execucao atual.
  */
 void printStreamPrintln(const char* descriptorName, Environment* environment){
+    
+    //Tipo do argumento de println, obtido do descritor pre-processado
+    Signature* signature = getSignature(descriptorName);
+    u1 argType = signature->argCount == 1 ? signature->argTypes[0] : TYPE_Void;
+    
     //Strings
-    if (strncmp(descriptorName, "(Ljava/lang/String;)V", 21)==0) {
+    if (argType == TYPE_String) {
         
-        JavaString* string = (JavaString*) popFromOperandStack(environment->thread);
+        JavaString* string =
+            (JavaString*) decodeReference(popFromOperandStack(environment->thread));
         
-        //Se for JavaString
+        //Se for JavaString (constantes String tambem sao JavaStrings)
         if(string->tag == CONSTANT_StringJava){
-            printf("\n%ls", string->stringAddress);
-        }
-        //Se for referencia de string para o pool de constantes
-        else{
-            cp_info* stringCP = (cp_info*) string;
-            
-            wchar_t* unicodeString = getUnicodeFromConstantPool(environment->thread->vmStack->top->javaClass->arqClass->constant_pool, stringCP->u.String.string_index);
-            
-            printf("\n%ls", unicodeString);
+            printf("\n%ls", (wchar_t*) decodeReference(string->stringAddress));
         }
     }
     //Decodificamos pelos tipos numericos, char e bool
-    else if (strncmp(descriptorName, "(I)V", 4)==0 ||
-             strncmp(descriptorName, "(S)V", 4)==0 ||
-             strncmp(descriptorName, "(B)V", 4)==0)
+    else if (argType == TYPE_Int || argType == TYPE_Short || argType == TYPE_Byte)
         printf("\n%d", (int) popFromOperandStack(environment->thread));
     
-    else if (strncmp(descriptorName, "(C)V", 4)==0)
+    else if (argType == TYPE_Char)
         printf("\n%c", (char) popFromOperandStack(environment->thread));
     
-    else if (strncmp(descriptorName, "(F)V", 4)==0)
+    else if (argType == TYPE_Float)
         printf("\n%.2f",  u4ToFLoat(popFromOperandStack(environment->thread)));
     
-    else if (strncmp(descriptorName, "(J)V", 4)==0){
+    else if (argType == TYPE_Long){
         u8 bytesl = popFromOperandStack(environment->thread);
         u8 low_Bytes = popFromOperandStack(environment->thread);
         bytesl = bytesl << 32 | low_Bytes;
-        printf("\n%lld", bytesl);
+        printf("\n%lld", (long long) bytesl);
     }
     
-    else if (strncmp(descriptorName, "(D)V", 4)==0){
+    else if (argType == TYPE_Double){
         u4 high = popFromOperandStack(environment->thread);
         u4 low = popFromOperandStack(environment->thread);
         printf("\n%.2lf", u4ToDouble(high, low));
     }
     
-    else if (strncmp(descriptorName, "(Z)V", 4)==0)
+    else if (argType == TYPE_Boolean)
         printf("\n%s", ((int) popFromOperandStack(environment->thread)) == 0 ? "false" : "true");
     
     else
@@ -251,6 +299,24 @@ void javaIONewObject(const char* className, Environment* environment){
 // SUBMODULO: java.lang
 //--------------------------------------------------------------------------------------------------
 
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que retorna o hash de identidade de uma referencia (Object.hashCode e
+ * System.identityHashCode). Arrays e strings nao tem cabecalho de objeto: o hash eh a propria
+ * referencia.
+ *
+ * \param reference Referencia (ou nulo)
+ * \return Hash de identidade (zero para nulo)
+ */
+static u4 identityHash(u4 reference){
+    
+    if (reference == 0) return 0;
+    
+    if (getHeapBlock(decodeReference(reference))->kind != HEAP_Object) return reference;
+    
+    return getObjectHash((Object*) decodeReference(reference));
+}
+
 
 //--------------------------------------------------------------------------------------------------
 /*!
@@ -263,62 +329,77 @@ void javaIONewObject(const char* className, Environment* environment){
  */
 void systemExecuteMethod(const char* className, const char* methodName,
                          const char* descriptorName, Environment* environment){
-        popFromOperandStack(environment->thread);
+    
+    u4 reference = popFromOperandStack(environment->thread);
+    
+    if (strncmp(methodName, "identityHashCode", 16)==0)
+        pushInOperandStack(environment->thread, identityHash(reference));
 }
 
 
 
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que aloca no heap um novo buffer para um StringBuffer, com o conteudo do buffer atual.
+ * O buffer antigo deixa de ser referenciado pelo StringBuffer.
+ *
+ * \param stringBuffer Buffer atual do StringBuffer
+ * \param length Numero de caracteres (incluindo o '\0') do novo buffer
+ * \param environment Ambiente de execucao atual.
+ * \return Novo buffer do StringBuffer
+ */
+static wchar_t* resizeStringBuffer(wchar_t* stringBuffer, u4 length, Environment* environment){
+    
+    wchar_t* newBuffer = (wchar_t*) heapAllocate(environment->thread, length*sizeof(wchar_t),
+                                                 HEAP_StringData);
+    wcscpy(newBuffer, stringBuffer);
+    
+    return newBuffer;
+}
+
+
 //--------------------------------------------------------------------------------------------------
 /*!
  * Metodo que decodifica e simula a execucao do metodo de java.lang.StringBuffer.append
  *
- * \param descriptor Descritor do metodo a ser executado.
+ * \param descriptor Descritor do metodo a ser executado (simbolo).
  * \param environment Ambiente de execucao atual.
  */
 void stringBufferAppend(const char* descriptorName, Environment* environment){
+    
+    //Tipo do argumento de append, obtido do descritor pre-processado
+    Signature* signature = getSignature(descriptorName);
+    u1 argType = signature->argCount == 1 ? signature->argTypes[0] : TYPE_Void;
+    
     //Se a entrada for uma string
-    if (strncmp(descriptorName, "(Ljava/lang/String;)Ljava/lang/StringBuffer;", 44)==0 ||
-        strncmp(descriptorName, "(Ljava/lang/Object;)Ljava/lang/StringBuffer;", 44)==0) {
+    if (argType == TYPE_String || argType == TYPE_Object) {
         
-        JavaString* string = (JavaString*) popFromOperandStack(environment->thread);
-        wchar_t* stringBuffer = (wchar_t*) popFromOperandStack(environment->thread);
+        JavaString* string =
+            (JavaString*) decodeReference(popFromOperandStack(environment->thread));
+        wchar_t* stringBuffer =
+            (wchar_t*) decodeReference(popFromOperandStack(environment->thread));
         
         //Se for JavaString
         if(string->tag == CONSTANT_StringJava){
             //Realocacao do buffer
-            stringBuffer = (wchar_t*) realloc(stringBuffer,
-                                              (wcslen(stringBuffer)+string->size+1)*sizeof(wchar_t));
-            //Concatenamos
-            wcsncat(stringBuffer, string->stringAddress, string->size);
-        }
-        //Se for referencia de string para o pool de constantes
-        else{
-            cp_info* stringCP = (cp_info*) string;
-            
-            wchar_t* unicodeString = getUnicodeFromConstantPool(environment->thread->vmStack->top->javaClass->arqClass->constant_pool, stringCP->u.String.string_index);
-            
-            int stringBuferLenght = wcslen(stringBuffer);
-            //Realocacao do buffer
-            stringBuffer = (wchar_t*) realloc(stringBuffer,
-                                              (stringBuferLenght+wcslen(unicodeString)+1)*sizeof(wchar_t));
+            stringBuffer = resizeStringBuffer(stringBuffer, wcslen(stringBuffer)+string->size+1,
+                                              environment);
             //Concatenamos
-            wcscat(stringBuffer, unicodeString);
+            wcsncat(stringBuffer, (wchar_t*) decodeReference(string->stringAddress), string->size);
         }
         //Empilhamos o string buffer
-        pushInOperandStack(environment->thread, (u4) stringBuffer);
+        pushInOperandStack(environment->thread, encodeReference(stringBuffer));
     }
     
     //Para cada tipo numerico, bool ou char
-    else if(strncmp(descriptorName, "(I)Ljava/lang/StringBuffer;", 44)==0 ||
-            strncmp(descriptorName, "(S)Ljava/lang/StringBuffer;", 44)==0 ||
-            strncmp(descriptorName, "(B)Ljava/lang/StringBuffer;", 44)==0){
+    else if(argType == TYPE_Int || argType == TYPE_Short || argType == TYPE_Byte){
         int valor = (int) popFromOperandStack(environment->thread);
-        wchar_t* stringBuffer = (wchar_t*) popFromOperandStack(environment->thread);
+        wchar_t* stringBuffer =
+            (wchar_t*) decodeReference(popFromOperandStack(environment->thread));
         
 //        int stringBufferLen = wcslen(stringBuffer);
         
-        stringBuffer = (wchar_t*) realloc(stringBuffer,
-                                          (wcslen(stringBuffer)+15)*sizeof(wchar_t));
+        stringBuffer = resizeStringBuffer(stringBuffer, wcslen(stringBuffer)+15, environment);
         
         //Procedimento para substiuicao de swprintf
         char buffer[15] = "";
@@ -326,15 +407,15 @@ void stringBufferAppend(const char* descriptorName, Environment* environment){
         wchar_t* wbuffer = (wchar_t*) malloc((sizeof(buffer)+1)*sizeof(wchar_t));
         mbstowcs(wbuffer, buffer, (strlen(buffer))+1);
         wcscat(stringBuffer, wbuffer);
-        pushInOperandStack(environment->thread, (u4) stringBuffer);
+        pushInOperandStack(environment->thread, encodeReference(stringBuffer));
     }
     
-    else if(strncmp(descriptorName, "(C)Ljava/lang/StringBuffer;", 44)==0){
+    else if(argType == TYPE_Char){
         char valor = (char) popFromOperandStack(environment->thread);
-        wchar_t* stringBuffer = (wchar_t*) popFromOperandStack(environment->thread);
+        wchar_t* stringBuffer =
+            (wchar_t*) decodeReference(popFromOperandStack(environment->thread));
         
-        stringBuffer = (wchar_t*) realloc(stringBuffer,
-                                          (wcslen(stringBuffer)+2)*sizeof(wchar_t));
+        stringBuffer = resizeStringBuffer(stringBuffer, wcslen(stringBuffer)+2, environment);
         
         //Procedimento para substiuicao de swprintf
         char buffer[3] = "";
@@ -342,15 +423,15 @@ void stringBufferAppend(const char* descriptorName, Environment* environment){
         wchar_t* wbuffer = (wchar_t*) malloc((sizeof(buffer)+1)*sizeof(wchar_t));
         mbstowcs(wbuffer, buffer, (strlen(buffer))+1);
         wcscat(stringBuffer, wbuffer);
-        pushInOperandStack(environment->thread, (u4) stringBuffer);
+        pushInOperandStack(environment->thread, encodeReference(stringBuffer));
     }
     
-    else if(strncmp(descriptorName, "(Z)Ljava/lang/StringBuffer;", 44)==0){
+    else if(argType == TYPE_Boolean){
         int valor = (char) popFromOperandStack(environment->thread);
-        wchar_t* stringBuffer = (wchar_t*) popFromOperandStack(environment->thread);
+        wchar_t* stringBuffer =
+            (wchar_t*) decodeReference(popFromOperandStack(environment->thread));
         
-        stringBuffer = (wchar_t*) realloc(stringBuffer,
-                                          (wcslen(stringBuffer)+6)*sizeof(wchar_t));
+        stringBuffer = resizeStringBuffer(stringBuffer, wcslen(stringBuffer)+6, environment);
         
         //Procedimento para substiuicao de swprintf
         char buffer[6] = "";
@@ -358,15 +439,15 @@ void stringBufferAppend(const char* descriptorName, Environment* environment){
         wchar_t* wbuffer = (wchar_t*) malloc((sizeof(buffer)+1)*sizeof(wchar_t));
         mbstowcs(wbuffer, buffer, (strlen(buffer))+1);
         wcscat(stringBuffer, wbuffer);
-        pushInOperandStack(environment->thread, (u4) stringBuffer);
+        pushInOperandStack(environment->thread, encodeReference(stringBuffer));
     }
 
-    else if(strncmp(descriptorName, "(F)Ljava/lang/StringBuffer;", 44)==0){
+    else if(argType == TYPE_Float){
         float valor = u4ToFLoat(popFromOperandStack(environment->thread));
-        wchar_t* stringBuffer = (wchar_t*) popFromOperandStack(environment->thread);
+        wchar_t* stringBuffer =
+            (wchar_t*) decodeReference(popFromOperandStack(environment->thread));
         
-        stringBuffer = (wchar_t*) realloc(stringBuffer,
-                                          (wcslen(stringBuffer)+20)*sizeof(wchar_t));
+        stringBuffer = resizeStringBuffer(stringBuffer, wcslen(stringBuffer)+20, environment);
         
         //Procedimento para substiuicao de swprintf
         char buffer[30] = "";
@@ -374,37 +455,37 @@ void stringBufferAppend(const char* descriptorName, Environment* environment){
         wchar_t* wbuffer = (wchar_t*) malloc((sizeof(buffer)+1)*sizeof(wchar_t));
         mbstowcs(wbuffer, buffer, (strlen(buffer))+1);
         wcscat(stringBuffer, wbuffer);
-        pushInOperandStack(environment->thread, (u4) stringBuffer);
+        pushInOperandStack(environment->thread, encodeReference(stringBuffer));
     }
     
-    else if(strncmp(descriptorName, "(J)Ljava/lang/StringBuffer;", 44)==0){
+    else if(argType == TYPE_Long){
         u8 valor = popFromOperandStack(environment->thread);
         u8 low_Bytes = popFromOperandStack(environment->thread);
         valor = valor << 32 | low_Bytes;
-        wchar_t* stringBuffer = (wchar_t*) popFromOperandStack(environment->thread);
+        wchar_t* stringBuffer =
+            (wchar_t*) decodeReference(popFromOperandStack(environment->thread));
         
-        stringBuffer = (wchar_t*) realloc(stringBuffer,
-                                          (wcslen(stringBuffer)+30)*sizeof(wchar_t));
+        stringBuffer = resizeStringBuffer(stringBuffer, wcslen(stringBuffer)+30, environment);
         
         //Procedimento para substiuicao de swprintf
         char buffer[30] = "";
-        sprintf(buffer, "%lld", valor);
+        sprintf(buffer, "%lld", (long long) valor);
         wchar_t* wbuffer = (wchar_t*) malloc((sizeof(buffer)+1)*sizeof(wchar_t));
         mbstowcs(wbuffer, buffer, (strlen(buffer))+1);
         wcscat(stringBuffer, wbuffer);
-        pushInOperandStack(environment->thread, (u4) stringBuffer);
+        pushInOperandStack(environment->thread, encodeReference(stringBuffer));
     }
     
-    else if(strncmp(descriptorName, "(D)Ljava/lang/StringBuffer;", 44)==0){
+    else if(argType == TYPE_Double){
         u4 high = popFromOperandStack(environment->thread);
         u4 low = popFromOperandStack(environment->thread);
         double valor = u4ToDouble(high, low);
         
-        wchar_t* stringBuffer = (wchar_t*) popFromOperandStack(environment->thread);
+        wchar_t* stringBuffer =
+            (wchar_t*) decodeReference(popFromOperandStack(environment->thread));
         
         
-        stringBuffer = (wchar_t*) realloc(stringBuffer,
-                                          (wcslen(stringBuffer)+15)*sizeof(wchar_t));
+        stringBuffer = resizeStringBuffer(stringBuffer, wcslen(stringBuffer)+15, environment);
         
         //Procedimento para substiuicao de swprintf
         char buffer[30] = "";
@@ -412,7 +493,7 @@ void stringBufferAppend(const char* descriptorName, Environment* environment){
         wchar_t* wbuffer = (wchar_t*) malloc((sizeof(buffer)+1)*sizeof(wchar_t));
         mbstowcs(wbuffer, buffer, (strlen(buffer))+1);
         wcscat(stringBuffer, wbuffer);
-        pushInOperandStack(environment->thread, (u4) stringBuffer);
+        pushInOperandStack(environment->thread, encodeReference(stringBuffer));
     }
 }
 
@@ -433,9 +514,10 @@ void stringBufferExecuteMethod(const char* className, const char* methodName,
     }
 
     else if (strncmp(methodName, "toString", 6)==0){
-        wchar_t* stringBuffer = (wchar_t*)(popFromOperandStack(environment->thread));
-        JavaString* string = newJavaString(stringBuffer);
-        pushInOperandStack(environment->thread, (u4) string);
+        wchar_t* stringBuffer =
+            (wchar_t*) decodeReference(popFromOperandStack(environment->thread));
+        JavaString* string = newJavaString(stringBuffer, environment->thread);
+        pushInOperandStack(environment->thread, encodeReference(string));
     }
 
     else if (strncmp(methodName, "append", 6)==0) {
@@ -464,6 +546,10 @@ void javaLangExecuteMethod(const char* className, const char* methodName, const
     else if ((strncmp(className, "Object", 6)==0)){
         if(strncmp(methodName, "getClass", 8)==0)
             return;
+        else if(strncmp(methodName, "hashCode", 8)==0) {
+            u4 reference = popFromOperandStack(environment->thread);
+            pushInOperandStack(environment->thread, identityHash(reference));
+        }
         else
             popFromOperandStack(environment->thread);
     }
@@ -497,9 +583,10 @@ void javaLangNewObject(const char* className, Environment* environment){
     }
     //Metodos de java/lang/StringBuffer
     else if (strncmp(className, "StringBuffer", 12)==0) {
-        wchar_t* stringBuffer = (wchar_t*)malloc(sizeof(wchar_t));
-        wcscpy(stringBuffer, L"");
-        pushInOperandStack(environment->thread, (u4) stringBuffer);
+        //O buffer alocado no heap ja esta zerado (string vazia)
+        wchar_t* stringBuffer = (wchar_t*) heapAllocate(environment->thread, sizeof(wchar_t),
+                                                        HEAP_StringData);
+        pushInOperandStack(environment->thread, encodeReference(stringBuffer));
     }
     else
         pushInOperandStack(environment->thread, 0);
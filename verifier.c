@@ -0,0 +1,1703 @@
+//#################################################################################################
+/*! \file verifier.c
+ *
+ *  \brief Modulo do Verificador de bytecodes
+ *
+ *  Modulo responsavel por verificar o codigo dos metodos de uma classe no seu carregamento. A
+ *  verificacao infere, para cada instrucao, a categoria (referencia ou nao) de cada variavel local
+ *  e de cada posicao da pilha de operandos, e cria os mapas de referencias que permitem ao coletor
+ *  de lixo tratar os frames de forma exata. Junto com os tipos, a verificacao acompanha o local de
+ *  alocacao (instrucao new) de cada referencia, encontrando os objetos que nao escapam do metodo e
+ *  podem ser alocados no frame. Contem submodulos responsaveis por:
+ *  - Decodificacao das instrucoes, do pool de constantes e dos descritores
+ *  - Inferencia de tipos (analise de fluxo de dados)
+ *  - Mapas de referencias dos pontos seguros do coletor de lixo
+ *  - Analise de escape dos objetos alocados
+ *  - Verificacao paralela dos metodos de uma classe
+ */
+//##################################################################################################
+
+#define VERIFIER
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#endif
+#include "include/verifier.h"
+#include "include/opcodes.h"
+#include "include/classloader.h"
+#include "include/memoryunit.h"
+#include "include/executionengine.h"
+#include "include/util.h"
+
+
+//--------------------------------------------------------------------------------------------------
+// SUBMODULO: Decodificacao das instrucoes, do pool de constantes e dos descritores
+//--------------------------------------------------------------------------------------------------
+
+#define VERIFIER_NoSite     0 //!< Posicao que nao guarda um objeto de um local de alocacao
+#define VERIFIER_MixedSites 0xFFFF //!< Posicao com objetos de locais diferentes em cada caminho
+
+//! Invocacao que recebe como objeto (receptor) o objeto de um local de alocacao
+typedef struct EscapeCall{
+    u2 site; //!< Local de alocacao do objeto
+    ReceiverCall call; //!< Instrucao de invocacao
+} EscapeCall;
+
+//! Estado da inferencia de tipos de um metodo
+typedef struct Inference{
+    CodeAttribute* code; //!< Atributo Code do metodo
+    ConstantPool* constantPool; //!< Pool de constantes da classe
+    u2 constantPoolCount; //!< Numero de entradas do pool de constantes (mais um)
+    u2 maxLocals; //!< Numero de variaveis locais
+    u2 maxStack; //!< Capacidade da pilha de operandos
+    u4 width; //!< Posicoes de um estado: variaveis locais seguidas da pilha de operandos
+    u4* instructionIndex; //!< Para cada pc, indice da instrucao que comeca nele mais um (ou zero)
+    u4* instructionPC; //!< pc de cada instrucao
+    u4 instructionCount; //!< Numero de instrucoes
+    u1* types; //!< Categorias na entrada de cada instrucao (width posicoes por instrucao)
+    u2* depths; //!< Numero de posicoes da pilha de operandos na entrada de cada instrucao
+    u1* reached; //!< A instrucao eh alcancavel
+    u1* queued; //!< A instrucao esta na lista de trabalho
+    u4* worklist; //!< Instrucoes cujo estado de entrada mudou
+    u4 worklistTop; //!< Numero de instrucoes na lista de trabalho
+    u1* locals; //!< Estado corrente: variaveis locais
+    u1* stack; //!< Estado corrente: pilha de operandos
+    u2 depth; //!< Estado corrente: numero de posicoes da pilha de operandos
+    u1 failed; //!< O codigo nao pode ser verificado
+    u2* siteOf; //!< Local de alocacao de cada instrucao (zero se ela nao eh um new acompanhado)
+    u2 siteCount; //!< Numero de locais de alocacao
+    u2 thisSite; //!< Local de alocacao que representa o objeto this (zero em metodos estaticos)
+    u1* escapes; //!< O objeto de cada local de alocacao escapa do metodo
+    EscapeCall* calls; //!< Invocacoes que recebem objetos de locais de alocacao
+    u4 callCount; //!< Numero de invocacoes registradas
+    u4 callSize; //!< Capacidade do vetor de invocacoes
+    u1* live; //!< Variaveis locais lidas antes de escritas a partir de cada instrucao
+    u2* tags; //!< Locais de alocacao na entrada de cada instrucao (width posicoes por instrucao)
+    u2* localTags; //!< Estado corrente: local de alocacao de cada variavel local
+    u2* stackTags; //!< Estado corrente: local de alocacao de cada posicao da pilha de operandos
+} Inference;
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que le um u2 (big-endian) do codigo.
+ *
+ * \param bytes Posicao do primeiro byte
+ * \return Valor lido
+ */
+static u2 readU2(u1* bytes){
+
+    return (u2) (bytes[0] << 8 | bytes[1]);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que le um u4 (big-endian) do codigo.
+ *
+ * \param bytes Posicao do primeiro byte
+ * \return Valor lido
+ */
+static u4 readU4(u1* bytes){
+
+    return (u4) bytes[0] << 24 | (u4) bytes[1] << 16 | (u4) bytes[2] << 8 | bytes[3];
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que retorna o tamanho em bytes de uma instrucao.
+ *
+ * \param code Codigo do metodo
+ * \param pc Posicao do opcode da instrucao
+ * \param codeLength Tamanho do codigo
+ * \return Tamanho da instrucao (ou zero se o opcode nao existe ou a instrucao passa do fim)
+ */
+static u4 instructionLength(u1* code, u4 pc, u4 codeLength){
+
+    //Os operandos de tableswitch e lookupswitch comecam no primeiro multiplo de 4 apos o opcode
+    u4 aligned = (pc + 4) & ~(u4) 3;
+    u8 length;
+
+    switch (code[pc]) {
+        case OP_tableswitch:{
+            if (aligned + 12 > codeLength) return 0;
+            int32_t low = (int32_t) readU4(&code[aligned + 4]);
+            int32_t high = (int32_t) readU4(&code[aligned + 8]);
+            if (high < low) return 0;
+            length = aligned + 12 + 4 * ((u8) ((int64_t) high - low) + 1) - pc;
+            break;
+        }
+        case OP_lookupswitch:{
+            if (aligned + 8 > codeLength) return 0;
+            int32_t pairs = (int32_t) readU4(&code[aligned + 4]);
+            if (pairs < 0) return 0;
+            length = aligned + 8 + 8 * (u8) pairs - pc;
+            break;
+        }
+        case OP_wide:
+            if (pc + 1 >= codeLength) return 0;
+            length = code[pc + 1] == OP_iinc ? 6 : 4;
+            break;
+
+        case OP_bipush: case OP_ldc: case OP_iload: case OP_lload: case OP_fload: case OP_dload:
+        case OP_aload: case OP_istore: case OP_lstore: case OP_fstore: case OP_dstore:
+        case OP_astore: case OP_ret: case OP_newarray:
+            length = 2;
+            break;
+
+        case OP_sipush: case OP_ldc_w: case OP_ldc2_w: case OP_iinc: case OP_ifeq: case OP_ifne:
+        case OP_iflt: case OP_ifge: case OP_ifgt: case OP_ifle: case OP_if_icmpeq:
+        case OP_if_icmpne: case OP_if_icmplt: case OP_if_icmpge: case OP_if_icmpgt:
+        case OP_if_icmple: case OP_if_acmpeq: case OP_if_acmpne: case OP_goto: case OP_jsr:
+        case OP_getstatic: case OP_putstatic: case OP_getfield: case OP_putfield:
+        case OP_invokevirtual: case OP_invokespecial: case OP_invokestatic: case OP_new:
+        case OP_anewarray: case OP_checkcast: case OP_instanceof: case OP_ifnull:
+        case OP_ifnonnull:
+            length = 3;
+            break;
+
+        case OP_multianewarray:
+            length = 4;
+            break;
+
+        case OP_invokeinterface: case OP_invokedynamic: case OP_goto_w: case OP_jsr_w:
+            length = 5;
+            break;
+
+        default:
+            //Os demais opcodes definidos nao tem operandos
+            length = code[pc] <= OP_jsr_w ? 1 : 0;
+            break;
+    }
+
+    if (length == 0 || pc + length > codeLength) return 0;
+
+    return (u4) length;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que retorna o numero de alvos de um tableswitch ou lookupswitch, sem o alvo padrao.
+ *
+ * \param code Codigo do metodo
+ * \param pc Posicao da instrucao
+ * \return Numero de alvos
+ */
+static int32_t switchTargetCount(u1* code, u4 pc){
+
+    u4 aligned = (pc + 4) & ~(u4) 3;
+
+    if (code[pc] == OP_tableswitch)
+        return (int32_t) readU4(&code[aligned + 8]) - (int32_t) readU4(&code[aligned + 4]) + 1;
+
+    return (int32_t) readU4(&code[aligned + 4]);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que retorna um alvo de um tableswitch ou lookupswitch.
+ *
+ * \param code Codigo do metodo
+ * \param pc Posicao da instrucao
+ * \param target Indice do alvo (-1 para o alvo padrao)
+ * \return pc do alvo
+ */
+static int64_t switchTarget(u1* code, u4 pc, int32_t target){
+
+    u4 aligned = (pc + 4) & ~(u4) 3;
+
+    if (target < 0) return (int64_t) pc + (int32_t) readU4(&code[aligned]);
+
+    //No lookupswitch o deslocamento vem depois do valor de cada par
+    u4 step = code[pc] == OP_tableswitch ? 4 : 8;
+
+    return (int64_t) pc + (int32_t) readU4(&code[aligned + 12 + target * step]);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que verifica o indice e a tag de uma entrada do pool de constantes.
+ *
+ * \param inference Estado da inferencia
+ * \param index Indice da entrada
+ * \param tag Tag esperada
+ * \param otherTag Outra tag aceita (ou zero)
+ * \return Tag da entrada (ou zero se o indice ou a tag sao invalidos)
+ */
+static u1 poolEntry(Inference* inference, u2 index, u1 tag, u1 otherTag){
+
+    if (index == 0 || index >= inference->constantPoolCount) return 0;
+
+    u1 entryTag = inference->constantPool->tags[index];
+
+    if (entryTag != tag && (otherTag == 0 || entryTag != otherTag)) return 0;
+
+    return entryTag;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que retorna a categoria e o numero de posicoes de um valor a partir do seu descritor.
+ *
+ * \param type Tipo do valor (TYPE_*)
+ * \param category Recebe a categoria do valor (VERIFIER_*)
+ * \return Numero de posicoes ocupadas pelo valor (zero para void)
+ */
+static u1 typeSlots(u1 type, u1* category){
+
+    *category = type >= TYPE_Reference ? VERIFIER_Reference : VERIFIER_NotReference;
+
+    if (type == TYPE_Void) return 0;
+
+    return (type == TYPE_Long || type == TYPE_Double) ? 2 : 1;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que decodifica um descritor de metodo nas categorias das posicoes dos seus argumentos.
+ * Nao utiliza as assinaturas compartilhadas (getSignature), que nao podem ser criadas por varias
+ * threads ao mesmo tempo.
+ *
+ * \param descriptor Descritor do metodo
+ * \param slots Recebe a categoria de cada posicao dos argumentos (256 posicoes)
+ * \param returnType Recebe o tipo do retorno (TYPE_*)
+ * \return Numero de posicoes dos argumentos (ou -1 se o descritor eh invalido)
+ */
+static int parseMethodDescriptor(const char* descriptor, u1* slots, u1* returnType){
+
+    if (descriptor[0] != '(') return -1;
+
+    const char* c = &descriptor[1];
+    int argSlots = 0;
+
+    while (*c && *c != ')') {
+        u1 category;
+        u1 count = typeSlots(parseDescriptorType(&c), &category);
+
+        //Um metodo tem no maximo 255 posicoes de argumentos
+        if (count == 0 || argSlots + count > 255) return -1;
+
+        while (count--) slots[argSlots++] = category;
+    }
+
+    if (*c != ')') return -1;
+    c++;
+    *returnType = parseDescriptorType(&c);
+
+    return argSlots;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// SUBMODULO: Inferencia de tipos (analise de fluxo de dados)
+//--------------------------------------------------------------------------------------------------
+
+static void computeLiveness(Inference* inference);
+static void buildEscapeInfo(Inference* inference, MethodEscapeInfo* escapeInfo);
+
+//Instrucoes de carga e armazenamento: posicoes e categoria do valor de cada tipo (i, l, f, d, a)
+static const u1 kindSlots[5] = {1, 2, 1, 2, 1};
+static const u1 kindCategory[5] = {VERIFIER_NotReference, VERIFIER_NotReference,
+                                   VERIFIER_NotReference, VERIFIER_NotReference,
+                                   VERIFIER_Reference};
+
+//Conversoes e comparacoes (i2l ate dcmpg): posicoes desempilhadas e empilhadas
+static const u1 conversionSlots[OP_dcmpg - OP_i2l + 1][2] = {
+    {1, 2}, {1, 1}, {1, 2}, {2, 1}, {2, 1}, {2, 2}, {1, 1}, {1, 2}, {1, 2}, {2, 1}, {2, 2},
+    {2, 1}, {1, 1}, {1, 1}, {1, 1}, {4, 1}, {2, 1}, {2, 1}, {4, 1}, {4, 1}
+};
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que registra que o objeto de um local de alocacao escapa do metodo.
+ *
+ * \param inference Estado da inferencia
+ * \param site Local de alocacao (VERIFIER_NoSite e VERIFIER_MixedSites sao ignorados)
+ */
+static void escape(Inference* inference, u2 site){
+
+    if (site != VERIFIER_NoSite && site != VERIFIER_MixedSites) inference->escapes[site] = 1;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que retira o local de alocacao de uma posicao da pilha de operandos, antes que ela seja
+ * desempilhada por um uso que nao deixa o objeto escapar (acesso a campo, comparacao, monitor).
+ *
+ * \param inference Estado da inferencia
+ * \param offset Distancia da posicao ate o topo da pilha (zero para o topo)
+ * \return Local de alocacao que estava na posicao
+ */
+static u2 releaseSite(Inference* inference, u2 offset){
+
+    if (inference->depth <= offset) return VERIFIER_NoSite;
+
+    u2 site = inference->stackTags[inference->depth - 1 - offset];
+    inference->stackTags[inference->depth - 1 - offset] = VERIFIER_NoSite;
+
+    return site;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que empilha uma posicao no estado corrente.
+ *
+ * \param inference Estado da inferencia
+ * \param category Categoria da posicao
+ */
+static void pushType(Inference* inference, u1 category){
+
+    if (inference->depth >= inference->maxStack) {
+        inference->failed = 1;
+        return;
+    }
+    inference->stackTags[inference->depth] = VERIFIER_NoSite;
+    inference->stack[inference->depth++] = category;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que desempilha uma posicao do estado corrente, verificando a sua categoria. Posicoes de
+ * categoria desconhecida sao aceitas por qualquer instrucao. O objeto desempilhado escapa, a nao
+ * ser que o seu local de alocacao tenha sido retirado antes (releaseSite).
+ *
+ * \param inference Estado da inferencia
+ * \param expected Categoria esperada (VERIFIER_Unknown aceita qualquer categoria)
+ * \return Categoria desempilhada
+ */
+static u1 popType(Inference* inference, u1 expected){
+
+    if (inference->depth == 0) {
+        inference->failed = 1;
+        return VERIFIER_Unknown;
+    }
+
+    u1 category = inference->stack[--inference->depth];
+    escape(inference, inference->stackTags[inference->depth]);
+
+    if (expected != VERIFIER_Unknown && category != VERIFIER_Unknown && category != expected)
+        inference->failed = 1;
+
+    return category;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que empilha posicoes que nao sao referencias (int, float, long ou double).
+ *
+ * \param inference Estado da inferencia
+ * \param count Numero de posicoes
+ */
+static void pushValues(Inference* inference, int count){
+
+    while (count-- > 0) pushType(inference, VERIFIER_NotReference);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que desempilha posicoes que nao sao referencias (int, float, long ou double).
+ *
+ * \param inference Estado da inferencia
+ * \param count Numero de posicoes
+ */
+static void popValues(Inference* inference, int count){
+
+    while (count-- > 0) popType(inference, VERIFIER_NotReference);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que executa uma instrucao de carga de variavel local no estado corrente.
+ *
+ * \param inference Estado da inferencia
+ * \param index Indice da variavel local
+ * \param kind Tipo da instrucao (0: i, 1: l, 2: f, 3: d, 4: a)
+ */
+static void loadLocal(Inference* inference, u4 index, u1 kind){
+
+    if (index + kindSlots[kind] > inference->maxLocals) {
+        inference->failed = 1;
+        return;
+    }
+
+    for (u1 i = 0; i < kindSlots[kind]; i++) {
+        u1 category = inference->locals[index + i];
+
+        if (category != VERIFIER_Unknown && category != kindCategory[kind]) inference->failed = 1;
+        pushType(inference, category);
+
+        if (!inference->failed)
+            inference->stackTags[inference->depth - 1] = inference->localTags[index + i];
+    }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que executa uma instrucao de armazenamento em variavel local no estado corrente.
+ *
+ * \param inference Estado da inferencia
+ * \param index Indice da variavel local
+ * \param kind Tipo da instrucao (0: i, 1: l, 2: f, 3: d, 4: a)
+ */
+static void storeLocal(Inference* inference, u4 index, u1 kind){
+
+    if (index + kindSlots[kind] > inference->maxLocals) {
+        inference->failed = 1;
+        return;
+    }
+
+    for (int i = kindSlots[kind] - 1; i >= 0; i--) {
+        inference->localTags[index + i] = releaseSite(inference, 0);
+        inference->locals[index + i] = popType(inference, kindCategory[kind]);
+    }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que combina o estado corrente com o estado de entrada de uma instrucao sucessora. Uma
+ * posicao com categorias diferentes em cada caminho passa a ter categoria desconhecida. Uma
+ * posicao com objetos de locais de alocacao diferentes em cada caminho deixa esses objetos
+ * escaparem; as variaveis locais que a sucessora nao le antes de escrever sao descartadas. Se o
+ * estado da sucessora mudou, ela volta para a lista de trabalho.
+ *
+ * \param inference Estado da inferencia
+ * \param target pc da instrucao sucessora
+ * \param locals Variaveis locais que chegam na sucessora
+ * \param stack Pilha de operandos que chega na sucessora
+ * \param stackTags Locais de alocacao da pilha de operandos que chega na sucessora
+ * \param depth Numero de posicoes da pilha de operandos
+ */
+static void mergeInto(Inference* inference, int64_t target, u1* locals, u1* stack, u2* stackTags,
+                      u2 depth){
+
+    if (target < 0 || target >= inference->code->code_length ||
+        inference->instructionIndex[target] == 0) {
+        inference->failed = 1;
+        return;
+    }
+
+    u4 index = inference->instructionIndex[target] - 1;
+    u1* state = &inference->types[(u8) index * inference->width];
+    u2* tags = &inference->tags[(u8) index * inference->width];
+    u1* live = &inference->live[(u8) index * inference->maxLocals];
+    u1 changed = 0;
+
+    if (!inference->reached[index]) {
+        memcpy(state, locals, inference->maxLocals);
+        memcpy(state + inference->maxLocals, stack, depth);
+        inference->depths[index] = depth;
+        inference->reached[index] = 1;
+        changed = 1;
+
+        for (u4 i = 0; i < inference->maxLocals; i++)
+            tags[i] = live[i] ? inference->localTags[i] : VERIFIER_NoSite;
+        memcpy(tags + inference->maxLocals, stackTags, depth * sizeof(u2));
+    }
+    else if (inference->depths[index] != depth) {
+        inference->failed = 1;
+        return;
+    }
+    else {
+        for (u4 i = 0; i < (u4) inference->maxLocals + depth; i++) {
+            u1 category = i < inference->maxLocals ? locals[i] : stack[i - inference->maxLocals];
+            u2 site = i >= inference->maxLocals ? stackTags[i - inference->maxLocals] :
+                      live[i] ? inference->localTags[i] : VERIFIER_NoSite;
+
+            if (state[i] != category && state[i] != VERIFIER_Unknown) {
+                state[i] = VERIFIER_Unknown;
+                changed = 1;
+            }
+
+            if (tags[i] != site) {
+                escape(inference, tags[i]);
+                escape(inference, site);
+
+                if (tags[i] != VERIFIER_MixedSites) changed = 1;
+                tags[i] = VERIFIER_MixedSites;
+            }
+        }
+    }
+
+    if (changed && !inference->queued[index]) {
+        inference->queued[index] = 1;
+        inference->worklist[inference->worklistTop++] = index;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que executa uma instrucao de acesso a campo no estado corrente. O objeto acessado nao
+ * escapa; o valor guardado por putfield e putstatic escapa.
+ *
+ * \param inference Estado da inferencia
+ * \param opcode getstatic, putstatic, getfield ou putfield
+ * \param index Indice da entrada Fieldref no pool de constantes
+ */
+static void executeFieldInstruction(Inference* inference, u1 opcode, u2 index){
+
+    if (poolEntry(inference, index, CONSTANT_Fieldref, 0) == 0) {
+        inference->failed = 1;
+        return;
+    }
+
+    char *className, *name, *descriptor;
+    getFieldOrMethodInfoAttributesFromConstantPool(index, inference->constantPool, &className,
+                                                   &name, &descriptor);
+    u1 category;
+    u1 slots = typeSlots(getFieldType(descriptor), &category);
+
+    //Dos campos de bibliotecas java, somente getstatic eh simulado (empilhando um u4)
+    if (javaLibIsFrom(className) && (opcode != OP_getstatic || slots != 1)) {
+        inference->failed = 1;
+        return;
+    }
+
+    if (opcode == OP_getfield) {
+        releaseSite(inference, 0);
+        popType(inference, VERIFIER_Reference);
+    }
+
+    if (opcode == OP_getstatic || opcode == OP_getfield) {
+        for (u1 i = 0; i < slots; i++) pushType(inference, category);
+    }
+    else {
+        for (u1 i = 0; i < slots; i++) popType(inference, category);
+
+        if (opcode == OP_putfield) {
+            releaseSite(inference, 0);
+            popType(inference, VERIFIER_Reference);
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que executa uma instrucao de invocacao no estado corrente. Metodos de bibliotecas java
+ * sao aceitos somente se a sua simulacao segue o descritor. Os argumentos escapam; a invocacao
+ * que recebe como objeto o objeto de um local de alocacao eh registrada, pois o metodo invocado
+ * so eh conhecido quando a classe do objeto eh carregada. O construtor de java/lang/Object, que
+ * nao eh executado, nao deixa o objeto escapar; os demais metodos de bibliotecas java deixam.
+ *
+ * \param inference Estado da inferencia
+ * \param opcode invokevirtual, invokespecial, invokestatic ou invokeinterface
+ * \param index Indice da entrada Methodref ou InterfaceMethodref no pool de constantes
+ */
+static void executeInvoke(Inference* inference, u1 opcode, u2 index){
+
+    u1 tag = opcode == OP_invokeinterface ? CONSTANT_InterfaceMethodref : CONSTANT_Methodref;
+    u1 otherTag = opcode == OP_invokespecial || opcode == OP_invokestatic ?
+                  CONSTANT_InterfaceMethodref : 0;
+
+    if (poolEntry(inference, index, tag, otherTag) == 0) {
+        inference->failed = 1;
+        return;
+    }
+
+    char *className, *name, *descriptor;
+    getFieldOrMethodInfoAttributesFromConstantPool(index, inference->constantPool, &className,
+                                                   &name, &descriptor);
+    u1 argSlots[256];
+    u1 returnType;
+    int argCount = parseMethodDescriptor(descriptor, argSlots, &returnType);
+    int hasReceiver = opcode != OP_invokestatic;
+
+    //A simulacao de invokeinterface de bibliotecas java nao avanca sobre os seus dois ultimos bytes
+    if (argCount < 0 || (javaLibIsFrom(className) && (opcode == OP_invokeinterface ||
+        !javaLibFollowsDescriptor(className, name, descriptor, hasReceiver)))) {
+        inference->failed = 1;
+        return;
+    }
+
+    for (int i = argCount - 1; i >= 0; i--) popType(inference, argSlots[i]);
+
+    if (hasReceiver) {
+        u2 site = inference->depth > 0 ? inference->stackTags[inference->depth - 1] :
+                  VERIFIER_NoSite;
+
+        if (javaLibIsFrom(className)) {
+            if (strcmp(className, "java/lang/Object") == 0 && strcmp(name, "<init>") == 0)
+                releaseSite(inference, 0);
+        }
+        else if (site != VERIFIER_NoSite && site != VERIFIER_MixedSites) {
+            if (inference->callCount == inference->callSize) {
+                inference->callSize = inference->callSize ? inference->callSize * 2 : 16;
+                inference->calls = (EscapeCall*) realloc(inference->calls,
+                                                         inference->callSize * sizeof(EscapeCall));
+                if (inference->calls == NULL)
+                    JVMstopAbrupt("Erro de alocacao de memoria para o verificador.");
+            }
+            EscapeCall* call = &inference->calls[inference->callCount++];
+            call->site = site;
+            call->call.opcode = opcode;
+            call->call.index = index;
+            releaseSite(inference, 0);
+        }
+        popType(inference, VERIFIER_Reference);
+    }
+
+    u1 category;
+    u1 slots = typeSlots(returnType, &category);
+    for (u1 i = 0; i < slots; i++) pushType(inference, category);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que combina o estado corrente com os alvos de um tableswitch ou lookupswitch.
+ *
+ * \param inference Estado da inferencia
+ * \param pc Posicao da instrucao
+ */
+static void mergeSwitchTargets(Inference* inference, u4 pc){
+
+    u1* code = inference->code->code;
+    int32_t count = switchTargetCount(code, pc);
+
+    for (int32_t i = -1; i < count && !inference->failed; i++) {
+        mergeInto(inference, switchTarget(code, pc, i), inference->locals, inference->stack,
+                  inference->stackTags, inference->depth);
+    }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que executa uma instrucao no estado corrente e combina o resultado com os estados das
+ * instrucoes sucessoras. Instrucoes que o interpretador nao executa conforme a especificacao
+ * (sub-rotinas, excecoes, invokedynamic, checkcast, instanceof, dup_x1 e variantes, swap, pop2,
+ * ifnull, ifnonnull e goto_w) impedem a verificacao do metodo.
+ *
+ * \param inference Estado da inferencia
+ * \param pc Posicao da instrucao
+ * \param length Tamanho da instrucao
+ */
+static void executeInstruction(Inference* inference, u4 pc, u4 length){
+
+    u1* code = inference->code->code;
+    u1 opcode = code[pc];
+    u1 fallsThrough = 1;
+    u1 branches = 0;
+    int64_t branch = 0;
+
+    if (opcode >= OP_iconst_m1 && opcode <= OP_iconst_5) pushValues(inference, 1);
+    else if (opcode >= OP_iload && opcode <= OP_aload)
+        loadLocal(inference, code[pc + 1], opcode - OP_iload);
+    else if (opcode >= OP_iload_0 && opcode <= OP_aload_3)
+        loadLocal(inference, (opcode - OP_iload_0) % 4, (opcode - OP_iload_0) / 4);
+    else if (opcode >= OP_istore && opcode <= OP_astore)
+        storeLocal(inference, code[pc + 1], opcode - OP_istore);
+    else if (opcode >= OP_istore_0 && opcode <= OP_astore_3)
+        storeLocal(inference, (opcode - OP_istore_0) % 4, (opcode - OP_istore_0) / 4);
+    else if (opcode >= OP_iadd && opcode <= OP_drem) {
+        //Operacoes binarias: i, l, f e d se alternam
+        u1 slots = (opcode - OP_iadd) % 2 ? 2 : 1;
+        popValues(inference, 2 * slots);
+        pushValues(inference, slots);
+    }
+    else if (opcode >= OP_ineg && opcode <= OP_dneg) {
+        u1 slots = (opcode - OP_ineg) % 2 ? 2 : 1;
+        popValues(inference, slots);
+        pushValues(inference, slots);
+    }
+    else if (opcode >= OP_ishl && opcode <= OP_lushr) {
+        //O deslocamento eh sempre um int
+        u1 slots = (opcode - OP_ishl) % 2 ? 2 : 1;
+        popValues(inference, slots + 1);
+        pushValues(inference, slots);
+    }
+    else if (opcode >= OP_iand && opcode <= OP_lxor) {
+        u1 slots = (opcode - OP_iand) % 2 ? 2 : 1;
+        popValues(inference, 2 * slots);
+        pushValues(inference, slots);
+    }
+    else if (opcode >= OP_i2l && opcode <= OP_dcmpg) {
+        popValues(inference, conversionSlots[opcode - OP_i2l][0]);
+        pushValues(inference, conversionSlots[opcode - OP_i2l][1]);
+    }
+    else if (opcode >= OP_ifeq && opcode <= OP_if_acmpne) {
+        if (opcode <= OP_ifle) popValues(inference, 1);
+        else if (opcode <= OP_if_icmple) popValues(inference, 2);
+        else {
+            releaseSite(inference, 0);
+            releaseSite(inference, 1);
+            popType(inference, VERIFIER_Reference);
+            popType(inference, VERIFIER_Reference);
+        }
+        branch = (int64_t) pc + (int16_t) readU2(&code[pc + 1]);
+        branches = 1;
+    }
+    else if (opcode >= OP_ireturn && opcode <= OP_return) {
+        //O objeto devolvido escapa
+        if (opcode == OP_areturn && inference->depth > 0)
+            escape(inference, inference->stackTags[inference->depth - 1]);
+        fallsThrough = 0;
+    }
+    else switch (opcode) {
+        case OP_nop:
+            break;
+
+        case OP_aconst_null:
+            pushType(inference, VERIFIER_Reference);
+            break;
+
+        case OP_lconst_0: case OP_lconst_1: case OP_dconst_0: case OP_dconst_1:
+            pushValues(inference, 2);
+            break;
+
+        case OP_fconst_0: case OP_fconst_1: case OP_fconst_2: case OP_bipush: case OP_sipush:
+            pushValues(inference, 1);
+            break;
+
+        case OP_ldc: case OP_ldc_w:{
+            u2 index = opcode == OP_ldc ? code[pc + 1] : readU2(&code[pc + 1]);
+
+            //Strings sao empilhadas como referencias para o pool de constantes
+            if (poolEntry(inference, index, CONSTANT_String, 0))
+                pushType(inference, VERIFIER_Reference);
+            else if (poolEntry(inference, index, CONSTANT_Integer, CONSTANT_Float))
+                pushValues(inference, 1);
+            else
+                inference->failed = 1;
+            break;
+        }
+        case OP_ldc2_w:
+            if (poolEntry(inference, readU2(&code[pc + 1]), CONSTANT_Long, CONSTANT_Double))
+                pushValues(inference, 2);
+            else
+                inference->failed = 1;
+            break;
+
+        case OP_iaload: case OP_laload: case OP_faload: case OP_daload: case OP_aaload:
+        case OP_baload: case OP_caload: case OP_saload:{
+            u1 kind = opcode <= OP_aaload ? opcode - OP_iaload : 0;
+            popValues(inference, 1);
+            popType(inference, VERIFIER_Reference);
+            for (u1 i = 0; i < kindSlots[kind]; i++) pushType(inference, kindCategory[kind]);
+            break;
+        }
+        case OP_iastore: case OP_lastore: case OP_fastore: case OP_dastore: case OP_aastore:
+        case OP_bastore: case OP_castore: case OP_sastore:{
+            u1 kind = opcode <= OP_aastore ? opcode - OP_iastore : 0;
+            for (u1 i = 0; i < kindSlots[kind]; i++) popType(inference, kindCategory[kind]);
+            popValues(inference, 1);
+            popType(inference, VERIFIER_Reference);
+            break;
+        }
+        case OP_pop:
+            releaseSite(inference, 0);
+            popType(inference, VERIFIER_Unknown);
+            break;
+
+        case OP_dup:{
+            u2 site = releaseSite(inference, 0);
+            u1 category = popType(inference, VERIFIER_Unknown);
+            pushType(inference, category);
+            pushType(inference, category);
+
+            if (!inference->failed) {
+                inference->stackTags[inference->depth - 2] = site;
+                inference->stackTags[inference->depth - 1] = site;
+            }
+            break;
+        }
+        case OP_iinc:
+            if (code[pc + 1] >= inference->maxLocals) inference->failed = 1;
+            else {
+                inference->locals[code[pc + 1]] = VERIFIER_NotReference;
+                inference->localTags[code[pc + 1]] = VERIFIER_NoSite;
+            }
+            break;
+
+        case OP_goto:
+            branch = (int64_t) pc + (int16_t) readU2(&code[pc + 1]);
+            branches = 1;
+            fallsThrough = 0;
+            break;
+
+        case OP_tableswitch: case OP_lookupswitch:
+            popValues(inference, 1);
+            if (!inference->failed) mergeSwitchTargets(inference, pc);
+            fallsThrough = 0;
+            break;
+
+        case OP_getstatic: case OP_putstatic: case OP_getfield: case OP_putfield:
+            executeFieldInstruction(inference, opcode, readU2(&code[pc + 1]));
+            break;
+
+        case OP_invokevirtual: case OP_invokespecial: case OP_invokestatic:
+        case OP_invokeinterface:
+            executeInvoke(inference, opcode, readU2(&code[pc + 1]));
+            break;
+
+        case OP_new:{
+            u2 site = inference->siteOf[inference->instructionIndex[pc] - 1];
+
+            if (poolEntry(inference, readU2(&code[pc + 1]), CONSTANT_Class, 0) == 0)
+                inference->failed = 1;
+
+            //O objeto do local eh reutilizado a cada execucao: o anterior nao pode estar vivo
+            for (u4 i = 0; site != VERIFIER_NoSite && i < (u4) inference->maxLocals +
+                 inference->depth; i++) {
+                if (inference->localTags[i] == site) escape(inference, site);
+            }
+            pushType(inference, VERIFIER_Reference);
+
+            if (!inference->failed) inference->stackTags[inference->depth - 1] = site;
+            break;
+        }
+        case OP_newarray: case OP_anewarray:
+            popValues(inference, 1);
+            pushType(inference, VERIFIER_Reference);
+            break;
+
+        case OP_multianewarray:
+            if (poolEntry(inference, readU2(&code[pc + 1]), CONSTANT_Class, 0) == 0 ||
+                code[pc + 3] == 0)
+                inference->failed = 1;
+            popValues(inference, code[pc + 3]);
+            pushType(inference, VERIFIER_Reference);
+            break;
+
+        case OP_arraylength:
+            popType(inference, VERIFIER_Reference);
+            pushValues(inference, 1);
+            break;
+
+        case OP_monitorenter: case OP_monitorexit:
+            releaseSite(inference, 0);
+            popType(inference, VERIFIER_Reference);
+            break;
+
+        case OP_wide:{
+            u1 wideOpcode = code[pc + 1];
+            u2 index = readU2(&code[pc + 2]);
+
+            if (wideOpcode >= OP_iload && wideOpcode <= OP_aload)
+                loadLocal(inference, index, wideOpcode - OP_iload);
+            else if (wideOpcode >= OP_istore && wideOpcode <= OP_astore)
+                storeLocal(inference, index, wideOpcode - OP_istore);
+            else if (wideOpcode == OP_iinc && index < inference->maxLocals) {
+                inference->locals[index] = VERIFIER_NotReference;
+                inference->localTags[index] = VERIFIER_NoSite;
+            }
+            else
+                inference->failed = 1;
+            break;
+        }
+        default:
+            inference->failed = 1;
+            break;
+    }
+
+    if (inference->failed) return;
+
+    if (branches) {
+        mergeInto(inference, branch, inference->locals, inference->stack, inference->stackTags,
+                  inference->depth);
+    }
+    if (fallsThrough) {
+        mergeInto(inference, (int64_t) pc + length, inference->locals, inference->stack,
+                  inference->stackTags, inference->depth);
+    }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que decodifica as instrucoes do codigo de um metodo e prepara o estado da inferencia. O
+ * estado de entrada da primeira instrucao contem o objeto (metodos de instancia) e os argumentos.
+ * Cada instrucao new de uma classe que nao eh de biblioteca java recebe um local de alocacao; o
+ * objeto this recebe o ultimo.
+ *
+ * \param inference Estado da inferencia (code e constantPool preenchidos)
+ * \param method Metodo verificado
+ * \return 1 se o codigo pode ser verificado, 0 caso contrario
+ */
+static int prepareInference(Inference* inference, method_info* method){
+
+    CodeAttribute* code = inference->code;
+
+    inference->maxLocals = code->max_locals;
+    inference->maxStack = code->max_stack;
+    inference->width = (u4) code->max_locals + code->max_stack;
+
+    if (code->code_length == 0) return 0;
+
+    //Inicio de cada instrucao
+    inference->instructionIndex = (u4*) calloc(code->code_length, sizeof(u4));
+    inference->instructionPC = (u4*) malloc(code->code_length * sizeof(u4));
+    inference->siteOf = (u2*) calloc(code->code_length, sizeof(u2));
+
+    if (!inference->instructionIndex || !inference->instructionPC || !inference->siteOf)
+        JVMstopAbrupt("Erro de alocacao de memoria para o verificador.");
+
+    for (u4 pc = 0; pc < code->code_length; ) {
+        u4 length = instructionLength(code->code, pc, code->code_length);
+
+        if (length == 0) return 0;
+
+        //Locais de alocacao acompanhados (os demais objetos sao sempre alocados no heap)
+        if (code->code[pc] == OP_new && inference->siteCount < VERIFIER_MixedSites - 2) {
+            u2 index = readU2(&code->code[pc + 1]);
+
+            if (poolEntry(inference, index, CONSTANT_Class, 0) != 0 &&
+                !javaLibIsFrom(getClassNameFromConstantPool(inference->constantPool, index)))
+                inference->siteOf[inference->instructionCount] = ++inference->siteCount;
+        }
+
+        inference->instructionPC[inference->instructionCount] = pc;
+        inference->instructionIndex[pc] = ++inference->instructionCount;
+        pc += length;
+    }
+
+    //Intervalos e tratadores de excecoes devem comecar em instrucoes
+    for (u2 i = 0; i < code->exception_table_length; i++) {
+        ExceptionTable* handler = &code->exception_table[i];
+
+        if (handler->start_pc >= handler->end_pc || handler->end_pc > code->code_length ||
+            handler->handler_pc >= code->code_length ||
+            inference->instructionIndex[handler->start_pc] == 0 ||
+            inference->instructionIndex[handler->handler_pc] == 0) {
+            return 0;
+        }
+    }
+
+    u4 count = inference->instructionCount;
+    inference->types = (u1*) malloc((u8) count * inference->width + 1);
+    inference->depths = (u2*) malloc(count * sizeof(u2));
+    inference->reached = (u1*) calloc(count, sizeof(u1));
+    inference->queued = (u1*) calloc(count, sizeof(u1));
+    inference->worklist = (u4*) malloc(count * sizeof(u4));
+    inference->locals = (u1*) malloc(inference->width + 1);
+    inference->stack = inference->locals + inference->maxLocals;
+    inference->tags = (u2*) malloc(((u8) count * inference->width + 1) * sizeof(u2));
+    inference->localTags = (u2*) calloc(inference->width + 1, sizeof(u2));
+    inference->stackTags = inference->localTags + inference->maxLocals;
+    inference->escapes = (u1*) calloc(inference->siteCount + 2, sizeof(u1));
+
+    if (!inference->types || !inference->depths || !inference->reached || !inference->queued ||
+        !inference->worklist || !inference->locals || !inference->tags || !inference->localTags ||
+        !inference->escapes)
+        JVMstopAbrupt("Erro de alocacao de memoria para o verificador.");
+
+    computeLiveness(inference);
+
+    //Estado de entrada: objeto e argumentos; as demais variaveis ainda nao foram inicializadas
+    memset(inference->locals, VERIFIER_Unknown, inference->maxLocals);
+
+    u1 argSlots[256];
+    u1 returnType;
+    const char* descriptor = getUTF8FromConstantPool(inference->constantPool,
+                                                     method->descriptor_index);
+    int argCount = parseMethodDescriptor(descriptor, argSlots, &returnType);
+    int first = (method->access_flags & ACC_STATIC) ? 0 : 1;
+
+    if (argCount < 0 || first + argCount > inference->maxLocals) return 0;
+
+    if (first) {
+        inference->locals[0] = VERIFIER_Reference;
+        inference->thisSite = inference->siteCount + 1;
+        inference->localTags[0] = inference->thisSite;
+    }
+    memcpy(&inference->locals[first], argSlots, argCount);
+
+    mergeInto(inference, 0, inference->locals, inference->stack, inference->stackTags, 0);
+
+    return !inference->failed;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que calcula o estado de entrada de todas as instrucoes alcancaveis, ate que nenhum
+ * estado mude. Os tratadores de excecoes recebem as variaveis locais de antes e de depois de cada
+ * instrucao do seu intervalo, com a excecao na pilha de operandos.
+ *
+ * \param inference Estado da inferencia preparado
+ */
+static void inferTypes(Inference* inference){
+
+    CodeAttribute* code = inference->code;
+    u1 exception = VERIFIER_Reference;
+    u2 exceptionSite = VERIFIER_NoSite;
+
+    while (inference->worklistTop > 0 && !inference->failed) {
+        u4 index = inference->worklist[--inference->worklistTop];
+        u4 pc = inference->instructionPC[index];
+        u4 next = index + 1 < inference->instructionCount ?
+                  inference->instructionPC[index + 1] : code->code_length;
+
+        inference->queued[index] = 0;
+
+        //Estado corrente: copia do estado de entrada da instrucao
+        memcpy(inference->locals, &inference->types[(u8) index * inference->width],
+               inference->width);
+        memcpy(inference->localTags, &inference->tags[(u8) index * inference->width],
+               inference->width * sizeof(u2));
+        inference->depth = inference->depths[index];
+
+        for (u2 i = 0; i < code->exception_table_length; i++) {
+            ExceptionTable* handler = &code->exception_table[i];
+
+            if (pc >= handler->start_pc && pc < handler->end_pc)
+                mergeInto(inference, handler->handler_pc, inference->locals, &exception,
+                          &exceptionSite, 1);
+        }
+
+        executeInstruction(inference, pc, next - pc);
+
+        for (u2 i = 0; i < code->exception_table_length && !inference->failed; i++) {
+            ExceptionTable* handler = &code->exception_table[i];
+
+            if (pc >= handler->start_pc && pc < handler->end_pc)
+                mergeInto(inference, handler->handler_pc, inference->locals, &exception,
+                          &exceptionSite, 1);
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// SUBMODULO: Mapas de referencias dos pontos seguros do coletor de lixo
+//--------------------------------------------------------------------------------------------------
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que retorna o numero de operandos consumidos por uma instrucao que pode iniciar uma
+ * coleta de lixo (alocacoes, constantes String e invocacoes). Os operandos ja foram desempilhados
+ * quando a coleta ocorre, durante a instrucao ou durante o metodo invocado.
+ *
+ * \param inference Estado da inferencia
+ * \param pc Posicao da instrucao
+ * \return Numero de posicoes consumidas (ou -1 se a instrucao nao eh um ponto seguro)
+ */
+static int safepointOperands(Inference* inference, u4 pc){
+
+    u1* code = inference->code->code;
+    u1 argSlots[256];
+    u1 returnType;
+    char *className, *name, *descriptor;
+    u2 index;
+
+    switch (code[pc]) {
+        case OP_new:
+            return 0;
+
+        //A string java de uma constante String eh criada no primeiro uso
+        case OP_ldc:
+            index = code[pc + 1];
+            return inference->constantPool->tags[index] == CONSTANT_String ? 0 : -1;
+
+        case OP_ldc_w:
+            index = readU2(&code[pc + 1]);
+            return inference->constantPool->tags[index] == CONSTANT_String ? 0 : -1;
+
+        case OP_newarray: case OP_anewarray:
+            return 1;
+
+        //Os tamanhos de todas as dimensoes sao desempilhados antes da alocacao
+        case OP_multianewarray:
+            return code[pc + 3];
+
+        case OP_invokevirtual: case OP_invokespecial: case OP_invokestatic:
+        case OP_invokeinterface:
+            getFieldOrMethodInfoAttributesFromConstantPool(readU2(&code[pc + 1]),
+                                                           inference->constantPool, &className,
+                                                           &name, &descriptor);
+            return parseMethodDescriptor(descriptor, argSlots, &returnType) +
+                   (code[pc] == OP_invokestatic ? 0 : 1);
+
+        default:
+            return -1;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que cria os mapas de referencias dos pontos seguros alcancaveis de um metodo. Os mapas
+ * de um metodo compartilham um unico vetor de categorias, com 2 bits para cada posicao.
+ *
+ * \param inference Estado da inferencia concluida
+ * \param methodMaps Recebe os mapas do metodo
+ */
+static void buildReferenceMaps(Inference* inference, MethodReferenceMaps* methodMaps){
+
+    u4 count = 0;
+    u4 bytes = 0;
+
+    //Primeira passagem: numero de mapas e de bytes de categorias
+    for (u4 index = 0; index < inference->instructionCount; index++) {
+        if (!inference->reached[index]) continue;
+
+        int consumed = safepointOperands(inference, inference->instructionPC[index]);
+
+        if (consumed < 0) continue;
+        if (consumed > inference->depths[index]) return;
+
+        count++;
+        bytes += (inference->maxLocals + inference->depths[index] - consumed + 3) / 4;
+    }
+
+    if (count == 0 || count > UINT16_MAX) return;
+
+    ReferenceMap* maps = (ReferenceMap*) malloc(count * sizeof(ReferenceMap));
+    u1* slots = (u1*) calloc(bytes + 1, sizeof(u1));
+    u4 mapIndex = 0;
+
+    if (maps == NULL || slots == NULL)
+        JVMstopAbrupt("Erro de alocacao de memoria para o verificador.");
+
+    for (u4 index = 0; index < inference->instructionCount; index++) {
+        if (!inference->reached[index]) continue;
+
+        u4 pc = inference->instructionPC[index];
+        int consumed = safepointOperands(inference, pc);
+
+        if (consumed < 0) continue;
+
+        u4 next = index + 1 < inference->instructionCount ?
+                  inference->instructionPC[index + 1] : inference->code->code_length;
+        ReferenceMap* map = &maps[mapIndex++];
+        u1* state = &inference->types[(u8) index * inference->width];
+
+        map->pc = (u2) (next - 1);
+        map->stackDepth = (u2) (inference->depths[index] - consumed);
+        map->slots = slots;
+
+        for (u4 i = 0; i < (u4) inference->maxLocals + map->stackDepth; i++)
+            map->slots[i / 4] |= state[i] << (i % 4 * 2);
+
+        slots += (inference->maxLocals + map->stackDepth + 3) / 4;
+    }
+
+    methodMaps->maps = maps;
+    methodMaps->count = (u2) count;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que libera o estado da inferencia de um metodo.
+ *
+ * \param inference Estado da inferencia
+ */
+static void freeInference(Inference* inference){
+
+    free(inference->instructionIndex);
+    free(inference->instructionPC);
+    free(inference->types);
+    free(inference->depths);
+    free(inference->reached);
+    free(inference->queued);
+    free(inference->worklist);
+    free(inference->locals);
+    free(inference->siteOf);
+    free(inference->escapes);
+    free(inference->calls);
+    free(inference->live);
+    free(inference->tags);
+    free(inference->localTags);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que verifica um metodo e cria os seus mapas de referencias e o resultado da sua analise
+ * de escape. Se o codigo nao pode ser verificado, o metodo fica sem mapas e todos os seus objetos
+ * sao alocados no heap.
+ *
+ * \param javaClass Classe do metodo
+ * \param index Indice do metodo em arqClass->methods
+ * \param code Atributo Code do metodo
+ */
+static void verifyMethod(JavaClass* javaClass, u2 index, CodeAttribute* code){
+
+    Inference inference;
+
+    memset(&inference, 0, sizeof(Inference));
+    inference.code = code;
+    inference.constantPool = javaClass->arqClass->constant_pool;
+    inference.constantPoolCount = javaClass->arqClass->constant_pool_count;
+
+    if (prepareInference(&inference, &javaClass->arqClass->methods[index])) {
+        inferTypes(&inference);
+
+        if (!inference.failed) {
+            buildReferenceMaps(&inference, &javaClass->referenceMaps[index]);
+            buildEscapeInfo(&inference, &javaClass->escapeInfo[index]);
+        }
+    }
+
+    freeInference(&inference);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+ReferenceMap* getReferenceMap(JavaClass* javaClass, method_info* method, int pc){
+
+    if (javaClass == NULL || method == NULL || javaClass->referenceMaps == NULL) return NULL;
+
+    MethodReferenceMaps* methodMaps =
+        &javaClass->referenceMaps[method - javaClass->arqClass->methods];
+
+    //Busca binaria pelo pc
+    int low = 0, high = methodMaps->count - 1;
+
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        ReferenceMap* map = &methodMaps->maps[middle];
+
+        if (map->pc == pc) return map;
+
+        if (map->pc < pc) low = middle + 1;
+        else high = middle - 1;
+    }
+
+    return NULL;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+u1 getReferenceMapSlot(ReferenceMap* map, u2 index){
+
+    return (map->slots[index / 4] >> (index % 4 * 2)) & 3;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// SUBMODULO: Analise de escape dos objetos alocados
+//--------------------------------------------------------------------------------------------------
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que acrescenta as variaveis locais vivas na entrada de uma instrucao sucessora.
+ *
+ * \param inference Estado da inferencia
+ * \param target pc da instrucao sucessora
+ * \param live Variaveis locais vivas (uma posicao por variavel)
+ */
+static void joinLive(Inference* inference, int64_t target, u1* live){
+
+    if (target < 0 || target >= inference->code->code_length ||
+        inference->instructionIndex[target] == 0)
+        return;
+
+    u1* targetLive = &inference->live[(u8) (inference->instructionIndex[target] - 1) *
+                                      inference->maxLocals];
+
+    for (u2 i = 0; i < inference->maxLocals; i++) live[i] |= targetLive[i];
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que calcula as variaveis locais vivas na saida de uma instrucao: as vivas na entrada das
+ * instrucoes sucessoras e dos tratadores de excecoes que cobrem a instrucao.
+ *
+ * \param inference Estado da inferencia
+ * \param index Indice da instrucao
+ * \param live Recebe as variaveis locais vivas
+ */
+static void liveOut(Inference* inference, u4 index, u1* live){
+
+    u1* code = inference->code->code;
+    u4 pc = inference->instructionPC[index];
+    u4 next = index + 1 < inference->instructionCount ?
+              inference->instructionPC[index + 1] : inference->code->code_length;
+    u1 opcode = code[pc];
+
+    memset(live, 0, inference->maxLocals);
+
+    if ((opcode >= OP_ifeq && opcode <= OP_if_acmpne) || opcode == OP_ifnull ||
+        opcode == OP_ifnonnull) {
+        joinLive(inference, (int64_t) pc + (int16_t) readU2(&code[pc + 1]), live);
+        joinLive(inference, next, live);
+    }
+    else if (opcode == OP_goto) {
+        joinLive(inference, (int64_t) pc + (int16_t) readU2(&code[pc + 1]), live);
+    }
+    else if (opcode == OP_goto_w) {
+        joinLive(inference, (int64_t) pc + (int32_t) readU4(&code[pc + 1]), live);
+    }
+    else if (opcode == OP_tableswitch || opcode == OP_lookupswitch) {
+        for (int32_t i = -1; i < switchTargetCount(code, pc); i++)
+            joinLive(inference, switchTarget(code, pc, i), live);
+    }
+    else if (!(opcode >= OP_ireturn && opcode <= OP_return) && opcode != OP_athrow) {
+        joinLive(inference, next, live);
+    }
+
+    for (u2 i = 0; i < inference->code->exception_table_length; i++) {
+        ExceptionTable* handler = &inference->code->exception_table[i];
+
+        if (pc >= handler->start_pc && pc < handler->end_pc)
+            joinLive(inference, handler->handler_pc, live);
+    }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que aplica as variaveis locais vivas na saida de uma instrucao a sua leitura e escrita de
+ * variaveis locais, obtendo as vivas na entrada. Somente a leitura de referencias (aload) conta.
+ *
+ * \param inference Estado da inferencia
+ * \param pc Posicao da instrucao
+ * \param live Variaveis locais vivas na saida; recebe as vivas na entrada
+ */
+static void transferLive(Inference* inference, u4 pc, u1* live){
+
+    u1* code = inference->code->code;
+    u1 opcode = code[pc];
+    u4 index = 0;
+
+    if (opcode == OP_wide) {
+        opcode = code[pc + 1];
+        index = readU2(&code[pc + 2]);
+    }
+    else if ((opcode >= OP_istore && opcode <= OP_astore) || opcode == OP_aload ||
+             opcode == OP_iinc) {
+        index = code[pc + 1];
+    }
+
+    if (opcode >= OP_istore_0 && opcode <= OP_astore_3) {
+        index = (opcode - OP_istore_0) % 4;
+        opcode = OP_istore + (opcode - OP_istore_0) / 4;
+    }
+    else if (opcode >= OP_aload_0 && opcode <= OP_aload_3) {
+        index = opcode - OP_aload_0;
+        opcode = OP_aload;
+    }
+
+    if (opcode >= OP_istore && opcode <= OP_astore) {
+        u1 slots = kindSlots[opcode - OP_istore];
+
+        for (u4 i = index; i < index + slots && i < inference->maxLocals; i++) live[i] = 0;
+    }
+    else if (opcode == OP_iinc && index < inference->maxLocals) {
+        live[index] = 0;
+    }
+    else if (opcode == OP_aload && index < inference->maxLocals) {
+        live[index] = 1;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que calcula as variaveis locais vivas (lidas antes de serem escritas) na entrada de cada
+ * instrucao. Como o conjunto de variaveis vivas so aumenta, as instrucoes sao percorridas de tras
+ * para frente ate que nenhum conjunto mude. Uma variavel morta pode guardar o objeto de um local
+ * de alocacao sem impedir que o local reutilize o objeto.
+ *
+ * \param inference Estado da inferencia com as instrucoes decodificadas
+ */
+static void computeLiveness(Inference* inference){
+
+    u4 count = inference->instructionCount;
+    u2 maxLocals = inference->maxLocals;
+    u1* live = (u1*) malloc(maxLocals + 1);
+    u1 changed = 1;
+
+    inference->live = (u1*) calloc((u8) count * maxLocals + 1, sizeof(u1));
+
+    if (live == NULL || inference->live == NULL)
+        JVMstopAbrupt("Erro de alocacao de memoria para o verificador.");
+
+    while (changed) {
+        changed = 0;
+
+        for (u4 index = count; index-- > 0; ) {
+            u1* state = &inference->live[(u8) index * maxLocals];
+
+            liveOut(inference, index, live);
+            transferLive(inference, inference->instructionPC[index], live);
+
+            if (memcmp(state, live, maxLocals) != 0) {
+                memcpy(state, live, maxLocals);
+                changed = 1;
+            }
+        }
+    }
+
+    free(live);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que preenche um local de alocacao com as invocacoes (sem repeticoes) que recebem o seu
+ * objeto. Sem invocacoes, o objeto ja pode ser alocado no frame.
+ *
+ * \param inference Estado da inferencia concluida
+ * \param site Local de alocacao na inferencia
+ * \param allocationSite Recebe as invocacoes
+ */
+static void collectReceiverCalls(Inference* inference, u2 site, AllocationSite* allocationSite){
+
+    allocationSite->calls = (ReceiverCall*) malloc((inference->callCount + 1) *
+                                                   sizeof(ReceiverCall));
+    if (allocationSite->calls == NULL)
+        JVMstopAbrupt("Erro de alocacao de memoria para o verificador.");
+    allocationSite->callCount = 0;
+
+    for (u4 i = 0; i < inference->callCount; i++) {
+        ReceiverCall* call = &inference->calls[i].call;
+        u2 j = 0;
+
+        if (inference->calls[i].site != site) continue;
+
+        while (j < allocationSite->callCount && (allocationSite->calls[j].opcode != call->opcode ||
+               allocationSite->calls[j].index != call->index))
+            j++;
+
+        if (j == allocationSite->callCount)
+            allocationSite->calls[allocationSite->callCount++] = *call;
+    }
+
+    allocationSite->state = allocationSite->callCount ? VERIFIER_SiteUnchecked : VERIFIER_SiteLocal;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que cria o resultado da analise de escape de um metodo: os locais de alocacao alcancaveis
+ * cujo objeto nao escapa e o uso do objeto this.
+ *
+ * \param inference Estado da inferencia concluida
+ * \param escapeInfo Recebe o resultado da analise
+ */
+static void buildEscapeInfo(Inference* inference, MethodEscapeInfo* escapeInfo){
+
+    u2 count = 0;
+
+    for (u4 index = 0; index < inference->instructionCount; index++) {
+        u2 site = inference->siteOf[index];
+
+        if (site != VERIFIER_NoSite && !inference->escapes[site] && inference->reached[index])
+            count++;
+    }
+
+    if (count > 0) {
+        escapeInfo->sites = (AllocationSite*) calloc(count, sizeof(AllocationSite));
+        if (escapeInfo->sites == NULL)
+            JVMstopAbrupt("Erro de alocacao de memoria para o verificador.");
+    }
+
+    for (u4 index = 0; index < inference->instructionCount && escapeInfo->siteCount < count;
+         index++) {
+        u2 site = inference->siteOf[index];
+
+        if (site == VERIFIER_NoSite || inference->escapes[site] || !inference->reached[index])
+            continue;
+
+        AllocationSite* allocationSite = &escapeInfo->sites[escapeInfo->siteCount];
+        allocationSite->pc = (u2) inference->instructionPC[index];
+        allocationSite->slot = escapeInfo->siteCount++;
+        collectReceiverCalls(inference, site, allocationSite);
+    }
+
+    if (inference->thisSite != VERIFIER_NoSite && !inference->escapes[inference->thisSite]) {
+        escapeInfo->receiver = (AllocationSite*) calloc(1, sizeof(AllocationSite));
+        if (escapeInfo->receiver == NULL)
+            JVMstopAbrupt("Erro de alocacao de memoria para o verificador.");
+        collectReceiverCalls(inference, inference->thisSite, escapeInfo->receiver);
+    }
+}
+
+
+//--------------------------------------------------------------------------------------------------
+MethodEscapeInfo* getEscapeInfo(JavaClass* javaClass, method_info* method){
+
+    if (javaClass == NULL || method == NULL || javaClass->escapeInfo == NULL) return NULL;
+
+    return &javaClass->escapeInfo[method - javaClass->arqClass->methods];
+}
+
+
+//--------------------------------------------------------------------------------------------------
+AllocationSite* getAllocationSite(JavaClass* javaClass, method_info* method, int pc){
+
+    MethodEscapeInfo* escapeInfo = getEscapeInfo(javaClass, method);
+
+    if (escapeInfo == NULL) return NULL;
+
+    //Busca binaria pelo pc
+    int low = 0, high = escapeInfo->siteCount - 1;
+
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        AllocationSite* site = &escapeInfo->sites[middle];
+
+        if (site->pc == pc) return site;
+
+        if (site->pc < pc) low = middle + 1;
+        else high = middle - 1;
+    }
+
+    return NULL;
+}
+
+
+//--------------------------------------------------------------------------------------------------
+// SUBMODULO: Verificacao paralela dos metodos de uma classe
+//--------------------------------------------------------------------------------------------------
+
+//! Metodos de uma classe a serem divididos entre as threads de verificacao
+typedef struct VerifierWork{
+    JavaClass* javaClass; //!< Classe verificada
+    CodeAttribute** codes; //!< Atributo Code de cada metodo (nulo se o metodo nao tem codigo)
+    volatile u4 next; //!< Indice do proximo metodo a ser verificado
+} VerifierWork;
+
+
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo que verifica os metodos ainda nao verificados de uma classe, um de cada vez, ate que
+ * todos tenham sido verificados.
+ *
+ * \param work Metodos da classe
+ */
+static void verifyMethods(VerifierWork* work){
+
+    u2 methodsCount = work->javaClass->arqClass->methods_count;
+
+    for (u4 i = __sync_fetch_and_add(&work->next, 1); i < methodsCount;
+         i = __sync_fetch_and_add(&work->next, 1)) {
+        if (work->codes[i] != NULL) verifyMethod(work->javaClass, (u2) i, work->codes[i]);
+    }
+}
+
+
+#ifndef _WIN32
+//--------------------------------------------------------------------------------------------------
+/*!
+ * Metodo executado por uma thread de verificacao.
+ *
+ * \param work Metodos da classe (VerifierWork)
+ * \return Nulo
+ */
+static void* verifierThread(void* work){
+
+    verifyMethods((VerifierWork*) work);
+
+    return NULL;
+}
+#endif
+
+
+//--------------------------------------------------------------------------------------------------
+u1 defaultVerifierThreads(){
+
+#ifdef _WIN32
+    return 1;
+#else
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (processors < 1) return 1;
+
+    return processors > VERIFIER_MaxThreads ? VERIFIER_MaxThreads : (u1) processors;
+#endif
+}
+
+
+//--------------------------------------------------------------------------------------------------
+void verifyClass(JavaClass* javaClass, u1 threads){
+
+    ArqClass* arqClass = javaClass->arqClass;
+    u4 codeLength = 0;
+
+    javaClass->referenceMaps = (MethodReferenceMaps*) calloc(arqClass->methods_count + 1,
+                                                             sizeof(MethodReferenceMaps));
+    javaClass->escapeInfo = (MethodEscapeInfo*) calloc(arqClass->methods_count + 1,
+                                                       sizeof(MethodEscapeInfo));
+
+    //Atributos Code dos metodos (decodificados na leitura da classe, na arena da classe)
+    CodeAttribute** codes = (CodeAttribute**) calloc(arqClass->methods_count + 1,
+                                                     sizeof(CodeAttribute*));
+
+    if (!javaClass->referenceMaps || !javaClass->escapeInfo || !codes)
+        JVMstopAbrupt("Erro de alocacao de memoria para o verificador.");
+
+    for (u2 i = 0; i < arqClass->methods_count; i++) {
+        codes[i] = getCodeFromMethodInfo(&arqClass->methods[i], arqClass->constant_pool);
+        if (codes[i] != NULL) codeLength += codes[i]->code_length;
+    }
+
+    VerifierWork work = {javaClass, codes, 0};
+
+    //Classes pequenas sao verificadas somente pela thread principal
+    if (codeLength < VERIFIER_ParallelCode || arqClass->methods_count < 2) threads = 1;
+    if (threads > arqClass->methods_count) threads = (u1) arqClass->methods_count;
+
+#ifndef _WIN32
+    pthread_t workers[VERIFIER_MaxThreads];
+    int started = 0;
+
+    //A thread principal tambem verifica metodos
+    while (started + 1 < threads &&
+           pthread_create(&workers[started], NULL, verifierThread, &work) == 0) {
+        started++;
+    }
+#endif
+
+    verifyMethods(&work);
+
+#ifndef _WIN32
+    for (int i = 0; i < started; i++) pthread_join(workers[i], NULL);
+#endif
+
+    free(codes);
+}
+
+
+//--------------------------------------------------------------------------------------------------
+void releaseVerifierData(JavaClass* javaClass){
+
+    for (u2 i = 0; javaClass->referenceMaps != NULL && i < javaClass->arqClass->methods_count;
+         i++) {
+        MethodReferenceMaps* methodMaps = &javaClass->referenceMaps[i];
+
+        //As posicoes de todos os mapas do metodo ficam em um unico bloco
+        if (methodMaps->count > 0) free(methodMaps->maps[0].slots);
+        free(methodMaps->maps);
+    }
+
+    for (u2 i = 0; javaClass->escapeInfo != NULL && i < javaClass->arqClass->methods_count; i++) {
+        MethodEscapeInfo* escapeInfo = &javaClass->escapeInfo[i];
+
+        for (u2 j = 0; j < escapeInfo->siteCount; j++) free(escapeInfo->sites[j].calls);
+        free(escapeInfo->sites);
+
+        if (escapeInfo->receiver != NULL) free(escapeInfo->receiver->calls);
+        free(escapeInfo->receiver);
+    }
+
+    free(javaClass->referenceMaps);
+    free(javaClass->escapeInfo);
+    javaClass->referenceMaps = NULL;
+    javaClass->escapeInfo = NULL;
+}